@@ -25,6 +25,7 @@
 #include "config.hpp"
 #include "log.hpp"
 #include "dico.hpp"
+#include "target_index.hpp"
 
 #include <string>
 #include <string.h>
@@ -60,6 +61,11 @@ enum {
 
 struct ModContext : public Dico {
     unsigned selector_focus;
+    // selector local index mode: targets received from acl, kept while
+    // selector module is recreated after each acl answer
+    TargetIndex selector_index;
+    size_t selector_index_page; // page of targets asked to acl, 0 when not loading
+    bool selector_index_loaded;
     enum {
         INTERNAL_NONE,
         INTERNAL_LOGIN,
@@ -77,6 +83,8 @@ struct ModContext : public Dico {
         Dico(KeywordsDefinitions, nbkeywords), nextmod(INTERNAL_NONE)
     {
         this->selector_focus = 0;
+        this->selector_index_page = 0;
+        this->selector_index_loaded = false;
     }
 
     ~ModContext(){
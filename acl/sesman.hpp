@@ -77,6 +77,16 @@ class SessionManager {
         }
     }
 
+    // auth_event outlives auth_trans_t, it must not use deleted transport
+    void forget_auth_trans()
+    {
+        if (this->auth_event){
+            this->auth_event->trans = 0;
+        }
+        delete this->auth_trans_t;
+        this->auth_trans_t = 0;
+    }
+
     bool event(){
         if (this->verbose & 0x40){
             LOG(LOG_INFO, "auth::event?");
@@ -423,8 +433,7 @@ class SessionManager {
                 }
                 TODO(" check life cycle of auth_trans_t")
                 if (this->auth_trans_t){
-                    delete this->auth_trans_t;
-                    this->auth_trans_t = 0;
+                    this->forget_auth_trans();
                 }
                 next_state = MCTX_STATUS_INTERNAL;
                 this->context.nextmod = ModContext::INTERNAL_CLOSE;
@@ -495,6 +504,11 @@ class SessionManager {
         }
     }
 
+    void add_to_reactor(Reactor & reactor)
+    {
+        reactor.add(this->auth_event);
+    }
+
 
     int ask_next_module_remote(const char * auth_host, int authport)
     {
@@ -514,7 +528,7 @@ class SessionManager {
                 if (this->auth_event){
                     delete this->auth_event;
                 }
-                this->auth_event = new wait_obj(this->auth_trans_t->sck);
+                this->auth_event = new wait_obj(this->auth_trans_t->sck, this->auth_trans_t);
             }
             this->out_item(stream, STRAUTHID_PROXY_TYPE);
             this->out_item(stream, STRAUTHID_DISPLAY_MESSAGE);
@@ -554,8 +568,7 @@ class SessionManager {
         } catch (Error e) {
             this->context.cpy(STRAUTHID_AUTHENTICATED, false);
             this->context.cpy(STRAUTHID_REJECTED, "Authentifier service failed");
-            delete this->auth_trans_t;
-            this->auth_trans_t = NULL;
+            this->forget_auth_trans();
         }
         return MCTX_STATUS_WAITING;
     }
@@ -583,8 +596,7 @@ class SessionManager {
         } catch (...) {
             this->context.cpy(STRAUTHID_AUTHENTICATED, false);
             this->context.cpy(STRAUTHID_REJECTED, "Authentifier service failed");
-            delete this->auth_trans_t;
-            this->auth_trans_t = NULL;
+            this->forget_auth_trans();
         }
         this->mod_state = MOD_STATE_DONE_RECEIVED_CREDENTIALS;
         return MCTX_STATUS_TRANSITORY;
@@ -0,0 +1,201 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Index of the targets authorized by acl, paged and filtered locally by
+   selector
+
+*/
+
+#if !defined(__TARGET_INDEX_HPP__)
+#define __TARGET_INDEX_HPP__
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+
+// All strings live in one buffer, entries only hold offsets. Group names
+// are stored once, group filter is evaluated once per distinct group.
+// Filters are substring matches like the ones applied by acl. When both
+// new filters contain the previous ones (typing in filter box), only
+// previous matches are scanned again.
+struct TargetIndex {
+    struct Entry {
+        uint32_t group;     // index in groups
+        uint32_t target;    // offsets in strings
+        uint32_t protocol;
+        uint32_t endtime;
+    };
+
+    std::string strings;
+    std::vector<Entry> entries;
+    std::vector<uint32_t> groups;
+    std::map<std::string, uint32_t> group_ids;
+
+    std::vector<uint32_t> matches;
+    std::vector<uint8_t> group_match;
+    std::string group_filter;
+    std::string device_filter;
+    bool filtered;
+    uint64_t scanned; // entries tested by filter()
+
+    TargetIndex() : filtered(false), scanned(0) {}
+
+    void clear()
+    {
+        this->strings.clear();
+        this->entries.clear();
+        this->groups.clear();
+        this->group_ids.clear();
+        this->matches.clear();
+        this->filtered = false;
+    }
+
+    size_t size() const
+    {
+        return this->entries.size();
+    }
+
+    // appends targets in the format of acl answers (space separated groups,
+    // targets and protocols, semicolon separated endtimes), returns number
+    // of targets added
+    size_t append(const char * groups, const char * targets, const char * protocols, const char * endtimes)
+    {
+        size_t nb = 0;
+        while (*targets && *targets != '\n'){
+            const char * group_end = next_item(groups);
+            const char * target_end = next_item(targets);
+            const char * protocol_end = next_item(protocols);
+            const char * endtime_end = next_item(endtimes, ';');
+            Entry entry;
+            entry.group = this->group_id(std::string(groups, group_end - groups));
+            entry.target = this->store(targets, target_end);
+            entry.protocol = this->store(protocols, protocol_end);
+            entry.endtime = this->store(endtimes, endtime_end);
+            this->entries.push_back(entry);
+            groups = group_end;
+            targets = target_end;
+            protocols = protocol_end;
+            endtimes = endtime_end;
+            nb++;
+            if (*groups == ' '){ groups++; }
+            if (*targets == ' '){ targets++; }
+            if (*protocols == ' '){ protocols++; }
+            if (*endtimes == ';'){ endtimes++; }
+        }
+        this->filtered = false;
+        return nb;
+    }
+
+    void filter(const char * group_filter, const char * device_filter)
+    {
+        const bool refine = this->filtered
+            && strstr(group_filter, this->group_filter.c_str())
+            && strstr(device_filter, this->device_filter.c_str());
+
+        this->group_match.resize(this->groups.size());
+        for (size_t g = 0 ; g < this->groups.size() ; g++){
+            this->group_match[g] = 0 != strstr(this->str(this->groups[g]), group_filter);
+        }
+
+        if (refine){
+            size_t kept = 0;
+            for (size_t i = 0 ; i < this->matches.size() ; i++){
+                if (this->match(this->matches[i], device_filter)){
+                    this->matches[kept++] = this->matches[i];
+                }
+            }
+            this->scanned += this->matches.size();
+            this->matches.resize(kept);
+        }
+        else {
+            this->matches.clear();
+            for (size_t i = 0 ; i < this->entries.size() ; i++){
+                if (this->match(i, device_filter)){
+                    this->matches.push_back(i);
+                }
+            }
+            this->scanned += this->entries.size();
+        }
+        this->group_filter = group_filter;
+        this->device_filter = device_filter;
+        this->filtered = true;
+    }
+
+    size_t nb_pages(size_t lines) const
+    {
+        return this->matches.empty() ? 1 : (this->matches.size() + lines - 1) / lines;
+    }
+
+    // i-th target matching current filters
+    const Entry & matching(size_t i) const
+    {
+        return this->entries[this->matches[i]];
+    }
+
+    const char * group(const Entry & entry) const
+    {
+        return this->str(this->groups[entry.group]);
+    }
+
+    const char * str(uint32_t offset) const
+    {
+        return this->strings.c_str() + offset;
+    }
+
+    private:
+
+    bool match(size_t i, const char * device_filter) const
+    {
+        const Entry & entry = this->entries[i];
+        return this->group_match[entry.group]
+            && strstr(this->str(entry.target), device_filter);
+    }
+
+    uint32_t store(const char * begin, const char * end)
+    {
+        const uint32_t offset = this->strings.size();
+        this->strings.append(begin, end - begin);
+        this->strings.push_back(0);
+        return offset;
+    }
+
+    uint32_t group_id(const std::string & name)
+    {
+        std::map<std::string, uint32_t>::iterator it = this->group_ids.find(name);
+        if (it != this->group_ids.end()){
+            return it->second;
+        }
+        const uint32_t id = this->groups.size();
+        this->groups.push_back(this->store(name.data(), name.data() + name.size()));
+        this->group_ids[name] = id;
+        return id;
+    }
+
+    static const char * next_item(const char * list, char sep = ' ')
+    {
+        while (*list != sep && *list != '\n' && *list){
+            list++;
+        }
+        return list;
+    }
+};
+
+#endif
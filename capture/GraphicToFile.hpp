@@ -109,6 +109,15 @@ struct GraphicsToFile : public RDPSerializer
     uint16_t offset_chunk_type;
     uint16_t chunk_type;
     TimerCapture timer;
+    uint64_t time_offset; // sum of recorded timestamps (replay time in us)
+
+    // zlib level of order and keyframe chunks, 0 = no compression.
+    // Small chunks, timestamps and file changes are never compressed,
+    // hence index (rebuilt from headers) and seek are the same.
+    int compression_level;
+    Stream compressed;
+    uint64_t raw_bytes;     // chunks size before compression
+    uint64_t written_bytes;
 
     GraphicsToFile(Transport * trans, const Inifile * ini,
           const uint8_t  bpp,
@@ -123,6 +132,10 @@ struct GraphicsToFile : public RDPSerializer
             0, 1, 1)
         , chunk_type(RDP_UPDATE_ORDERS)
         , timer(now)
+        , time_offset(0)
+        , compression_level(0)
+        , raw_bytes(0)
+        , written_bytes(0)
     {
         this->init();
     }
@@ -140,6 +153,10 @@ struct GraphicsToFile : public RDPSerializer
                     0, 1, 1)
     , chunk_type(RDP_UPDATE_ORDERS)
     , timer()
+    , time_offset(0)
+    , compression_level(0)
+    , raw_bytes(0)
+    , written_bytes(0)
     {
         this->init();
     }
@@ -180,6 +197,7 @@ struct GraphicsToFile : public RDPSerializer
         this->chunk_type = WRMChunk::TIMESTAMP;
         this->order_count = 1;
         uint64_t micro_sec = this->timer.elapsed(now);
+        this->time_offset += micro_sec;
         this->stream.out_uint64_be(micro_sec);
         this->flush();
     }
@@ -203,7 +221,25 @@ struct GraphicsToFile : public RDPSerializer
         this->stream.set_out_uint16_le(this->chunk_type, this->offset_chunk_type);
         this->stream.set_out_uint16_le(chunk_size, this->offset_chunk_size);
         this->stream.set_out_uint16_le(this->order_count, this->offset_order_count);
+        this->raw_bytes += chunk_size;
+        if (this->compression_level > 0 && chunk_size > 8 + 64
+        && (this->chunk_type == RDP_UPDATE_ORDERS || this->chunk_type == WRMChunk::BREAKPOINT)){
+            this->compressed.init(65536);
+            uLongf len = this->compressed.capacity - 8;
+            // compressed chunk is only kept if it is smaller
+            if (Z_OK == compress2(this->compressed.data + 8, &len,
+                                  this->stream.data + 8, chunk_size - 8, this->compression_level)
+            && len + 8 < chunk_size){
+                this->compressed.out_copy_bytes(this->stream.data, 8);
+                this->compressed.set_out_uint16_le(len + 8, this->offset_chunk_size);
+                this->compressed.set_out_uint16_le(WRMCompression::ZLIB, this->offset_order_count + 2);
+                this->trans->send(this->compressed.data, len + 8);
+                this->written_bytes += len + 8;
+                return;
+            }
+        }
         this->trans->send(this->stream.data, chunk_size);
+        this->written_bytes += chunk_size;
     }
 
 };
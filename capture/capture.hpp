@@ -24,6 +24,8 @@
 #include "staticcapture.hpp"
 #include "nativecapture.hpp"
 #include "meta_wrm.hpp"
+#include "capture_writer.hpp"
+#include "videocapture.hpp"
 
 class Capture : public RDPGraphicDevice
 {
@@ -31,30 +33,52 @@ class Capture : public RDPGraphicDevice
 
     struct timeval start_static_capture;
     uint64_t inter_frame_interval_static_capture;
+    uint64_t nb_skipped_snapshots; // nothing drawn since previous png
 
     struct timeval start_native_capture;
     uint64_t inter_frame_interval_native_capture;
 
+    struct timeval start_keyframe;
+    uint64_t keyframe_interval; // us between breakpoints (seek points), 0 = never
+
+    // png and wrm files are written by writer thread, never by session
+    CaptureWriter writer;
     StaticCapture sc;
     NativeCapture nc;
+    VideoCapture * vc; // optional, encodes sc drawable
 
     public:
 
     TODO(" fat interface : ugly  find another way")
     Capture(int width, int height, const char * path, const char * codec_id, const char * video_quality, bool bgr = true) :
-        sc(width, height, path, codec_id, video_quality, bgr),
-        nc(width, height, path)
+        nb_skipped_snapshots(0),
+        sc(width, height, path, codec_id, video_quality, bgr, &this->writer),
+        nc(width, height, path, &this->writer),
+        vc(0)
     {
         this->log_prefix[0] = 0;
         struct timeval now;
         gettimeofday(&now, NULL);
         this->start_static_capture = now;
         this->start_native_capture = now;
+        this->start_keyframe = now;
+        this->keyframe_interval = 0;
         this->inter_frame_interval_static_capture = 5000000; // 1 000 000 us is 1 sec (default)
         this->inter_frame_interval_native_capture =   40000; // 1 000 000 us is 1 sec (default)
     }
 
     ~Capture(){
+        LOG(LOG_INFO, "capture: %llu png snapshots skipped, screen unchanged",
+            (unsigned long long)this->nb_skipped_snapshots);
+        delete this->vc;
+    }
+
+    // mjpeg video of session in path-pid-N.avi
+    void start_video(const char * path, unsigned fps, int qscale)
+    {
+        delete this->vc;
+        this->vc = 0;
+        this->vc = new VideoCapture(this->sc.drawable, path, fps, qscale, &this->writer);
     }
 
     void timestamp()
@@ -62,6 +86,24 @@ class Capture : public RDPGraphicDevice
         this->nc.recorder.timestamp();
     }
 
+    // png snapshots only hold area changed since previous one
+    void set_png_dirty_only(bool dirty_only)
+    {
+        this->sc.dirty_only = dirty_only;
+    }
+
+    // zlib level of wrm chunks (0 = no compression), to be set before emit_meta
+    void set_wrm_compression(int level)
+    {
+        this->nc.recorder.compression_level = level;
+    }
+
+    // a breakpoint (new wrm file, indexed) is recorded every interval seconds
+    void set_keyframe_interval(int seconds)
+    {
+        this->keyframe_interval = (seconds > 0) ? seconds * 1000000ULL : 0;
+    }
+
     void set_prefix(const char * prefix, size_t len_prefix)
     {
         size_t len = (len_prefix < sizeof(log_prefix))?len_prefix:(sizeof(log_prefix)-1);
@@ -72,6 +114,7 @@ class Capture : public RDPGraphicDevice
     TODO("looks better to have some function in capture returning native recorder if any and perform meta.emit outside this class. Or some other strategy not implying capture having a dependance on MetaWRM. Logicaly dependence should be between MetaWRM and native recorder")
     void emit_meta(MetaWRM& meta)
     {
+        meta.set_compression(this->nc.recorder.compression_level ? WRMCompression::ZLIB : WRMCompression::NONE);
         meta.emit(this->nc.recorder);
     }
 
@@ -80,20 +123,58 @@ class Capture : public RDPGraphicDevice
         struct timeval now;
         gettimeofday(&now, NULL);
         if (difftimeval(now, this->start_static_capture) >= this->inter_frame_interval_static_capture){
-            TODO("change code below, it would be better to provide now to drawable instead of tm struct");
-            time_t rawtime;
-            time(&rawtime);
-            tm *ptm = localtime(&rawtime);
-            this->sc.drawable.trace_timestamp(*ptm);
-            this->sc.flush();
-            this->sc.drawable.clear_timestamp();
+            if (this->sc.drawable.dirty.isempty()){
+                this->nb_skipped_snapshots++;
+            }
+            else {
+                TODO("change code below, it would be better to provide now to drawable instead of tm struct");
+                time_t rawtime;
+                time(&rawtime);
+                tm *ptm = localtime(&rawtime);
+                this->sc.drawable.trace_timestamp(*ptm);
+                this->sc.flush();
+                this->sc.drawable.clear_timestamp();
+            }
             this->start_static_capture = now;
         }
         if (difftimeval(now, this->start_native_capture) >= this->inter_frame_interval_native_capture){
             this->nc.recorder.timestamp(now);
             this->start_native_capture = now;
         }
+        if (this->vc){
+            try {
+                this->vc->snapshot(now);
+            }
+            catch (Error & e){
+                LOG(LOG_ERR, "video capture: stopped on error %u", e.id);
+                delete this->vc;
+                this->vc = 0;
+            }
+        }
+        if (this->keyframe_interval
+        && difftimeval(now, this->start_keyframe) >= this->keyframe_interval){
+            this->breakpoint();
+            this->start_keyframe = now;
+        }
         this->nc.recorder.flush();
+        this->writer.flush();
+    }
+
+    // time left (us) before next snapshot() has something to record
+    uint64_t snapshot_delay(const struct timeval & now)
+    {
+        uint64_t elapsed_static = difftimeval(now, this->start_static_capture);
+        uint64_t elapsed_native = difftimeval(now, this->start_native_capture);
+        uint64_t delay_static = (elapsed_static >= this->inter_frame_interval_static_capture)
+                              ? 0 : this->inter_frame_interval_static_capture - elapsed_static;
+        uint64_t delay_native = (elapsed_native >= this->inter_frame_interval_native_capture)
+                              ? 0 : this->inter_frame_interval_native_capture - elapsed_native;
+        uint64_t delay = (delay_static < delay_native) ? delay_static : delay_native;
+        if (this->vc){
+            uint64_t delay_video = this->vc->snapshot_delay(now);
+            delay = (delay_video < delay) ? delay_video : delay;
+        }
+        return delay;
     }
 
     void flush()
@@ -103,30 +184,45 @@ class Capture : public RDPGraphicDevice
     {
         this->sc.draw(cmd, clip);
         this->nc.draw(cmd, clip);
+        if (this->vc){
+            this->vc->draw(cmd, clip);
+        }
     }
 
     void draw(const RDPDestBlt & cmd, const Rect &clip)
     {
         this->sc.draw(cmd, clip);
         this->nc.draw(cmd, clip);
+        if (this->vc){
+            this->vc->draw(cmd, clip);
+        }
     }
 
     void draw(const RDPPatBlt & cmd, const Rect &clip)
     {
         this->sc.draw(cmd, clip);
         this->nc.draw(cmd, clip);
+        if (this->vc){
+            this->vc->draw(cmd, clip);
+        }
     }
 
     void draw(const RDPMemBlt & cmd, const Rect & clip, const Bitmap & bmp)
     {
         this->sc.draw(cmd, clip, bmp);
         this->nc.draw(cmd, clip, bmp);
+        if (this->vc){
+            this->vc->draw(cmd, clip, bmp);
+        }
     }
 
     void draw(const RDPOpaqueRect & cmd, const Rect & clip)
     {
         this->sc.draw(cmd, clip);
         this->nc.draw(cmd, clip);
+        if (this->vc){
+            this->vc->draw(cmd, clip);
+        }
     }
 
 
@@ -134,6 +230,9 @@ class Capture : public RDPGraphicDevice
     {
         this->sc.draw(cmd, clip);
         this->nc.draw(cmd, clip);
+        if (this->vc){
+            this->vc->draw(cmd, clip);
+        }
     }
 
     void draw(const RDPGlyphIndex & cmd, const Rect & clip)
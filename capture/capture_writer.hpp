@@ -0,0 +1,522 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Background writer of captures: PNG encoding and all file writes are done
+   by a dedicated thread, session thread only copies frames or WRM chunks
+   to a bounded single producer / single consumer queue (no lock, only
+   memory barriers, semaphores are used to sleep).
+
+   When queue is full, PNG frames are dropped (there will be another
+   snapshot) and WRM chunks are kept in pending batch (lag), producer only
+   waits for writer thread when pending batch goes over max_lag bytes.
+   Video frames are kept by producer (see VideoCapture) until queue has
+   room again, then given at once.
+*/
+
+#if !defined(__CAPTURE_CAPTURE_WRITER_HPP__)
+#define __CAPTURE_CAPTURE_WRITER_HPP__
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log.hpp"
+#include "error.hpp"
+#include "png.hpp"
+#include "transport.hpp"
+
+class CaptureVideoSink;
+
+struct CaptureJob {
+    enum {
+        PNG_FRAME, // data is a 24 bits frame (or part of frame at x, y) to write in path
+        WRM_DATA,  // data is appended to current wrm file
+        WRM_FD,    // current wrm file is closed, fd becomes current wrm file
+        WRM_OPEN,  // current wrm file is closed, path becomes current wrm file
+        TEXT_LINE, // path (a text line) is appended to file index_path
+        VIDEO_FRAME, // repeats unchanged frames then one frame of video, data (if any) is the part of frame changed at x, y
+        VIDEO_CLOSE, // video is deleted (file closed) by writer thread
+        STOP
+    };
+    int type;
+    char path[1024];
+    uint8_t * data;
+    size_t len;
+    uint16_t width;
+    uint16_t height;
+    size_t rowsize;
+    int16_t x;
+    int16_t y;
+    uint16_t screen_width;
+    uint16_t screen_height;
+    char index_path[1024]; // if set, part of frame is listed in this file
+    int fd;
+    CaptureVideoSink * video;
+    unsigned repeats;
+};
+
+// video encoded and written by writer thread, errors are handled by video
+// (video_frame() does not throw)
+class CaptureVideoSink
+{
+    public:
+    virtual ~CaptureVideoSink() {}
+    virtual void video_frame(const CaptureJob & job) = 0;
+};
+
+class CaptureWriter
+{
+    public:
+    enum {
+        QUEUE_SIZE = 8,
+        BATCH_SIZE = 65536,
+        MAX_LAG = 16 * 1024 * 1024
+    };
+
+    private:
+    CaptureJob jobs[QUEUE_SIZE];
+    volatile unsigned head; // only written by producer
+    volatile unsigned tail; // only written by writer thread
+    sem_t queued_jobs;
+    sem_t done_jobs;
+    pthread_t thread;
+    bool running;
+
+    // producer side, wrm chunks not yet given to writer thread
+    uint8_t * batch;
+    size_t batch_len;
+    size_t batch_capacity;
+
+    // writer thread side
+    int fd;
+
+    public:
+    size_t max_lag;
+
+    // producer side counters
+    uint64_t nb_frames;
+    uint64_t nb_dropped_frames;
+    uint64_t nb_video_frames;
+    uint64_t nb_batches;
+    uint64_t nb_lagged; // queue full, batch kept pending
+    uint64_t nb_stalls; // producer had to wait for writer thread
+
+    // writer thread side counters
+    volatile uint64_t bytes_written;
+    volatile uint32_t nb_errors;
+
+    CaptureWriter()
+    : head(0)
+    , tail(0)
+    , running(false)
+    , batch(0)
+    , batch_len(0)
+    , batch_capacity(0)
+    , fd(-1)
+    , max_lag(MAX_LAG)
+    , nb_frames(0)
+    , nb_dropped_frames(0)
+    , nb_video_frames(0)
+    , nb_batches(0)
+    , nb_lagged(0)
+    , nb_stalls(0)
+    , bytes_written(0)
+    , nb_errors(0)
+    {
+        sem_init(&this->queued_jobs, 0, 0);
+        sem_init(&this->done_jobs, 0, 0);
+        if (0 == pthread_create(&this->thread, NULL, CaptureWriter::run, this)){
+            this->running = true;
+        }
+        else {
+            LOG(LOG_WARNING, "capture writer: thread creation failed, captures written synchronously");
+        }
+    }
+
+    ~CaptureWriter()
+    {
+        this->flush(true);
+        CaptureJob & job = this->reserve();
+        job.type = CaptureJob::STOP;
+        this->commit();
+        if (this->running){
+            pthread_join(this->thread, NULL);
+        }
+        free(this->batch);
+        sem_destroy(&this->queued_jobs);
+        sem_destroy(&this->done_jobs);
+        LOG(LOG_INFO, "capture writer: %llu frames (%llu dropped), %llu video frames, %llu wrm batches"
+            " (%llu lagged, %llu stalls), %llu bytes written, %u errors",
+            (unsigned long long)this->nb_frames,
+            (unsigned long long)this->nb_dropped_frames,
+            (unsigned long long)this->nb_video_frames,
+            (unsigned long long)this->nb_batches,
+            (unsigned long long)this->nb_lagged,
+            (unsigned long long)this->nb_stalls,
+            (unsigned long long)this->bytes_written,
+            (unsigned)this->nb_errors);
+    }
+
+    bool full() const
+    {
+        return this->head - this->tail >= (unsigned)QUEUE_SIZE;
+    }
+
+    // queues a copy of frame (PNG_FRAME job) to be written as png, frame is
+    // dropped if writer thread is late
+    bool frame(const CaptureJob & frame)
+    {
+        const size_t line_len = frame.width * 3;
+        uint8_t * copy = this->full() ? 0 : (uint8_t*)malloc(line_len * frame.height);
+        if (!copy){
+            this->nb_dropped_frames++;
+            return false;
+        }
+        for (size_t y = 0; y < frame.height; y++){
+            memcpy(copy + y * line_len, frame.data + y * frame.rowsize, line_len);
+        }
+        CaptureJob & job = this->jobs[this->head % QUEUE_SIZE];
+        job = frame;
+        job.data = copy;
+        job.len = line_len * frame.height;
+        job.rowsize = line_len;
+        this->commit();
+        this->nb_frames++;
+        return true;
+    }
+
+    // queues a copy of changed part of video frame (VIDEO_FRAME job), if
+    // writer thread is late returns false unless wait is set
+    bool video_frame(const CaptureJob & frame, bool wait = false)
+    {
+        if (this->full() && !wait){
+            return false;
+        }
+        const size_t line_len = frame.width * 3;
+        uint8_t * copy = 0;
+        if (frame.data){
+            copy = (uint8_t*)malloc(line_len * frame.height);
+            if (!copy){
+                LOG(LOG_ERR, "capture writer: failed to allocate %u bytes", (unsigned)(line_len * frame.height));
+                throw Error(ERR_RECORDER_ALLOCATION_FAILED);
+            }
+            for (size_t y = 0; y < frame.height; y++){
+                memcpy(copy + y * line_len, frame.data + y * frame.rowsize, line_len);
+            }
+        }
+        CaptureJob & job = this->reserve();
+        job = frame;
+        job.type = CaptureJob::VIDEO_FRAME;
+        job.data = copy;
+        job.len = copy ? line_len * frame.height : 0;
+        job.rowsize = line_len;
+        this->commit();
+        this->nb_video_frames += 1 + frame.repeats;
+        return true;
+    }
+
+    // video is deleted by writer thread once queued frames are written
+    void video_close(CaptureVideoSink * video)
+    {
+        CaptureJob & job = this->reserve();
+        job.type = CaptureJob::VIDEO_CLOSE;
+        job.video = video;
+        this->commit();
+    }
+
+    // writes png of frame and its .meta file (screen size), part of frame is
+    // also listed in index file, returns png size or -1 on error
+    static long write_png(const CaptureJob & frame)
+    {
+        char meta_path[1040];
+        snprintf(meta_path, sizeof(meta_path), "%s.meta", frame.path);
+        FILE * f = fopen(meta_path, "w");
+        if (f){
+            fprintf(f, "%d,%d\n", frame.screen_width, frame.screen_height);
+            fclose(f);
+        }
+        f = fopen(frame.path, "w");
+        if (!f){
+            LOG(LOG_ERR, "capture writer: failed to open %s : %s", frame.path, strerror(errno));
+            return -1;
+        }
+        ::dump_png24(f, frame.data, frame.width, frame.height, frame.rowsize);
+        long size = ftell(f);
+        fclose(f);
+        if (frame.index_path[0]){
+            char line[1100];
+            snprintf(line, sizeof(line), "%s,%d,%d,%u,%u\n", frame.path, frame.x, frame.y, frame.width, frame.height);
+            if (!CaptureWriter::append_line(frame.index_path, line)){
+                return -1;
+            }
+        }
+        return size;
+    }
+
+    // appends data to current wrm file (data is only queued on flush)
+    void write(const char * data, size_t len)
+    {
+        if (this->batch_len + len > this->batch_capacity){
+            size_t capacity = this->batch_capacity ? this->batch_capacity : (size_t)BATCH_SIZE;
+            while (capacity < this->batch_len + len){
+                capacity *= 2;
+            }
+            uint8_t * batch = (uint8_t*)realloc(this->batch, capacity);
+            if (!batch){
+                LOG(LOG_ERR, "capture writer: failed to allocate %u bytes", (unsigned)capacity);
+                throw Error(ERR_RECORDER_ALLOCATION_FAILED);
+            }
+            this->batch = batch;
+            this->batch_capacity = capacity;
+        }
+        memcpy(this->batch + this->batch_len, data, len);
+        this->batch_len += len;
+        if (this->batch_len >= this->max_lag){
+            this->flush();
+        }
+    }
+
+    // gives pending wrm data to writer thread, if queue is full data is kept
+    // for next flush unless force is set or lag is over max_lag
+    void flush(bool force = false)
+    {
+        if (!this->batch_len){
+            return;
+        }
+        if (!force && this->full() && this->batch_len < this->max_lag){
+            this->nb_lagged++;
+            return;
+        }
+        CaptureJob & job = this->reserve();
+        job.type = CaptureJob::WRM_DATA;
+        job.data = this->batch;
+        job.len = this->batch_len;
+        this->batch = 0;
+        this->batch_len = 0;
+        this->batch_capacity = 0;
+        this->commit();
+        this->nb_batches++;
+    }
+
+    // next wrm data goes to already opened fd (owned by writer from now)
+    void wrm_fd(int fd)
+    {
+        this->flush(true);
+        CaptureJob & job = this->reserve();
+        job.type = CaptureJob::WRM_FD;
+        job.fd = fd;
+        this->commit();
+    }
+
+    // next wrm data goes to path, opened by writer thread
+    void wrm_open(const char * path)
+    {
+        this->flush(true);
+        CaptureJob & job = this->reserve();
+        job.type = CaptureJob::WRM_OPEN;
+        strncpy(job.path, path, sizeof(job.path) - 1);
+        job.path[sizeof(job.path) - 1] = 0;
+        this->commit();
+    }
+
+    // appends line to text file (index files)
+    void text_line(const char * filename, const char * line)
+    {
+        CaptureJob & job = this->reserve();
+        job.type = CaptureJob::TEXT_LINE;
+        strncpy(job.path, line, sizeof(job.path) - 1);
+        job.path[sizeof(job.path) - 1] = 0;
+        strncpy(job.index_path, filename, sizeof(job.index_path) - 1);
+        job.index_path[sizeof(job.index_path) - 1] = 0;
+        this->commit();
+    }
+
+    // appends line to text file, returns false on error
+    static bool append_line(const char * filename, const char * line)
+    {
+        FILE * f = fopen(filename, "a");
+        if (!f){
+            LOG(LOG_ERR, "capture writer: failed to open %s : %s", filename, strerror(errno));
+            return false;
+        }
+        fputs(line, f);
+        fclose(f);
+        return true;
+    }
+
+    // waits until everything queued so far is written
+    void sync()
+    {
+        this->flush(true);
+        while (this->tail != this->head){
+            sem_wait(&this->done_jobs);
+        }
+    }
+
+    private:
+    CaptureJob & reserve()
+    {
+        if (this->full()){
+            this->nb_stalls++;
+            while (this->full()){
+                sem_wait(&this->done_jobs);
+            }
+        }
+        return this->jobs[this->head % QUEUE_SIZE];
+    }
+
+    void commit()
+    {
+        if (!this->running){
+            this->process(this->jobs[this->head % QUEUE_SIZE]);
+            this->head++;
+            this->tail++;
+            return;
+        }
+        __sync_synchronize();
+        this->head++;
+        sem_post(&this->queued_jobs);
+    }
+
+    static void * run(void * arg)
+    {
+        CaptureWriter * self = static_cast<CaptureWriter*>(arg);
+        for (bool stop = false ; !stop ; ){
+            while (0 != sem_wait(&self->queued_jobs)){
+                // EINTR
+            }
+            __sync_synchronize();
+            CaptureJob & job = self->jobs[self->tail % QUEUE_SIZE];
+            stop = (job.type == CaptureJob::STOP);
+            self->process(job);
+            __sync_synchronize();
+            self->tail++;
+            sem_post(&self->done_jobs);
+        }
+        return 0;
+    }
+
+    void close_wrm()
+    {
+        if (this->fd >= 0){
+            close(this->fd);
+            this->fd = -1;
+        }
+    }
+
+    void write_wrm(const uint8_t * data, size_t len)
+    {
+        size_t total = 0;
+        while (this->fd >= 0 && total < len){
+            ssize_t ret = ::write(this->fd, data + total, len - total);
+            if (ret > 0){
+                total += ret;
+                continue;
+            }
+            if (ret < 0 && errno == EINTR){
+                continue;
+            }
+            LOG(LOG_ERR, "capture writer: wrm write failed with error %s, wrm file closed", strerror(errno));
+            this->nb_errors++;
+            this->close_wrm();
+        }
+        this->bytes_written += total;
+    }
+
+    void process(CaptureJob & job)
+    {
+        switch (job.type){
+        case CaptureJob::PNG_FRAME:
+        {
+            long size = CaptureWriter::write_png(job);
+            if (size < 0){
+                this->nb_errors++;
+            }
+            else {
+                this->bytes_written += size;
+            }
+            free(job.data);
+        }
+        break;
+        case CaptureJob::WRM_DATA:
+            this->write_wrm(job.data, job.len);
+            free(job.data);
+        break;
+        case CaptureJob::WRM_FD:
+            this->close_wrm();
+            this->fd = job.fd;
+        break;
+        case CaptureJob::WRM_OPEN:
+            this->close_wrm();
+            LOG(LOG_INFO, "Recording to file : %s", job.path);
+            this->fd = open(job.path, O_WRONLY|O_CREAT, 0666);
+            if (this->fd < 0){
+                LOG(LOG_ERR, "Error opening native capture file : %s", strerror(errno));
+                this->nb_errors++;
+            }
+        break;
+        case CaptureJob::TEXT_LINE:
+            if (!CaptureWriter::append_line(job.index_path, job.path)){
+                this->nb_errors++;
+            }
+        break;
+        case CaptureJob::VIDEO_FRAME:
+            job.video->video_frame(job);
+            free(job.data);
+        break;
+        case CaptureJob::VIDEO_CLOSE:
+            delete job.video;
+        break;
+        case CaptureJob::STOP:
+            this->close_wrm();
+        break;
+        }
+        job.data = 0;
+    }
+};
+
+// WRM chunks output, written to file by capture writer thread
+class CaptureWriterTransport : public Transport {
+
+    public:
+    CaptureWriter * writer;
+
+    CaptureWriterTransport(CaptureWriter * writer) : Transport(), writer(writer) {}
+
+    ~CaptureWriterTransport() {}
+
+    using Transport::recv;
+    virtual void recv(char ** pbuffer, size_t len) throw (Error) {
+        LOG(LOG_INFO, "CaptureWriterTransport used for recv");
+        throw Error(ERR_TRANSPORT_OUTPUT_ONLY_USED_FOR_RECV, 0);
+    }
+
+    using Transport::send;
+    virtual void send(const char * const buffer, size_t len) throw (Error) {
+        this->writer->write(buffer, len);
+        this->total_sent += len;
+    }
+};
+
+#endif
@@ -24,11 +24,16 @@
 #include "RDP/RDPGraphicDevice.hpp"
 #include <iosfwd>
 
+// version 0: width, height, bpp
+// version 1: width, height, bpp, compression of chunks (WRMCompression)
 struct MetaWRM {
+    static const uint16_t LAST_VERSION = 1;
+
     uint16_t version;
     uint16_t width;
     uint16_t height;
     uint8_t bpp;
+    uint8_t compression;
 
     static const size_t size_for_stream = 7;
 
@@ -37,6 +42,7 @@ struct MetaWRM {
     , width(0)
     , height(0)
     , bpp(0)
+    , compression(WRMCompression::NONE)
     {}
 
     MetaWRM(RDPUnserializer& unserializer)
@@ -44,19 +50,38 @@ struct MetaWRM {
         this->recv(unserializer);
     }
 
-    MetaWRM(uint16_t width, uint16_t height, uint8_t bpp)
-    : version(0)
+    MetaWRM(uint16_t width, uint16_t height, uint8_t bpp,
+            uint8_t compression = WRMCompression::NONE)
+    : version(compression ? 1 : 0)
     , width(width)
     , height(height)
     , bpp(bpp)
+    , compression(compression)
     {}
 
+    // compressed recordings need version 1 (readers of version 0 would
+    // misread chunks)
+    void set_compression(uint8_t compression)
+    {
+        this->compression = compression;
+        this->version = compression ? 1 : 0;
+    }
+
     void recv(Stream& stream)
     {
         this->version = stream.in_uint16_le();
+        if (this->version > LAST_VERSION){
+            LOG(LOG_ERR, "Unsupported wrm version %u (last supported %u)", this->version, LAST_VERSION);
+            throw Error(ERR_WRM_UNSUPPORTED_FORMAT);
+        }
         this->width = stream.in_uint16_le();
         this->height = stream.in_uint16_le();
         this->bpp = stream.in_uint8();
+        this->compression = (this->version >= 1) ? stream.in_uint8() : WRMCompression::NONE;
+        if (this->compression > WRMCompression::ZLIB){
+            LOG(LOG_ERR, "Unsupported wrm compression %u", this->compression);
+            throw Error(ERR_WRM_UNSUPPORTED_FORMAT);
+        }
     }
 
     void recv(RDPUnserializer& unserializer)
@@ -71,6 +96,7 @@ struct MetaWRM {
             this->width = 800;
             this->height = 600;
             this->bpp = 24;
+            this->compression = WRMCompression::NONE;
         }
     }
 
@@ -81,17 +107,18 @@ struct MetaWRM {
 
     void emit(Stream& stream, Transport& transport) const
     {
+        const uint16_t chunk_size = this->size() + 8;
         if (stream.p == stream.data)
         {
             stream.out_uint16_le(WRMChunk::META_INFO);
-            stream.out_uint16_le(7 + 8);
+            stream.out_uint16_le(chunk_size);
             stream.out_uint16_le(1);
             stream.out_uint16_le(0);
         }
         else
         {
             stream.set_out_uint16_le(WRMChunk::META_INFO, 0);
-            stream.set_out_uint16_le(7 + 8, 2);
+            stream.set_out_uint16_le(chunk_size, 2);
             stream.set_out_uint16_le(1, 4);
         }
         this->emit(stream);
@@ -106,6 +133,14 @@ struct MetaWRM {
         stream.out_uint16_le(this->width);
         stream.out_uint16_le(this->height);
         stream.out_uint8(this->bpp);
+        if (this->version >= 1){
+            stream.out_uint8(this->compression);
+        }
+    }
+
+    size_t size() const
+    {
+        return (this->version >= 1) ? 8 : 7;
     }
 };
 
@@ -128,7 +163,8 @@ operator<<(std::basic_ostream<_Char, _CharTraits>& os, const MetaWRM& meta)
     return os << "{version:" << meta.version
     << ", width: " << meta.width
     << ", height: " << meta.height
-    << ", bpp: " << short(meta.bpp) << '}';
+    << ", bpp: " << short(meta.bpp)
+    << ", compression: " << short(meta.compression) << '}';
 }
 
 #endif
\ No newline at end of file
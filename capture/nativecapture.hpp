@@ -51,6 +51,8 @@
 #include "stream.hpp"
 
 #include "GraphicToFile.hpp"
+#include "capture_writer.hpp"
+#include "wrm_index.hpp"
 
 // #include <iostream>
 
@@ -61,10 +63,13 @@ class NativeCapture : public RDPGraphicDevice
     int height;
     int bpp;
     OutFileTransport trans;
+    CaptureWriter * writer; // if set, wrm files are written by writer thread
+    CaptureWriterTransport writer_trans;
     GraphicsToFile recorder;
     char basepath[1024];
     uint16_t basepath_len;
     uint32_t nb_file;
+    char index_path[1024]; // keyframe index, one line per wrm file
 
 private:
     int next_filename()
@@ -82,22 +87,47 @@ private:
         }
     }
 
+    // current file starts with a keyframe at current recording time
+    void index_file()
+    {
+        char line[1100];
+        WRMIndex::line(line, sizeof(line), this->recorder.time_offset, 0, this->basepath);
+        if (this->writer){
+            this->writer->text_line(this->index_path, line);
+        }
+        else {
+            CaptureWriter::append_line(this->index_path, line);
+        }
+    }
+
 public:
-    NativeCapture(int width, int height, const char * path)
+    NativeCapture(int width, int height, const char * path, CaptureWriter * writer = 0)
     : width(width)
     , height(height)
     , bpp(24)
     , trans(-1)
-    , recorder(&this->trans, NULL, 24, 8192, 768, 8192, 3072, 8192, 12288)
+    , writer(writer)
+    , writer_trans(writer)
+    , recorder(writer ? (Transport*)&this->writer_trans : (Transport*)&this->trans,
+               NULL, 24, 8192, 768, 8192, 3072, 8192, 12288)
     , nb_file(0)
     {
         this->basepath_len = sprintf(this->basepath, "%s-%u-", path, getpid());
+        snprintf(this->index_path, sizeof(this->index_path), "%s-%u.wrm.idx", path, getpid());
+        unlink(this->index_path);
         this->next_filename();
         this->open_file();
+        if (this->writer){
+            this->writer->wrm_fd(this->trans.fd);
+            this->trans.fd = -1;
+        }
+        this->index_file();
     }
 
     ~NativeCapture(){
-        close(this->trans.fd);
+        if (this->trans.fd >= 0){
+            close(this->trans.fd);
+        }
     }
 
     virtual void flush()
@@ -186,14 +216,21 @@ public:
         }
         this->recorder.send_order();
 
-        close(this->trans.fd);
-        this->open_file();
+        if (this->writer){
+            this->writer->wrm_open(this->basepath);
+        }
+        else {
+            close(this->trans.fd);
+            this->open_file();
+        }
+        this->index_file();
 
         this->recorder.init();
         this->recorder.chunk_type = WRMChunk::BREAKPOINT;
         this->recorder.order_count = 1;
         {
-            MetaWRM meta(this->width, this->height, this->bpp);
+            MetaWRM meta(this->width, this->height, this->bpp,
+                         this->recorder.compression_level ? WRMCompression::ZLIB : WRMCompression::NONE);
             meta.emit(this->recorder.stream);
             //std::cout << "write meta " << meta << '\n';
         }
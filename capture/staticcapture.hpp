@@ -50,6 +50,7 @@
 #include "colors.hpp"
 
 #include "RDP/RDPDrawable.hpp"
+#include "capture_writer.hpp"
 
 
 class StaticCapture : public RDPDrawable
@@ -59,14 +60,20 @@ public:
     char path[1024];
     char image_path[1024];
     uint16_t image_basepath_len;
+    CaptureWriter * writer; // if set, png are written by writer thread
+    bool dirty_only;        // png only hold area changed since previous png
+    char index_path[1024];  // list of changed areas when dirty_only is set
 
 public:
-    StaticCapture(int width, int height, const char * path, const char * codec_id, const char * video_quality, bool bgr = true)
+    StaticCapture(int width, int height, const char * path, const char * codec_id, const char * video_quality, bool bgr = true, CaptureWriter * writer = 0)
         : RDPDrawable(width, height, bgr),
-          framenb(0)
+          framenb(0),
+          writer(writer),
+          dirty_only(false)
     {
         strcpy(this->path, path);
         this->image_basepath_len = sprintf(this->image_path, "%s-%u-", path, getpid());
+        snprintf(this->index_path, sizeof(this->index_path), "%s-%u.idx", path, getpid());
     }
 
     ~StaticCapture(){
@@ -77,21 +84,37 @@ public:
         this->dump_png();
     }
 
+    // whole frame, or area changed since previous png if dirty_only is set
+    // (nothing is written if nothing changed)
     void dump_png(void){
-        char rawImageMetaPath[256] = {0};
-        sprintf(this->image_path + this->image_basepath_len, "%u.png", this->framenb++);
-        snprintf(rawImageMetaPath, 254, "%s.meta", this->image_path);
-//        LOG(LOG_INFO, "Dumping to file %s", rawImagePath);
-        FILE * fd = fopen(rawImageMetaPath, "w");
-        if (fd) {
-           fprintf(fd, "%d,%d\n", this->drawable.width, this->drawable.height);
+        Rect rect(0, 0, this->drawable.width, this->drawable.height);
+        if (this->dirty_only){
+            rect = this->drawable.dirty;
+            if (rect.isempty()){
+                return;
+            }
         }
-        fclose(fd);
-        fd = fopen(this->image_path, "w");
-        if (fd) {
-            ::dump_png24(fd, this->drawable.data, this->drawable.width, this->drawable.height, this->drawable.rowsize);
+        sprintf(this->image_path + this->image_basepath_len, "%u.png", this->framenb);
+
+        CaptureJob frame;
+        frame.type = CaptureJob::PNG_FRAME;
+        strcpy(frame.path, this->image_path);
+        frame.data = this->drawable.first_pixel(rect);
+        frame.width = rect.cx;
+        frame.height = rect.cy;
+        frame.rowsize = this->drawable.rowsize;
+        frame.x = rect.x;
+        frame.y = rect.y;
+        frame.screen_width = this->drawable.width;
+        frame.screen_height = this->drawable.height;
+        frame.index_path[0] = 0;
+        if (this->dirty_only){
+            strcpy(frame.index_path, this->index_path);
+        }
+        if (this->writer ? this->writer->frame(frame) : (CaptureWriter::write_png(frame) >= 0)){
+            this->framenb++;
+            this->drawable.reset_dirty();
         }
-        fclose(fd);
     }
 
     void glyph_index(const RDPGlyphIndex & glyph_index, const Rect & clip)
@@ -22,7 +22,9 @@
 #define __TIMER_CAPTURE_HPP__
 
 #include <sys/time.h>
+#include <time.h>
 #include "difftimeval.hpp"
+#include "log.hpp"
 
 class TimerCapture
 {
@@ -122,76 +124,96 @@ public:
     }
 };
 
-struct WaitCapture {
-    TimerCapture timer;
+// Replay clock of native recordings, recorded time is the sum of TIMESTAMP
+// chunks. REAL_TIME sleeps until wall time elapsed since first timestamp
+// reaches recorded time (absolute schedule: time spent drawing is taken off
+// next sleep, hence no drift), BATCH never sleeps.
+struct ReplayClock {
+    enum {
+        REAL_TIME,
+        BATCH
+    };
+    int mode;
+    uint64_t recorded;       // us, recording time reached by replay
+    uint64_t origin;         // us, recording time when replay (re)started
+    struct timeval start;    // wall time of first timestamp since (re)start
+    bool started;
 
-private:
-    uint64_t time_future;
+    // instrumentation
+    uint32_t nb_timestamps;
+    uint64_t slept;          // us
+    uint64_t late;           // us, worst delay behind recording schedule
 
-//public:
-    uint64_t time_wait;
-
-public:
-    WaitCapture()
-    : timer(TimerCapture::invalid_timer())
-    , time_future(0)
-    {}
+    ReplayClock(int mode = REAL_TIME)
+    : mode(mode)
+    {
+        this->reset();
+    }
 
-    void future(uint64_t micro_sec)
+    // replay (re)starts at recorded time (after seek)
+    void reset(uint64_t recorded = 0)
     {
-        if (this->timer.valid())
-        {
-            uint64_t elapsed = this->timer.elapsed() + this->time_future;
-            if (elapsed <= micro_sec)
-            {
-                this->time_wait = micro_sec - elapsed;
-                this->time_future = 0;
-            }
-            else
-            {
-                this->time_future = elapsed - micro_sec;
-                this->time_wait = 0;
-            }
-        }
-        else
-        {
-            timer.reset();
-            this->time_wait = micro_sec;
-            this->time_future = 0;
-        }
+        this->recorded = recorded;
+        this->origin = recorded;
+        this->started = false;
+        this->nb_timestamps = 0;
+        this->slept = 0;
+        this->late = 0;
     }
 
-    void sleep()
+    void wait(uint64_t micro_sec)
     {
-        if (this->time_wait)
-        {
-            struct timespec wtime = {
-                this->time_wait / 1000000,
-                this->time_wait % 1000000 * 1000
-            };
-            nanosleep(&wtime, NULL);
-            this->timer += this->time_wait;
+        struct timeval now;
+        gettimeofday(&now, 0);
+        if (!this->started){
+            this->start = now;
+            this->started = true;
+        }
+        this->recorded += micro_sec;
+        this->nb_timestamps++;
+        if (this->mode == REAL_TIME){
+            uint64_t elapsed = difftimeval(now, this->start);
+            uint64_t due = this->recorded - this->origin;
+            if (elapsed < due){
+                uint64_t delay = due - elapsed;
+                struct timespec wtime = { (time_t)(delay / 1000000), (long)(delay % 1000000 * 1000) };
+                nanosleep(&wtime, NULL);
+                this->slept += delay;
+            }
+            else if (elapsed - due > this->late){
+                this->late = elapsed - due;
+            }
         }
     }
 
-    void fake_sleep()
+    // us of wall time since first timestamp
+    uint64_t elapsed() const
     {
-        if (this->time_wait)
-        {
-            this->timer += this->time_wait;
+        if (!this->started){
+            return 0;
         }
+        struct timeval now;
+        gettimeofday(&now, 0);
+        return difftimeval(now, this->start);
     }
 
-    void wait(uint64_t micro_sec)
+    // recorded time replayed per wall time (1 in real time, more in batch)
+    double speed() const
     {
-        this->future(micro_sec);
-        this->sleep();
+        uint64_t elapsed = this->elapsed();
+        return elapsed ? (double)(this->recorded - this->origin) / elapsed : 0.;
     }
 
-    void fake_wait(uint64_t micro_sec)
+    void log() const
     {
-        this->future(micro_sec);
-        this->fake_sleep();
+        LOG(LOG_INFO, "replay %s: %llu us of recording in %llu us (x%.2f), "
+                      "%u timestamps, %llu us asleep, up to %llu us late",
+            (this->mode == REAL_TIME) ? "real time" : "batch",
+            (unsigned long long)(this->recorded - this->origin),
+            (unsigned long long)this->elapsed(), this->speed(),
+            (unsigned)this->nb_timestamps,
+            (unsigned long long)this->slept,
+            (unsigned long long)this->late);
     }
 };
 
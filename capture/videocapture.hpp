@@ -0,0 +1,552 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Video capture of session: drawable frames at fixed framerate encoded as
+   MJPEG (libjpeg) in AVI files path-pid-N.avi. Frames where nothing was
+   drawn since previous frame are not encoded, an empty chunk is written
+   instead (players show previous frame again).
+
+   With a capture writer, session thread only copies the part of drawable
+   changed since previous frame, encoding and file writes are done by
+   writer thread (VideoRecorder keeps its own copy of the whole frame).
+*/
+
+#if !defined(__CAPTURE_VIDEOCAPTURE_HPP__)
+#define __CAPTURE_VIDEOCAPTURE_HPP__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <vector>
+#include <jpeglib.h>
+
+#include "log.hpp"
+#include "error.hpp"
+#include "rect.hpp"
+#include "stream.hpp"
+#include "difftimeval.hpp"
+#include "drawable.hpp"
+#include "capture_writer.hpp"
+#include "RDP/RDPGraphicDevice.hpp"
+
+// one jpeg image for every frame, output buffer allocated once
+struct JPEGEncoder
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    int quality;
+    unsigned char * buffer;
+    unsigned long capacity;
+
+    JPEGEncoder(uint16_t width, uint16_t height, int quality)
+    : quality(quality)
+    // jpeg of 24 bits image is always smaller than raw image and headers
+    , capacity(width * height * 3 + 65536)
+    {
+        this->buffer = (unsigned char *)malloc(this->capacity);
+        if (!this->buffer){
+            LOG(LOG_ERR, "video capture: failed to allocate %lu bytes for jpeg", this->capacity);
+            throw Error(ERR_RECORDER_SNAPSHOT_FAILED);
+        }
+        this->cinfo.err = jpeg_std_error(&this->jerr);
+        jpeg_create_compress(&this->cinfo);
+        this->cinfo.image_width = width;
+        this->cinfo.image_height = height;
+        this->cinfo.input_components = 3;
+        this->cinfo.in_color_space = JCS_RGB;
+        jpeg_set_defaults(&this->cinfo);
+        jpeg_set_quality(&this->cinfo, quality, TRUE);
+        this->cinfo.dct_method = JDCT_IFAST;
+    }
+
+    ~JPEGEncoder()
+    {
+        jpeg_destroy_compress(&this->cinfo);
+        free(this->buffer);
+    }
+
+    // ffmpeg like qscale (2 best .. 31 worst) to jpeg quality
+    static int quality_of_qscale(int qscale)
+    {
+        int quality = 100 - 3 * qscale;
+        return (quality < 5) ? 5 : (quality > 95) ? 95 : quality;
+    }
+
+    // encodes rows of 24 bits image (same byte order as png snapshots),
+    // returns size of jpeg image in buffer
+    size_t encode(const uint8_t * data, size_t rowsize)
+    {
+        unsigned char * out = this->buffer;
+        unsigned long len = this->capacity;
+        jpeg_mem_dest(&this->cinfo, &out, &len);
+        jpeg_start_compress(&this->cinfo, TRUE);
+        while (this->cinfo.next_scanline < this->cinfo.image_height){
+            JSAMPROW row = (JSAMPROW)(data + this->cinfo.next_scanline * rowsize);
+            jpeg_write_scanlines(&this->cinfo, &row, 1);
+        }
+        jpeg_finish_compress(&this->cinfo);
+        if (out != this->buffer){
+            // buffer was too small, libjpeg allocated a larger one holding
+            // the whole image: it becomes output buffer of next frames
+            free(this->buffer);
+            this->buffer = out;
+            this->capacity = len;
+        }
+        return len;
+    }
+};
+
+// AVI 1.0 file with one MJPG video stream. Headers have fixed size and are
+// written again with frame count when file is closed, followed by idx1 index.
+struct AVIWriter
+{
+    enum {
+        AVIF_HASINDEX  = 0x10,
+        AVIIF_KEYFRAME = 0x10,
+        HEADERS_SIZE   = 224  // RIFF, hdrl list and movi list headers
+    };
+
+    FILE * f;
+    uint16_t width;
+    uint16_t height;
+    unsigned fps;
+    uint32_t nb_frames;
+    uint32_t movi_size;      // bytes of frame chunks
+    uint32_t max_frame_size;
+    std::vector<uint32_t> index; // offset, size and flags of every frame chunk
+
+    AVIWriter(uint16_t width, uint16_t height, unsigned fps)
+    : f(0)
+    , width(width)
+    , height(height)
+    , fps(fps)
+    , nb_frames(0)
+    , movi_size(0)
+    , max_frame_size(0)
+    {}
+
+    ~AVIWriter()
+    {
+        this->close();
+    }
+
+    void open(const char * filename)
+    {
+        this->close();
+        this->f = fopen(filename, "w");
+        if (!this->f){
+            LOG(LOG_ERR, "video capture: failed to open %s : %s", filename, strerror(errno));
+            throw Error(ERR_RECORDER_SNAPSHOT_FAILED);
+        }
+        this->nb_frames = 0;
+        this->movi_size = 0;
+        this->max_frame_size = 0;
+        this->index.clear();
+        if (!this->write_headers()){
+            throw Error(ERR_RECORDER_SNAPSHOT_FAILED);
+        }
+    }
+
+    // jpeg image, or repeat of previous image if len is 0
+    void frame(const uint8_t * data, size_t len)
+    {
+        Stream stream(8);
+        stream.out_copy_bytes("00dc", 4);
+        stream.out_uint32_le(len);
+        this->index.push_back(this->movi_size + 4);
+        this->index.push_back(len);
+        this->index.push_back(len ? AVIIF_KEYFRAME : 0);
+        if (!this->write(stream.data, 8)
+        || !this->write(data, len)
+        || ((len & 1) && !this->write((const uint8_t *)"", 1))){
+            throw Error(ERR_RECORDER_SNAPSHOT_FAILED);
+        }
+        this->movi_size += 8 + len + (len & 1);
+        this->nb_frames++;
+        if (len > this->max_frame_size){
+            this->max_frame_size = len;
+        }
+    }
+
+    // file size once closed
+    uint64_t size() const
+    {
+        return HEADERS_SIZE + this->movi_size + 8 + this->nb_frames * 16;
+    }
+
+    void close()
+    {
+        if (!this->f){
+            return;
+        }
+        Stream stream(8 + this->nb_frames * 16);
+        stream.out_copy_bytes("idx1", 4);
+        stream.out_uint32_le(this->nb_frames * 16);
+        for (size_t i = 0; i < this->index.size(); i += 3){
+            stream.out_copy_bytes("00dc", 4);
+            stream.out_uint32_le(this->index[i + 2]);
+            stream.out_uint32_le(this->index[i]);
+            stream.out_uint32_le(this->index[i + 1]);
+        }
+        // no exception as called from destructor, file is left without index
+        if (this->write(stream.data, stream.p - stream.data)){
+            fseek(this->f, 0, SEEK_SET);
+            this->write_headers();
+        }
+        fclose(this->f);
+        this->f = 0;
+    }
+
+private:
+    bool write(const uint8_t * data, size_t len)
+    {
+        if (len && len != fwrite(data, 1, len, this->f)){
+            LOG(LOG_ERR, "video capture: write failed : %s", strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    bool write_headers()
+    {
+        Stream stream(HEADERS_SIZE);
+        stream.out_copy_bytes("RIFF", 4);
+        stream.out_uint32_le(this->size() - 8);
+        stream.out_copy_bytes("AVI ", 4);
+
+        stream.out_copy_bytes("LIST", 4);
+        stream.out_uint32_le(192);
+        stream.out_copy_bytes("hdrl", 4);
+
+        stream.out_copy_bytes("avih", 4);
+        stream.out_uint32_le(56);
+        stream.out_uint32_le(1000000 / this->fps);         // dwMicroSecPerFrame
+        stream.out_uint32_le(this->max_frame_size * this->fps); // dwMaxBytesPerSec
+        stream.out_uint32_le(0);                           // dwPaddingGranularity
+        stream.out_uint32_le(AVIF_HASINDEX);               // dwFlags
+        stream.out_uint32_le(this->nb_frames);             // dwTotalFrames
+        stream.out_uint32_le(0);                           // dwInitialFrames
+        stream.out_uint32_le(1);                           // dwStreams
+        stream.out_uint32_le(this->max_frame_size);        // dwSuggestedBufferSize
+        stream.out_uint32_le(this->width);
+        stream.out_uint32_le(this->height);
+        stream.out_clear_bytes(16);                        // dwReserved
+
+        stream.out_copy_bytes("LIST", 4);
+        stream.out_uint32_le(116);
+        stream.out_copy_bytes("strl", 4);
+
+        stream.out_copy_bytes("strh", 4);
+        stream.out_uint32_le(56);
+        stream.out_copy_bytes("vids", 4);
+        stream.out_copy_bytes("MJPG", 4);
+        stream.out_uint32_le(0);                           // dwFlags
+        stream.out_uint16_le(0);                           // wPriority
+        stream.out_uint16_le(0);                           // wLanguage
+        stream.out_uint32_le(0);                           // dwInitialFrames
+        stream.out_uint32_le(1);                           // dwScale
+        stream.out_uint32_le(this->fps);                   // dwRate
+        stream.out_uint32_le(0);                           // dwStart
+        stream.out_uint32_le(this->nb_frames);             // dwLength
+        stream.out_uint32_le(this->max_frame_size);        // dwSuggestedBufferSize
+        stream.out_uint32_le(0xFFFFFFFF);                  // dwQuality
+        stream.out_uint32_le(0);                           // dwSampleSize
+        stream.out_uint16_le(0);                           // rcFrame
+        stream.out_uint16_le(0);
+        stream.out_uint16_le(this->width);
+        stream.out_uint16_le(this->height);
+
+        stream.out_copy_bytes("strf", 4);
+        stream.out_uint32_le(40);
+        stream.out_uint32_le(40);                          // biSize
+        stream.out_uint32_le(this->width);
+        stream.out_uint32_le(this->height);
+        stream.out_uint16_le(1);                           // biPlanes
+        stream.out_uint16_le(24);                          // biBitCount
+        stream.out_copy_bytes("MJPG", 4);                  // biCompression
+        stream.out_uint32_le(this->width * this->height * 3); // biSizeImage
+        stream.out_clear_bytes(16);                        // resolution and palette
+
+        stream.out_copy_bytes("LIST", 4);
+        stream.out_uint32_le(4 + this->movi_size);
+        stream.out_copy_bytes("movi", 4);
+        return this->write(stream.data, stream.p - stream.data);
+    }
+};
+
+// encodes video frames and writes avi files, in writer thread if any
+class VideoRecorder : public CaptureVideoSink
+{
+public:
+    enum {
+        MAX_FILE_SIZE = 1000000000 // a new avi file is started past this size
+    };
+
+    JPEGEncoder encoder;
+    AVIWriter avi;
+    uint16_t width;
+    uint16_t height;
+    uint8_t * image; // current frame, 24 bits rows of width * 3 bytes
+    char path[1024];
+    unsigned nb_file;
+    volatile bool failed; // recording stopped on error
+
+    uint64_t nb_encoded;
+    uint64_t encode_time; // us spent in jpeg encoder
+
+    VideoRecorder(uint16_t width, uint16_t height, const char * path, unsigned fps, int qscale)
+    : encoder(width, height, JPEGEncoder::quality_of_qscale(qscale))
+    , avi(width, height, fps)
+    , width(width)
+    , height(height)
+    , image((uint8_t *)calloc(width * height, 3))
+    , nb_file(0)
+    , failed(false)
+    , nb_encoded(0)
+    , encode_time(0)
+    {
+        if (!this->image){
+            LOG(LOG_ERR, "video capture: failed to allocate %u bytes for frame", (unsigned)(width * height * 3));
+            throw Error(ERR_RECORDER_SNAPSHOT_FAILED);
+        }
+        snprintf(this->path, sizeof(this->path), "%s", path);
+    }
+
+    virtual ~VideoRecorder()
+    {
+        LOG(LOG_INFO, "video capture: %llu frames encoded in %llu ms",
+            (unsigned long long)this->nb_encoded,
+            (unsigned long long)this->encode_time / 1000);
+        free(this->image);
+    }
+
+    // writes repeats of previous frame, then frame updated with job data
+    virtual void video_frame(const CaptureJob & job)
+    {
+        if (this->failed){
+            return;
+        }
+        try {
+            for (unsigned i = 0; i < job.repeats; i++){
+                this->chunk(false);
+            }
+            for (size_t y = 0; job.data && y < job.height; y++){
+                memcpy(this->image + (job.y + y) * this->width * 3 + job.x * 3,
+                       job.data + y * job.rowsize, job.width * 3);
+            }
+            this->chunk(job.data != 0);
+        }
+        catch (Error & e){
+            LOG(LOG_ERR, "video capture: stopped on error %u", e.id);
+            this->failed = true;
+        }
+    }
+
+private:
+    // first frame of every file is a full image
+    void chunk(bool changed)
+    {
+        if (!this->avi.f){
+            char filename[1100];
+            snprintf(filename, sizeof(filename), "%s-%u-%u.avi", this->path, getpid(), this->nb_file++);
+            this->avi.open(filename);
+        }
+        if (changed || !this->avi.nb_frames){
+            struct timeval start;
+            gettimeofday(&start, NULL);
+            size_t len = this->encoder.encode(this->image, this->width * 3);
+            this->avi.frame(this->encoder.buffer, len);
+            struct timeval end;
+            gettimeofday(&end, NULL);
+            this->encode_time += difftimeval(end, start);
+            this->nb_encoded++;
+        }
+        else {
+            this->avi.frame(0, 0);
+        }
+        if (this->avi.size() > MAX_FILE_SIZE){
+            this->avi.close();
+        }
+    }
+};
+
+class VideoCapture : public RDPGraphicDevice
+{
+public:
+    Drawable & drawable; // shared with png snapshots
+    CaptureWriter * writer; // if set, frames are encoded and written by writer thread
+    VideoRecorder * recorder; // given to writer thread when capture ends
+    uint64_t frame_interval; // us
+    struct timeval next_frame;
+    bool started;
+    Rect damage; // area drawn since previous frame given to recorder
+    unsigned pending; // frames due, not given to recorder yet (writer queue full)
+
+    uint64_t nb_skipped; // frames without damage, not encoded
+    uint64_t nb_delayed; // frames kept pending as writer thread was late
+
+    VideoCapture(Drawable & drawable, const char * path, unsigned fps, int qscale, CaptureWriter * writer = 0)
+    : drawable(drawable)
+    , writer(writer)
+    , recorder(new VideoRecorder(drawable.width, drawable.height, path, fps ? fps : 1, qscale))
+    , frame_interval(1000000 / (fps ? fps : 1))
+    , started(false)
+    , damage(0, 0, drawable.width, drawable.height)
+    , pending(0)
+    , nb_skipped(0)
+    , nb_delayed(0)
+    {
+    }
+
+    ~VideoCapture()
+    {
+        LOG(LOG_INFO, "video capture: %llu unchanged frames skipped, %llu frames delayed",
+            (unsigned long long)this->nb_skipped,
+            (unsigned long long)this->nb_delayed);
+        if (!this->writer){
+            delete this->recorder;
+            return;
+        }
+        try {
+            this->push(true);
+        }
+        catch (Error &){
+        }
+        this->writer->video_close(this->recorder);
+    }
+
+    // frames due at now, at most one frame with changes is given to recorder
+    void snapshot(const struct timeval & now)
+    {
+        if (!this->started){
+            this->next_frame = now;
+            this->started = true;
+        }
+        while (!timercmp(&now, &this->next_frame, <)){
+            this->frame();
+            this->next_frame.tv_usec += this->frame_interval;
+            this->next_frame.tv_sec += this->next_frame.tv_usec / 1000000;
+            this->next_frame.tv_usec %= 1000000;
+        }
+    }
+
+    // time left (us) before next frame
+    uint64_t snapshot_delay(const struct timeval & now) const
+    {
+        if (!this->started || !timercmp(&now, &this->next_frame, <)){
+            return 0;
+        }
+        return difftimeval(this->next_frame, now);
+    }
+
+    void frame()
+    {
+        if (this->damage.isempty()){
+            this->nb_skipped++;
+        }
+        this->pending++;
+        this->push(false);
+    }
+
+    void flush()
+    {}
+
+    void draw(const RDPOpaqueRect & cmd, const Rect & clip)
+    {
+        this->mark(cmd.rect.intersect(clip));
+    }
+
+    void draw(const RDPScrBlt & cmd, const Rect & clip)
+    {
+        this->mark(cmd.rect.intersect(clip));
+    }
+
+    void draw(const RDPDestBlt & cmd, const Rect & clip)
+    {
+        this->mark(cmd.rect.intersect(clip));
+    }
+
+    void draw(const RDPPatBlt & cmd, const Rect & clip)
+    {
+        this->mark(cmd.rect.intersect(clip));
+    }
+
+    void draw(const RDPMemBlt & cmd, const Rect & clip, const Bitmap & bmp)
+    {
+        this->mark(cmd.rect.intersect(clip));
+    }
+
+    void draw(const RDPLineTo & cmd, const Rect & clip)
+    {
+        this->mark(Rect(cmd.startx, cmd.starty, 1, 1).enlarge_to(cmd.endx, cmd.endy).intersect(clip));
+    }
+
+    void draw(const RDPGlyphIndex & cmd, const Rect & clip)
+    {
+        this->mark(cmd.bk.intersect(clip));
+    }
+
+private:
+    void mark(const Rect & rect)
+    {
+        const Rect & r = rect.intersect(this->drawable.width, this->drawable.height);
+        if (r.isempty()){
+            return;
+        }
+        this->damage = this->damage.isempty() ? r
+                     : this->damage.enlarge_to(r.x, r.y).enlarge_to(r.x + r.cx - 1, r.y + r.cy - 1);
+    }
+
+    // gives pending frames to recorder: repeats of previous frame, then
+    // frame with damaged area. Kept pending if writer thread is late,
+    // unless wait is set.
+    void push(bool wait)
+    {
+        if (!this->pending || this->recorder->failed){
+            return;
+        }
+        CaptureJob job;
+        job.type = CaptureJob::VIDEO_FRAME;
+        job.video = this->recorder;
+        job.repeats = this->pending - 1;
+        job.data = 0;
+        job.x = this->damage.x;
+        job.y = this->damage.y;
+        job.width = this->damage.cx;
+        job.height = this->damage.cy;
+        job.rowsize = this->drawable.rowsize;
+        if (!this->damage.isempty()){
+            job.data = this->drawable.data + this->damage.y * this->drawable.rowsize + this->damage.x * 3;
+        }
+        if (!this->writer){
+            this->recorder->video_frame(job);
+        }
+        else if (!this->writer->video_frame(job, wait)){
+            this->nb_delayed++;
+            return;
+        }
+        this->pending = 0;
+        this->damage = Rect();
+    }
+};
+
+#endif
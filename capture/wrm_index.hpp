@@ -0,0 +1,220 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Keyframe index of a native (wrm) recording. Recording is split in files
+   path-pid-N.wrm, every file after the first one begins with a BREAKPOINT
+   (full screen and caches), first one with META_INFO. Index path-pid.wrm.idx
+   has one line per file start:
+
+   time,offset,filename
+
+   time is recording time in microseconds (sum of TIMESTAMP chunks before
+   keyframe), offset is position of keyframe chunk in filename.
+*/
+
+#if !defined(__CAPTURE_WRM_INDEX_HPP__)
+#define __CAPTURE_WRM_INDEX_HPP__
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "log.hpp"
+#include "RDP/RDPGraphicDevice.hpp"
+
+struct WRMIndexEntry {
+    uint64_t time;
+    uint64_t offset;
+    std::string filename;
+    size_t first_timestamp; // position in WRMIndex::timestamps (rebuilt index only)
+
+    WRMIndexEntry(uint64_t time, uint64_t offset, const std::string & filename, size_t first_timestamp = 0)
+    : time(time)
+    , offset(offset)
+    , filename(filename)
+    , first_timestamp(first_timestamp)
+    {}
+
+    bool operator<(const WRMIndexEntry & other) const
+    {
+        return this->time < other.time;
+    }
+};
+
+struct WRMIndex {
+    std::vector<WRMIndexEntry> entries;
+    std::vector<uint64_t> timestamps; // time of every TIMESTAMP chunk (rebuilt index only)
+
+    // index line of keyframe, returns line length
+    static int line(char * buffer, size_t len, uint64_t time, uint64_t offset, const char * filename)
+    {
+        return snprintf(buffer, len, "%llu,%llu,%s\n",
+                        (unsigned long long)time, (unsigned long long)offset, filename);
+    }
+
+    // path-pid-N.wrm -> path-pid.wrm.idx
+    static std::string path(const std::string & wrm_filename)
+    {
+        std::string::size_type dash = wrm_filename.rfind('-');
+        if (dash == std::string::npos
+        || wrm_filename.size() < 4
+        || wrm_filename.compare(wrm_filename.size() - 4, 4, ".wrm") != 0){
+            return wrm_filename + ".idx";
+        }
+        return wrm_filename.substr(0, dash) + ".wrm.idx";
+    }
+
+    bool load(const char * index_filename)
+    {
+        this->entries.clear();
+        FILE * f = fopen(index_filename, "r");
+        if (!f){
+            return false;
+        }
+        char buffer[2048];
+        while (fgets(buffer, sizeof(buffer), f)){
+            unsigned long long time = 0;
+            unsigned long long offset = 0;
+            int pos = 0;
+            if (sscanf(buffer, "%llu,%llu,%n", &time, &offset, &pos) < 2 || !pos){
+                continue;
+            }
+            std::string filename(buffer + pos);
+            while (!filename.empty() && (filename[filename.size() - 1] == '\n'
+                                     || filename[filename.size() - 1] == '\r')){
+                filename.erase(filename.size() - 1);
+            }
+            this->entries.push_back(WRMIndexEntry(time, offset, filename));
+        }
+        fclose(f);
+        std::stable_sort(this->entries.begin(), this->entries.end());
+        return !this->entries.empty();
+    }
+
+    // builds index by reading chunk headers only, from first file of a
+    // recording and following NEXT_FILE chunks
+    bool rebuild(const char * wrm_filename)
+    {
+        this->entries.clear();
+        this->timestamps.clear();
+        std::string filename(wrm_filename);
+        uint64_t time = 0;
+        this->entries.push_back(WRMIndexEntry(0, 0, filename));
+        FILE * f = fopen(filename.c_str(), "r");
+        if (!f){
+            this->entries.clear();
+            return false;
+        }
+        uint64_t offset = 0;
+        uint8_t header[8];
+        while (f && 8 == fread(header, 1, 8, f)){
+            uint16_t chunk_type = header[0] | (header[1] << 8);
+            uint16_t chunk_size = header[2] | (header[3] << 8);
+            if (chunk_size < 8){
+                LOG(LOG_ERR, "WRMIndex::rebuild: bad chunk size %u in %s", chunk_size, filename.c_str());
+                break;
+            }
+            if (offset == 0 && chunk_type == WRMChunk::BREAKPOINT
+            && this->entries.back().filename != filename){
+                this->entries.push_back(WRMIndexEntry(time, 0, filename, this->timestamps.size()));
+            }
+            switch (chunk_type){
+            case WRMChunk::TIMESTAMP:
+            {
+                uint8_t data[8];
+                if (chunk_size < 16 || 8 != fread(data, 1, 8, f)){
+                    chunk_size = 0;
+                    break;
+                }
+                uint64_t micro_sec = 0;
+                for (size_t i = 0; i < 8; i++){
+                    micro_sec = (micro_sec << 8) | data[i];
+                }
+                time += micro_sec;
+                this->timestamps.push_back(time);
+                fseek(f, chunk_size - 16, SEEK_CUR);
+            }
+            break;
+            case WRMChunk::NEXT_FILE:
+            {
+                uint8_t data[4];
+                char next[1024];
+                uint32_t len = 0;
+                if (4 == fread(data, 1, 4, f)){
+                    len = data[0] | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
+                }
+                if (!len || len >= sizeof(next) || len != fread(next, 1, len, f)){
+                    chunk_size = 0;
+                    break;
+                }
+                next[len] = 0;
+                fclose(f);
+                filename = next;
+                f = fopen(next, "r");
+                offset = 0;
+                continue;
+            }
+            default:
+                fseek(f, chunk_size - 8, SEEK_CUR);
+            break;
+            }
+            if (!chunk_size){
+                LOG(LOG_ERR, "WRMIndex::rebuild: truncated chunk in %s", filename.c_str());
+                break;
+            }
+            offset += chunk_size;
+        }
+        if (f){
+            fclose(f);
+        }
+        return true;
+    }
+
+    bool save(const char * index_filename) const
+    {
+        FILE * f = fopen(index_filename, "w");
+        if (!f){
+            return false;
+        }
+        for (size_t i = 0; i < this->entries.size(); i++){
+            char buffer[2048];
+            WRMIndex::line(buffer, sizeof(buffer), this->entries[i].time,
+                           this->entries[i].offset, this->entries[i].filename.c_str());
+            fputs(buffer, f);
+        }
+        fclose(f);
+        return true;
+    }
+
+    // last keyframe at or before time (binary search), 0 if none
+    const WRMIndexEntry * find(uint64_t time) const
+    {
+        std::vector<WRMIndexEntry>::const_iterator it =
+            std::upper_bound(this->entries.begin(), this->entries.end(),
+                             WRMIndexEntry(time, 0, std::string()));
+        if (it == this->entries.begin()){
+            return 0;
+        }
+        return &*(it - 1);
+    }
+};
+
+#endif
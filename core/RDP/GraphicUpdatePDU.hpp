@@ -35,6 +35,7 @@
 #include "RDP/rdp.hpp"
 #include "RDP/sec.hpp"
 #include "RDP/lic.hpp"
+#include "RDP/fastpath.hpp"
 #include "RDP/RDPGraphicDevice.hpp"
 // MS-RDPECGI 2.2.2.2 Fast-Path Orders Update (TS_FP_UPDATE_ORDERS)
 // ================================================================
@@ -105,10 +106,17 @@ struct GraphicsUpdatePDU : public RDPSerializer
     SecOut * sec_out;
     ShareControlOut * out_control;
     ShareDataOut * out_data;
+    FastPathOut * fastpath_out;
+    FastPathUpdateOut * fastpath_update;
     uint16_t & userid;
     int & shareid;
     int & crypt_level;
     CryptContext & encrypt;
+    // client advertised FASTPATH_OUTPUT_SUPPORTED, orders are sent using
+    // fast-path updates instead of slow-path Update PDUs
+    const bool fastpath;
+    // bulk compressor shared with other PDUs sent to client, NULL if none
+    rdp_mppc_enc * mppc_enc;
 
     GraphicsUpdatePDU(Transport * trans,
                       uint16_t & userid,
@@ -122,7 +130,9 @@ struct GraphicsUpdatePDU : public RDPSerializer
                       uint32_t big_entries, uint32_t big_size,
                       const int bitmap_cache_version,
                       const int use_bitmap_comp,
-                      const int op2)
+                      const int op2,
+                      const bool fastpath = false,
+                      rdp_mppc_enc * mppc_enc = NULL)
         : RDPSerializer(trans, ini,
             bpp,
             small_entries, small_size,
@@ -134,10 +144,14 @@ struct GraphicsUpdatePDU : public RDPSerializer
         sec_out(NULL),
         out_control(NULL),
         out_data(NULL),
+        fastpath_out(NULL),
+        fastpath_update(NULL),
         userid(userid),
         shareid(shareid),
         crypt_level(crypt_level),
-        encrypt(encrypt)
+        encrypt(encrypt),
+        fastpath(fastpath),
+        mppc_enc(mppc_enc)
     {
         this->init();
     }
@@ -148,6 +162,8 @@ struct GraphicsUpdatePDU : public RDPSerializer
         if (this->sec_out){ delete this->sec_out; }
         if (this->out_control){ delete this->out_control; }
         if (this->out_data){ delete this->out_data; }
+        if (this->fastpath_update){ delete this->fastpath_update; }
+        if (this->fastpath_out){ delete this->fastpath_out; }
     }
 
     void init(){
@@ -156,16 +172,32 @@ struct GraphicsUpdatePDU : public RDPSerializer
         if (this->sec_out){ delete this->sec_out; }
         if (this->out_control){ delete this->out_control; }
         if (this->out_data){ delete this->out_data; }
+        if (this->fastpath_update){ delete this->fastpath_update; }
+        if (this->fastpath_out){ delete this->fastpath_out; }
+        this->tpdu = NULL;
+        this->mcs_sdin = NULL;
+        this->sec_out = NULL;
+        this->out_control = NULL;
+        this->out_data = NULL;
+        this->fastpath_update = NULL;
+        this->fastpath_out = NULL;
 
         if (this->ini->globals.debug.primary_orders > 63){
             LOG(LOG_INFO, "GraphicsUpdatePDU::init::Initializing orders batch mcs_userid=%u shareid=%u", this->userid, this->shareid);
         }
         this->stream.init(32768);
+        if (this->fastpath){
+            this->fastpath_out = new FastPathOut(this->stream, this->crypt_level != 0, this->encrypt);
+            this->fastpath_update = new FastPathUpdateOut(this->stream, FASTPATH_UPDATETYPE_ORDERS, this->mppc_enc);
+            this->offset_order_count = this->stream.get_offset(0);
+            this->stream.out_clear_bytes(2); /* number of orders, set later */
+            return;
+        }
         this->tpdu = new X224Out(X224Packet::DT_TPDU, this->stream);
         this->mcs_sdin = new McsOut(this->stream, DomainMCSPDU_SendDataIndication, this->userid, MCS_GLOBAL_CHANNEL);
         this->sec_out = new SecOut(this->stream, this->crypt_level?SEC_ENCRYPT:0, this->encrypt);
         this->out_control = new ShareControlOut(this->stream, PDUTYPE_DATAPDU, this->userid + MCS_USERCHANNEL_BASE);
-        this->out_data = new ShareDataOut(this->stream, PDUTYPE2_UPDATE, this->shareid, RDP::STREAM_MED);
+        this->out_data = new ShareDataOut(this->stream, PDUTYPE2_UPDATE, this->shareid, RDP::STREAM_MED, this->mppc_enc);
 
         this->stream.out_uint16_le(RDP_UPDATE_ORDERS);
         this->stream.out_clear_bytes(2); /* pad */
@@ -183,6 +215,13 @@ struct GraphicsUpdatePDU : public RDPSerializer
             this->stream.set_out_uint16_le(this->order_count, this->offset_order_count);
             this->order_count = 0;
 
+            if (this->fastpath){
+                this->fastpath_update->end();
+                this->fastpath_out->end();
+                this->fastpath_out->send(this->trans);
+                this->init();
+                return;
+            }
             this->out_data->end();
             this->out_control->end();
             this->sec_out->end();
@@ -58,6 +58,7 @@ public:
             color = ((color << 16) & 0xFF0000) | (color & 0xFF00) |((color >> 16) & 0xFF);
         }
         this->drawable.opaquerect(trect, color);
+        this->drawable.mark_dirty(trect);
     }
 
     void draw(const RDPScrBlt & cmd, const Rect & clip)
@@ -69,12 +70,14 @@ public:
         const signed int deltax = cmd.srcx - cmd.rect.x;
         const signed int deltay = cmd.srcy - cmd.rect.y;
         this->drawable.scrblt(drect.x + deltax, drect.y + deltay, drect, cmd.rop);
+        this->drawable.mark_dirty(drect);
     }
 
     void draw(const RDPDestBlt & cmd, const Rect & clip)
     {
         const Rect trect = clip.intersect(this->drawable.width, this->drawable.height).intersect(cmd.rect);
         this->drawable.destblt(trect, cmd.rop);
+        this->drawable.mark_dirty(trect);
     }
 
     void draw(const RDPPatBlt & cmd, const Rect & clip)
@@ -86,6 +89,7 @@ public:
             color = ((color << 16) & 0xFF0000) | (color & 0xFF00) |((color >> 16) & 0xFF);
         }
         this->drawable.patblt(trect, cmd.rop, color);
+        this->drawable.mark_dirty(trect);
     }
 
     void draw(const RDPMemBlt & cmd, const Rect & clip, const Bitmap & bmp)
@@ -109,8 +113,9 @@ public:
         break;
         default:
             // should not happen
-        break;
+            return;
         }
+        this->drawable.mark_dirty(rect);
     }
 
     /*
@@ -143,6 +148,8 @@ public:
             return;
         }
 
+        this->drawable.mark_dirty(line_rect);
+
         // Color handling
         uint32_t color = lineto.pen.color;
         if (!this->bgr){
@@ -187,6 +194,7 @@ public:
         }
     }
 
+    // glyphs are not rendered yet, hence never make drawable dirty
     virtual void draw(const RDPGlyphIndex & cmd, const Rect & clip) {}
     virtual void draw(const RDPBrushCache & cmd) {}
     virtual void draw(const RDPColCache & cmd) {}
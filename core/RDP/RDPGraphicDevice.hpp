@@ -50,6 +50,7 @@
 #include "bmpcache.hpp"
 #include "timer_capture.hpp"
 #include "stream.hpp"
+#include <zlib.h>
 #include "rect.hpp"
 #include "RDP/orders/RDPOrdersCommon.hpp"
 #include "colors.hpp"
@@ -90,9 +91,19 @@ struct WRMChunk {
     static const uint16_t BREAKPOINT = 1005;
 };
 
+// compression of a chunk payload, stored in pad field of chunk header
+// (chunk size is then compressed size) and in MetaWRM of recording
+struct WRMCompression {
+    enum {
+        NONE = 0,
+        ZLIB = 1
+    };
+};
+
 struct RDPUnserializer
 {
     Stream stream;
+    Stream compressed; // payload of compressed chunks
 
 //    uint8_t padding[65536];
 
@@ -121,7 +132,7 @@ struct RDPUnserializer
     uint16_t remaining_order_count;
     uint16_t order_count;
 
-    WaitCapture wait_cap;
+    ReplayClock clock; // real time (default) or batch replay
 
     RDPUnserializer(Transport * trans, RDPGraphicDevice * consumer, const Rect screen_rect)
      : stream(4096), consumer(consumer), trans(trans), screen_rect(screen_rect),
@@ -143,7 +154,7 @@ struct RDPUnserializer
     chunk_type(0),
     remaining_order_count(0),
     order_count(0),
-    wait_cap()
+    clock(ReplayClock::REAL_TIME)
     {
     }
 
@@ -159,19 +170,24 @@ struct RDPUnserializer
                          (this->stream.end - this->stream.p), this->chunk_size);
         }
         if (!this->remaining_order_count){
+            uint16_t compression = WRMCompression::NONE;
             try {
                 this->stream.init(4096);
                 this->trans->recv(&this->stream.end, 8);
                 this->chunk_type = this->stream.in_uint16_le();
                 this->chunk_size = this->stream.in_uint16_le();
                 this->remaining_order_count = this->order_count = this->stream.in_uint16_le();
-                uint16_t pad = this->stream.in_uint16_le(); (void)pad;
+                compression = this->stream.in_uint16_le();
             }
             catch (Error & e){
                 TODO(" check specific error and return 0 only if actual EOF is reached or rethrow the error")
                 return (e.id == ERR_TRANSPORT_READ_FAILED) ? false : true;
             }
             const uint16_t stream_size = this->chunk_size - 8;
+            if (compression){
+                this->uncompress_chunk(compression, stream_size);
+                return true;
+            }
             if (stream_size > 4096){
                 this->stream.init(stream_size);
             }
@@ -180,6 +196,21 @@ struct RDPUnserializer
         return true;
     }
 
+    // uncompressed payload of a chunk is never larger than 64K (chunk size is 16 bits)
+    void uncompress_chunk(uint16_t compression, uint16_t size)
+    {
+        this->compressed.init(size);
+        this->trans->recv(&this->compressed.end, size);
+        this->stream.init(65536);
+        uLongf len = this->stream.capacity;
+        if (compression != WRMCompression::ZLIB
+        || Z_OK != uncompress(this->stream.data, &len, this->compressed.data, size)){
+            LOG(LOG_ERR, "Failed to uncompress chunk %u (compression=%u)", this->chunk_num, compression);
+            throw Error(ERR_WRM_UNSUPPORTED_FORMAT);
+        }
+        this->stream.end = this->stream.data + len;
+    }
+
     void interpret_order()
     {
         switch (this->chunk_type){
@@ -283,10 +314,15 @@ struct RDPUnserializer
             case WRMChunk::TIMESTAMP:
             {
                 uint64_t micro_sec = this->stream.in_uint64_be();
-                this->wait_cap.wait(micro_sec);
+                this->clock.wait(micro_sec);
                 --this->remaining_order_count;
             }
             break;
+            case WRMChunk::OLD_TIMESTAMP:
+                // old recordings hold no time, they were made at 25 frames per second
+                this->clock.wait(40000);
+                this->remaining_order_count = 0;
+            break;
             /*case 1002: //BPP
             {
                 uint8_t bpp;
@@ -309,9 +345,7 @@ struct RDPUnserializer
             }*/
             break;
             default:
-                TODO("This is a naive way to replay native movies at the recording speed. As we recorded at 25 frames per second (snapshots), we inserted timestamp chunks more or less every 1/25 seconds. Naive idea is just to wait 1/25 second every time we get a timestamp frame when replaying. This is naive because sending data in between frames is not timeless. In the worst case it can often be larger than inter frame time. Hence we have to find a better way, probably based on timestamp difference between recording and replay.")
-                struct timespec wtime = { 0, 40000000 };
-                nanosleep(&wtime,NULL);
+                LOG(LOG_WARNING, "replay: chunk %u ignored", this->chunk_type);
                 this->remaining_order_count = 0;
             break;
         }
@@ -351,6 +385,7 @@ struct RDPSerializer : public RDPGraphicDevice
     size_t order_count;
     uint32_t offset_order_count;
     BmpCache bmp_cache;
+    Bitmap::CompressStats compress_stats;
 
 
     RDPSerializer(Transport * trans, const Inifile * ini,
@@ -379,9 +414,18 @@ struct RDPSerializer : public RDPGraphicDevice
         // state variables for a batch of orders
         order_count(0),
         offset_order_count(0),
-        bmp_cache(bpp, small_entries, small_size, medium_entries, medium_size, big_entries, big_size)
+        bmp_cache(bpp, small_entries, small_size, medium_entries, medium_size, big_entries, big_size,
+                  ini ? ini->globals.bitmap_cache_signature : BMPCACHE_SIGNATURE_SHA1)
      {}
-    ~RDPSerializer() {}
+    ~RDPSerializer()
+    {
+        if (this->ini && this->ini->globals.debug.bitmap){
+            const Bitmap::CompressStats & stats = this->compress_stats;
+            const unsigned long long total = stats.hits + stats.misses;
+            LOG(LOG_INFO, "compressed bitmaps memo: hits=%llu misses=%llu hit rate=%llu%%",
+                stats.hits, stats.misses, total ? (stats.hits * 100 / total) : 0);
+        }
+    }
     virtual void flush() = 0;
 
     /*****************************************************************************/
@@ -463,6 +507,7 @@ struct RDPSerializer : public RDPGraphicDevice
         if ((res >> 24) == BITMAP_ADDED_TO_CACHE){
             const Bitmap * bmp = this->bmp_cache.get(cache_id, cache_idx);
             RDPBmpCache cmd_cache(bmp, cache_id, cache_idx, this->ini?this->ini->globals.debug.primary_orders:0);
+            cmd_cache.stats = &this->compress_stats;
             this->reserve_order(cmd_cache.bmp->bmp_size + 16);
             cmd_cache.emit(this->stream, this->bitmap_cache_version, this->use_bitmap_comp, this->op2);
 
@@ -25,6 +25,15 @@
 #if !defined(__FASTPATH_HPP__)
 #define __FASTPATH_HPP__
 
+#include <stdint.h>
+#include "transport.hpp"
+#include "stream.hpp"
+#include "log.hpp"
+#include "error.hpp"
+#include "constants.hpp"
+#include "ssl_calls.hpp"
+#include "RDP/mppc.hpp"
+
 // 2.2.9.1.2 Server Fast-Path Update PDU (TS_FP_UPDATE_PDU)
 // ========================================================
 
@@ -117,6 +126,342 @@
 // fpOutputUpdates (variable): An array of Fast-Path Update (section
 // 2.2.9.1.2.1) structures to be processed by the client.
 
+enum {
+    FASTPATH_OUTPUT_ACTION_FASTPATH = 0x0,
+    FASTPATH_OUTPUT_ACTION_X224     = 0x3
+};
+
+enum {
+    FASTPATH_OUTPUT_SECURE_CHECKSUM = 0x1,
+    FASTPATH_OUTPUT_ENCRYPTED       = 0x2
+};
+
+// 2.2.9.1.2.1 Fast-Path Update (TS_FP_UPDATE)
+// ===========================================
+
+// updateHeader (1 byte): An 8-bit, unsigned integer. Three pieces of
+//  information are collapsed into this byte:
+//  - Fast-path update type (updateCode, 4 bits)
+//  - Fast-path fragment sequencing (fragmentation, 2 bits)
+//  - Update data compression (compression, 2 bits)
+
+enum {
+    FASTPATH_UPDATETYPE_ORDERS       = 0x0,
+    FASTPATH_UPDATETYPE_BITMAP       = 0x1,
+    FASTPATH_UPDATETYPE_PALETTE      = 0x2,
+    FASTPATH_UPDATETYPE_SYNCHRONIZE  = 0x3,
+    FASTPATH_UPDATETYPE_SURFCMDS     = 0x4,
+    FASTPATH_UPDATETYPE_PTR_NULL     = 0x5,
+    FASTPATH_UPDATETYPE_PTR_DEFAULT  = 0x6,
+    FASTPATH_UPDATETYPE_PTR_POSITION = 0x8,
+    FASTPATH_UPDATETYPE_COLOR        = 0x9,
+    FASTPATH_UPDATETYPE_CACHED       = 0xA,
+    FASTPATH_UPDATETYPE_POINTER      = 0xB
+};
+
+enum {
+    FASTPATH_OUTPUT_COMPRESSION_USED = 0x2
+};
+
+enum {
+    FASTPATH_FRAGMENT_SINGLE = 0x0,
+    FASTPATH_FRAGMENT_LAST   = 0x1,
+    FASTPATH_FRAGMENT_FIRST  = 0x2,
+    FASTPATH_FRAGMENT_NEXT   = 0x3
+};
+
+// compressionFlags (1 byte): present if compression bits are set in
+//  updateHeader (FASTPATH_OUTPUT_COMPRESSION_USED).
+
+// size (2 bytes): A 16-bit, unsigned integer. The size in bytes of the data in
+//  the updateData field.
+
+// updateData (variable): Update data. Each fast-path update type has a
+//  corresponding content, it is the same as slow-path update content without
+//  updateType and padding fields for pointer and synchronize updates:
+//  - FASTPATH_UPDATETYPE_ORDERS: numberOrders (2 bytes) followed by orders
+//  - FASTPATH_UPDATETYPE_BITMAP: TS_UPDATE_BITMAP_DATA (including updateType)
+//  - FASTPATH_UPDATETYPE_PALETTE: TS_UPDATE_PALETTE_DATA (including updateType)
+//  - FASTPATH_UPDATETYPE_SYNCHRONIZE: no data
+//  - FASTPATH_UPDATETYPE_COLOR: TS_COLORPOINTERATTRIBUTE
+//  - FASTPATH_UPDATETYPE_CACHED: TS_CACHEDPOINTERATTRIBUTE
+
+// FastPathOut replaces X224Out, McsOut and SecOut stack for server output
+// packets and client input packets (num_events is then the numEvents field of
+// fpInputHeader, 1 to 15). Length is always written using 2 bytes form as it
+// is only known at end of packet.
+struct FastPathOut
+{
+    Stream & stream;
+    uint16_t bop;
+    bool encrypted;
+    CryptContext & crypt;
+
+    FastPathOut(Stream & stream, bool encrypted, CryptContext & crypt, uint8_t num_events = 0)
+        : stream(stream), bop(stream.get_offset(0)), encrypted(encrypted), crypt(crypt)
+    {
+        this->stream.out_uint8(((this->encrypted ? FASTPATH_OUTPUT_ENCRYPTED : 0) << 6)
+                              | ((num_events & 0x0F) << 2)
+                              | FASTPATH_OUTPUT_ACTION_FASTPATH);
+        this->stream.out_uint16_be(0); // length1 and length2, set later
+        if (this->encrypted){
+            this->stream.out_skip_bytes(8); // dataSignature, filled later
+        }
+    }
+
+    void end()
+    {
+        this->stream.set_out_uint16_be(0x8000 | this->stream.get_offset(this->bop), this->bop + 1);
+        if (this->encrypted){
+            uint8_t * pdata = this->stream.data + this->bop + 11;
+            int datalen = this->stream.p - pdata;
+            this->crypt.sign(pdata - 8, 8, pdata, datalen);
+            this->crypt.encrypt(pdata, datalen);
+        }
+    }
+
+    void send(Transport * t)
+    {
+        t->send(this->stream.data + this->bop, this->stream.get_offset(this->bop));
+    }
+};
+
+// One (non fragmented) update inside a fast-path PDU, several updates may
+// follow each other in the same FastPathOut. When a bulk compressor is given
+// updateData is compressed in place by end().
+struct FastPathUpdateOut
+{
+    Stream & stream;
+    uint16_t offset_size;
+    rdp_mppc_enc * mppc_enc;
+
+    FastPathUpdateOut(Stream & stream, uint8_t updateCode, rdp_mppc_enc * mppc_enc = NULL)
+        : stream(stream), mppc_enc(mppc_enc)
+    {
+        this->stream.out_uint8(((this->mppc_enc ? FASTPATH_OUTPUT_COMPRESSION_USED : 0) << 6)
+                              | (FASTPATH_FRAGMENT_SINGLE << 4) | (updateCode & 0x0F));
+        if (this->mppc_enc){
+            this->stream.out_uint8(0); // compressionFlags, set later
+        }
+        this->offset_size = this->stream.get_offset(0);
+        this->stream.out_clear_bytes(2); // size, set later
+    }
+
+    void end()
+    {
+        if (this->mppc_enc){
+            uint8_t * data = this->stream.data + this->offset_size + 2;
+            this->mppc_enc->compress(data, this->stream.p - data);
+            if (this->mppc_enc->flags & PACKET_COMPRESSED){
+                memcpy(data, this->mppc_enc->outputBuffer, this->mppc_enc->bytes_in_opb);
+                this->stream.p = data + this->mppc_enc->bytes_in_opb;
+            }
+            this->stream.data[this->offset_size - 1] = this->mppc_enc->flags
+                ? (this->mppc_enc->flags | this->mppc_enc->protocol_type) : 0;
+        }
+        this->stream.set_out_uint16_le(this->stream.get_offset(this->offset_size + 2), this->offset_size);
+    }
+};
+
+// 2.2.8.1.2 Client Fast-Path Input Event PDU (TS_FP_INPUT_PDU)
+// ============================================================
+
+// fpInputHeader (1 byte): An 8-bit, unsigned integer. Three pieces of
+//  information are collapsed into this byte:
+//  - Security flags (2 bits, FASTPATH_INPUT_SECURE_CHECKSUM,
+//    FASTPATH_INPUT_ENCRYPTED)
+//  - Number of events (4 bits), if 0 numberEvents byte is present
+//  - Action code (2 bits, FASTPATH_INPUT_ACTION_FASTPATH or
+//    FASTPATH_INPUT_ACTION_X224 for slow-path packets starting with TPKT)
+
+// length1, length2 (1 or 2 bytes): PER encoded length of whole PDU.
+
+// fipsInformation (4 bytes): only present when FIPS encryption is used.
+
+// dataSignature (8 bytes): present if FASTPATH_INPUT_ENCRYPTED is set.
+
+// numberEvents (1 byte): present if numEvents bits of fpInputHeader are 0.
+
+// fpInputEvents (variable): array of TS_FP_INPUT_EVENT.
+
+enum {
+    FASTPATH_INPUT_ACTION_FASTPATH = 0x0,
+    FASTPATH_INPUT_ACTION_X224     = 0x3
+};
+
+enum {
+    FASTPATH_INPUT_SECURE_CHECKSUM = 0x1,
+    FASTPATH_INPUT_ENCRYPTED       = 0x2
+};
+
+// 2.2.8.1.2.2 Fast-Path Input Event (TS_FP_INPUT_EVENT)
+// =====================================================
+
+// eventHeader (1 byte): eventFlags (low 5 bits) and eventCode (high 3 bits).
+
+enum {
+    FASTPATH_INPUT_EVENT_SCANCODE = 0x0,
+    FASTPATH_INPUT_EVENT_MOUSE    = 0x1,
+    FASTPATH_INPUT_EVENT_MOUSEX   = 0x2,
+    FASTPATH_INPUT_EVENT_SYNC     = 0x3,
+    FASTPATH_INPUT_EVENT_UNICODE  = 0x4
+};
+
+enum {
+    FASTPATH_INPUT_KBDFLAGS_RELEASE  = 0x01,
+    FASTPATH_INPUT_KBDFLAGS_EXTENDED = 0x02
+};
+
+// Event content:
+//  - SCANCODE: keyCode (1 byte), eventFlags are keyboard flags
+//  - MOUSE, MOUSEX: pointerFlags (2 bytes), xPos (2 bytes), yPos (2 bytes)
+//  - SYNC: no data, eventFlags are toggle flags (same as slow-path)
+//  - UNICODE: unicodeCode (2 bytes)
+
+// Reads a fast-path input PDU whose first byte (fpInputHeader) is already
+// available in stream (stream.p at beginning of PDU). Header is decoded, the
+// remaining of PDU is received and decrypted if necessary, stream.p is then
+// on first event.
+struct FastPathIn
+{
+    uint8_t action;
+    uint8_t numEvents;
+    uint8_t flags;
+    uint16_t length;
+
+    FastPathIn(Transport * t, Stream & stream, CryptContext & decrypt)
+        : action(0), numEvents(0), flags(0), length(0)
+    {
+        uint8_t * bop = stream.p;
+        uint8_t header = stream.in_uint8();
+        this->action = header & 0x03;
+        this->numEvents = (header >> 2) & 0x0F;
+        this->flags = (header >> 6) & 0x03;
+
+        t->recv((char**)(&(stream.end)), 1);
+        this->length = stream.in_uint8();
+        if (this->length & 0x80){
+            t->recv((char**)(&(stream.end)), 1);
+            this->length = ((this->length & 0x7F) << 8) | stream.in_uint8();
+        }
+        const uint16_t header_len = stream.p - bop;
+        if (this->length < header_len || !stream.has_room(this->length - header_len)){
+            LOG(LOG_ERR, "FastPathIn: bad fast-path PDU length %u", this->length);
+            throw Error(ERR_RDP_FASTPATH);
+        }
+        t->recv((char**)(&(stream.end)), this->length - header_len);
+        t->total_pdu_received++;
+
+        if (this->flags & FASTPATH_INPUT_ENCRYPTED){
+            if (!stream.check_rem(8)){
+                LOG(LOG_ERR, "FastPathIn: missing signature in encrypted PDU");
+                throw Error(ERR_RDP_FASTPATH);
+            }
+            TODO("shouldn't we check signature ?")
+            stream.in_skip_bytes(8);
+            decrypt.decrypt(stream.p, stream.end - stream.p);
+        }
+        if (this->numEvents == 0){
+            this->numEvents = stream.in_uint8();
+        }
+    }
+};
+
+// One fast-path input event, decoded to its slow-path equivalent fields
+// (TS_INPUT_EVENT messageType, deviceFlags, param1, param2) so that it can
+// be processed the same way.
+struct FastPathInputEventIn
+{
+    uint8_t eventCode;
+    uint8_t eventFlags;
+    uint16_t message_type;
+    uint16_t device_flags;
+    int16_t param1;
+    int16_t param2;
+
+    FastPathInputEventIn(Stream & stream)
+        : eventCode(0), eventFlags(0), message_type(0), device_flags(0), param1(0), param2(0)
+    {
+        if (!stream.check_rem(1)){
+            LOG(LOG_ERR, "FastPathInputEventIn: truncated event");
+            throw Error(ERR_RDP_FASTPATH);
+        }
+        uint8_t header = stream.in_uint8();
+        this->eventCode = header >> 5;
+        this->eventFlags = header & 0x1F;
+        switch (this->eventCode){
+        case FASTPATH_INPUT_EVENT_SCANCODE:
+            this->check(stream, 1);
+            this->message_type = RDP_INPUT_SCANCODE;
+            this->device_flags = ((this->eventFlags & FASTPATH_INPUT_KBDFLAGS_RELEASE) ? KBD_FLAG_UP : 0)
+                               | ((this->eventFlags & FASTPATH_INPUT_KBDFLAGS_EXTENDED) ? KBD_FLAG_EXT : 0);
+            this->param1 = stream.in_uint8();
+            break;
+        case FASTPATH_INPUT_EVENT_MOUSE:
+        case FASTPATH_INPUT_EVENT_MOUSEX:
+            this->check(stream, 6);
+            this->message_type = (this->eventCode == FASTPATH_INPUT_EVENT_MOUSE) ? RDP_INPUT_MOUSE : RDP_INPUT_MOUSEX;
+            this->device_flags = stream.in_uint16_le();
+            this->param1 = stream.in_sint16_le();
+            this->param2 = stream.in_sint16_le();
+            break;
+        case FASTPATH_INPUT_EVENT_SYNC:
+            this->message_type = RDP_INPUT_SYNCHRONIZE;
+            this->param1 = this->eventFlags;
+            break;
+        case FASTPATH_INPUT_EVENT_UNICODE:
+            this->check(stream, 2);
+            this->message_type = RDP_INPUT_UNICODE;
+            this->param1 = stream.in_uint16_le();
+            break;
+        default:
+            LOG(LOG_ERR, "FastPathInputEventIn: unknown event code %u", this->eventCode);
+            throw Error(ERR_RDP_FASTPATH);
+        }
+    }
+
+    void check(Stream & stream, unsigned n)
+    {
+        if (!stream.check_rem(n)){
+            LOG(LOG_ERR, "FastPathInputEventIn: truncated event (code %u)", this->eventCode);
+            throw Error(ERR_RDP_FASTPATH);
+        }
+    }
+};
+
+// Writes a slow-path input event (TS_INPUT_EVENT fields) as a fast-path
+// input event. Slow-path events without fast-path equivalent are not
+// expected here.
+static inline void emit_fastpath_input_event(Stream & stream, uint16_t message_type,
+                                             uint16_t device_flags, int16_t param1, int16_t param2)
+{
+    switch (message_type){
+    case RDP_INPUT_SCANCODE:
+        stream.out_uint8((FASTPATH_INPUT_EVENT_SCANCODE << 5)
+                        | ((device_flags & KBD_FLAG_UP) ? FASTPATH_INPUT_KBDFLAGS_RELEASE : 0)
+                        | ((device_flags & KBD_FLAG_EXT) ? FASTPATH_INPUT_KBDFLAGS_EXTENDED : 0));
+        stream.out_uint8(param1);
+        break;
+    case RDP_INPUT_MOUSE:
+    case RDP_INPUT_MOUSEX:
+        stream.out_uint8(((message_type == RDP_INPUT_MOUSE) ? FASTPATH_INPUT_EVENT_MOUSE : FASTPATH_INPUT_EVENT_MOUSEX) << 5);
+        stream.out_uint16_le(device_flags);
+        stream.out_uint16_le(param1);
+        stream.out_uint16_le(param2);
+        break;
+    case RDP_INPUT_SYNCHRONIZE:
+        stream.out_uint8((FASTPATH_INPUT_EVENT_SYNC << 5) | (param1 & 0x1F));
+        break;
+    case RDP_INPUT_UNICODE:
+        stream.out_uint8(FASTPATH_INPUT_EVENT_UNICODE << 5);
+        stream.out_uint16_le(param1);
+        break;
+    default:
+        LOG(LOG_ERR, "emit_fastpath_input_event: unsupported input event type %u", message_type);
+        throw Error(ERR_RDP_FASTPATH);
+    }
+}
+
 TODO("To implement fastpath, the idea is to replace the current layer stack X224->Mcs->Sec with only one FastPath object. The FastPath layer would also handle legacy packets still using several independant layers. That should lead to a much simpler code in both front.hpp and rdp.hpp but still keep a flat easy to test model.")
 
 
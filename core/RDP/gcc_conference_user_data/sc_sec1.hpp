@@ -589,6 +589,13 @@ static inline void parse_mcs_data_sc_security(Stream & cr_stream,
 //20 00 00 00 -> TS_UD_SC_SEC1::serverRandomLen = 32 bytes
 //b8 00 00 00 -> TS_UD_SC_SEC1::serverCertLen = 184 bytes
 
+// server keys, read once per process (before forking session workers if any)
+inline const Rsakeys & server_rsakeys()
+{
+    static Rsakeys rsa_keys(CFG_PATH "/" RSAKEYS_INI);
+    return rsa_keys;
+}
+
 static inline void front_out_gcc_conference_user_data_sc_sec1(Stream & stream,
                                                 int encryptionLevel,
                                                 uint8_t (&serverRandom)[32],
@@ -598,7 +605,7 @@ static inline void front_out_gcc_conference_user_data_sc_sec1(Stream & stream,
                                                 Random * gen)
 {
 
-    Rsakeys rsa_keys(CFG_PATH "/" RSAKEYS_INI);
+    const Rsakeys & rsa_keys = server_rsakeys();
 
     gen->random(serverRandom, 32);
 
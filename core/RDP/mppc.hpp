@@ -0,0 +1,428 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   MPPC bulk compression (RDP 4.0 8K history and RDP 5.0 64K history)
+   see [MS-RDPBCGR] 3.1.8 and [RFC2118]
+*/
+
+#if !defined(__MPPC_HPP__)
+#define __MPPC_HPP__
+
+#include <stdint.h>
+#include <string.h>
+#include "log.hpp"
+#include "RDP/logon.hpp"
+
+// compressedType (or fast-path compressionFlags) flags, the low 4 bits
+// (0x0F) hold compression type (PACKET_COMPR_TYPE_8K, PACKET_COMPR_TYPE_64K)
+
+enum {
+    PACKET_COMPRESSED = 0x20,
+    PACKET_AT_FRONT   = 0x40,
+    PACKET_FLUSHED    = 0x80
+};
+
+// 3.1.8.4.1 RDP 4.0 (8K history) and 3.1.8.4.2 RDP 5.0 (64K history)
+// ==================================================================
+
+// Literals:
+//  - 0x00 to 0x7F: 0 followed by the lower 7 bits
+//  - 0x80 to 0xFF: 10 followed by the lower 7 bits
+
+// Copy offsets (distance to match start, backward from current position):
+
+// RDP 4.0                          RDP 5.0
+//   0-63      : 1111  + 6 bits       0-63       : 11111 + 6 bits
+//   64-319    : 1110  + 8 bits       64-319     : 11110 + 8 bits
+//   320-8191  : 110   + 13 bits      320-2367   : 1110  + 11 bits
+//                                    2368-65535 : 110   + 16 bits
+
+// Length of match:
+//   3            : 0
+//   4-7          : 10 + 2 bits
+//   8-15         : 110 + 3 bits
+//   ...
+//   2^k-2^(k+1)-1: (k-1) bits set to 1, one bit 0, then k lower bits
+//   (up to 8191 for RDP 4.0 and 65535 for RDP 5.0)
+
+// Compressed data is padded with 0 bits up to a byte boundary.
+
+struct rdp_mppc_enc
+{
+    enum {
+        HASH_BITS = 14,
+        HASH_SIZE = 1 << HASH_BITS
+    };
+
+    int protocol_type;       // PACKET_COMPR_TYPE_8K or PACKET_COMPR_TYPE_64K
+    uint32_t buf_len;        // history size
+    uint8_t * history_buffer;
+    uint32_t history_offset;
+    uint8_t * outputBuffer;
+    uint32_t bytes_in_opb;   // compressed data size in outputBuffer
+    uint8_t flags;           // compressedType flags of last compressed data
+    bool first_pkt;
+    uint16_t * hash_table;   // last position in history of 3 bytes strings
+
+    // bit writer
+    uint32_t bits;
+    uint32_t nbits;
+
+    // statistics
+    uint64_t total_in;
+    uint64_t total_out;
+
+    rdp_mppc_enc(int protocol_type)
+        : protocol_type((protocol_type == PACKET_COMPR_TYPE_8K) ? PACKET_COMPR_TYPE_8K : PACKET_COMPR_TYPE_64K)
+        , buf_len((this->protocol_type == PACKET_COMPR_TYPE_8K) ? 8192 : 65536)
+        , history_buffer(new uint8_t[this->buf_len])
+        , history_offset(0)
+        , outputBuffer(new uint8_t[this->buf_len + 16])
+        , bytes_in_opb(0)
+        , flags(0)
+        , first_pkt(true)
+        , hash_table(new uint16_t[HASH_SIZE])
+        , bits(0)
+        , nbits(0)
+        , total_in(0)
+        , total_out(0)
+    {
+        memset(this->history_buffer, 0, this->buf_len);
+        memset(this->hash_table, 0, HASH_SIZE * sizeof(uint16_t));
+    }
+
+    ~rdp_mppc_enc()
+    {
+        delete [] this->history_buffer;
+        delete [] this->outputBuffer;
+        delete [] this->hash_table;
+    }
+
+    static unsigned hash(const uint8_t * p)
+    {
+        return ((((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2]) * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // nbits <= 24
+    void put_bits(uint32_t value, uint32_t nbits)
+    {
+        this->bits = (this->bits << nbits) | value;
+        this->nbits += nbits;
+        while (this->nbits >= 8){
+            this->nbits -= 8;
+            this->outputBuffer[this->bytes_in_opb++] = this->bits >> this->nbits;
+        }
+        this->bits &= (1 << this->nbits) - 1;
+    }
+
+    void put_literal(uint8_t c)
+    {
+        if (c < 0x80){
+            this->put_bits(c, 8);
+        }
+        else {
+            this->put_bits(0x100 | (c & 0x7F), 9);
+        }
+    }
+
+    void put_copy_offset(uint32_t offset)
+    {
+        if (this->protocol_type == PACKET_COMPR_TYPE_8K){
+            if (offset < 64){
+                this->put_bits(0x3C0 | offset, 10);
+            }
+            else if (offset < 320){
+                this->put_bits(0xE00 | (offset - 64), 12);
+            }
+            else {
+                this->put_bits(0xC000 | (offset - 320), 16);
+            }
+        }
+        else {
+            if (offset < 64){
+                this->put_bits(0x7C0 | offset, 11);
+            }
+            else if (offset < 320){
+                this->put_bits(0x1E00 | (offset - 64), 13);
+            }
+            else if (offset < 2368){
+                this->put_bits(0x7000 | (offset - 320), 15);
+            }
+            else {
+                this->put_bits(0x60000 | (offset - 2368), 19);
+            }
+        }
+    }
+
+    void put_length_of_match(uint32_t length)
+    {
+        if (length == 3){
+            this->put_bits(0, 1);
+            return;
+        }
+        uint32_t k = 31 - __builtin_clz(length);
+        this->put_bits((1 << k) - 2, k);
+        this->put_bits(length - (1 << k), k);
+    }
+
+    // Compresses len bytes from src. On return flags holds compressedType
+    // flags (compression type not included): if PACKET_COMPRESSED is set
+    // outputBuffer contains bytes_in_opb bytes of compressed data, otherwise
+    // data must be sent as is (with flags, PACKET_FLUSHED may be set).
+    void compress(const uint8_t * src, uint32_t len)
+    {
+        this->flags = 0;
+        this->bytes_in_opb = 0;
+        this->total_in += len;
+        if (len == 0 || len > this->buf_len){
+            // history untouched, receiver does not update it either
+            this->total_out += len;
+            return;
+        }
+
+        if (this->first_pkt){
+            this->first_pkt = false;
+            this->flags |= PACKET_AT_FRONT;
+        }
+        if (this->history_offset + len > this->buf_len){
+            this->history_offset = 0;
+            this->flags |= PACKET_AT_FRONT;
+        }
+
+        uint8_t * const history = this->history_buffer;
+        memcpy(history + this->history_offset, src, len);
+
+        const uint32_t max_length = (this->protocol_type == PACKET_COMPR_TYPE_8K) ? 8191 : 65535;
+        this->bits = 0;
+        this->nbits = 0;
+
+        uint32_t i = this->history_offset;
+        const uint32_t end = this->history_offset + len;
+        while (i + 2 < end){
+            if (this->bytes_in_opb > len){
+                break;
+            }
+            const unsigned h = hash(history + i);
+            const uint32_t candidate = this->hash_table[h];
+            this->hash_table[h] = i;
+            // positions before i were all written since history was last
+            // reset, and are known the same way by the receiver
+            if (candidate < i
+            && history[candidate] == history[i]
+            && history[candidate + 1] == history[i + 1]
+            && history[candidate + 2] == history[i + 2]){
+                uint32_t length = 3;
+                const uint32_t max = (end - i < max_length) ? end - i : max_length;
+                while (length < max && history[candidate + length] == history[i + length]){
+                    length++;
+                }
+                this->put_copy_offset(i - candidate);
+                this->put_length_of_match(length);
+                i += length;
+            }
+            else {
+                this->put_literal(history[i]);
+                i++;
+            }
+        }
+        for (; i < end && this->bytes_in_opb <= len; i++){
+            this->put_literal(history[i]);
+        }
+        if (this->nbits > 0){
+            this->outputBuffer[this->bytes_in_opb++] = this->bits << (8 - this->nbits);
+            this->nbits = 0;
+        }
+
+        if (this->bytes_in_opb >= len){
+            // compressed data would be larger, data is sent as is and
+            // history is reinitialized on both sides
+            this->history_offset = 0;
+            this->bytes_in_opb = 0;
+            this->flags = PACKET_FLUSHED;
+            this->total_out += len;
+            return;
+        }
+        this->history_offset = end;
+        this->flags |= PACKET_COMPRESSED;
+        this->total_out += this->bytes_in_opb;
+    }
+};
+
+
+struct rdp_mppc_dec
+{
+    enum {
+        HISTORY_SIZE = 65536
+    };
+
+    uint8_t * history_buf;
+    uint8_t * history_ptr;
+
+    rdp_mppc_dec()
+        : history_buf(new uint8_t[HISTORY_SIZE])
+    {
+        memset(this->history_buf, 0, HISTORY_SIZE);
+        this->history_ptr = this->history_buf;
+    }
+
+    ~rdp_mppc_dec()
+    {
+        delete [] this->history_buf;
+    }
+
+    // Decompresses len bytes of cbuf according to ctype (compressedType).
+    // On success decompressed data is at history_buf + roff (rlen bytes),
+    // if PACKET_COMPRESSED is not set data was not compressed and rlen is 0.
+    bool decompress(const uint8_t * cbuf, uint32_t len, uint8_t ctype, uint32_t & roff, uint32_t & rlen)
+    {
+        roff = 0;
+        rlen = 0;
+        const int type = ctype & 0x0F;
+        if (type != PACKET_COMPR_TYPE_8K && type != PACKET_COMPR_TYPE_64K){
+            LOG(LOG_ERR, "mppc: unsupported compression type %u", type);
+            return false;
+        }
+        const uint32_t history_size = (type == PACKET_COMPR_TYPE_8K) ? 8192 : HISTORY_SIZE;
+
+        if (ctype & PACKET_FLUSHED){
+            memset(this->history_buf, 0, HISTORY_SIZE);
+            this->history_ptr = this->history_buf;
+        }
+        if (!(ctype & PACKET_COMPRESSED)){
+            return true;
+        }
+        if (ctype & PACKET_AT_FRONT){
+            this->history_ptr = this->history_buf;
+        }
+
+        uint8_t * const history_end = this->history_buf + history_size;
+        uint8_t * const start = this->history_ptr;
+        uint8_t * dst = this->history_ptr;
+
+        const uint32_t total_bits = len * 8;
+        uint32_t pos = 0;
+
+        while (total_bits - pos >= 8){
+            uint32_t value = peek32(cbuf, len, pos);
+            const uint32_t avail = total_bits - pos;
+
+            if ((value >> 31) == 0){ // 0 + 7 bits literal
+                if (dst >= history_end){ return this->error("history overflow"); }
+                *dst++ = value >> 24;
+                pos += 8;
+                continue;
+            }
+            if ((value >> 30) == 2){ // 10 + 7 bits literal
+                if (avail < 9){ return this->error("truncated literal"); }
+                if (dst >= history_end){ return this->error("history overflow"); }
+                *dst++ = 0x80 | ((value >> 23) & 0x7F);
+                pos += 9;
+                continue;
+            }
+
+            uint32_t offset = 0;
+            uint32_t used = 0;
+            if (type == PACKET_COMPR_TYPE_8K){
+                if ((value >> 28) == 0xF){
+                    offset = (value >> 22) & 0x3F; used = 10;
+                }
+                else if ((value >> 28) == 0xE){
+                    offset = ((value >> 20) & 0xFF) + 64; used = 12;
+                }
+                else { // 110
+                    offset = ((value >> 16) & 0x1FFF) + 320; used = 16;
+                }
+            }
+            else {
+                if ((value >> 27) == 0x1F){
+                    offset = (value >> 21) & 0x3F; used = 11;
+                }
+                else if ((value >> 27) == 0x1E){
+                    offset = ((value >> 19) & 0xFF) + 64; used = 13;
+                }
+                else if ((value >> 28) == 0xE){
+                    offset = ((value >> 17) & 0x7FF) + 320; used = 15;
+                }
+                else { // 110
+                    offset = ((value >> 13) & 0xFFFF) + 2368; used = 19;
+                }
+            }
+            pos += used;
+
+            // length of match: k bits set to 1, one bit 0, then k+1 bits
+            value = peek32(cbuf, len, pos);
+            const uint32_t k = (~value) ? __builtin_clz(~value) : 32;
+            if (k > 14){ return this->error("bad length of match"); }
+            uint32_t length = 3;
+            if (k == 0){
+                pos += 1;
+            }
+            else {
+                const uint32_t nb = k + 1;
+                length = (1 << nb) + ((value << (k + 1)) >> (32 - nb));
+                pos += k + 1 + nb;
+            }
+            if (pos > total_bits){ return this->error("truncated copy"); }
+
+            if (offset == 0 || dst - this->history_buf < (ptrdiff_t)offset){
+                return this->error("bad copy offset");
+            }
+            if (dst + length > history_end){
+                return this->error("history overflow");
+            }
+            const uint8_t * src = dst - offset;
+            // overlapping copy, byte after byte
+            for (uint32_t n = 0; n < length; n++){
+                dst[n] = src[n];
+            }
+            dst += length;
+        }
+
+        this->history_ptr = dst;
+        roff = start - this->history_buf;
+        rlen = dst - start;
+        return true;
+    }
+
+    // 32 bits of cbuf starting at bit pos, missing bits are 0
+    static uint32_t peek32(const uint8_t * cbuf, uint32_t len, uint32_t pos)
+    {
+        const uint32_t byte = pos >> 3;
+        uint64_t v = 0;
+        if (byte + 5 <= len){
+            v = ((uint64_t)cbuf[byte] << 32) | ((uint64_t)cbuf[byte + 1] << 24)
+              | ((uint64_t)cbuf[byte + 2] << 16) | ((uint64_t)cbuf[byte + 3] << 8)
+              | cbuf[byte + 4];
+        }
+        else {
+            for (uint32_t i = 0; i < 5; i++){
+                v = (v << 8) | ((byte + i < len) ? cbuf[byte + i] : 0);
+            }
+        }
+        return (uint32_t)(v >> (8 - (pos & 7)));
+    }
+
+    bool error(const char * msg)
+    {
+        LOG(LOG_ERR, "mppc: decompression failed: %s", msg);
+        return false;
+    }
+};
+
+#endif
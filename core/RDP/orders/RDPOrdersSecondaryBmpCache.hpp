@@ -448,13 +448,14 @@ class RDPBmpCache {
     int idx;
     const Bitmap * bmp;
     uint32_t verbose;
+    Bitmap::CompressStats * stats; // if not NULL, counts compressions served from memo
 
     RDPBmpCache(const Bitmap * bmp, int id, int idx, int verbose = 0)
-        : id(id), idx(idx), bmp(bmp), verbose(verbose)
+        : id(id), idx(idx), bmp(bmp), verbose(verbose), stats(NULL)
     {
     }
 
-    RDPBmpCache() : id(0), idx(0), bmp(NULL), verbose(0)
+    RDPBmpCache() : id(0), idx(0), bmp(NULL), verbose(0), stats(NULL)
     {
     }
 
@@ -534,7 +535,7 @@ class RDPBmpCache {
         }
 
         uint32_t offset_buf_start = stream.get_offset(0);
-        this->bmp->compress(stream);
+        this->bmp->compress(stream, this->stats);
         uint32_t bufsize = stream.get_offset(offset_buf_start);
 
         if (!use_compact_packets){
@@ -773,7 +774,7 @@ class RDPBmpCache {
         stream.out_uint16_be(0);
         stream.out_2BUE(this->idx);
         uint32_t offset_startBitmap = stream.get_offset(0);
-        this->bmp->compress(stream);
+        this->bmp->compress(stream, this->stats);
 
         stream.set_out_uint16_be(stream.get_offset(offset_startBitmap) | 0x4000, offset_bitmapLength); // set the actual size
         stream.set_out_uint16_le(stream.get_offset(offset_header+12), offset_header); // length after type minus 7
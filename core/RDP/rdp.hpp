@@ -31,6 +31,7 @@
 
 #include "channel_list.hpp"
 #include "log.hpp"
+#include "RDP/mppc.hpp"
 
 // [MS-RDPBCGR] 2.2.8.1.1.1.1 Share Control Header (TS_SHARECONTROLHEADER)
 // =======================================================================
@@ -302,10 +303,12 @@ class ShareDataOut
 {
     Stream & stream;
     uint16_t offlen;
+    rdp_mppc_enc * mppc_enc;
     public:
-    ShareDataOut(Stream & stream, uint8_t pdu_type2, uint32_t share_id, uint8_t streamid)
+    ShareDataOut(Stream & stream, uint8_t pdu_type2, uint32_t share_id, uint8_t streamid, rdp_mppc_enc * mppc_enc = NULL)
         : stream(stream)
         , offlen(stream.get_offset(0))
+        , mppc_enc(mppc_enc)
     {
         stream.out_uint32_le(share_id);
         stream.out_uint8(0); // pad1
@@ -316,8 +319,23 @@ class ShareDataOut
         stream.out_uint16_le(0); // compressedLen
     }
 
+    // when a bulk compressor is given, data following header is compressed
+    // in place (before security layer signs and encrypts it)
     void end(){
         stream.set_out_uint16_le(stream.get_offset(this->offlen + 8), this->offlen + 6);
+        if (this->mppc_enc){
+            uint8_t * data = this->stream.data + this->offlen + 12;
+            this->mppc_enc->compress(data, this->stream.p - data);
+            if (this->mppc_enc->flags & PACKET_COMPRESSED){
+                memcpy(data, this->mppc_enc->outputBuffer, this->mppc_enc->bytes_in_opb);
+                this->stream.p = data + this->mppc_enc->bytes_in_opb;
+                // compressedLen includes Share Control and Share Data headers
+                this->stream.set_out_uint16_le(this->mppc_enc->bytes_in_opb + 18, this->offlen + 10);
+            }
+            if (this->mppc_enc->flags){
+                this->stream.data[this->offlen + 9] = this->mppc_enc->flags | this->mppc_enc->protocol_type;
+            }
+        }
     }
 };
 
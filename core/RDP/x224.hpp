@@ -517,7 +517,9 @@ struct X224In : public X224Packet
             LOG(LOG_INFO, "ERR_STREAM_MEMORY_TOO_SMALL");
             throw Error(ERR_STREAM_MEMORY_TOO_SMALL);
         }
-        t->recv((char**)(&(stream.end)), TPKT_HEADER_LEN);
+        // first bytes of header may already have been received by caller
+        // (to distinguish between fast-path and slow-path PDUs)
+        t->recv((char**)(&(stream.end)), TPKT_HEADER_LEN - (stream.end - stream.p));
 
         this->tpkt.version = stream.in_uint8();
 
@@ -536,6 +538,7 @@ struct X224In : public X224Packet
         }
 
         t->recv((char**)(&(stream.end)), payload_len);
+        t->total_pdu_received++;
         this->tpdu_hdr.LI = stream.in_uint8();
         this->tpdu_hdr.code = stream.in_uint8() & 0xF0;
         switch (this->tpdu_hdr.code){
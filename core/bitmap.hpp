@@ -48,10 +48,21 @@
 #include <inttypes.h>
 
 #include "ssl_calls.hpp"
+#include "fingerprint.hpp"
+#include "rle_scan.hpp"
 
 #include "rect.hpp"
 
 
+// constant table built by its constructor when program starts
+template <class Table>
+struct StaticTable {
+    static const Table table;
+};
+
+template <class Table>
+const Table StaticTable<Table>::table;
+
 class Bitmap {
 
 public:
@@ -63,31 +74,119 @@ public:
     size_t line_size;
     size_t bmp_size;
 
+    // Compressed versions of bitmap data, one for each target color depth.
+    // It is shared by all bitmaps built from the same pixels: bitmaps
+    // sharing the same data buffer or converted from the same source bitmap.
+    struct CompressedMemo {
+        unsigned count;
+        struct {
+            uint8_t * data;
+            size_t size;
+            uint16_t cx;
+            uint16_t cy;
+        } by_bpp[5];
+
+        CompressedMemo() : count(1)
+        {
+            for (size_t i = 0; i < 5 ; i++){
+                this->by_bpp[i].data = 0;
+                this->by_bpp[i].size = 0;
+                this->by_bpp[i].cx = 0;
+                this->by_bpp[i].cy = 0;
+            }
+        }
+
+        ~CompressedMemo()
+        {
+            for (size_t i = 0; i < 5 ; i++){
+                free(this->by_bpp[i].data);
+            }
+        }
+
+        static unsigned slot(uint8_t bpp)
+        {
+            switch (bpp){
+            case 8:  return 0;
+            case 15: return 1;
+            case 16: return 2;
+            case 24: return 3;
+            default: return 4;
+            }
+        }
+
+        void release()
+        {
+            if (!--this->count){
+                delete this;
+            }
+        }
+    };
+
+    // compressions served from memo, kept by caller (one per serializer)
+    struct CompressStats {
+        unsigned long long hits;
+        unsigned long long misses;
+        CompressStats() : hits(0), misses(0) {}
+    };
+
     struct CountdownData {
+        // 16 bytes header before data: byte 0 is reference counter,
+        // bytes 8 to 15 pointer to compressed memo (if any)
         uint8_t * ptr;
         CountdownData() {
             this->ptr = 0;
         }
         ~CountdownData(){
+            this->release();
+        }
+        void release() {
             if (this->ptr){
                 this->ptr[0]--;
                 if (!this->ptr[0]){
+                    if (this->memo()){
+                        this->memo()->release();
+                    }
                     free(this->ptr);
                 }
+                this->ptr = 0;
+            }
+        }
+        // data also used by other bitmaps (as kept by bitmap caches)
+        bool shared() const {
+            return this->ptr[0] > 1;
+        }
+        // pixels are about to be rewritten in place, compressed versions are obsolete
+        void forget_memo() {
+            if (this->memo()){
+                this->memo()->release();
+                this->memo() = 0;
             }
         }
         uint8_t * get() const {
             return this->ptr + 16;
         }
+        CompressedMemo *& memo() const {
+            return *reinterpret_cast<CompressedMemo**>(this->ptr + 8);
+        }
         void alloc(uint32_t size) {
             this->ptr = (uint8_t*)malloc(size+16);
             this->ptr[0] = 1;
+            this->memo() = 0;
         }
         void use(const CountdownData & other)
         {
             this->ptr = other.ptr;
             this->ptr[0]++;
         }
+        // data is a color conversion of other data, share compressed memo
+        void use_memo(const CountdownData & other)
+        {
+            if (!other.memo()){
+                other.memo() = new CompressedMemo;
+            }
+            this->memo() = other.memo();
+            this->memo()->count++;
+        }
 
     } data_bitmap;
 
@@ -169,6 +268,19 @@ public:
     }
 
 
+    // bitmap of pixels already in data (bottom-up rows of align4(cx) pixels),
+    // data is shared, not copied
+    Bitmap(uint8_t bpp, uint16_t cx, uint16_t cy, const CountdownData & data)
+        : original_bpp(bpp)
+        , cx(align4(cx))
+        , cy(cy)
+        , line_size(this->cx * nbbytes(this->original_bpp))
+        , bmp_size(this->line_size * this->cy)
+        , data_bitmap()
+    {
+        this->data_bitmap.use(data);
+    }
+
     TODO("add palette support");
     Bitmap(const uint8_t * vnc_raw, uint16_t vnc_cx, uint16_t vnc_cy, uint8_t vnc_bpp, const Rect & tile)
         : original_bpp(vnc_bpp)
@@ -464,9 +576,359 @@ public:
 //        LOG(LOG_INFO, "\n-----End of dump [%p] -----------------------\n", this);
     }
 
+    // set to use historical pixel by pixel decompressor (to compare decoders)
+    static bool & use_reference_decompressor()
+    {
+        static bool reference = false;
+        return reference;
+    }
+
 private:
-    TODO("move that function to external definition")
     void decompress(const uint8_t* input, uint16_t src_cx, uint16_t src_cy, size_t size)
+    {
+        // padding of rows (when src_cx is not aligned) is only handled by reference decompressor
+        if (use_reference_decompressor() || src_cx != this->cx){
+            this->decompress_reference(input, src_cx, src_cy, size);
+            return;
+        }
+        switch (nbbytes(this->original_bpp)){
+        case 1: this->decompress_runs<1>(input, size); break;
+        case 2: this->decompress_runs<2>(input, size); break;
+        case 3: this->decompress_runs<3>(input, size); break;
+        default: this->decompress_runs<4>(input, size); break;
+        }
+    }
+
+    template <uint8_t Bpp>
+    static unsigned pixel_at(const uint8_t * p)
+    {
+        unsigned res = 0;
+        for (uint8_t b = 0 ; b < Bpp ; ++b){
+            res |= p[b] << (8 * b);
+        }
+        return res;
+    }
+
+    template <uint8_t Bpp>
+    static void put_pixel(uint8_t * p, unsigned value)
+    {
+        for (uint8_t b = 0 ; b < Bpp ; ++b){
+            p[b] = (uint8_t)(value >> (8 * b));
+        }
+    }
+
+    // first period bytes of out are allready set, repeat them up to n bytes
+    static void repeat_pattern(uint8_t * out, size_t period, size_t n)
+    {
+        // short runs are the most common, memcpy calls would cost more than copy
+        if (n <= 64){
+            for (size_t i = period ; i < n ; i++){
+                out[i] = out[i - period];
+            }
+            return;
+        }
+        size_t done = std::min(period, n);
+        while (done < n){
+            const size_t chunk = std::min(done, n - done);
+            memcpy(out + done, out, chunk);
+            done += chunk;
+        }
+    }
+
+    // Decoding of RLE order first byte: opcode and count or where to find it
+    struct RLEOrder {
+        enum {
+            COUNT,       // count is given
+            COUNT8,      // count is next byte + given count
+            COUNT8_X2,   // count is twice (next byte + given count)
+            COUNT16,     // count is next 2 bytes
+            COUNT16_X2   // count is twice next 2 bytes
+        };
+        uint8_t opcode;
+        uint8_t form;
+        uint16_t count;
+    };
+
+    // built once at program start, read only afterward
+    struct RLEOrderTable {
+        RLEOrder orders[256];
+
+        RLEOrderTable()
+        {
+            for (unsigned code = 0 ; code < 256 ; code++){
+                RLEOrder & order = this->orders[code];
+                order.form = RLEOrder::COUNT;
+                switch (code >> 4) {
+                case 0xf:
+                    order.opcode = code & 0xf;
+                    order.form = RLEOrder::COUNT16;
+                    order.count = 0;
+                    switch (code){
+                    case 0xFD: order.opcode = 13; order.form = RLEOrder::COUNT; order.count = 1; break; // WHITE
+                    case 0xFE: order.opcode = 14; order.form = RLEOrder::COUNT; order.count = 1; break; // BLACK
+                    case 0xFA: order.opcode = 9;  order.form = RLEOrder::COUNT; order.count = 8; break; // SPECIAL_FGBG_1
+                    case 0xF9: order.opcode = 10; order.form = RLEOrder::COUNT; order.count = 8; break; // SPECIAL_FGBG_2
+                    case 0xF8: order.form = RLEOrder::COUNT16_X2; break;                                // BICOLOR
+                    }
+                break;
+                case 0x0e: // BICOLOR, short form (1 or 2 bytes)
+                    order.opcode = 8;
+                    order.count = 2 * (code & 0xf);
+                    if (!order.count){
+                        order.form = RLEOrder::COUNT8_X2;
+                        order.count = 16;
+                    }
+                break;
+                case 0x0d: // FOM SET, short form  (1 or 2 bytes)
+                case 0x05:
+                case 0x04: // FOM, short form  (1 or 2 bytes)
+                    order.opcode = ((code >> 4) == 0x0d) ? 7 : 2;
+                    order.count = (code & (((code >> 4) == 0x0d) ? 0x0F : 0x1F)) << 3;
+                    if (!order.count){
+                        order.form = RLEOrder::COUNT8;
+                        order.count = 1;
+                    }
+                break;
+                case 0x0c: // MIX SET, short form (1 or 2 bytes)
+                    order.opcode = 6;
+                    order.count = code & 0x0f;
+                    if (!order.count){
+                        order.form = RLEOrder::COUNT8;
+                        order.count = 16;
+                    }
+                break;
+                default: // FILL, MIX, FOM, COLOR, COPY
+                    order.opcode = code >> 5;
+                    order.count = code & 0x1f;
+                    if (!order.count){
+                        order.form = RLEOrder::COUNT8;
+                        order.count = 32;
+                    }
+                break;
+                }
+            }
+        }
+    };
+
+    static const RLEOrder * rle_orders()
+    {
+        return StaticTable<RLEOrderTable>::table.orders;
+    }
+
+    // RLE decompressor writing whole runs at once: bounds are checked once
+    // by run and spans are set using memset/memcpy when possible. Decoded
+    // data is the same as decompress_reference() output.
+    template <uint8_t Bpp>
+    void decompress_runs(const uint8_t* input, size_t size)
+    {
+        uint8_t * const pmin = this->data_bitmap.get();
+        uint8_t * const pmax = pmin + this->bmp_size;
+        const size_t line_size = this->line_size;
+        // rows before row1 have no row above (considered as black)
+        uint8_t * const row1 = pmin + line_size;
+        const uint8_t * const end = input + size;
+        uint8_t * out = pmin;
+        unsigned color1 = 0;
+        unsigned color2 = 0;
+        unsigned mix = 0xFFFFFFFF;
+        unsigned fom_mask = 0;
+
+        enum {
+            FILL    = 0,
+            MIX     = 1,
+            FOM     = 2,
+            COLOR   = 3,
+            COPY    = 4,
+            MIX_SET = 6,
+            FOM_SET = 7,
+            BICOLOR = 8,
+            SPECIAL_FGBG_1 = 9,
+            SPECIAL_FGBG_2 = 10,
+            WHITE = 13,
+            BLACK = 14
+        };
+
+        const RLEOrder * const orders = rle_orders();
+        uint8_t lastopcode = 0xFF;
+
+        while (input < end) {
+            // Read RLE operators, handle short and long forms
+            const RLEOrder & order = orders[input[0]]; input++;
+            const uint8_t opcode = order.opcode;
+            unsigned count = order.count;
+            switch (order.form){
+            case RLEOrder::COUNT8:
+                count += input[0]; input++;
+            break;
+            case RLEOrder::COUNT8_X2:
+                count = 2 * (count + input[0]); input++;
+            break;
+            case RLEOrder::COUNT16:
+                count = input[0]|(input[1] << 8); input += 2;
+            break;
+            case RLEOrder::COUNT16_X2:
+                count = 2 * (input[0]|(input[1] << 8)); input += 2;
+            break;
+            default:
+            break;
+            }
+
+            /* Read preliminary data */
+            switch (opcode) {
+            case FOM:
+                fom_mask = input[0]; input++;
+            break;
+            case SPECIAL_FGBG_1:
+                fom_mask = 7;
+            break;
+            case SPECIAL_FGBG_2:
+                fom_mask = 3;
+            break;
+            case BICOLOR:
+                color1 = pixel_at<Bpp>(input);
+                input += Bpp;
+                color2 = pixel_at<Bpp>(input);
+                input += Bpp;
+                break;
+            case COLOR:
+                color2 = pixel_at<Bpp>(input);
+                input += Bpp;
+                break;
+            case MIX_SET:
+                mix = pixel_at<Bpp>(input);
+                input += Bpp;
+            break;
+            case FOM_SET:
+                mix = pixel_at<Bpp>(input);
+                input += Bpp;
+                fom_mask = input[0]; input++;
+                break;
+            default: // for FILL, MIX or COPY nothing to do here
+                break;
+            }
+
+            // MAGIC MIX of one pixel to comply with crap in Bitmap RLE compression
+            if ((opcode == FILL)
+            && (opcode == lastopcode)
+            && (out != row1)){
+                if (count == 0 || out + Bpp > pmax){
+                    LOG(LOG_WARNING, "Decompressed bitmap too large. Dying.");
+                    throw Error(ERR_BITMAP_DECOMPRESSED_DATA_TOO_LARGE);
+                }
+                put_pixel<Bpp>(out, ((out < row1) ? 0 : pixel_at<Bpp>(out - line_size)) ^ mix);
+                count--;
+                out += Bpp;
+            }
+            lastopcode = opcode;
+
+            /* Output body */
+            const size_t n = count * Bpp;
+            if (n > (size_t)(pmax - out)) {
+                LOG(LOG_WARNING, "Decompressed bitmap too large. Dying.");
+                throw Error(ERR_BITMAP_DECOMPRESSED_DATA_TOO_LARGE);
+            }
+
+            switch (opcode) {
+            case FILL:
+            {
+                size_t done = 0;
+                if (out < row1){
+                    done = std::min(n, (size_t)(row1 - out));
+                    memset(out, 0, done);
+                }
+                if (n - done <= 64 && line_size >= 64){
+                    for (; done < n ; done++){
+                        out[done] = out[done - line_size];
+                    }
+                }
+                // source and destination overlap when run is longer than a row
+                while (done < n){
+                    const size_t chunk = std::min(n - done, line_size);
+                    memcpy(out + done, out + done - line_size, chunk);
+                    done += chunk;
+                }
+            }
+            break;
+            case MIX_SET:
+            case MIX:
+            {
+                size_t done = 0;
+                if (out < row1 && n){
+                    done = std::min(n, (size_t)(row1 - out));
+                    put_pixel<Bpp>(out, mix);
+                    repeat_pattern(out, Bpp, done);
+                }
+                for (uint8_t * p = out + done ; p < out + n ; p += Bpp){
+                    put_pixel<Bpp>(p, pixel_at<Bpp>(p - line_size) ^ mix);
+                }
+            }
+            break;
+            case FOM_SET:
+            case FOM:
+            case SPECIAL_FGBG_1:
+            case SPECIAL_FGBG_2:
+            {
+                unsigned mask = 1;
+                uint8_t * p = out;
+                uint8_t * const stop = out + n;
+                // first scanline, pixels above are black
+                for (; p < stop && p < row1 ; p += Bpp){
+                    if (mask == 0x100){
+                        mask = 1;
+                        fom_mask = input[0]; input++;
+                    }
+                    put_pixel<Bpp>(p, (mask & fom_mask) ? mix : 0);
+                    mask <<= 1;
+                }
+                for (; p < stop ; p += Bpp){
+                    if (mask == 0x100){
+                        mask = 1;
+                        fom_mask = input[0]; input++;
+                    }
+                    put_pixel<Bpp>(p, pixel_at<Bpp>(p - line_size) ^ (mix & -(unsigned)((mask & fom_mask) != 0)));
+                    mask <<= 1;
+                }
+            }
+            break;
+            case COLOR:
+                if (n){
+                    put_pixel<Bpp>(out, color2);
+                    repeat_pattern(out, Bpp, n);
+                }
+            break;
+            case COPY:
+                if (n > (size_t)(end - input)){
+                    LOG(LOG_WARNING, "Compressed bitmap truncated. Dying.");
+                    throw Error(ERR_BITMAP_DECOMPRESSED_DATA_TOO_LARGE);
+                }
+                memcpy(out, input, n);
+                input += n;
+            break;
+            case BICOLOR:
+                if (n){
+                    put_pixel<Bpp>(out, color1);
+                    if (n > Bpp){
+                        put_pixel<Bpp>(out + Bpp, color2);
+                    }
+                    repeat_pattern(out, 2 * Bpp, n);
+                }
+            break;
+            case WHITE:
+                memset(out, 0xFF, n);
+            break;
+            case BLACK:
+                memset(out, 0, n);
+            break;
+            default:
+                assert(false);
+            break;
+            }
+            out += n;
+        }
+    }
+
+    TODO("move that function to external definition")
+    void decompress_reference(const uint8_t* input, uint16_t src_cx, uint16_t src_cy, size_t size)
     {
 //        printf("============================================\n");
 //        printf("Compressed bitmap data\n");
@@ -731,7 +1193,12 @@ private:
 public:
     unsigned get_pixel(const uint8_t Bpp, const uint8_t * const p) const
     {
-        return in_bytes_le(Bpp, p);
+        switch (Bpp){
+        case 1: return p[0];
+        case 2: return p[0] | (p[1] << 8);
+        case 3: return p[0] | (p[1] << 8) | (p[2] << 16);
+        default: return in_bytes_le(Bpp, p);
+        }
     }
 
     unsigned get_pixel_above(const uint8_t Bpp, const uint8_t * pmin, const uint8_t * const p) const
@@ -741,12 +1208,49 @@ public:
         : this->get_pixel(Bpp, p - this->line_size);
     }
 
+    // Most runs are short and found by the pixel by pixel loops below, when
+    // they go beyond LONG_RUN pixels the remaining of the run is found by
+    // get_span_count using RLEScan (unless reference engine is selected).
+    enum {
+        LONG_RUN = 16
+    };
+
+    // Number of pixels from p to pmax such that pixel ^ pixel_above is value
+    // (when above is false pixel itself is compared to value). Scans are made
+    // by RLEScan on bytes, pmax - p must be a whole number of pixels (it is
+    // always the case for compressor as it works by rows).
+    unsigned get_span_count(const uint8_t Bpp, const uint8_t * pmin, const uint8_t * pmax, const uint8_t * p, unsigned value, bool above) const
+    {
+        uint8_t pattern[RLEScan::PATTERN_SIZE];
+        RLEScan::make_pattern(pattern, Bpp, value);
+
+        if (!above){
+            return RLEScan::scan(p, 0, pattern, pmax - p) / Bpp;
+        }
+        size_t acc = 0;
+        if ((p - this->line_size) < pmin){
+            // first scanline, pixels above are black
+            const uint8_t * end = std::min(pmax, pmin + this->line_size);
+            const size_t n = end - p;
+            acc = RLEScan::scan(p, 0, pattern, n);
+            if (acc < n || end == pmax){
+                return acc / Bpp;
+            }
+            p = end;
+        }
+        acc += RLEScan::scan(p, p - this->line_size, pattern, pmax - p);
+        return acc / Bpp;
+    }
+
     unsigned get_color_count(const uint8_t Bpp, const uint8_t * pmax, const uint8_t * p, unsigned color) const
     {
         unsigned acc = 0;
         while (p < pmax && this->get_pixel(Bpp, p) == color){
             acc++;
             p = p + Bpp;
+            if (acc == LONG_RUN && RLEScan::engine() != RLE_SCAN_REFERENCE){
+                return acc + this->get_span_count(Bpp, 0, pmax, p, color, false);
+            }
         }
         return acc;
     }
@@ -777,6 +1281,9 @@ public:
             }
             p = p + Bpp;
             acc = acc + 1;
+            if (acc == LONG_RUN && RLEScan::engine() != RLE_SCAN_REFERENCE){
+                return acc + this->get_span_count(Bpp, pmin, pmax, p, 0, true);
+            }
         }
         return acc;
     }
@@ -791,6 +1298,9 @@ public:
             }
             p += Bpp;
             acc += 1;
+            if (acc == LONG_RUN && RLEScan::engine() != RLE_SCAN_REFERENCE){
+                return acc + this->get_span_count(Bpp, pmin, pmax, p, foreground, true);
+            }
         }
         return acc;
     }
@@ -934,9 +1444,39 @@ public:
         return mix_count + this->get_fom_count_fill(Bpp, pmin, pmax, p + mix_count * Bpp, foreground);
     }
 
+    // Compressed data is computed once and kept in the compressed memo of
+    // bitmap data, later compressions of the same pixels are just a copy.
+    void compress(Stream & out, CompressStats * stats = 0) const
+    {
+        if (!this->data_bitmap.memo()){
+            this->data_bitmap.memo() = new CompressedMemo;
+        }
+        CompressedMemo * memo = this->data_bitmap.memo();
+        unsigned slot = CompressedMemo::slot(this->original_bpp);
+        if (memo->by_bpp[slot].data
+        && memo->by_bpp[slot].cx == this->cx
+        && memo->by_bpp[slot].cy == this->cy){
+            if (stats){
+                stats->hits++;
+            }
+            out.out_copy_bytes(memo->by_bpp[slot].data, memo->by_bpp[slot].size);
+            return;
+        }
+        if (stats){
+            stats->misses++;
+        }
+        uint8_t * start = out.p;
+        this->rle_compress(out);
+        free(memo->by_bpp[slot].data);
+        memo->by_bpp[slot].size = out.p - start;
+        memo->by_bpp[slot].cx = this->cx;
+        memo->by_bpp[slot].cy = this->cy;
+        memo->by_bpp[slot].data = (uint8_t*)malloc(memo->by_bpp[slot].size);
+        memcpy(memo->by_bpp[slot].data, start, memo->by_bpp[slot].size);
+    }
+
     TODO(" simplify and enhance compression using 1 pixel orders BLACK or WHITE.")
-    TODO(" keep allready compressed bitmaps in cache to avoid useless computations")
-    void compress(Stream & out) const
+    void rle_compress(Stream & out) const
     {
         const uint8_t Bpp = nbbytes(this->original_bpp);
         const uint8_t * pmin = this->data_bitmap.get();
@@ -1103,6 +1643,15 @@ public:
         ssl.sha1_final(&sha1, sig);
     }
 
+    // Fast non cryptographic alternative to compute_sha1, geometry and
+    // color depth are part of the fingerprint.
+    void compute_fingerprint(uint8_t (&sig)[16]) const
+    {
+        Fingerprint128 fp(((uint64_t)this->original_bpp << 32)|((uint64_t)this->cx << 16)|(uint64_t)this->cy);
+        fp.update(this->data_bitmap.get(), this->bmp_size);
+        fp.final(sig);
+    }
+
     uint32_t compute_crc() const
     {
         const static int crc_seed = 0xffffffff;
@@ -1208,6 +1757,7 @@ public:
                 TODO("padding code should not be necessary for source either as source bmp width is already aligned")
                 src += bmp.line_size - bmp.cx * nbbytes(bmp.original_bpp);
             }
+            this->data_bitmap.use_memo(bmp.data_bitmap);
         }
         else {
             this->data_bitmap.use(bmp.data_bitmap);
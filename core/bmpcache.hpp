@@ -21,16 +21,26 @@
 #if !defined(__BMPCACHE_HPP__)
 #define __BMPCACHE_HPP__
 
+#include <algorithm>
+
 enum {
     BITMAP_FOUND_IN_CACHE,
     BITMAP_ADDED_TO_CACHE
 };
 
+// How bitmaps are recognized as allready in cache
+enum {
+    BMPCACHE_SIGNATURE_SHA1,            // cryptographic signature (default)
+    BMPCACHE_SIGNATURE_FINGERPRINT,     // 128 bits non cryptographic fingerprint
+    BMPCACHE_SIGNATURE_FINGERPRINT_CMP  // fingerprint, and bitmap data compared on match
+};
+
 class Bitmap;
 
 struct BmpCache {
 
     const uint8_t bpp;
+    const uint8_t signature;
     uint16_t small_entries;
     uint16_t small_size;
     uint16_t medium_entries;
@@ -41,14 +51,33 @@ struct BmpCache {
     const Bitmap * cache[3][8192];
     uint32_t stamps[3][8192];
     //uint32_t crc[3][8192];
-    uint8_t sha1[3][8192][20];
+    uint8_t sig[3][8192][20];
     uint32_t stamp;
+
+    // Bitmaps in cache are indexed by signature (hash buckets with
+    // chained collisions) and linked in a list ordered by stamps, oldest
+    // first. Hence looking for a bitmap or for the entry to replace does
+    // not need to scan the whole cache. Links are cache indexes,
+    // NO_ENTRY marks the end of a chain.
+    enum {
+        NO_ENTRY = 0xFFFF,
+        NB_BUCKETS = 16384
+    };
+    uint16_t buckets[3][NB_BUCKETS];
+    uint16_t chain[3][8192];
+    uint16_t lru_prev[3][8192];
+    uint16_t lru_next[3][8192];
+    uint16_t lru_first[3];
+    uint16_t lru_last[3];
+
     public:
         BmpCache(const uint8_t bpp,
                  uint16_t small_entries = 8192, uint16_t small_size = 768,
                  uint16_t medium_entries = 8192, uint16_t medium_size = 3072,
-                 uint16_t big_entries = 8192, uint16_t big_size = 12288)
+                 uint16_t big_entries = 8192, uint16_t big_size = 12288,
+                 uint8_t signature = BMPCACHE_SIGNATURE_SHA1)
             : bpp(bpp)
+            , signature(signature)
             , small_entries(small_entries)
             , small_size(small_size)
             , medium_entries(medium_entries)
@@ -79,9 +108,102 @@ struct BmpCache {
                     this->cache[cid][cidx] = NULL;
                     this->stamps[cid][cidx] = 0;
                     //this->crc[cid][cidx] = 0;
-                    bzero(this->sha1[cid][cidx], 20);
+                    bzero(this->sig[cid][cidx], 20);
+                    this->chain[cid][cidx] = NO_ENTRY;
+                }
+                for (size_t bucket = 0; bucket < NB_BUCKETS ; bucket++){
+                    this->buckets[cid][bucket] = NO_ENTRY;
                 }
             }
+            this->rebuild_lru();
+        }
+
+        uint16_t nb_entries(uint8_t id) const
+        {
+            return std::min<uint16_t>(8192,
+                  (id == 0) ? this->small_entries
+                : (id == 1) ? this->medium_entries
+                : this->big_entries);
+        }
+
+        // signatures are already uniformly distributed, their first bytes are a good hash
+        static unsigned bucket_of(const uint8_t (&sig)[20])
+        {
+            return (sig[0] | (sig[1] << 8) | (sig[2] << 16)) & (NB_BUCKETS - 1);
+        }
+
+        void index_insert(uint8_t id, uint16_t idx)
+        {
+            uint16_t & head = this->buckets[id][bucket_of(this->sig[id][idx])];
+            this->chain[id][idx] = head;
+            head = idx;
+        }
+
+        void index_remove(uint8_t id, uint16_t idx)
+        {
+            uint16_t * link = &this->buckets[id][bucket_of(this->sig[id][idx])];
+            while (*link != NO_ENTRY){
+                if (*link == idx){
+                    *link = this->chain[id][idx];
+                    break;
+                }
+                link = &this->chain[id][*link];
+            }
+            this->chain[id][idx] = NO_ENTRY;
+        }
+
+        void lru_unlink(uint8_t id, uint16_t idx)
+        {
+            const uint16_t prev = this->lru_prev[id][idx];
+            const uint16_t next = this->lru_next[id][idx];
+            if (prev == NO_ENTRY){ this->lru_first[id] = next; }
+            else                 { this->lru_next[id][prev] = next; }
+            if (next == NO_ENTRY){ this->lru_last[id] = prev; }
+            else                 { this->lru_prev[id][next] = prev; }
+        }
+
+        void lru_append(uint8_t id, uint16_t idx)
+        {
+            this->lru_prev[id][idx] = this->lru_last[id];
+            this->lru_next[id][idx] = NO_ENTRY;
+            if (this->lru_last[id] == NO_ENTRY){ this->lru_first[id] = idx; }
+            else                               { this->lru_next[id][this->lru_last[id]] = idx; }
+            this->lru_last[id] = idx;
+        }
+
+        void set_stamp(uint8_t id, uint16_t idx)
+        {
+            this->stamps[id][idx] = ++stamp;
+            // entries above negotiated number of entries are never candidates for replacement
+            if (idx < this->nb_entries(id)){
+                this->lru_unlink(id, idx);
+                this->lru_append(id, idx);
+            }
+        }
+
+        void compute_signature(const Bitmap & bmp, uint8_t (&sig)[20]) const
+        {
+            if (this->signature == BMPCACHE_SIGNATURE_SHA1){
+                bmp.compute_sha1(sig);
+            }
+            else {
+                uint8_t fingerprint[16];
+                bmp.compute_fingerprint(fingerprint);
+                memcpy(sig, fingerprint, 16);
+                bzero(sig + 16, 4);
+            }
+        }
+
+        bool same_bitmap(const Bitmap & bmp, uint8_t id, uint16_t idx, const uint8_t (&sig)[20]) const
+        {
+            const Bitmap & cached = *this->cache[id][idx];
+            return 0 == memcmp(sig, this->sig[id][idx], sizeof(sig))
+                && cached.cx == bmp.cx
+                && cached.cy == bmp.cy
+                && (this->signature != BMPCACHE_SIGNATURE_FINGERPRINT_CMP
+                   || (cached.bmp_size == bmp.bmp_size
+                      && (cached.data() == bmp.data()
+                         || 0 == memcmp(cached.data(), bmp.data(), bmp.bmp_size))));
         }
 
     public:
@@ -91,16 +213,49 @@ struct BmpCache {
             this->reset_values();
         }
 
+        // rebuild list of entries ordered by stamps, to call after stamps
+        // or number of entries were changed from outside (like when
+        // restoring cache from a breakpoint).
+        void rebuild_lru()
+        {
+            for (uint8_t cid = 0; cid < 3 ; cid++){
+                const uint16_t entries = this->nb_entries(cid);
+                uint16_t order[8192];
+                for (uint16_t cidx = 0; cidx < entries ; cidx++){
+                    order[cidx] = cidx;
+                }
+                std::stable_sort(order, order + entries, StampLess(this->stamps[cid]));
+                this->lru_first[cid] = this->lru_last[cid] = NO_ENTRY;
+                for (uint16_t i = 0; i < entries ; i++){
+                    this->lru_append(cid, order[i]);
+                }
+            }
+        }
+
+    private:
+        struct StampLess {
+            const uint32_t (&stamps)[8192];
+            StampLess(const uint32_t (&stamps)[8192]) : stamps(stamps) {}
+            bool operator()(uint16_t a, uint16_t b) const {
+                return this->stamps[a] < this->stamps[b];
+            }
+        };
+
+    public:
         void put(uint8_t id, uint16_t idx, const Bitmap * const bmp){
+            if (this->cache[id][idx]){
+                this->index_remove(id, idx);
+            }
             delete this->cache[id][idx];
             this->cache[id][idx] = bmp;
-            this->stamps[id][idx] = ++stamp;
+            this->set_stamp(id, idx);
             //this->crc[id][idx] = bmp->compute_crc();
-            bmp->compute_sha1(this->sha1[id][idx]);
+            this->compute_signature(*bmp, this->sig[id][idx]);
+            this->index_insert(id, idx);
         }
 
         void restamp(uint8_t id, uint16_t idx){
-            this->stamps[id][idx] = ++stamp;
+            this->set_stamp(id, idx);
         }
 
         const Bitmap * get(uint8_t id, uint16_t idx){
@@ -117,24 +272,17 @@ struct BmpCache {
             const Bitmap * bmp = new Bitmap(this->bpp, oldbmp);
 
             //const unsigned bmp_crc = bmp->compute_crc();
-            uint8_t bmp_sha1[20];
-            bmp->compute_sha1(bmp_sha1);
+            uint8_t bmp_sig[20];
+            this->compute_signature(*bmp, bmp_sig);
 
-            uint16_t oldest_cidx = 0;
-            unsigned oldstamp = this->stamps[0][0];
-
-            uint16_t entries = 0;
             uint8_t id = 0;
             uint32_t bmp_size = bmp->bmp_size;
 
             if (bmp_size <= this->small_size) {
-                entries = this->small_entries;
                 id = 0;
             } else if (bmp_size <= this->medium_size) {
-                entries = this->medium_entries;
                 id = 1;
             } else if (bmp_size <= this->big_size) {
-                entries = this->big_entries;
                 id = 2;
             }
             else {
@@ -144,25 +292,28 @@ struct BmpCache {
                 throw Error(ERR_BITMAP_CACHE_TOO_BIG);
             }
 
-            for (uint16_t cidx = 0 ; cidx < entries; cidx++){
-                if (/*bmp_crc == this->crc[id][cidx]
-                && */0 == memcmp(bmp_sha1, this->sha1[id][cidx], sizeof(bmp_sha1))
-                && this->cache[id][cidx]->cx == bmp->cx
-                && this->cache[id][cidx]->cy == bmp->cy){
+            const uint16_t entries = this->nb_entries(id);
+            for (uint16_t cidx = this->buckets[id][bucket_of(bmp_sig)]
+                ; cidx != NO_ENTRY
+                ; cidx = this->chain[id][cidx]){
+                if (cidx < entries
+                && /*bmp_crc == this->crc[id][cidx]
+                && */this->same_bitmap(*bmp, id, cidx, bmp_sig)){
                     delete bmp;
                     return (BITMAP_FOUND_IN_CACHE << 24)|(id<<16)|cidx;
                 }
-                if (this->stamps[id][cidx] < oldstamp){
-                    oldest_cidx = cidx;
-                    oldstamp = this->stamps[id][cidx];
-                }
             }
-            // find oldest stamp (or 0) and replace bitmap
+            // replace oldest stamp (or 0) bitmap
+            const uint16_t oldest_cidx = (this->lru_first[id] == NO_ENTRY) ? 0 : this->lru_first[id];
+            if (this->cache[id][oldest_cidx]){
+                this->index_remove(id, oldest_cidx);
+            }
             delete this->cache[id][oldest_cidx];
             this->cache[id][oldest_cidx] = bmp;
-            this->stamps[id][oldest_cidx] = ++stamp;
+            this->set_stamp(id, oldest_cidx);
             //this->crc[id][oldest_cidx] = bmp_crc;
-            memcpy(this->sha1[id][oldest_cidx], bmp_sha1, 20);
+            memcpy(this->sig[id][oldest_cidx], bmp_sig, 20);
+            this->index_insert(id, oldest_cidx);
             return (BITMAP_ADDED_TO_CACHE << 24)|(id<<16)|oldest_cidx;
         }
 };
@@ -37,6 +37,11 @@ struct Callback
     virtual void rdp_input_mouse(int device_flags, int x, int y, Keymap2 * keymap) = 0;
     virtual void rdp_input_synchronize(uint32_t time, uint16_t device_flags, int16_t param1, int16_t param2) = 0;
     virtual void rdp_input_invalidate(const Rect & r) = 0;
+    // all input events of a client input PDU were given, modules batching
+    // input events should send them now
+    virtual void rdp_input_flush()
+    {
+    }
 };
 
 
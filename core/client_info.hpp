@@ -51,6 +51,7 @@ struct ClientInfo {
     int op1; /* use smaller bitmap header, non cache */
     uint32_t desktop_cache;
     bool use_compact_packets; /* rdp5 smaller packets */
+    bool fastpath_output; /* client supports fast-path output */
     char hostname[512];
     int build;
     int keylayout;
@@ -60,6 +61,7 @@ struct ClientInfo {
     char program[512];
     char directory[512];
     int rdp_compression;
+    int rdp_compression_type; /* highest PACKET_COMPR_TYPE_* supported */
     int rdp_autologin;
     int crypt_level; /* 1, 2, 3 = low, medium, high */
     int channel_code; /* 0 = no channels 1 = channels */
@@ -91,6 +93,7 @@ struct ClientInfo {
         this->op1 = 0; /* use smaller bitmap header, non cache */
         this->desktop_cache = 0;
         this->use_compact_packets = false; /* rdp5 smaller packets */
+        this->fastpath_output = false; /* client supports fast-path output */
         memset(this->hostname, 0, sizeof(this->hostname));
         this->build = 0;
         this->keylayout = 0;
@@ -100,6 +103,7 @@ struct ClientInfo {
         memset(this->program, 0, sizeof(this->program));
         memset(this->directory, 0, sizeof(this->directory));
         this->rdp_compression = 0;
+        this->rdp_compression_type = 0;
         this->rdp_autologin = 0;
         this->sound_code = 0; /* 1 = leave sound at server */
         this->is_mce = 0;
@@ -161,6 +165,7 @@ struct ClientInfo {
         }
         if (infoPacket.flags & INFO_COMPRESSION){
             this->rdp_compression = 1;
+            this->rdp_compression_type = (infoPacket.flags & CompressionTypeMask) >> 9;
         }
     }
 
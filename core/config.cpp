@@ -62,6 +62,14 @@ TODO(" should throw an exeption for unrecognised values")
     return res;
 }
 
+unsigned bitmap_cache_signature_from_string(string str)
+{ // sha1 = 0, fingerprint = 1, fingerprint_compare = 2
+    unsigned res = 0;
+    if (0 == string("fingerprint").compare(str)) { res = 1; }
+    else if (0 == string("fingerprint_compare").compare(str)) { res = 2; }
+    return res;
+}
+
 bool check_name(string str)
 {
     return ((str.length() > 0) && (str.length() < 250));
@@ -213,7 +221,15 @@ TODO(" find a more generic way to read this struct with any number of account li
     Inifile_desc.add_options()
     ("globals.bitmap_cache", po::value<string>()->default_value("yes"), "")
     ("globals.bitmap_compression", po::value<string>()->default_value("yes"), "")
+    ("globals.rdp_compression", po::value<string>()->default_value("yes"), "bulk compression (MPPC 8K or 64K)")
+    ("globals.rdp_server_compression", po::value<string>()->default_value("no"), "ask target server for bulk compression (MPPC 64K)")
+    ("globals.bitmap_cache_signature", po::value<string>()->default_value("sha1"), "sha1, fingerprint or fingerprint_compare")
     ("globals.port", po::value<int>(&this->globals.port)->default_value(3389), "")
+    ("globals.listen_backlog", po::value<int>(&this->globals.listen_backlog)->default_value(128), "")
+    ("globals.session_workers", po::value<int>(&this->globals.session_workers)->default_value(0), "number of pre-forked session processes, 0 to fork on accept")
+    ("globals.send_queue_high_water", po::value<int>(&this->globals.send_queue_high_water)->default_value(524288), "bytes queued to client above which back end is paused")
+    ("globals.vnc_pipeline", po::value<int>(&this->globals.vnc_pipeline)->default_value(2), "FramebufferUpdateRequests sent ahead to VNC server while client is not congested, 1 to wait for each update")
+    ("globals.xup_shm", po::value<string>()->default_value("no"), "accept shared memory framebuffer from a local X side instead of paint orders (xup)")
     ("globals.crypt_level", po::value<string>()->default_value("low"), "")
     ("globals.channel_code", po::value<unsigned>()->default_value(1), "")
     ("globals.autologin", po::value<string>()->default_value("no"), "")
@@ -222,6 +238,11 @@ TODO(" find a more generic way to read this struct with any number of account li
     ("globals.authport", po::value<int>()->default_value(3350), "")
     ("globals.nomouse", po::value<string>()->default_value("false"), "")
     ("globals.notimestamp", po::value<string>()->default_value("false"), "")
+    ("globals.png_dirty_only", po::value<string>()->default_value("no"), "png captures only hold area changed since previous png, listed in .idx file")
+    ("globals.wrm_keyframe_interval", po::value<int>(&this->globals.wrm_keyframe_interval)->default_value(600), "seconds between keyframes of native capture (seek points of replay), 0 to disable")
+    ("globals.wrm_compression", po::value<int>(&this->globals.wrm_compression)->default_value(0), "zlib level (1-9) of native capture, 0 for uncompressed wrm readable by older players")
+    ("globals.video_capture", po::value<string>()->default_value("no"), "mjpeg avi video of sessions, framerate and qscale of video_quality (l_, m_ or h_ settings)")
+    ("globals.selector_local_index", po::value<string>()->default_value("no"), "selector fetches all authorized targets from acl once, then pages and filters them locally")
     ("globals.autovalidate", po::value<string>()->default_value("false"), "")
     ("globals.l_bitrate", po::value<int>()->default_value(20000), "")
     ("globals.l_framerate", po::value<int>()->default_value(1), "")
@@ -323,8 +344,22 @@ TODO(" find a more generic way to read this struct with any number of account li
             bool_from_string(vm["globals.nomouse"].as<string>());
         this->globals.notimestamp =
             bool_from_string(vm["globals.notimestamp"].as<string>());
+        this->globals.png_dirty_only =
+            bool_from_string(vm["globals.png_dirty_only"].as<string>());
+        this->globals.video_capture =
+            bool_from_string(vm["globals.video_capture"].as<string>());
+        this->globals.selector_local_index =
+            bool_from_string(vm["globals.selector_local_index"].as<string>());
+        this->globals.xup_shm =
+            bool_from_string(vm["globals.xup_shm"].as<string>());
         this->globals.bitmap_compression =
             bool_from_string(vm["globals.bitmap_compression"].as<string>());
+        this->globals.rdp_compression =
+            bool_from_string(vm["globals.rdp_compression"].as<string>());
+        this->globals.rdp_server_compression =
+            bool_from_string(vm["globals.rdp_server_compression"].as<string>());
+        this->globals.bitmap_cache_signature =
+            bitmap_cache_signature_from_string(vm["globals.bitmap_cache_signature"].as<string>());
         this->globals.crypt_level =
             level_from_string(vm["globals.crypt_level"].as<string>());
         this->globals.channel_code =
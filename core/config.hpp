@@ -153,6 +153,7 @@ typedef enum{
 
 idlib_t idlib_from_string(std::string str);
 bool bool_from_string(std::string str);
+unsigned bitmap_cache_signature_from_string(std::string str);
 
 #include <fstream>
 
@@ -196,7 +197,15 @@ struct Inifile {
     struct Inifile_globals {
         bool bitmap_cache;       // default true
         bool bitmap_compression; // default true
+        bool rdp_compression;    // default true, bulk (MPPC) compression of data sent to client if it supports it
+        bool rdp_server_compression; // default false, ask target RDP server for bulk (MPPC 64K) compression
+        unsigned bitmap_cache_signature; // 0 = sha1 (default), 1 = fingerprint, 2 = fingerprint + compare
         int port;                // default 3389
+        int listen_backlog;      // default 128, pending connections queue of listener
+        int session_workers;     // default 0 (fork after accept), else number of pre-forked workers waiting for connections
+        int send_queue_high_water; // default 524288, bytes queued to client above which back end is not read any more
+        int vnc_pipeline;        // default 2, FramebufferUpdateRequests sent ahead to VNC server, 1 to wait for each update
+        bool xup_shm;            // default false, accept shared memory framebuffer from a local X side (xup)
         int crypt_level;   // 0=low, 1=medium, 2=high
         // TODO: CGR : didn't changed it to boolean as I don't know if it shouldn't be a number of channel
         unsigned channel_code; /* 0 = no channels 1 = channels */
@@ -223,6 +232,11 @@ struct Inifile {
         unsigned authversion;
         bool nomouse;
         bool notimestamp;
+        bool png_dirty_only;    // default false, png captures only hold area changed since previous png
+        int wrm_keyframe_interval; // default 600, seconds between keyframes (new wrm file) of native capture, 0 = never
+        int wrm_compression;    // default 0, zlib level (1-9) of native capture chunks, 0 = no compression
+        bool video_capture;     // default false, mjpeg avi video of sessions, framerate and qscale from video_quality
+        bool selector_local_index; // default false, selector fetches all targets once then pages and filters them locally
         bool autovalidate;      // dialog autovalidation for test
 
         int l_bitrate;         // bitrate for low quality
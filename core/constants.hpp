@@ -136,7 +136,9 @@ enum {
     RDP_INPUT_CODEPOINT            = 1,
     RDP_INPUT_VIRTKEY              = 2,
     RDP_INPUT_SCANCODE             = 4,
+    RDP_INPUT_UNICODE              = 5,
     RDP_INPUT_MOUSE                = 0x8001,
+    RDP_INPUT_MOUSEX               = 0x8002,
 };
 
 /* Device flags */
@@ -140,6 +140,8 @@ enum {
     ERR_RDP_UNEXPECTED_DEMANDACTIVEPDU,
     ERR_RDP_UNEXPECTED_VIRTUAL_CHANNEL,
     ERR_RDP_RESIZE_NOT_AVAILABLE,
+    ERR_RDP_FASTPATH,
+    ERR_RDP_DATA_DECOMPRESS,
 
     ERR_WM_PASSWORD = 9000,
     ERR_WM_USERNAME,
@@ -152,6 +154,7 @@ enum {
     ERR_VNC_CONNECTION_ERROR,
     ERR_VNC_MEMORY_ALLOCATION_FAILED,
     ERR_VNC_OLDER_RDP_CLIENT_CANT_RESIZE,
+    ERR_VNC_DECODE_FAILED,
 
     ERR_XUP_BAD_BPP = 11000,
 
@@ -168,6 +171,7 @@ enum {
     ERR_SESSION_UNKNOWN_BACKEND = 13000,
 
     ERR_WAIT_OBJ_SOCKET = 14000,
+    ERR_REACTOR,
 
     ERR_ORDERS_FORCE_SEND_FAILED = 15000,
 
@@ -196,6 +200,7 @@ enum {
     ERR_WRM_RECORDER_OPEN_FAILED,
 
     ERR_RECORDER_SNAPSHOT_FAILED,
+    ERR_WRM_UNSUPPORTED_FORMAT,
 
     ERR_BITMAP_LOAD_FAILED = 17000,
 
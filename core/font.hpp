@@ -36,6 +36,7 @@
 #include <limits.h>
 #include <bits/posix1_lim.h>
 #include "altoco.hpp"
+#include "constants.hpp"
 
 struct FontChar {
     int offset;  // leading whistespace before char
@@ -227,4 +228,13 @@ TODO(" baseline is always -height (seen from the code of fontdump) looks strange
 
 };
 
+// Font used by sessions, loaded once per process. When listener uses
+// pre-forked workers it loads it before forking, all sessions then share
+// the same (copy-on-write) pages.
+inline Font & default_font()
+{
+    static Font font(SHARE_PATH "/" DEFAULT_FONT_NAME);
+    return font;
+}
+
 #endif
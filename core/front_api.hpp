@@ -32,6 +32,8 @@ class FrontAPI : public RDPGraphicDevice {
     using RDPGraphicDevice::draw;
 
     virtual void draw_vnc(const Rect & rect, const uint8_t bpp, const BGRPalette & palette332, const uint8_t * raw, uint32_t need_size) {};
+    // tile already in RDP bitmap layout, drawn at dst_tile without copy
+    virtual void draw_bitmap_tile(const Rect & dst_tile, const Bitmap & tile) {};
 
     virtual const ChannelDefArray & get_channel_list(void) const = 0;
     virtual void send_to_channel(const ChannelDef & channel, uint8_t* data, size_t length, size_t chunk_size, int flags) = 0;
@@ -47,6 +49,9 @@ class FrontAPI : public RDPGraphicDevice {
     virtual void server_draw_text(uint16_t x, uint16_t y, const char * text, uint32_t fgcolor, uint32_t bgcolor, const Rect & clip) = 0;
     virtual void text_metrics(const char * text, int & width, int & height) = 0;
     virtual int server_resize(int width, int height, int bpp) = 0;
+    // true if client does not take what is sent fast enough, modules should
+    // then not ask their server for more
+    virtual bool congested() { return false; }
 
     int mouse_x;
     int mouse_y;
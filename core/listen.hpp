@@ -40,6 +40,7 @@
 #include "wait_obj.hpp"
 #include <iostream>
 #include <vector>
+#include <algorithm>
 using namespace std;
 
 /* rdp listener */
@@ -85,13 +86,15 @@ struct Listen {
                 }
             }
 
-            /* set non blocking */
-            fcntl(this->sck, F_SETFL, fcntl(this->sck, F_GETFL) | O_NONBLOCK);
-
             memset(&s, 0, sizeof(struct sockaddr_in));
             s.sin_family = AF_INET;
             Inifile ini_listen(CFG_PATH "/" RDPPROXY_INI);
 
+            /* set non blocking, pre-forked workers wait in accept */
+            if (ini_listen.globals.session_workers <= 0){
+                fcntl(this->sck, F_SETFL, fcntl(this->sck, F_GETFL) | O_NONBLOCK);
+            }
+
             s.sin_port = htons(ini_listen.globals.port);
             s.sin_addr.s_addr = INADDR_ANY;
             rv = bind(this->sck, (struct sockaddr*)&s, sizeof(struct sockaddr_in));
@@ -103,11 +106,14 @@ struct Listen {
                 throw 1;
             }
 
-            rv = listen(this->sck, 2);
+            rv = listen(this->sck, ini_listen.globals.listen_backlog);
             if (0 != rv) {
                 LOG(LOG_ERR, "listen error in listen_main_loop\n");
                 throw 1;
             }
+            if (ini_listen.globals.session_workers > 0){
+                return this->workers_main_loop(ini_listen);
+            }
             struct wait_obj listen_event(this->sck);
 
             while (1) {
@@ -192,6 +198,123 @@ struct Listen {
         }
        return rv;
     }
+
+    /*****************************************************************************/
+    /* keep session_workers processes waiting in accept, each of them runs one
+       session then exits. Font and keys are loaded before forking.
+       Configuration is read again by a worker once it accepted a connection,
+       as when forking on accept, so rdpproxy.ini changes apply to new
+       sessions. */
+    int workers_main_loop(Inifile & ini)
+    {
+        default_font();
+        server_rsakeys();
+
+        int notify[2];
+        if (pipe(notify) < 0){
+            LOG(LOG_ERR, "Listener: can't create workers pipe (%s)\n", strerror(errno));
+            return 1;
+        }
+        LOG(LOG_INFO, "Listener: starting %d session workers\n", ini.globals.session_workers);
+        int missing = ini.globals.session_workers;
+        unsigned retry_delay = 1;
+        while (1) {
+            while (missing > 0 && this->start_worker(notify)){
+                missing--;
+                retry_delay = 1;
+            }
+            /* a byte is received each time a worker accepted a connection
+               ('a') or failed to ('e'), a new worker then replaces it. While
+               some workers could not be forked, forking is retried with a
+               growing delay (up to a minute). */
+            fd_set rfds;
+            FD_ZERO(&rfds);
+            FD_SET(notify[0], &rfds);
+            struct timeval timeout = { retry_delay, 0 };
+            int res = select(notify[0] + 1, &rfds, NULL, NULL, missing ? &timeout : NULL);
+            if (res < 0 && errno == EINTR){
+                continue;
+            }
+            if (res == 0){
+                LOG(LOG_WARNING, "Listener: %d session workers missing, retrying\n", missing);
+                retry_delay = std::min(2 * retry_delay, 60u);
+                continue;
+            }
+            char c;
+            if (res < 0 || 1 != read(notify[0], &c, 1)){
+                LOG(LOG_WARNING, "Listener: workers pipe error (%s)\n", strerror(errno));
+                break;
+            }
+            if (c == 'e'){
+                /* worker exited on accept error, don't respawn in a tight loop */
+                sleep(1);
+            }
+            missing++;
+        }
+        close(notify[0]);
+        close(notify[1]);
+        return 1;
+    }
+
+    /* returns false if worker process could not be created */
+    bool start_worker(int (&notify)[2])
+    {
+        pid_t pid = fork();
+        switch (pid) {
+        case 0: /* child */
+        {
+            close(notify[0]);
+            struct sockaddr_in sin;
+            unsigned int sin_size = sizeof(struct sockaddr_in);
+            int sck = -1;
+            while (sck < 0){
+                sin_size = sizeof(struct sockaddr_in);
+                memset(&sin, 0, sin_size);
+                sck = accept(this->sck, (struct sockaddr*)&sin, &sin_size);
+                /* pending connection reset before it was accepted */
+                if (sck >= 0 || errno == EINTR || errno == ECONNABORTED || errno == EPROTO){
+                    continue;
+                }
+                /* out of descriptors or memory: wait for some to be released
+                   instead of exiting, listener would fork a new worker at once */
+                if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM){
+                    LOG(LOG_WARNING, "Listener: worker accept error (%s), retrying\n", strerror(errno));
+                    sleep(1);
+                    continue;
+                }
+                break;
+            }
+            const int accept_errno = errno;
+            if (1 != write(notify[1], (sck < 0) ? "e" : "a", 1)){
+                LOG(LOG_WARNING, "Listener: worker can't notify listener (%s)\n", strerror(errno));
+            }
+            close(notify[1]);
+            close(this->sck);
+            if (sck < 0){
+                LOG(LOG_INFO, "socket Listener : accept error detected (%s)\n", strerror(accept_errno));
+                exit(0);
+            }
+            try {
+                char ip_source[256];
+                strcpy(ip_source, inet_ntoa(sin.sin_addr));
+                LOG(LOG_INFO, "Setting new session socket to %d\n", sck);
+                Inifile ini(CFG_PATH "/" RDPPROXY_INI);
+                Session session(sck, ip_source, &ini);
+                session.session_main_loop();
+            } catch (...) {
+            };
+            exit(0);
+        }
+        break;
+        case -1:
+            // error forking
+            LOG(LOG_ERR, "Error creating process for session worker : %s\n", strerror(errno));
+            return false;
+        default: /* father */
+        break;
+        }
+        return true;
+    }
 };
 
 #endif
@@ -161,6 +161,7 @@ struct Session {
 
     wait_obj * front_event;
     wait_obj * back_event;
+    Reactor reactor;
 
 
     struct client_mod * mod; /* module interface */
@@ -188,10 +189,12 @@ struct Session {
         this->mod = 0;
 
         this->internal_state = SESSION_STATE_ENTRY;
-        this->front_event = new wait_obj(sck);
-
         /* create these when up and running */
         this->trans = new SocketTransport("RDP Client", sck, this->ini->globals.debug.front);
+        // session loop flushes front queue when socket is writable
+        this->trans->send_queueing = true;
+        this->trans->send_high_water = this->ini->globals.send_queue_high_water;
+        this->front_event = new wait_obj(sck, this->trans);
 
         /* set non blocking */
         int rv = 0;
@@ -249,12 +252,9 @@ struct Session {
         try {
             int previous_state = SESSION_STATE_STOP;
             while (1) {
-                int timeout = 50;
-                static struct timeval time_mark = { 0, 0 };
-                if (time_mark.tv_sec == 0 && time_mark.tv_usec < 500){
-                    time_mark.tv_sec = timeout / 1000;
-                    time_mark.tv_usec = (timeout % 1000) * 1000;
-                }
+                // longest sleep when nothing happens, sockets and timer
+                // objects wake up reactor as soon as they are ready
+                const struct timeval time_mark = { 1, 0 };
                 switch (this->internal_state)
                 {
                     case SESSION_STATE_ENTRY:
@@ -288,6 +288,10 @@ struct Session {
                         this->internal_state = this->step_STATE_CLOSE_CONNECTION(time_mark);
                     break;
                 }
+                // data queued for client is sent as soon as its socket is writable
+                if (this->trans->has_queued_output() && this->front_event->can_send()){
+                    this->trans->send_queue(NULL, 0);
+                }
                 if (this->internal_state == SESSION_STATE_STOP){
                     if (this->verbose){
                         LOG(LOG_INFO, "Session::Session::session_main_loop::stop required()");
@@ -301,6 +305,14 @@ struct Session {
             rv = 1;
         };
         LOG(LOG_INFO, "Session::Client Session Disconnected\n");
+        if (this->verbose){
+            LOG(LOG_INFO, "Session::reactor waits=%llu syscalls=%llu",
+                (unsigned long long)this->reactor.nb_waits,
+                (unsigned long long)this->reactor.nb_syscalls);
+            LOG(LOG_INFO, "Session::front PDUs=%llu recv syscalls=%llu",
+                (unsigned long long)this->trans->total_pdu_received,
+                (unsigned long long)this->trans->total_recv_syscalls);
+        }
         this->front->stop_capture();
         if (this->sck){
             shutdown(this->sck, 2);
@@ -314,20 +326,9 @@ struct Session {
         if (this->verbose){
             LOG(LOG_INFO, "Session::step_STATE_ENTRY(%u.%0.6u)", time_mark.tv_sec, time_mark.tv_usec);
         }
-        unsigned max = 0;
-        fd_set rfds;
-        fd_set wfds;
-
-        FD_ZERO(&rfds);
-        FD_ZERO(&wfds);
-        struct timeval timeout = time_mark;
-
-        this->front_event->add_to_fd_set(rfds, max);
-        select(max + 1, &rfds, &wfds, 0, &timeout);
+        this->reactor.add(this->front_event);
+        this->reactor.wait(URT(time_mark).usec());
 
-        if (this->verbose){
-            LOG(LOG_INFO, "Session::step_STATE_ENTRY::timeout=%u.%0.6u", timeout.tv_sec, timeout.tv_usec);
-        }
         if (this->front_event->is_set()) {
             try {
                 this->front->incoming(*this->mod);
@@ -352,18 +353,10 @@ struct Session {
         if (this->verbose){
             LOG(LOG_INFO, "Session::step_STATE_WAITING_FOR_NEXT_MODULE(%u.%0.6u)", time_mark.tv_sec, time_mark.tv_usec);
         }
-        unsigned max = 0;
-        fd_set rfds;
-        fd_set wfds;
-
-        FD_ZERO(&rfds);
-        FD_ZERO(&wfds);
-
-        struct timeval timeout = time_mark;
+        this->reactor.add(this->front_event);
+        this->sesman->add_to_reactor(this->reactor);
+        this->reactor.wait(URT(time_mark).usec());
 
-        this->front_event->add_to_fd_set(rfds, max);
-        this->sesman->add_to_fd_set(rfds, max);
-        select(max + 1, &rfds, &wfds, 0, &timeout);
         if (this->front_event->is_set()) { /* incoming client data */
             try {
                 this->front->incoming(*this->mod);
@@ -389,19 +382,10 @@ struct Session {
         if (this->verbose){
             LOG(LOG_INFO, "Session::step_STATE_WAITING_FOR_CONTEXT(%u.%0.6u)", time_mark.tv_sec, time_mark.tv_usec);
         }
-        unsigned max = 0;
-        fd_set rfds;
-        fd_set wfds;
-
-        FD_ZERO(&rfds);
-        FD_ZERO(&wfds);
-
         TODO(" we should manage some **real** timeout here  if context didn't answered in time  then we should close session.")
-        struct timeval timeout = { 1, 0 };
-
-        this->front_event->add_to_fd_set(rfds, max);
-        this->sesman->add_to_fd_set(rfds, max);
-        select(max + 1, &rfds, &wfds, 0, &timeout);
+        this->reactor.add(this->front_event);
+        this->sesman->add_to_reactor(this->reactor);
+        this->reactor.wait(URT(time_mark).usec());
 
         if (this->front_event->is_set()) { /* incoming client data */
             try {
@@ -429,22 +413,16 @@ struct Session {
         if (this->verbose > 1000){
             LOG(LOG_INFO, "Session::step_STATE_RUNNING(%u.%0.6u)", time_mark.tv_sec, time_mark.tv_usec);
         }
-        unsigned max = 0;
-        fd_set rfds;
-        fd_set wfds;
-
-        FD_ZERO(&rfds);
-        FD_ZERO(&wfds);
-
-        struct timeval timeout = time_mark;
-
-        this->front_event->add_to_fd_set(rfds, max);
-        if (this->front->up_and_running){
-            this->back_event->add_to_fd_set(rfds, max);
+        this->reactor.add(this->front_event);
+        // back end is not read while client does not take what was already
+        // sent to it, server is then slowed down by TCP flow control
+        const bool congested = this->trans->congested();
+        if (this->front->up_and_running && !congested){
+            this->reactor.add(this->back_event);
         }
-        this->sesman->add_to_fd_set(rfds, max);
-
-        select(max + 1, &rfds, &wfds, 0, &timeout);
+        this->sesman->add_to_reactor(this->reactor);
+        // keep alive and end of session are checked at least every second
+        this->reactor.wait(this->front->periodic_snapshot_delay(URT(time_mark).usec()));
 
         time_t timestamp = time(NULL);
         this->front->periodic_snapshot(this->mod->get_pointer_displayed());
@@ -476,12 +454,15 @@ struct Session {
         }
 
         // data incoming from server module
-        if (this->front->up_and_running && this->back_event->is_set()){
+        if (this->front->up_and_running && !congested && this->back_event->is_set()){
             this->back_event->reset();
             if (this->verbose){
                 LOG(LOG_INFO, "Session::back_event fired");
             }
+            // PDUs sent to client for one back end event go out together
+            this->trans->cork();
             BackEvent_t signal = this->mod->draw_event();
+            this->trans->uncork();
             switch (signal){
             case BACK_EVENT_NONE:
                 // continue with same module
@@ -505,6 +486,7 @@ struct Session {
                                                     record_video, keep_alive);
                 if (next_state != MCTX_STATUS_WAITING){
                     this->internal_state = SESSION_STATE_STOP;
+                    this->back_event->trans = 0;
                     delete this->mod;
                     this->mod = this->no_mod;
                     this->session_setup_mod(next_state, this->context);
@@ -526,6 +508,8 @@ struct Session {
                 }
                // end the current module and switch to new one
                 if (this->mod != this->no_mod){
+                    // back event must not use transport of deleted module
+                    this->back_event->trans = 0;
                     delete this->mod;
                     this->mod = this->no_mod;
                 }
@@ -605,19 +589,9 @@ struct Session {
             LOG(LOG_INFO, "Session::step_STATE_CLOSE_CONNECTION(%u.%0.6u)", time_mark.tv_sec, time_mark.tv_usec);
         }
 
-        struct timeval timeout = time_mark;
-
-        unsigned max = 0;
-        fd_set rfds;
-        fd_set wfds;
-
-        FD_ZERO(&rfds);
-        FD_ZERO(&wfds);
-
-        this->front_event->add_to_fd_set(rfds, max);
-        this->back_event->add_to_fd_set(rfds, max);
-
-        select(max + 1, &rfds, &wfds, 0, &timeout);
+        this->reactor.add(this->front_event);
+        this->reactor.add(this->back_event);
+        this->reactor.wait(URT(time_mark).usec());
 
         if (this->back_event->is_set()) {
             return SESSION_STATE_STOP;
@@ -842,7 +816,8 @@ struct Session {
                                         *this->context,
                                         *this->front,
                                         this->front->client_info.width,
-                                        this->front->client_info.height
+                                        this->front->client_info.height,
+                                        this->ini->globals.selector_local_index
                                         );
                         if (this->verbose){
                             LOG(LOG_INFO, "Session::internal module 'selector' ready");
@@ -872,11 +847,18 @@ struct Session {
                 else {
                     this->context->cpy(STRAUTHID_AUTH_ERROR_MESSAGE, "failed authentification on remote X host");
                 }
-                this->back_event = new wait_obj(t->sck);
+                this->back_event = new wait_obj(t->sck, t);
                 this->front->init_mod();
+                // shared memory framebuffer only from a local X side, and
+                // only if enabled: X side keeps sending paint orders otherwise
+                uid_t x_uid = (uid_t)-1;
+                if (this->ini->globals.xup_shm){
+                    xup_mod::local_peer_uid(t->sck, x_uid);
+                }
                 this->mod = new xup_mod(t, *this->context, *(this->front),
                                         this->front->client_info.width,
-                                        this->front->client_info.height);
+                                        this->front->client_info.height,
+                                        x_uid);
                 this->mod->draw_event();
 //                    this->mod->rdp_input_invalidate(Rect(0, 0, this->front->get_client_info().width, this->front->get_client_info().height));
                 this->context->cpy(STRAUTHID_AUTH_ERROR_MESSAGE, "");
@@ -913,8 +895,7 @@ struct Session {
                 else {
                     this->context->cpy(STRAUTHID_AUTH_ERROR_MESSAGE, "failed authentification on remote RDP host");
                 }
-                TODO("Wait obj should work with transport object, not directly with socket")
-                this->back_event = new wait_obj(t->sck);
+                this->back_event = new wait_obj(t->sck, t);
                 // enable or disable clipboard
                 // this->context->get_bool(STRAUTHID_OPT_CLIPBOARD)
                 // enable or disable device redirection
@@ -931,7 +912,8 @@ struct Session {
                                     true,
                                     info,
                                     &this->gen,
-                                    this->ini->globals.debug.mod_rdp);
+                                    this->ini->globals.debug.mod_rdp,
+                                    this->ini->globals.rdp_server_compression);
                 this->back_event->set();
 
                 this->mod->rdp_input_invalidate(Rect(0, 0, this->front->client_info.width, this->front->client_info.height));
@@ -961,7 +943,7 @@ struct Session {
                 else {
                     this->context->cpy(STRAUTHID_AUTH_ERROR_MESSAGE, "failed authentification on remote VNC host");
                 }
-                this->back_event = new wait_obj(t->sck);
+                this->back_event = new wait_obj(t->sck, t);
                 this->front->init_mod();
                 this->mod = new mod_vnc(t,
                     this->back_event,
@@ -972,7 +954,8 @@ struct Session {
                     this->front->client_info.height,
                     this->front->client_info.keylayout,
                     this->front->keymap.key_flags,
-                    this->ini->globals.debug.mod_vnc);
+                    this->ini->globals.debug.mod_vnc,
+                    this->ini->globals.vnc_pipeline);
                 this->mod->draw_event();
 //                    this->mod->rdp_input_invalidate(Rect(0, 0, this->front->get_client_info().width, this->front->get_client_info().height));
                 if (this->verbose){
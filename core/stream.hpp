@@ -42,6 +42,70 @@ enum {
      AUTOSIZE = 8192
 };
 
+// Buffers of Streams larger than AUTOSIZE come from a pool of size classes
+// (16 KB to 128 KB, larger buffers are not pooled). A Stream holds its buffer
+// as a lease given back by destructor or by init() to another size, hence
+// Streams created for each PDU reuse the same few buffers instead of doing a
+// malloc/free pair each time. There is one pool per thread (a session is a
+// process, hence per session).
+struct StreamBufferPool {
+    enum {
+        MIN_CLASS_SHIFT = 14, // 16 KB
+        NB_CLASSES = 4,       // 16, 32, 64 and 128 KB
+        MAX_CACHED = 4        // free buffers kept by size class
+    };
+
+    uint8_t * cached[NB_CLASSES][MAX_CACHED];
+    size_t nb_cached[NB_CLASSES];
+    bool disabled; // every buffer is allocated then freed (benchmarks)
+
+    // statistics
+    uint64_t nb_acquired;
+    uint64_t nb_allocated; // acquired buffers that were allocated on heap
+
+    static int size_class(size_t size)
+    {
+        for (int c = 0; c < NB_CLASSES; c++){
+            if (size <= ((size_t)1 << (MIN_CLASS_SHIFT + c))){
+                return c;
+            }
+        }
+        return -1;
+    }
+
+    uint8_t * acquire(size_t size)
+    {
+        this->nb_acquired++;
+        int c = size_class(size);
+        if (c < 0){
+            this->nb_allocated++;
+            return new uint8_t[size];
+        }
+        if (this->nb_cached[c] > 0){
+            return this->cached[c][--this->nb_cached[c]];
+        }
+        this->nb_allocated++;
+        return new uint8_t[(size_t)1 << (MIN_CLASS_SHIFT + c)];
+    }
+
+    void release(uint8_t * buffer, size_t size)
+    {
+        int c = size_class(size);
+        if (c >= 0 && !this->disabled && this->nb_cached[c] < MAX_CACHED){
+            this->cached[c][this->nb_cached[c]++] = buffer;
+            return;
+        }
+        delete [] buffer;
+    }
+};
+
+// zero initialized, buffers cached by a thread are not freed when it ends
+inline StreamBufferPool & stream_buffer_pool()
+{
+    static __thread StreamBufferPool pool;
+    return pool;
+}
+
 /* parser state */
 class Stream {
     public:
@@ -58,7 +122,7 @@ class Stream {
     ~Stream() {
         if (this->capacity > AUTOSIZE) {
 //            LOG(LOG_DEBUG, "Stream buffer freed : size=%d @%p\n", this->capacity, this->data);
-            delete [] this->data;
+            stream_buffer_pool().release(this->data, this->capacity);
         }
     }
 
@@ -68,11 +132,11 @@ class Stream {
             try {
                 if (this->capacity > AUTOSIZE){
 //                    LOG(LOG_DEBUG, "Stream buffer freed : size=%d @%p\n", this->capacity, this->data);
-                    delete [] this->data;
+                    stream_buffer_pool().release(this->data, this->capacity);
                 }
                 if (v > AUTOSIZE){
 //                    LOG(LOG_DEBUG, "Stream buffer allocation succeeded : size=%d @%p\n", v, this->data);
-                    this->data = new uint8_t[v];
+                    this->data = stream_buffer_pool().acquire(v);
                 }
                 else {
                     this->data = &(this->autobuffer[0]);
@@ -25,12 +25,14 @@
 
 #include <sys/types.h> // recv, send
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/un.h>
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <algorithm>
 #include </usr/include/openssl/ssl.h>
 #include </usr/include/openssl/err.h>
 
@@ -45,6 +47,8 @@ public:
     uint64_t total_sent;
     uint64_t last_quantum_sent;
     uint64_t quantum_count;
+    uint64_t total_recv_syscalls; // syscalls done by recv()
+    uint64_t total_pdu_received;  // PDUs read by X224In and FastPathIn
     bool status;
 
     Transport() :
@@ -53,6 +57,8 @@ public:
         total_sent(0),
         last_quantum_sent(0),
         quantum_count(0),
+        total_recv_syscalls(0),
+        total_pdu_received(0),
         status(true)
     {}
 
@@ -72,6 +78,21 @@ public:
     }
     virtual void recv(char ** pbuffer, size_t len) throw (Error) = 0;
     virtual void send(const char * const buffer, size_t len) throw (Error) = 0;
+    // true if transport already holds received data not read yet
+    virtual bool has_pending() const
+    {
+        return false;
+    }
+    // true if transport holds data waiting for socket to be writable
+    virtual bool has_queued_output() const
+    {
+        return false;
+    }
+    // true if peer does not take sent data fast enough
+    virtual bool congested() const
+    {
+        return false;
+    }
     void send(const uint8_t * const buffer, size_t len) throw (Error) {
         this->send(reinterpret_cast<const char * const>(buffer), len);
     }
@@ -345,13 +366,46 @@ class SocketTransport : public Transport {
         bool tls;
         SSL * ssl;
     public:
+        enum {
+            RECV_BUFFER_SIZE = 65536,
+            SEND_HIGH_WATER = 524288
+        };
+
         int sck;
         int sck_closed;
         const char * name;
         uint32_t verbose;
 
-    SocketTransport(const char * name, int sck, uint32_t verbose)
+        // receive buffer, data not read yet is between rbuf_begin and rbuf_end
+        char * rbuf;
+        size_t rbuf_size;
+        size_t rbuf_begin;
+        size_t rbuf_end;
+
+        // send queue (TCP only), data not sent yet is between sbuf_begin and sbuf_end
+        char * sbuf;
+        size_t sbuf_capacity;
+        size_t sbuf_begin;
+        size_t sbuf_end;
+        bool corked;
+        bool send_queueing;     // false: send blocks until socket took all data
+        size_t send_high_water;
+
+    // recv_buffer_size 0 disables receive buffer
+    SocketTransport(const char * name, int sck, uint32_t verbose,
+                    size_t recv_buffer_size = RECV_BUFFER_SIZE)
         : Transport(), name(name), verbose(verbose)
+        , rbuf(recv_buffer_size?new char[recv_buffer_size]:NULL)
+        , rbuf_size(recv_buffer_size)
+        , rbuf_begin(0)
+        , rbuf_end(0)
+        , sbuf(NULL)
+        , sbuf_capacity(0)
+        , sbuf_begin(0)
+        , sbuf_end(0)
+        , corked(false)
+        , send_queueing(false)
+        , send_high_water(SEND_HIGH_WATER)
     {
         this->ssl = NULL;
         this->tls = false;
@@ -363,6 +417,8 @@ class SocketTransport : public Transport {
         if (!this->sck_closed){
             this->disconnect();
         }
+        delete [] this->rbuf;
+        delete [] this->sbuf;
     }
 
 
@@ -393,6 +449,16 @@ class SocketTransport : public Transport {
 
         LOG(LOG_INFO, "Transport::SSL_set_fd()");
         SSL_set_fd(this->ssl, this->sck);
+
+        if (this->rbuf_end > this->rbuf_begin){
+            LOG(LOG_WARNING, "Transport::enable_tls() %u bytes received before TLS negotiation are lost",
+                (unsigned)(this->rbuf_end - this->rbuf_begin));
+            this->rbuf_begin = this->rbuf_end = 0;
+        }
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+        // a whole bunch of records is read at once, has_pending() knows about them
+        SSL_set_read_ahead(this->ssl, 1);
+#endif
         LOG(LOG_INFO, "Transport::SSL_connect()");
     again:
         int connection_status = SSL_connect(ssl);
@@ -574,6 +640,13 @@ class SocketTransport : public Transport {
 
     void disconnect(){
         LOG(LOG_INFO, "Socket %s (%d) : closing connection\n", this->name, this->sck);
+        if (this->queued() && !this->sck_closed){
+            try {
+                this->wait_send_queue(0);
+            }
+            catch (...) {
+            }
+        }
         if (this->sck != 0) {
             shutdown(this->sck, 2);
             close(this->sck);
@@ -590,59 +663,127 @@ class SocketTransport : public Transport {
 
     using Transport::recv;
 
-    virtual void recv(char ** pbuffer, size_t len) throw (Error)
-    {
-        if (this->tls){
-            this->recv_tls(pbuffer, len);
-        }
-        else {
-            this->recv_tcp(pbuffer, len);
-        }
-    }
-
-    void recv_tls(char ** input_buffer, size_t total_len) throw (Error)
+    // Reads are served from receive buffer, filled with as much data as
+    // socket (or TLS layer) has ready: reading a PDU header then its payload
+    // usually costs one syscall or none. Reads larger than buffer bypass it.
+    virtual void recv(char ** input_buffer, size_t total_len) throw (Error)
     {
         if (this->verbose & 0x100){
-            LOG(LOG_INFO, "TLS Socket %s (%u) receiving %u bytes", this->name, this->sck, total_len);
+            LOG(LOG_INFO, "%sSocket %s (%u) receiving %u bytes", this->tls?"TLS ":"", this->name, this->sck, total_len);
         }
         char * start = *input_buffer;
         size_t len = total_len;
         char * pbuffer = *input_buffer;
-        unsigned long error;
 
         if (this->sck_closed) {
-            LOG(LOG_INFO, "TLS Socket %s (%u) already closed", this->name, this->sck);
+            LOG(LOG_INFO, "Socket %s (%u) already closed", this->name, this->sck);
             throw Error(ERR_SOCKET_ALLREADY_CLOSED);
         }
 
         while (len > 0) {
-            ssize_t rcvd = ::SSL_read(this->ssl, pbuffer, len);
+            size_t buffered = this->rbuf_end - this->rbuf_begin;
+            if (buffered > 0){
+                size_t n = (buffered < len)?buffered:len;
+                memcpy(pbuffer, this->rbuf + this->rbuf_begin, n);
+                this->rbuf_begin += n;
+                pbuffer += n;
+                len -= n;
+                continue;
+            }
+            this->rbuf_begin = 0;
+            this->rbuf_end = 0;
+            if (len >= this->rbuf_size){
+                size_t rcvd = this->recv_some(pbuffer, len);
+                pbuffer += rcvd;
+                len -= rcvd;
+            }
+            else {
+                this->rbuf_end = this->recv_some(this->rbuf, this->rbuf_size);
+            }
+        }
+
+        if (this->verbose & 0x100){
+            LOG(LOG_INFO, "Recv done on %s (%u) %u bytes", this->name, this->sck, total_len);
+            hexdump_c(start, total_len);
+            LOG(LOG_INFO, "Dump done on %s (%u) %u bytes", this->name, this->sck, total_len);
+        }
+
+        *input_buffer = pbuffer;
+        total_received += total_len;
+        last_quantum_received += total_len;
+    }
+
+    // true if some received data can be read without waiting on socket
+    virtual bool has_pending() const
+    {
+        if (this->rbuf_end > this->rbuf_begin){
+            return true;
+        }
+        if (this->tls && this->ssl){
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+            return SSL_has_pending(this->ssl);
+#else
+            return SSL_pending(this->ssl) > 0;
+#endif
+        }
+        return false;
+    }
+
+    // receives at least one byte and at most len bytes
+    size_t recv_some(char * buffer, size_t len) throw (Error)
+    {
+        // peer may wait for queued data before sending anything: send what
+        // socket takes while waiting for data, not the whole queue
+        while (this->queued() && !this->has_pending()){
+            this->send_queue(NULL, 0);
+            if (!this->queued() || this->wait_socket_flushing()){
+                break;
+            }
+        }
+        if (this->tls){
+            return this->recv_tls(buffer, len);
+        }
+        return this->recv_tcp(buffer, len);
+    }
+
+    size_t recv_tls(char * buffer, size_t len) throw (Error)
+    {
+        unsigned long error;
+        size_t total = 0;
+
+        for (;;) {
+            // data already in TLS layer costs no syscall
+            if (!this->has_pending()){
+                this->total_recv_syscalls++;
+            }
+            ssize_t rcvd = ::SSL_read(this->ssl, buffer + total, len - total);
             switch (SSL_get_error(this->ssl, rcvd)) {
                 case SSL_ERROR_NONE:
-//                    LOG(LOG_INFO, "recv_tls ERROR NONE");
-                    pbuffer += rcvd;
-                    len -= rcvd;
+                    total += rcvd;
+                    if (total == len || SSL_pending(this->ssl) == 0){
+                        return total;
+                    }
                     break;
 
                 case SSL_ERROR_WANT_READ:
                     LOG(LOG_INFO, "recv_tls WANT READ");
-                    continue;
+                    break;
 
                 case SSL_ERROR_WANT_WRITE:
                     LOG(LOG_INFO, "recv_tls WANT WRITE");
-                    continue;
+                    break;
 
                 case SSL_ERROR_WANT_CONNECT:
                     LOG(LOG_INFO, "recv_tls WANT CONNECT");
-                    continue;
+                    break;
 
                 case SSL_ERROR_WANT_ACCEPT:
                     LOG(LOG_INFO, "recv_tls WANT ACCEPT");
-                    continue;
+                    break;
 
                 case SSL_ERROR_WANT_X509_LOOKUP:
                     LOG(LOG_INFO, "recv_tls WANT X509 LOOKUP");
-                    continue;
+                    break;
 
                 case SSL_ERROR_ZERO_RETURN:
                     LOG(LOG_INFO, "recv_tls ZERO RETURN");
@@ -669,33 +810,13 @@ class SocketTransport : public Transport {
                 break;
             }
         }
-
-        if (this->verbose & 0x100){
-            LOG(LOG_INFO, "Recv done on %s (%u) %u bytes", this->name, this->sck, total_len);
-            hexdump_c(start, total_len);
-            LOG(LOG_INFO, "Dump done on %s (%u) %u bytes", this->name, this->sck, total_len);
-        }
-        *input_buffer = pbuffer;
-        total_received += total_len;
-        last_quantum_received += total_len;
     }
 
-    void recv_tcp(char ** input_buffer, size_t total_len) throw (Error)
+    size_t recv_tcp(char * buffer, size_t len) throw (Error)
     {
-        if (this->verbose & 0x100){
-            LOG(LOG_INFO, "Socket %s (%u) receiving %u bytes", this->name, this->sck, total_len);
-        }
-        char * start = *input_buffer;
-        size_t len = total_len;
-        char * pbuffer = *input_buffer;
-
-        if (this->sck_closed) {
-            LOG(LOG_INFO, "Socket %s (%u) already closed", this->name, this->sck);
-            throw Error(ERR_SOCKET_ALLREADY_CLOSED);
-        }
-
-        while (len > 0) {
-            ssize_t rcvd = ::recv(this->sck, pbuffer, len, 0);
+        for (;;) {
+            this->total_recv_syscalls++;
+            ssize_t rcvd = ::recv(this->sck, buffer, len, 0);
             switch (rcvd) {
                 case -1: /* error, maybe EAGAIN */
                     if (!this->try_again(errno)) {
@@ -704,11 +825,8 @@ class SocketTransport : public Transport {
                         throw Error(ERR_SOCKET_ERROR, errno);
                     }
                     else {
-                        fd_set fds;
-                        struct timeval time = { 0, 100000 };
-                        FD_ZERO(&fds);
-                        FD_SET(this->sck, &fds);
-                        select(this->sck + 1, &fds, NULL, NULL, &time);
+                        this->total_recv_syscalls++;
+                        this->wait_socket(false);
                     }
                     break;
                 case 0: /* no data received, socket closed */
@@ -716,24 +834,12 @@ class SocketTransport : public Transport {
                     this->sck_closed = 1;
                     throw Error(ERR_SOCKET_CLOSED);
                 default: /* some data received */
-                    pbuffer += rcvd;
-                    len -= rcvd;
+                    return rcvd;
             }
         }
-
-        if (this->verbose & 0x100){
-            LOG(LOG_INFO, "Recv done on %s (%u) %u bytes", this->name, this->sck, total_len);
-            hexdump_c(start, total_len);
-            LOG(LOG_INFO, "Dump done on %s (%u) %u bytes", this->name, this->sck, total_len);
-        }
-
-        *input_buffer = pbuffer;
-        total_received += total_len;
-        last_quantum_received += total_len;
     }
 
 
-
     using Transport::send;
 
     virtual void send(const char * const buffer, size_t len) throw (Error)
@@ -776,10 +882,12 @@ class SocketTransport : public Transport {
 
                 case SSL_ERROR_WANT_READ:
                     LOG(LOG_INFO, "send_tls WANT READ");
+                    this->wait_socket(false);
                     continue;
 
                 case SSL_ERROR_WANT_WRITE:
                     LOG(LOG_INFO, "send_tls WANT WRITE");
+                    this->wait_socket(true);
                     continue;
 
                 default:
@@ -806,6 +914,13 @@ class SocketTransport : public Transport {
 
     }
 
+    // With send_queueing, data the socket can't take at once is queued
+    // instead of blocking session: queued data is sent (along with next data,
+    // using a single sendmsg) when socket is writable again. Once queue is
+    // above send_high_water, peer is congested and session stops feeding it,
+    // send only blocks when queue is 4 times over high water mark.
+    // Only a transport whose owner flushes the queue when socket is writable
+    // should enable it, other ones block until all data is sent.
     void send_tcp(const char * const buffer, size_t len) throw (Error)
     {
         if (this->verbose & 0x100){
@@ -817,39 +932,163 @@ class SocketTransport : public Transport {
             LOG(LOG_INFO, "Socket already closed on %s (%u)", this->name, this->sck);
             throw Error(ERR_SOCKET_ALLREADY_CLOSED);
         }
-        size_t total = 0;
-        while (total < len) {
-            ssize_t sent = ::send(this->sck, buffer + total, len - total, 0);
-            switch (sent){
-            case -1:
-                if (!this->try_again(errno)) {
-                    this->sck_closed = 1;
-                    LOG(LOG_INFO, "Socket %s (%u) : %s", this->name, this->sck, strerror(errno));
-                    throw Error(ERR_SOCKET_ERROR, errno);
-                }
-                else {
-                    fd_set fds;
-                    struct timeval time = { 0, 100000 };
-                    FD_ZERO(&fds);
-                    FD_SET(this->sck, &fds);
-                    select(this->sck + 1, NULL, &fds, NULL, &time);
-                }
-                break;
-            case 0:
-                this->sck_closed = 1;
-                LOG(LOG_INFO, "Socket %s (%u) closed on sending : %s", this->name, this->sck, strerror(errno));
-                throw Error(ERR_SOCKET_CLOSED, errno);
-            default:
-                total = total + sent;
-            }
+        size_t sent = 0;
+        if (!this->corked){
+            sent = this->send_queue(buffer, len);
+        }
+        if (sent < len){
+            this->queue(buffer + sent, len - sent);
         }
         total_sent += len;
         last_quantum_sent += len;
+        if (!this->send_queueing){
+            if (!this->corked){
+                this->wait_send_queue(0);
+            }
+        }
+        else if (this->queued() > 4 * this->send_high_water){
+            this->wait_send_queue(this->send_high_water);
+        }
         if (this->verbose & 0x100){
             LOG(LOG_INFO, "Send done on %s (%u)", this->name, this->sck);
         }
     }
 
+    // while corked, sent data is only queued, uncork() sends it all at once
+    void cork()
+    {
+        this->corked = true;
+    }
+
+    void uncork() throw (Error)
+    {
+        this->corked = false;
+        if (this->queued() && !this->sck_closed){
+            this->send_queue(NULL, 0);
+        }
+    }
+
+    size_t queued() const
+    {
+        return this->sbuf_end - this->sbuf_begin;
+    }
+
+    virtual bool has_queued_output() const
+    {
+        return this->queued() > 0;
+    }
+
+    bool congested() const
+    {
+        return this->queued() >= this->send_high_water;
+    }
+
+    // sends what socket can take right now of queue then of data (without
+    // blocking), returns bytes of data sent
+    size_t send_queue(const char * data, size_t len) throw (Error)
+    {
+        size_t data_sent = 0;
+        while (this->queued() || data_sent < len){
+            struct iovec iov[2];
+            size_t nb_iov = 0;
+            if (this->queued()){
+                iov[nb_iov].iov_base = this->sbuf + this->sbuf_begin;
+                iov[nb_iov].iov_len = this->queued();
+                nb_iov++;
+            }
+            if (data_sent < len){
+                iov[nb_iov].iov_base = const_cast<char *>(data + data_sent);
+                iov[nb_iov].iov_len = len - data_sent;
+                nb_iov++;
+            }
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nb_iov;
+            ssize_t sent = ::sendmsg(this->sck, &msg, MSG_DONTWAIT);
+            if (sent < 0){
+                if (errno == EINTR){
+                    continue;
+                }
+                if (errno == EAGAIN){
+                    break;
+                }
+                this->sck_closed = 1;
+                LOG(LOG_INFO, "Socket %s (%u) : %s", this->name, this->sck, strerror(errno));
+                throw Error(ERR_SOCKET_ERROR, errno);
+            }
+            size_t from_queue = std::min((size_t)sent, this->queued());
+            this->sbuf_begin += from_queue;
+            data_sent += sent - from_queue;
+        }
+        if (!this->queued()){
+            this->sbuf_begin = this->sbuf_end = 0;
+        }
+        return data_sent;
+    }
+
+    // blocks until no more than limit bytes are queued
+    void wait_send_queue(size_t limit) throw (Error)
+    {
+        while (this->queued() > limit){
+            this->send_queue(NULL, 0);
+            if (this->queued() > limit){
+                this->wait_socket(true);
+            }
+        }
+    }
+
+    void queue(const char * data, size_t len)
+    {
+        if (this->sbuf_end + len > this->sbuf_capacity){
+            size_t waiting = this->queued();
+            if (waiting + len <= this->sbuf_capacity){
+                memmove(this->sbuf, this->sbuf + this->sbuf_begin, waiting);
+            }
+            else {
+                size_t capacity = std::max((size_t)16384, 2 * (waiting + len));
+                char * sbuf = new char[capacity];
+                if (waiting){
+                    memcpy(sbuf, this->sbuf + this->sbuf_begin, waiting);
+                }
+                delete [] this->sbuf;
+                this->sbuf = sbuf;
+                this->sbuf_capacity = capacity;
+            }
+            this->sbuf_begin = 0;
+            this->sbuf_end = waiting;
+        }
+        memcpy(this->sbuf + this->sbuf_end, data, len);
+        this->sbuf_end += len;
+    }
+
+    // waits (at most 100 ms) for socket to be readable or writable
+    void wait_socket(bool write)
+    {
+        fd_set fds;
+        struct timeval time = { 0, 100000 };
+        FD_ZERO(&fds);
+        FD_SET(this->sck, &fds);
+        select(this->sck + 1, write?NULL:&fds, write?&fds:NULL, NULL, &time);
+    }
+
+    // waits (at most 100 ms) for socket to be readable or writable, true if
+    // there is something to read
+    bool wait_socket_flushing()
+    {
+        fd_set rfds;
+        fd_set wfds;
+        struct timeval time = { 0, 100000 };
+        FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
+        FD_SET(this->sck, &rfds);
+        FD_SET(this->sck, &wfds);
+        if (select(this->sck + 1, &rfds, &wfds, NULL, &time) <= 0){
+            return false;
+        }
+        return FD_ISSET(this->sck, &rfds);
+    }
+
     private:
 
 };
@@ -905,6 +1144,17 @@ class ClientSocketTransport : public Transport {
             return;
         }
         this->st->recv(pbuffer, len);
+        this->total_recv_syscalls = this->st->total_recv_syscalls;
+    }
+
+    virtual bool has_pending() const
+    {
+        return this->st && this->st->has_pending();
+    }
+
+    virtual bool has_queued_output() const
+    {
+        return this->st && this->st->has_queued_output();
     }
 
     virtual void enable_tls() throw (Error)
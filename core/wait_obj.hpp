@@ -18,15 +18,29 @@
    Author(s): Christophe Grosjean, Javier Caverni
    Based on xrdp Copyright (C) Jay Sorg 2004-2010
 
-   Synchronisation objects
+   Synchronisation objects, and Reactor waiting for a set of them
+   (epoll for sockets, timerfd for timer objects)
 
 */
 
 #if !defined(__WAIT_OBJS_HPP__)
 #define __WAIT_OBJS_HPP__
 
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "log.hpp"
 #include "error.hpp"
 #include "urt.hpp"
+#include "difftimeval.hpp"
+#include "transport.hpp"
+
+class Reactor;
 
 class wait_obj
 {
@@ -34,21 +48,18 @@ class wait_obj
     int obj;
     bool set_state;
     URT trigger_time;
-    wait_obj(int sck) : obj(sck), set_state(false), trigger_time(URT()) {}
+    Reactor * reactor; // reactor watching socket, readiness then comes from it
+    bool ready;        // socket readable at last reactor wait
+    bool writable;     // socket writable at last reactor wait
+    uint32_t events;   // epoll events watched by reactor
+    Transport * trans; // transport using socket, may hold data already received
+                       // or data to send
 
-    ~wait_obj()
-    {
-        if (this->obj > 0){
-            struct sockaddr_un sa;
-            socklen_t sa_size = sizeof(sa);
+    wait_obj(int sck, Transport * trans = 0)
+        : obj(sck), set_state(false), trigger_time(URT()), reactor(0), ready(false)
+        , writable(false), events(0), trans(trans) {}
 
-            if (getsockname(this->obj, (struct sockaddr*)&sa, &sa_size) < 0) {
-                /* socket is in error state : can't close */
-                return;
-            }
-            close(this->obj);
-        }
-    }
+    ~wait_obj();
 
     void add_to_fd_set(fd_set & rfds, unsigned & max)
     {
@@ -66,6 +77,12 @@ class wait_obj
     bool is_set()
     {
         if (this->obj > 0){
+            if (this->trans && this->trans->has_pending()){
+                return true;
+            }
+            if (this->reactor){
+                return this->ready;
+            }
             return this->can_recv();
         }
         else{
@@ -79,6 +96,13 @@ class wait_obj
         return false;
     }
 
+    // true if queued output of transport may be sent now (without reactor,
+    // we don't know, sending just tries)
+    bool can_send()
+    {
+        return this->reactor ? this->writable : true;
+    }
+
     // Idle time in millisecond
     void set(uint64_t idle_usec = 0)
     {
@@ -114,4 +138,260 @@ class wait_obj
 
 };
 
+// Waits for the wait_obj added since last wait: sockets are kept in an epoll
+// set while they are watched, timer objects deadlines arm a timerfd. wait()
+// only returns when a socket is readable, a timer object is due or max_usec
+// elapsed, is_set() then gives readiness without any other syscall.
+class Reactor
+{
+    enum {
+        MAX_OBJS = 8
+    };
+
+    int epfd;
+    int tfd;
+    wait_obj * watched[MAX_OBJS];    // objects given for next wait
+    size_t nb_watched;
+    wait_obj * registered[MAX_OBJS]; // sockets in epoll set
+    size_t nb_registered;
+    struct timeval armed;            // timerfd deadline, 0 if not armed
+
+    public:
+    // statistics
+    uint64_t nb_waits;
+    uint64_t nb_syscalls;
+
+    Reactor()
+        : nb_watched(0)
+        , nb_registered(0)
+        , nb_waits(0)
+        , nb_syscalls(0)
+    {
+        this->armed.tv_sec = 0;
+        this->armed.tv_usec = 0;
+        this->epfd = epoll_create(MAX_OBJS + 1);
+        if (this->epfd < 0){
+            LOG(LOG_ERR, "Reactor: epoll_create failed: %s", strerror(errno));
+            throw Error(ERR_REACTOR);
+        }
+        this->tfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK);
+        if (this->tfd < 0){
+            LOG(LOG_ERR, "Reactor: timerfd_create failed: %s", strerror(errno));
+            close(this->epfd);
+            throw Error(ERR_REACTOR);
+        }
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = 0;
+        epoll_ctl(this->epfd, EPOLL_CTL_ADD, this->tfd, &ev);
+    }
+
+    ~Reactor()
+    {
+        for (size_t i = 0; i < this->nb_registered; i++){
+            this->registered[i]->reactor = 0;
+        }
+        close(this->tfd);
+        close(this->epfd);
+    }
+
+    void add(wait_obj * obj)
+    {
+        if (obj && this->nb_watched < MAX_OBJS){
+            this->watched[this->nb_watched++] = obj;
+        }
+    }
+
+    // called when a watched wait_obj is destroyed (before closing socket)
+    void forget(wait_obj * obj)
+    {
+        for (size_t i = 0; i < this->nb_registered; i++){
+            if (this->registered[i] == obj){
+                this->unregister(i);
+                break;
+            }
+        }
+        for (size_t i = 0; i < this->nb_watched; i++){
+            if (this->watched[i] == obj){
+                this->watched[i] = this->watched[--this->nb_watched];
+                break;
+            }
+        }
+    }
+
+    void wait(uint64_t max_usec)
+    {
+        this->nb_waits++;
+
+        // sockets not watched any more leave epoll set
+        for (size_t i = 0; i < this->nb_registered; ){
+            if (!this->is_watched(this->registered[i])){
+                this->unregister(i);
+                continue;
+            }
+            this->registered[i]->ready = false;
+            this->registered[i]->writable = false;
+            i++;
+        }
+
+        URT now;
+        URT deadline = now + URT(max_usec);
+        bool timer = false;
+        for (size_t i = 0; i < this->nb_watched; i++){
+            wait_obj * obj = this->watched[i];
+            if (obj->obj > 0){
+                // socket also watched for writing while transport has queued data
+                uint32_t events = EPOLLIN;
+                if (obj->trans && obj->trans->has_queued_output()){
+                    events |= EPOLLOUT;
+                }
+                if (obj->reactor != this){
+                    this->do_register(obj, events);
+                }
+                else if (obj->events != events){
+                    this->modify(obj, events);
+                }
+                if (obj->trans && obj->trans->has_pending()){
+                    // data already received, only polls other objects
+                    deadline = now;
+                    timer = false;
+                }
+            }
+            else if (obj->set_state && obj->trigger_time < deadline){
+                deadline = obj->trigger_time;
+                timer = true;
+            }
+        }
+        this->nb_watched = 0;
+
+        int timeout_ms = 0;
+        if (now < deadline){
+            if (timer){
+                // timer objects are set when now > trigger_time
+                deadline = deadline + URT(1);
+                this->arm(deadline.tv);
+                timeout_ms = -1;
+            }
+            else {
+                timeout_ms = (difftimeval(deadline.tv, now.tv) + 999) / 1000;
+            }
+        }
+
+        struct epoll_event events[MAX_OBJS + 1];
+        this->nb_syscalls++;
+        int n = epoll_wait(this->epfd, events, MAX_OBJS + 1, timeout_ms);
+        for (int i = 0; i < n; i++){
+            wait_obj * obj = static_cast<wait_obj*>(events[i].data.ptr);
+            if (obj){
+                // errors and hang up are reported as readable, recv will fail
+                if (events[i].events & (EPOLLIN|EPOLLERR|EPOLLHUP)){
+                    obj->ready = true;
+                }
+                if (events[i].events & EPOLLOUT){
+                    obj->writable = true;
+                }
+            }
+            else {
+                uint64_t expirations;
+                this->nb_syscalls++;
+                if (read(this->tfd, &expirations, sizeof(expirations)) > 0){
+                    this->armed.tv_sec = 0;
+                    this->armed.tv_usec = 0;
+                }
+            }
+        }
+    }
+
+    private:
+    bool is_watched(wait_obj * obj)
+    {
+        for (size_t i = 0; i < this->nb_watched; i++){
+            if (this->watched[i] == obj){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void do_register(wait_obj * obj, uint32_t events)
+    {
+        if (this->nb_registered >= MAX_OBJS){
+            return;
+        }
+        if (obj->reactor){
+            obj->reactor->forget(obj);
+        }
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.ptr = obj;
+        this->nb_syscalls++;
+        if (epoll_ctl(this->epfd, EPOLL_CTL_ADD, obj->obj, &ev) < 0){
+            // is_set() falls back to polling socket
+            LOG(LOG_WARNING, "Reactor: can't watch socket %d: %s", obj->obj, strerror(errno));
+            return;
+        }
+        obj->reactor = this;
+        obj->ready = false;
+        obj->writable = false;
+        obj->events = events;
+        this->registered[this->nb_registered++] = obj;
+    }
+
+    void modify(wait_obj * obj, uint32_t events)
+    {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.ptr = obj;
+        this->nb_syscalls++;
+        if (epoll_ctl(this->epfd, EPOLL_CTL_MOD, obj->obj, &ev) == 0){
+            obj->events = events;
+        }
+    }
+
+    void unregister(size_t i)
+    {
+        wait_obj * obj = this->registered[i];
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        this->nb_syscalls++;
+        epoll_ctl(this->epfd, EPOLL_CTL_DEL, obj->obj, &ev);
+        obj->reactor = 0;
+        this->registered[i] = this->registered[--this->nb_registered];
+    }
+
+    void arm(const struct timeval & deadline)
+    {
+        if (deadline.tv_sec == this->armed.tv_sec && deadline.tv_usec == this->armed.tv_usec){
+            return;
+        }
+        struct itimerspec its;
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec = deadline.tv_sec;
+        its.it_value.tv_nsec = deadline.tv_usec * 1000;
+        this->nb_syscalls++;
+        timerfd_settime(this->tfd, TFD_TIMER_ABSTIME, &its, 0);
+        this->armed = deadline;
+    }
+};
+
+inline wait_obj::~wait_obj()
+{
+    if (this->reactor){
+        this->reactor->forget(this);
+    }
+    if (this->obj > 0){
+        struct sockaddr_un sa;
+        socklen_t sa_size = sizeof(sa);
+
+        if (getsockname(this->obj, (struct sockaddr*)&sa, &sa_size) < 0) {
+            /* socket is in error state : can't close */
+            return;
+        }
+        close(this->obj);
+    }
+}
+
 #endif
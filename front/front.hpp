@@ -163,6 +163,7 @@ class Front : public FrontAPI {
 public:
     Capture * capture;
     GraphicsUpdatePDU * orders;
+    rdp_mppc_enc * mppc_enc; // bulk compressor, NULL if not used
     Keymap2 keymap;
     ChannelDefArray channel_list;
     int up_and_running;
@@ -180,7 +181,7 @@ public:
     Inifile * ini;
     uint32_t verbose;
 
-    struct Font font;
+    struct Font & font;
     Cache cache;
 
     bool palette_sent;
@@ -204,6 +205,7 @@ public:
         FrontAPI(ini->globals.notimestamp, ini->globals.nomouse),
         capture(NULL),
         orders(NULL),
+        mppc_enc(NULL),
         up_and_running(0),
         share_id(65538),
         client_info(ini->globals.crypt_level, ini->globals.channel_code, ini->globals.bitmap_compression, ini->globals.bitmap_cache),
@@ -213,7 +215,7 @@ public:
         order_level(0),
         ini(ini),
         verbose(this->ini?this->ini->globals.debug.front:0),
-        font(SHARE_PATH "/" DEFAULT_FONT_NAME),
+        font(default_font()),
         cache(),
         state(CONNECTION_INITIATION),
         gen(gen)
@@ -253,6 +255,9 @@ public:
     }
 
     ~Front(){
+        if (this->mppc_enc){
+            delete this->mppc_enc;
+        }
     }
 
     void init_mod()
@@ -422,10 +427,45 @@ public:
             buffer[255] = 0;
             this->capture = new Capture(width, height, path, codec_id, quality);
             this->capture->set_prefix(buffer, strlen(buffer));
+            this->capture->set_png_dirty_only(this->ini && this->ini->globals.png_dirty_only);
+            if (this->ini){
+                this->capture->set_keyframe_interval(this->ini->globals.wrm_keyframe_interval);
+                this->capture->set_wrm_compression(this->ini->globals.wrm_compression);
+                if (this->ini->globals.video_capture){
+                    this->start_video(path, codec_id, quality);
+                }
+            }
+            // recording geometry and compression, for players
+            MetaWRM meta(width, height, 24);
+            this->capture->emit_meta(meta);
         }
     }
 
 
+    // framerate and qscale of video_quality settings, only mjpeg is available
+    void start_video(const char * path, const char * codec_id, const char * quality)
+    {
+        if (0 != strcmp(codec_id, "mjpeg")){
+            LOG(LOG_INFO, "video capture: codec %s not available, using mjpeg", codec_id);
+        }
+        int fps = this->ini->globals.m_framerate;
+        int qscale = this->ini->globals.m_qscale;
+        if (0 == strcmp(quality, "low")){
+            fps = this->ini->globals.l_framerate;
+            qscale = this->ini->globals.l_qscale;
+        }
+        else if (0 == strcmp(quality, "high")){
+            fps = this->ini->globals.h_framerate;
+            qscale = this->ini->globals.h_qscale;
+        }
+        try {
+            this->capture->start_video(path, (fps > 0) ? fps : 1, qscale);
+        }
+        catch (Error & e){
+            LOG(LOG_ERR, "video capture: failed to start, error %u", e.id);
+        }
+    }
+
     void periodic_snapshot(bool pointer_is_displayed)
     {
         if (this->capture){
@@ -435,6 +475,18 @@ public:
     }
 
 
+    // time left (us) before next periodic snapshot, at most max_usec
+    uint64_t periodic_snapshot_delay(uint64_t max_usec)
+    {
+        if (this->capture){
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            uint64_t delay = this->capture->snapshot_delay(now);
+            return (delay < max_usec) ? delay : max_usec;
+        }
+        return max_usec;
+    }
+
     void stop_capture()
     {
         if (this->capture){
@@ -449,6 +501,7 @@ public:
             LOG(LOG_INFO, "Front::reset()");
             LOG(LOG_INFO, "Front::reset::use_bitmap_comp=%u", this->client_info.use_bitmap_comp);
             LOG(LOG_INFO, "Front::reset::use_compact_packets=%u", this->client_info.use_compact_packets);
+            LOG(LOG_INFO, "Front::reset::fastpath_output=%u", this->client_info.fastpath_output);
             LOG(LOG_INFO, "Front::reset::bitmap_cache_version=%u", this->client_info.bitmap_cache_version);
 
         }
@@ -470,7 +523,9 @@ public:
                         this->client_info.cache3_size,
                         this->client_info.bitmap_cache_version,
                         this->client_info.use_bitmap_comp,
-                        this->client_info.use_compact_packets);
+                        this->client_info.use_compact_packets,
+                        this->client_info.fastpath_output,
+                        this->mppc_enc);
 
         this->cache.reset(this->client_info);
     }
@@ -509,6 +564,11 @@ public:
                  pointer_item.y);
     }
 
+    virtual bool congested()
+    {
+        return this->trans->congested();
+    }
+
     virtual void begin_update()
     {
         if (this->verbose & 8){
@@ -587,6 +647,39 @@ public:
         }
     }
 
+    // Sends update or pointer content prepared in data as it would follow
+    // Share Data Header in a slow-path PDU. When client supports fast-path
+    // output it is sent as a fast-path update instead, fast-path content
+    // being the same without its first fastpath_skip bytes (updateType or
+    // messageType and padding for pointer and synchronize updates).
+    void send_update(Stream & data, uint8_t pdutype2, uint8_t fastpath_update_code, size_t fastpath_skip) throw (Error)
+    {
+        Stream stream(32768);
+        if (this->client_info.fastpath_output){
+            FastPathOut fastpath_out(stream, this->client_info.crypt_level != 0, this->encrypt);
+            FastPathUpdateOut fastpath_update(stream, fastpath_update_code, this->mppc_enc);
+            stream.out_copy_bytes(data.data + fastpath_skip, data.end - data.data - fastpath_skip);
+            fastpath_update.end();
+            fastpath_out.end();
+            fastpath_out.send(this->trans);
+            return;
+        }
+        X224Out tpdu(X224Packet::DT_TPDU, stream);
+        McsOut sdin_out(stream, DomainMCSPDU_SendDataIndication, this->userid, MCS_GLOBAL_CHANNEL);
+        SecOut sec_out(stream, this->client_info.crypt_level?SEC_ENCRYPT:0, this->encrypt);
+        ShareControlOut rdp_control_out(stream, PDUTYPE_DATAPDU, this->userid + MCS_USERCHANNEL_BASE);
+        ShareDataOut rdp_data_out(stream, pdutype2, this->share_id, RDP::STREAM_MED, this->mppc_enc);
+
+        stream.out_copy_bytes(data.data, data.end - data.data);
+
+        rdp_data_out.end();
+        rdp_control_out.end();
+        sec_out.end();
+        sdin_out.end();
+        tpdu.end();
+        tpdu.send(this->trans);
+    }
+
     // Global palette cf [MS-RDPCGR] 2.2.9.1.1.3.1.1.1 Palette Update Data
     // -------------------------------------------------------------------
 
@@ -610,11 +703,6 @@ public:
                 LOG(LOG_INFO, "Front::send_global_palette()");
             }
             Stream stream(32768);
-            X224Out tpdu(X224Packet::DT_TPDU, stream);
-            McsOut sdin_out(stream, DomainMCSPDU_SendDataIndication, this->userid, MCS_GLOBAL_CHANNEL);
-            SecOut sec_out(stream, this->client_info.crypt_level?SEC_ENCRYPT:0, this->encrypt);
-            ShareControlOut rdp_control_out(stream, PDUTYPE_DATAPDU, this->userid + MCS_USERCHANNEL_BASE);
-            ShareDataOut rdp_data_out(stream, PDUTYPE2_UPDATE, this->share_id, RDP::STREAM_MED);
 
             stream.out_uint16_le(RDP_UPDATE_PALETTE);
             stream.out_uint16_le(0);
@@ -628,13 +716,9 @@ public:
                 stream.out_uint8(g);
                 stream.out_uint8(r);
             }
+            stream.mark_end();
 
-            rdp_data_out.end();
-            rdp_control_out.end();
-            sec_out.end();
-            sdin_out.end();
-            tpdu.end();
-            tpdu.send(this->trans);
+            this->send_update(stream, PDUTYPE2_UPDATE, FASTPATH_UPDATETYPE_PALETTE, 0);
 
             this->palette_sent = true;
         }
@@ -756,11 +840,6 @@ public:
             LOG(LOG_INFO, "Front::send_pointer(cache_idx=%u x=%u y=%u)", cache_idx, x, y);
         }
         Stream stream(32768);
-        X224Out tpdu(X224Packet::DT_TPDU, stream);
-        McsOut sdin_out(stream, DomainMCSPDU_SendDataIndication, this->userid, MCS_GLOBAL_CHANNEL);
-        SecOut sec_out(stream, this->client_info.crypt_level?SEC_ENCRYPT:0, this->encrypt);
-        ShareControlOut rdp_control_out(stream, PDUTYPE_DATAPDU, this->userid + MCS_USERCHANNEL_BASE);
-        ShareDataOut rdp_data_out(stream, PDUTYPE2_POINTER, this->share_id, RDP::STREAM_MED);
 
         stream.out_uint16_le(RDP_POINTER_COLOR);
         stream.out_uint16_le(0); /* pad */
@@ -828,12 +907,8 @@ public:
 //    colorPointerData (1 byte): Single byte representing unused padding.
 //      The contents of this byte should be ignored.
 
-        rdp_data_out.end();
-        rdp_control_out.end();
-        sec_out.end();
-        sdin_out.end();
-        tpdu.end();
-        tpdu.send(this->trans);
+        stream.mark_end();
+        this->send_update(stream, PDUTYPE2_POINTER, FASTPATH_UPDATETYPE_COLOR, 4);
 
         if (this->verbose){
             LOG(LOG_INFO, "Front::send_pointer done");
@@ -878,22 +953,13 @@ public:
             LOG(LOG_INFO, "Front::set_pointer(cache_idx=%u)", cache_idx);
         }
         Stream stream(32768);
-        X224Out tpdu(X224Packet::DT_TPDU, stream);
-        McsOut sdin_out(stream, DomainMCSPDU_SendDataIndication, this->userid, MCS_GLOBAL_CHANNEL);
-        SecOut sec_out(stream, this->client_info.crypt_level?SEC_ENCRYPT:0, this->encrypt);
-        ShareControlOut rdp_control_out(stream, PDUTYPE_DATAPDU, this->userid + MCS_USERCHANNEL_BASE);
-        ShareDataOut rdp_data_out(stream, PDUTYPE2_POINTER, this->share_id, RDP::STREAM_MED);
 
         stream.out_uint16_le(RDP_POINTER_CACHED);
         stream.out_uint16_le(0); /* pad */
         stream.out_uint16_le(cache_idx);
+        stream.mark_end();
 
-        rdp_data_out.end();
-        rdp_control_out.end();
-        sec_out.end();
-        sdin_out.end();
-        tpdu.end();
-        tpdu.send(this->trans);
+        this->send_update(stream, PDUTYPE2_POINTER, FASTPATH_UPDATETYPE_CACHED, 4);
         if (this->verbose){
             LOG(LOG_INFO, "Front::set_pointer done");
         }
@@ -1165,6 +1231,13 @@ public:
 
             this->keymap.init_layout(this->client_info.keylayout);
 
+            if (this->client_info.rdp_compression && this->ini->globals.rdp_compression && !this->mppc_enc){
+                // RDP 6.0 and 6.1 bulk compression are not supported
+                this->mppc_enc = new rdp_mppc_enc(this->client_info.rdp_compression_type);
+                LOG(LOG_INFO, "Front::incoming::bulk compression enabled (%s)",
+                    (this->mppc_enc->protocol_type == PACKET_COMPR_TYPE_8K) ? "8K" : "64K");
+            }
+
             if (this->client_info.is_mce) {
                 LOG(LOG_INFO, "Front::incoming::licencing client_info.is_mce");
                 LOG(LOG_INFO, "Front::incoming::licencing send_media_lic_response");
@@ -1400,6 +1473,23 @@ public:
 
             Stream stream(65535);
 
+            // Fast-path input PDU or slow-path X224 TPDU, first byte tells which
+            this->trans->recv((char**)(&(stream.end)), 1);
+            if ((stream.p[0] & 0x03) != FASTPATH_INPUT_ACTION_X224){
+                FastPathIn fastpath_in(this->trans, stream, this->decrypt);
+                if (this->verbose & 4){
+                    LOG(LOG_INFO, "Front::incoming::fast-path input num_events=%u", fastpath_in.numEvents);
+                }
+                for (uint8_t index = 0; index < fastpath_in.numEvents; index++){
+                    FastPathInputEventIn event(stream);
+                    this->input_event(cb, 0, event.message_type, event.device_flags, event.param1, event.param2);
+                }
+                if (this->up_and_running){
+                    cb.rdp_input_flush();
+                }
+                break;
+            }
+
             X224In tpdu(this->trans, stream);
 
             if (tpdu.tpdu_hdr.code != X224Packet::DT_TPDU){
@@ -1479,8 +1569,14 @@ public:
                 stream.p += chunk_size;
             }
             else {
-                while (stream.p < stream.end) {
+                uint8_t * next_packet = stream.p;
+                while (next_packet < stream.end) {
+                    stream.p = next_packet;
                     ShareControlIn sci(stream);
+                    // next share control PDU starts at totalLength, whatever
+                    // handler of this one consumed
+                    next_packet = (sci.len >= 4 && sci.len <= stream.end - next_packet)
+                                ? next_packet + sci.len : stream.end;
 
                     switch (sci.pdu_type1) {
                     case PDUTYPE_DEMANDACTIVEPDU:
@@ -1538,21 +1634,11 @@ public:
             LOG(LOG_INFO, "send_data_update_sync");
         }
         Stream stream(32768);
-        X224Out tpdu(X224Packet::DT_TPDU, stream);
-        McsOut sdin_out(stream, DomainMCSPDU_SendDataIndication, this->userid, MCS_GLOBAL_CHANNEL);
-        SecOut sec_out(stream, this->client_info.crypt_level?SEC_ENCRYPT:0, this->encrypt);
-        ShareControlOut rdp_control_out(stream, PDUTYPE_DATAPDU, this->userid + MCS_USERCHANNEL_BASE);
-        ShareDataOut rdp_data_out(stream, PDUTYPE2_UPDATE, this->share_id, RDP::STREAM_MED);
-
         stream.out_uint16_le(RDP_UPDATE_SYNCHRONIZE);
         stream.out_clear_bytes(2);
+        stream.mark_end();
 
-        rdp_data_out.end();
-        rdp_control_out.end();
-        sec_out.end();
-        sdin_out.end();
-        tpdu.end();
-        tpdu.send(this->trans);
+        this->send_update(stream, PDUTYPE2_UPDATE, FASTPATH_UPDATETYPE_SYNCHRONIZE, 4);
     }
 
 
@@ -1584,6 +1670,7 @@ public:
         uint8_t * caps_ptr = stream.p;
 
         GeneralCaps general_caps;
+        general_caps.extraflags |= FASTPATH_OUTPUT_SUPPORTED;
         general_caps.log("Sending to client");
         general_caps.emit(stream);
         caps_count++;
@@ -1639,7 +1726,7 @@ public:
         caps_count++;
 
         InputCaps input_caps;
-        input_caps.inputFlags = 1;
+        input_caps.inputFlags = INPUT_FLAG_SCANCODES | INPUT_FLAG_FASTPATH_INPUT | INPUT_FLAG_FASTPATH_INPUT2;
         input_caps.keyboardLayout = 0;
         input_caps.keyboardType = 0;
         input_caps.keyboardSubType = 0;
@@ -1735,6 +1822,7 @@ public:
                     general.recv(stream, len);
                     general.log("Receiving from client");
                     this->client_info.use_compact_packets = (general.extraflags & NO_BITMAP_COMPRESSION_HDR)?1:0;
+                    this->client_info.fastpath_output = (general.extraflags & FASTPATH_OUTPUT_SUPPORTED)?1:0;
                 }
                 break;
             case CAPSTYPE_BITMAP: {
@@ -1989,6 +2077,52 @@ public:
         tpdu.send(this->trans);
     }
 
+    // Input event, from slow-path Input PDU or fast-path input PDU (then
+    // converted to slow-path event fields, time being 0)
+    void input_event(Callback & cb, int time, uint16_t msg_type, uint16_t device_flags, int16_t param1, int16_t param2)
+    {
+        TODO(" we should always call send_input with original data  if the other side is rdp it will merely transmit it to the other end without change. If the other side is some internal module it will be it's own responsibility to decode it")
+        TODO(" with the scheme above  any kind of keymap management is only necessary for internal modules or if we convert mapping. But only the back-end module really knows what the target mapping should be.")
+        switch (msg_type) {
+        case RDP_INPUT_SYNCHRONIZE:
+            if (this->verbose & 2){
+                LOG(LOG_INFO, "RDP_INPUT_SYNCHRONIZE");
+            }
+            /* happens when client gets focus and sends key modifier info */
+            this->keymap.synchronize(param1);
+            if (this->up_and_running){
+                cb.rdp_input_synchronize(time, device_flags, param1, param2);
+            }
+            break;
+        case RDP_INPUT_SCANCODE:
+            {
+                if (this->verbose & 2){
+                    LOG(LOG_INFO, "RDP_INPUT_SCANCODE time=%u flags=%04x param1=%04x param2=%04x",
+                        time, device_flags, param1, param2
+                    );
+                }
+                this->keymap.event(device_flags, param1);
+                if (this->up_and_running){
+                    cb.rdp_input_scancode(param1, param2, device_flags, time, &this->keymap);
+                }
+            }
+            break;
+        case RDP_INPUT_MOUSE:
+            if (this->verbose & 6){
+                LOG(LOG_INFO, "RDP_INPUT_MOUSE(device_flags=%u, param1=%u, param2=%u)", device_flags, param1, param2);
+            }
+            this->mouse_x = param1;
+            this->mouse_y = param2;
+            if (this->up_and_running){
+                cb.rdp_input_mouse(device_flags, param1, param2, &this->keymap);
+            }
+            break;
+        default:
+            LOG(LOG_INFO, "unsupported PDUTYPE2_INPUT msg %u", msg_type);
+            break;
+        }
+    }
+
     /* PDUTYPE_DATAPDU */
     void process_data(Stream & stream, Callback & cb) throw (Error)
     {
@@ -2054,47 +2188,10 @@ public:
                     uint16_t device_flags = stream.in_uint16_le();
                     int16_t param1 = stream.in_sint16_le();
                     int16_t param2 = stream.in_sint16_le();
-
-                    TODO(" we should always call send_input with original data  if the other side is rdp it will merely transmit it to the other end without change. If the other side is some internal module it will be it's own responsibility to decode it")
-                    TODO(" with the scheme above  any kind of keymap management is only necessary for internal modules or if we convert mapping. But only the back-end module really knows what the target mapping should be.")
-                    switch (msg_type) {
-                    case RDP_INPUT_SYNCHRONIZE:
-                        if (this->verbose & 2){
-                            LOG(LOG_INFO, "RDP_INPUT_SYNCHRONIZE");
-                        }
-                        /* happens when client gets focus and sends key modifier info */
-                        this->keymap.synchronize(param1);
-                        if (this->up_and_running){
-                            cb.rdp_input_synchronize(time, device_flags, param1, param2);
-                        }
-                        break;
-                    case RDP_INPUT_SCANCODE:
-                        {
-                            if (this->verbose & 2){
-                                LOG(LOG_INFO, "RDP_INPUT_SCANCODE time=%u flags=%04x param1=%04x param2=%04x",
-                                    time, device_flags, param1, param2
-                                );
-                            }
-                            this->keymap.event(device_flags, param1);
-                            if (this->up_and_running){
-                                cb.rdp_input_scancode(param1, param2, device_flags, time, &this->keymap);
-                            }
-                        }
-                        break;
-                    case RDP_INPUT_MOUSE:
-                        if (this->verbose & 6){
-                            LOG(LOG_INFO, "RDP_INPUT_MOUSE(device_flags=%u, param1=%u, param2=%u)", device_flags, param1, param2);
-                        }
-                        this->mouse_x = param1;
-                        this->mouse_y = param2;
-                        if (this->up_and_running){
-                            cb.rdp_input_mouse(device_flags, param1, param2, &this->keymap);
-                        }
-                        break;
-                    default:
-                        LOG(LOG_INFO, "unsupported PDUTYPE2_INPUT msg %u", msg_type);
-                        break;
-                    }
+                    this->input_event(cb, time, msg_type, device_flags, param1, param2);
+                }
+                if (this->up_and_running){
+                    cb.rdp_input_flush();
                 }
             }
         break;
@@ -2400,16 +2497,21 @@ public:
                 const Rect src_tile(x, y, cx, cy);
 
                 const Bitmap tiled_bmp(raw, rect.cx, rect.cy, bpp, src_tile);
-                const RDPMemBlt cmd2(0, dst_tile, 0xCC, 0, 0, 0);
-                this->orders->draw(cmd2, dst_tile, tiled_bmp);
-                if (this->capture){
-                    this->capture->draw(cmd2, dst_tile, tiled_bmp);
-                }
+                this->draw_bitmap_tile(dst_tile, tiled_bmp);
             }
         }
 
     }
 
+    void draw_bitmap_tile(const Rect & dst_tile, const Bitmap & tile)
+    {
+        const RDPMemBlt cmd(0, dst_tile, 0xCC, 0, 0, 0);
+        this->orders->draw(cmd, dst_tile, tile);
+        if (this->capture){
+            this->capture->draw(cmd, dst_tile, tile);
+        }
+    }
+
     void draw_tile(const Rect & dst_tile, const Rect & src_tile, const RDPMemBlt & cmd, const Bitmap & bitmap, const Rect & clip)
     {
 //        LOG(LOG_INFO, "front::draw:draw_tile((%u, %u, %u, %u) (%u, %u, %u, %u)",
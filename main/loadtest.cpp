@@ -0,0 +1,229 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   load test program: opens many RDP connections to a proxy (concurrency
+   client processes, each one opening connections one after the other) and
+   reports connections per second and time to first frame, that is time
+   between TCP connection and first drawing order received.
+
+   Proxy should send sessions of the given user to test card module
+   (INTERNAL protocol target), for instance using authhook.py.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#include <boost/program_options.hpp>
+
+#include "log.hpp"
+#include "transport.hpp"
+#include "RDP/RDPGraphicDevice.hpp"
+#include "channel_list.hpp"
+#include "front_api.hpp"
+#include "client_info.hpp"
+#include "genrandom.hpp"
+#include "rdp/rdp.hpp"
+
+namespace po = boost::program_options;
+
+static long long ustime() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (long long)now.tv_sec*1000000LL + (long long)now.tv_usec;
+}
+
+// front of load test client, only counts drawings
+class LoadFront : public FrontAPI {
+    public:
+    ChannelDefArray cl;
+    unsigned nb_draws;
+
+    virtual void flush() {}
+    virtual void draw(const RDPOpaqueRect& cmd, const Rect& clip) { this->nb_draws++; }
+    virtual void draw(const RDPScrBlt& cmd, const Rect& clip) { this->nb_draws++; }
+    virtual void draw(const RDPDestBlt& cmd, const Rect& clip) { this->nb_draws++; }
+    virtual void draw(const RDPPatBlt& cmd, const Rect& clip) { this->nb_draws++; }
+    virtual void draw(const RDPMemBlt& cmd, const Rect& clip, const Bitmap& bmp) { this->nb_draws++; }
+    virtual void draw(const RDPLineTo& cmd, const Rect& clip) { this->nb_draws++; }
+    virtual void draw(const RDPGlyphIndex& cmd, const Rect& clip) { this->nb_draws++; }
+
+    virtual const ChannelDefArray & get_channel_list(void) const { return cl; }
+    virtual void send_to_channel(const ChannelDef & channel, uint8_t* data, size_t length, size_t chunk_size, int flags) {}
+    virtual void send_pointer(int cache_idx, uint8_t* data, uint8_t* mask, int x, int y) throw (Error) {}
+    virtual void send_global_palette() throw (Error) {}
+    virtual void set_pointer(int cache_idx) throw (Error) {}
+    virtual void begin_update() {}
+    virtual void end_update() {}
+    virtual void color_cache(const BGRPalette & palette, uint8_t cacheIndex) {}
+    virtual void set_mod_palette(const BGRPalette & palette) {}
+    virtual void server_set_pointer(int x, int y, uint8_t* data, uint8_t* mask) {}
+    virtual void server_draw_text(uint16_t x, uint16_t y, const char * text, uint32_t fgcolor, uint32_t bgcolor, const Rect & clip) {}
+    virtual void text_metrics(const char * text, int & width, int & height) { width = height = 0; }
+    virtual int server_resize(int width, int height, int bpp) { return 0; }
+
+    LoadFront() : FrontAPI(false, false), nb_draws(0) {}
+};
+
+// one connection, returns time to first frame in usec or -1 on failure
+static long long one_connection(const std::string & host, int port,
+                                const std::string & user, const std::string & password,
+                                bool tls, unsigned max_events)
+{
+    long long start = ustime();
+    try {
+        ClientInfo info(1, 1, true, true);
+        info.keylayout = 0x040C;
+        info.console_session = 0;
+        info.brush_cache_code = 0;
+        info.bpp = 16;
+        info.width = 800;
+        info.height = 600;
+
+        LoadFront front;
+        UdevRandom gen;
+        ClientSocketTransport t("loadtest", host.c_str(), port, 3, 1000);
+        if (!t.connect()){
+            return -1;
+        }
+        mod_rdp mod(&t, user.c_str(), password.c_str(), front, "loadtest", tls, info, &gen);
+        for (unsigned i = 0; i < max_events && front.nb_draws == 0; i++){
+            if (mod.draw_event() != BACK_EVENT_NONE){
+                break;
+            }
+        }
+        if (front.nb_draws == 0){
+            return -1;
+        }
+    }
+    catch (...) {
+        return -1;
+    }
+    return ustime() - start;
+}
+
+int main(int argc, char** argv)
+{
+    std::string host;
+    int port;
+    std::string user;
+    std::string password;
+    unsigned connections;
+    unsigned concurrency;
+    unsigned max_events;
+
+    po::options_description desc("Options");
+    desc.add_options()
+    ("help,h", "produce help message")
+    ("host,H", po::value(&host)->default_value("127.0.0.1"), "proxy address")
+    ("port,p", po::value(&port)->default_value(3389), "proxy port")
+    ("user,u", po::value(&user)->default_value("test@card:INTERNAL"), "user name sent in client info")
+    ("password,w", po::value(&password)->default_value(""), "password sent in client info")
+    ("connections,n", po::value(&connections)->default_value(100), "total number of connections")
+    ("concurrency,c", po::value(&concurrency)->default_value(10), "number of client processes")
+    ("max-events,e", po::value(&max_events)->default_value(50), "received PDUs after which a connection without drawing fails")
+    ("tls,t", "negotiate TLS")
+    ;
+
+    po::variables_map options;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), options);
+        po::notify(options);
+    }
+    catch (const std::exception & e){
+        std::cerr << e.what() << "\n" << desc;
+        return 1;
+    }
+    if (options.count("help")) {
+        std::cout << desc;
+        return 0;
+    }
+    if (concurrency == 0){
+        concurrency = 1;
+    }
+    const bool tls = options.count("tls");
+
+    signal(SIGPIPE, SIG_IGN);
+
+    int results[2];
+    if (pipe(results) < 0){
+        perror("pipe");
+        return 1;
+    }
+
+    long long start = ustime();
+    for (unsigned c = 0; c < concurrency; c++){
+        unsigned nb = connections / concurrency + (c < connections % concurrency);
+        pid_t pid = fork();
+        if (pid == 0){
+            close(results[0]);
+            for (unsigned i = 0; i < nb; i++){
+                long long ttff = one_connection(host, port, user, password, tls, max_events);
+                if (sizeof(ttff) != write(results[1], &ttff, sizeof(ttff))){
+                    exit(1);
+                }
+            }
+            exit(0);
+        }
+        if (pid < 0){
+            perror("fork");
+        }
+    }
+    close(results[1]);
+
+    std::vector<long long> ttffs;
+    unsigned failed = 0;
+    long long ttff;
+    while (sizeof(ttff) == read(results[0], &ttff, sizeof(ttff))){
+        if (ttff < 0){
+            failed++;
+        }
+        else {
+            ttffs.push_back(ttff);
+        }
+    }
+    long long elapsed = ustime() - start;
+    while (wait(NULL) > 0){
+    }
+
+    printf("connections: %u ok, %u failed in %.3f s\n",
+        (unsigned)ttffs.size(), failed, elapsed / 1000000.0);
+    printf("connections per second: %.1f\n",
+        elapsed ? ttffs.size() * 1000000.0 / elapsed : 0.0);
+    if (!ttffs.empty()){
+        std::sort(ttffs.begin(), ttffs.end());
+        long long total = 0;
+        for (size_t i = 0; i < ttffs.size(); i++){
+            total += ttffs[i];
+        }
+        printf("time to first frame (ms): min %.1f avg %.1f p50 %.1f p95 %.1f max %.1f\n",
+            ttffs.front() / 1000.0,
+            total / 1000.0 / ttffs.size(),
+            ttffs[ttffs.size() / 2] / 1000.0,
+            ttffs[(ttffs.size() * 95) / 100 < ttffs.size() ? (ttffs.size() * 95) / 100 : ttffs.size() - 1] / 1000.0,
+            ttffs.back() / 1000.0);
+    }
+    return failed ? 2 : 0;
+}
@@ -27,10 +27,7 @@
 #include <boost/program_options.hpp>
 
 #include "range_time_point.hpp"
-// #include "wrm_recorder.hpp"
-
-class NativeCapture;
-class StaticCapture;
+#include "wrm_to_png.hpp"
 
 namespace po = boost::program_options;
 
@@ -79,7 +76,7 @@ struct RecorderError{
 /**
  * TODO create class { po::options_description desc; [value...]; command_line_parser(int argc, char** argv):int}
  */
-bool load_options(int argc, char** argv, po::variables_map& options,
+int load_options(int argc, char** argv, po::variables_map& options,
                   range_time_point& range,
                   uint& frame,
                   time_point& time,
@@ -87,6 +84,7 @@ bool load_options(int argc, char** argv, po::variables_map& options,
                   std::string& png_filename,
                   std::vector<std::string>& wrm_files,
                   std::string& synchronise,
+                  uint& jobs,
                   int& flag
                 )
 {
@@ -109,6 +107,7 @@ bool load_options(int argc, char** argv, po::variables_map& options,
     ("frame,f", po::value(&frame), "maximum frame for png capture option")
     ("time,t", po::value(&time), "time capture for 1 file, with wrm capture option. format: [+|-]time[h|m|s][...]")
     ("synchronise,s", po::value(&synchronise), "")
+    ("jobs,j", po::value(&jobs), "number of processes for png capture, recording is split at keyframes")
     ("input-file,i", po::value(&wrm_files), "")
     ("output-file,o", po::value<std::string>(), "alias -w ... -p ... -s")
     ("1", "")
@@ -163,6 +162,7 @@ int main(int argc, char** argv)
     std::string png_filename;
     std::vector<std::string> wrm_files;
     std::string synchronise;
+    uint jobs = 1;
     int flag = 0;
 
     po::variables_map options;
@@ -171,9 +171,10 @@ int main(int argc, char** argv)
                             wrm_filename, png_filename,
                             wrm_files,
                             synchronise,
+                            jobs,
                             flag
                             );
-    if (!error)
+    if (error)
         return error; ///NOTE load_options_errors[error]: const char *
 
     po::variables_map::iterator it = options.find("wrm");
@@ -194,6 +195,7 @@ int main(int argc, char** argv)
     << "frame: " << frame << '\n'
     << "time: " << time << '\n'
     << "range: " << range << '\n'
+    << "jobs: " << jobs << '\n'
     ;
     if (!range.valid()){
         std::swap<>(range.left, range.right);
@@ -201,11 +203,16 @@ int main(int argc, char** argv)
     }
 
 
-    //     NativeCapture *native_capture = 0;
-    //     StaticCapture *static_capture = 0;
-    //WRMRecorder recorder(filename);
-
-
+    if (!png_filename.empty() && !wrm_files.empty()){
+        const uint64_t start = (uint64_t)range.left.time * 1000000;
+        const uint64_t stop = (range.right.time == std::numeric_limits<std::size_t>::max())
+                            ? std::numeric_limits<uint64_t>::max()
+                            : (uint64_t)range.right.time * 1000000;
+        // starts from nearest keyframe instead of decoding whole recording
+        WRMToPng to_png(wrm_files[0].c_str(), start, stop, frame);
+        unsigned nb_frames = to_png.run(png_filename.c_str(), jobs);
+        std::cout << "png: " << nb_frames << " frames\n";
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -27,6 +27,7 @@
 
 #include <stdio.h>
 #include "colors.hpp"
+#include "target_index.hpp"
 
 struct selector_mod : public internal_mod {
     struct TargetDevice {
@@ -110,8 +111,19 @@ struct selector_mod : public internal_mod {
     Bitmap * next_page_inactive;
     Bitmap * last_page_inactive;
 
+    // local index mode: all targets are fetched from acl once (by pages of
+    // INDEX_CHUNK_LINES lines), paging and filtering do not go to acl anymore
+    enum { INDEX_CHUNK_LINES = 50 };
+    bool local_index;
+    TargetIndex & index;
+    size_t & index_page;
+    bool & index_loaded;
+    size_t grid_entry[50];  // index entry shown on each line + 1, 0 for none
+    uint32_t shown[50];     // what each grid line shows on screen, see line_key()
+    bool full_redraw;       // false if next draw only updates filters, grid lines and page number
 
-    selector_mod(wait_obj * event, ModContext & context, FrontAPI & front, uint16_t width, uint16_t height):
+
+    selector_mod(wait_obj * event, ModContext & context, FrontAPI & front, uint16_t width, uint16_t height, bool local_index = false):
             internal_mod(front, width, height), focus_line(0),
             focus_item(context.selector_focus),
             click_focus(NO_FOCUS),
@@ -120,8 +132,15 @@ struct selector_mod : public internal_mod {
             filter_device_edit_pos(0),
             showed_page(0),
             total_page(1),
-            context(context)
+            context(context),
+            local_index(local_index),
+            index(context.selector_index),
+            index_page(context.selector_index_page),
+            index_loaded(context.selector_index_loaded),
+            full_redraw(true)
     {
+        memset(this->grid_entry, 0, sizeof(this->grid_entry));
+        memset(this->shown, 0, sizeof(this->shown));
 
         LOG(LOG_INFO, "Creating selector");
 
@@ -3353,9 +3372,14 @@ struct selector_mod : public internal_mod {
     };
     this->last_page = new Bitmap(24, NULL, 32, 20, raw_last_page, sizeof(raw_last_page));
 
+        this->event = event;
         this->refresh_context(context);
+        if (this->local_index){
+            this->filter_group_text[0] = 0;
+            this->filter_device_text[0] = 0;
+            this->load_index(context);
+        }
         LOG(LOG_INFO, "selector init done : signal = %u", this->signal);
-        this->event = event;
         this->event->set();
     }
 
@@ -3365,6 +3389,24 @@ struct selector_mod : public internal_mod {
 
     virtual void refresh_context(ModContext & context)
     {
+        this->rect_button_logout = Rect(this->get_screen_rect().cx-240, this->get_screen_rect().cy- 100, 60, 26);
+        this->rect_button_apply = this->rect_button_logout.offset(70,0);
+        this->rect_button_connect = this->rect_button_apply.offset(70,0);
+
+        this->rect_button_first = Rect(this->get_screen_rect().cx - 240, this->get_screen_rect().cy - 130, 30, 20);
+        this->rect_button_prec = this->rect_button_first.offset(40, 0);
+        this->rect_button_next = this->rect_button_prec.offset(40 + 50, 0);
+        this->rect_button_last = this->rect_button_next.offset(40, 0);
+
+        uint32_t w = (this->get_screen_rect().cx - 40) / 20;
+        this->rect_group_filter = Rect(30, 70, 3*w - 15, 20);
+        this->rect_device_filter = Rect(30 + 3*w, 70, 10*w - 15, 20);
+        this->rect_grid = Rect(20, 100, this->get_screen_rect().cx-40, this->nblines() * 20);
+
+        if (this->local_index){
+            return;
+        }
+
         this->showed_page = atoi(context.get(STRAUTHID_SELECTOR_CURRENT_PAGE));
         this->total_page = atoi(context.get(STRAUTHID_SELECTOR_NUMBER_OF_PAGES));
 
@@ -3381,20 +3423,6 @@ struct selector_mod : public internal_mod {
             strcpy(this->filter_group_text, context.get(STRAUTHID_SELECTOR_GROUP_FILTER));
         }
 
-        this->rect_button_logout = Rect(this->get_screen_rect().cx-240, this->get_screen_rect().cy- 100, 60, 26);
-        this->rect_button_apply = this->rect_button_logout.offset(70,0);
-        this->rect_button_connect = this->rect_button_apply.offset(70,0);
-
-        this->rect_button_first = Rect(this->get_screen_rect().cx - 240, this->get_screen_rect().cy - 130, 30, 20);
-        this->rect_button_prec = this->rect_button_first.offset(40, 0);
-        this->rect_button_next = this->rect_button_prec.offset(40 + 50, 0);
-        this->rect_button_last = this->rect_button_next.offset(40, 0);
-
-        uint32_t w = (this->get_screen_rect().cx - 40) / 20;
-        this->rect_group_filter = Rect(30, 70, 3*w - 15, 20);
-        this->rect_device_filter = Rect(30 + 3*w, 70, 10*w - 15, 20);
-        this->rect_grid = Rect(20, 100, this->get_screen_rect().cx-40, this->nblines() * 20);
-
 
         const char * groups = context.get(STRAUTHID_TARGET_USER);
         const char * targets = context.get(STRAUTHID_TARGET_DEVICE);
@@ -3436,6 +3464,100 @@ struct selector_mod : public internal_mod {
     }
 
 
+    // selector is recreated after each acl answer: each instance adds the
+    // page of targets received to index and asks the next one until all
+    // targets are known
+    void load_index(ModContext & context)
+    {
+        if (!this->index_loaded && !this->index_page){
+            this->index.clear();
+            this->index_page = 1;
+            this->ask_index_page();
+            return;
+        }
+        if (this->index_page){
+            const size_t added = this->index.append(
+                context.get(STRAUTHID_TARGET_USER),
+                context.get(STRAUTHID_TARGET_DEVICE),
+                context.get(STRAUTHID_TARGET_PROTOCOL),
+                context.get(STRAUTHID_END_TIME));
+            const size_t pages = atoi(context.get(STRAUTHID_SELECTOR_NUMBER_OF_PAGES));
+            if (added > 0 && this->index_page < pages){
+                this->index_page++;
+                this->ask_index_page();
+                return;
+            }
+            LOG(LOG_INFO, "selector: %u targets indexed from %u acl pages",
+                (unsigned)this->index.size(), (unsigned)this->index_page);
+            this->index_page = 0;
+            this->index_loaded = true;
+        }
+        this->showed_page = 1;
+        this->show_index_page();
+    }
+
+    void ask_index_page()
+    {
+        char buffer[64];
+        sprintf(buffer, "%u", (unsigned int)INDEX_CHUNK_LINES);
+        this->context.cpy(STRAUTHID_SELECTOR_LINES_PER_PAGE, buffer);
+        sprintf(buffer, "%u", (unsigned int)this->index_page);
+        this->context.cpy(STRAUTHID_SELECTOR_CURRENT_PAGE, buffer);
+        this->context.cpy(STRAUTHID_SELECTOR_GROUP_FILTER, "");
+        this->context.cpy(STRAUTHID_SELECTOR_DEVICE_FILTER, "");
+        this->context.ask(STRAUTHID_TARGET_USER);
+        this->context.ask(STRAUTHID_TARGET_DEVICE);
+        this->context.ask(STRAUTHID_SELECTOR);
+        this->signal = BACK_EVENT_REFRESH;
+        this->event->set();
+    }
+
+    bool index_filter_changed()
+    {
+        return !this->index.filtered
+            || this->index.group_filter != this->filter_group_text
+            || this->index.device_filter != this->filter_device_text;
+    }
+
+    // fills grid with showed_page of targets matching filters
+    void show_index_page()
+    {
+        if (this->index_filter_changed()){
+            this->index.filter(this->filter_group_text, this->filter_device_text);
+        }
+        const size_t lines = this->nblines();
+        this->total_page = this->index.nb_pages(lines);
+        if (this->showed_page < 1){
+            this->showed_page = 1;
+        }
+        if (this->showed_page > this->total_page){
+            this->showed_page = this->total_page;
+        }
+        for (size_t line = 0 ; line < 50 ; line++){
+            const size_t i = (this->showed_page - 1) * lines + line;
+            TargetDevice & item = this->grid[line];
+            if (line < lines && i < this->index.matches.size()){
+                const TargetIndex::Entry & entry = this->index.matching(i);
+                copy_item(item.group, this->index.group(entry));
+                copy_item(item.target, this->index.str(entry.target));
+                copy_item(item.protocol, this->index.str(entry.protocol));
+                copy_item(item.endtime, this->index.str(entry.endtime));
+                this->grid_entry[line] = this->index.matches[i] + 1;
+            }
+            else {
+                item.group[0] = item.target[0] = item.protocol[0] = item.endtime[0] = 0;
+                this->grid_entry[line] = 0;
+            }
+        }
+        this->event->set();
+    }
+
+    static inline void copy_item(char * grid_item, const char * item)
+    {
+        strncpy(grid_item, item, 255);
+        grid_item[255] = 0;
+    }
+
     static inline const char * proceed_item(const char * list, char * grid_item, char sep = ' ')
     {
         const char * p = list;
@@ -3454,6 +3576,7 @@ struct selector_mod : public internal_mod {
 
     virtual void rdp_input_mouse(int device_flags, int x, int y, Keymap2 * keymap)
     {
+        this->full_redraw = true;
 //        LOG(LOG_INFO, "x=%u y=%u flags=%x", x, y, device_flags);
 
         if (device_flags & MOUSE_FLAG_BUTTON1) { /* 0x1000 */
@@ -3520,6 +3643,12 @@ struct selector_mod : public internal_mod {
     }
 
     void ask_page(void){
+        if (this->local_index){
+            if (this->index_loaded){
+                this->show_index_page();
+            }
+            return;
+        }
         this->context.ask(STRAUTHID_SELECTOR);
         char buffer[64];
         sprintf(buffer, "%u", (unsigned int)this->showed_page);
@@ -3606,6 +3735,9 @@ struct selector_mod : public internal_mod {
     {
         LOG(LOG_INFO, "selector::rdp_input_scancode");
         if (keymap->nb_kevent_available() > 0){
+            if (!this->local_index || !this->grid_only_kevent(keymap->top_kevent())){
+                this->full_redraw = true;
+            }
             switch (keymap->top_kevent()){
             case Keymap2::KEVENT_BACKSPACE:
                 keymap->get_kevent();
@@ -3765,6 +3897,32 @@ struct selector_mod : public internal_mod {
                 keymap->get_kevent();
             break;
             }
+            if (this->local_index && this->index_loaded && this->index_filter_changed()){
+                this->show_index_page();
+            }
+        }
+    }
+
+    // keyboard events that only change filters, grid lines or page number
+    bool grid_only_kevent(unsigned kevent)
+    {
+        switch (kevent){
+        case Keymap2::KEVENT_UP_ARROW:
+        case Keymap2::KEVENT_DOWN_ARROW:
+            return true;
+        case Keymap2::KEVENT_KEY:
+        case Keymap2::KEVENT_BACKSPACE:
+        case Keymap2::KEVENT_DELETE:
+        case Keymap2::KEVENT_LEFT_ARROW:
+        case Keymap2::KEVENT_RIGHT_ARROW:
+        case Keymap2::KEVENT_ENTER:
+            return this->focus_item == FOCUS_ON_FILTER_GROUP
+                || this->focus_item == FOCUS_ON_FILTER_DEVICE
+                || (kevent == Keymap2::KEVENT_ENTER
+                    && this->focus_item >= FOCUS_ON_FIRSTPAGE
+                    && this->focus_item <= FOCUS_ON_LASTPAGE);
+        default:
+            return false;
         }
     }
 
@@ -3778,7 +3936,16 @@ struct selector_mod : public internal_mod {
     virtual BackEvent_t draw_event()
     {
 //        LOG(LOG_INFO, "selector::draw_event");
-        this->draw(this->get_screen_rect());
+        if (this->index_page > 1){
+            // still loading local index, screen already drawn
+        }
+        else if (this->full_redraw){
+            this->draw(this->get_screen_rect());
+        }
+        else {
+            this->draw_grid_update(this->get_screen_rect());
+        }
+        this->full_redraw = !this->local_index;
         this->event->reset();
 //        LOG(LOG_INFO, "draw_event : signal = %u", this->signal);
         return this->signal;
@@ -3820,15 +3987,7 @@ struct selector_mod : public internal_mod {
         this->front.server_draw_text(30 + 16*w, 50,  "Close Time", GREY, BLACK, clip);
 
         for (size_t line = 0 ; line < this->nblines() ; line++){
-            Rect rect(this->rect_grid.x, this->rect_grid.y + line * 20, this->get_screen_rect().cx-40, 19);
-            uint32_t bc = this->back_color[line%2+2*(line == this->focus_line)];
-            uint32_t fc = this->fore_color[line%2+2*(line == this->focus_line)];
-
-            this->front.draw(RDPOpaqueRect(rect, bc), clip);
-            this->front.server_draw_text(35       , rect.y + 2,  this->grid[line].group, bc, fc, clip);
-            this->front.server_draw_text(35 +  3*w, rect.y + 2,  this->grid[line].target, bc, fc, clip);
-            this->front.server_draw_text(35 + 13*w, rect.y + 2,  this->grid[line].protocol, bc, fc, clip);
-            this->front.server_draw_text(35 + 15*w, rect.y + 2,  this->grid[line].endtime, bc, fc, clip);
+            this->draw_line(line, clip);
         }
 
         if (this->focus_item == FOCUS_ON_FIRSTPAGE){
@@ -3859,6 +4018,28 @@ struct selector_mod : public internal_mod {
             this->front.draw(RDPMemBlt(0, this->rect_button_last, 0xCC, 0, 0, 0), clip, *this->last_page_inactive);
         }
 
+        this->draw_page_number(clip);
+    }
+
+    uint32_t line_key(size_t line){
+        return (this->grid_entry[line] << 2) | (line%2+2*(line == this->focus_line));
+    }
+
+    void draw_line(size_t line, const Rect & clip){
+        uint32_t w = (this->get_screen_rect().cx - 40) / 20;
+        Rect rect(this->rect_grid.x, this->rect_grid.y + line * 20, this->get_screen_rect().cx-40, 19);
+        uint32_t bc = this->back_color[line%2+2*(line == this->focus_line)];
+        uint32_t fc = this->fore_color[line%2+2*(line == this->focus_line)];
+
+        this->front.draw(RDPOpaqueRect(rect, bc), clip);
+        this->front.server_draw_text(35       , rect.y + 2,  this->grid[line].group, bc, fc, clip);
+        this->front.server_draw_text(35 +  3*w, rect.y + 2,  this->grid[line].target, bc, fc, clip);
+        this->front.server_draw_text(35 + 13*w, rect.y + 2,  this->grid[line].protocol, bc, fc, clip);
+        this->front.server_draw_text(35 + 15*w, rect.y + 2,  this->grid[line].endtime, bc, fc, clip);
+        this->shown[line] = this->line_key(line);
+    }
+
+    void draw_page_number(const Rect & clip){
         char buffer[256];
         if (this->showed_page < 1){
             this->showed_page = 1;
@@ -3868,8 +4049,24 @@ struct selector_mod : public internal_mod {
         }
         sprintf(buffer, "%u/%u", (unsigned int)this->showed_page, (unsigned int)this->total_page);
         Rect rect_num_pages = this->rect_button_prec.offset(50, 2);
+        this->front.draw(RDPOpaqueRect(Rect(rect_num_pages.x, rect_num_pages.y, 40, 16), GREY), clip);
         this->front.server_draw_text(rect_num_pages.x, rect_num_pages.y, buffer, GREY, BLACK, clip);
+    }
 
+    // local index mode: only filters, grid lines that changed and page number
+    void draw_grid_update(const Rect & clip){
+        this->front.begin_update();
+        this->draw_edit(this->rect_group_filter, 0, this->filter_group_text, this->filter_group_edit_pos,
+            this->focus_item == FOCUS_ON_FILTER_GROUP, clip);
+        this->draw_edit(this->rect_device_filter, 0, this->filter_device_text, this->filter_device_edit_pos,
+            this->focus_item == FOCUS_ON_FILTER_DEVICE, clip);
+        for (size_t line = 0 ; line < this->nblines() ; line++){
+            if (this->shown[line] != this->line_key(line)){
+                this->draw_line(line, clip);
+            }
+        }
+        this->draw_page_number(clip);
+        this->front.end_update();
     }
 
     void draw_buttons(const Rect & clip){
@@ -44,6 +44,7 @@
 
 #include "RDP/x224.hpp"
 #include "RDP/sec.hpp"
+#include "RDP/fastpath.hpp"
 #include "RDP/nego.hpp"
 #include "RDP/connection.hpp"
 #include "RDP/lic.hpp"
@@ -365,6 +366,26 @@ struct mod_rdp : public client_mod {
     Random * gen;
     uint32_t verbose;
 
+    // server supports fast-path input (input capability flags)
+    bool fastpath_input;
+
+    // input events received from front, sent together in one input PDU by
+    // send_input_events(), at most 15 (numEvents of fast-path input header)
+    enum {
+        MAX_INPUT_EVENTS = 15
+    };
+    struct input_event {
+        int time;
+        int message_type;
+        int device_flags;
+        int param1;
+        int param2;
+    } input_events[MAX_INPUT_EVENTS];
+    size_t nb_input_events;
+
+    // bulk decompressor, NULL if compression was not requested to server
+    rdp_mppc_dec * mppc_dec;
+
     RdpNego nego;
 
     mod_rdp(Transport * trans,
@@ -375,7 +396,8 @@ struct mod_rdp : public client_mod {
             const bool tls,
             const ClientInfo & info,
             Random * gen,
-            uint32_t verbose = 0)
+            uint32_t verbose = 0,
+            bool rdp_compression = false)
             :
                 client_mod(front, info.width, info.height),
                     in_stream(65536),
@@ -397,6 +419,9 @@ struct mod_rdp : public client_mod {
                     front_bpp(info.bpp),
                     gen(gen),
                     verbose(verbose),
+                    fastpath_input(false),
+                    nb_input_events(0),
+                    mppc_dec(rdp_compression ? new rdp_mppc_dec() : NULL),
                     nego(tls, trans, target_user)
     {
         LOG(LOG_INFO, "Creation of new mod 'RDP'");
@@ -441,19 +466,22 @@ struct mod_rdp : public client_mod {
     }
 
     virtual ~mod_rdp() {
+        if (this->mppc_dec){
+            delete this->mppc_dec;
+        }
     }
 
     virtual void rdp_input_scancode(long param1, long param2, long device_flags, long time, Keymap2 * keymap){
         if (UP_AND_RUNNING == this->connection_finalization_state) {
 //            LOG(LOG_INFO, "Direct parameter transmission ");
-            this->send_input(time, RDP_INPUT_SCANCODE, device_flags, param1, param2);
+            this->queue_input(time, RDP_INPUT_SCANCODE, device_flags, param1, param2);
         }
     }
 
     virtual void rdp_input_synchronize(uint32_t time, uint16_t device_flags, int16_t param1, int16_t param2)
     {
         if (UP_AND_RUNNING == this->connection_finalization_state) {
-            this->send_input(0, RDP_INPUT_SYNCHRONIZE, device_flags, param1, 0);
+            this->queue_input(0, RDP_INPUT_SYNCHRONIZE, device_flags, param1, 0);
         }
     }
 
@@ -462,28 +490,33 @@ struct mod_rdp : public client_mod {
         if (UP_AND_RUNNING == this->connection_finalization_state) {
             TODO(" is decoding and reencoding really necessary  a simple pass-through from front to back-end should be enough")
             if (device_flags & MOUSE_FLAG_MOVE) { /* 0x0800 */
-                this->send_input(0, RDP_INPUT_MOUSE, MOUSE_FLAG_MOVE, x, y);
+                this->queue_input(0, RDP_INPUT_MOUSE, MOUSE_FLAG_MOVE, x, y);
             }
             if (device_flags & MOUSE_FLAG_BUTTON1) { /* 0x1000 */
-                this->send_input(0, RDP_INPUT_MOUSE, MOUSE_FLAG_BUTTON1 | (device_flags & MOUSE_FLAG_DOWN), x, y);
+                this->queue_input(0, RDP_INPUT_MOUSE, MOUSE_FLAG_BUTTON1 | (device_flags & MOUSE_FLAG_DOWN), x, y);
             }
             if (device_flags & MOUSE_FLAG_BUTTON2) { /* 0x2000 */
-                this->send_input(0, RDP_INPUT_MOUSE, MOUSE_FLAG_BUTTON2 | (device_flags & MOUSE_FLAG_DOWN), x, y);
+                this->queue_input(0, RDP_INPUT_MOUSE, MOUSE_FLAG_BUTTON2 | (device_flags & MOUSE_FLAG_DOWN), x, y);
             }
             if (device_flags & MOUSE_FLAG_BUTTON3) { /* 0x4000 */
-                this->send_input(0, RDP_INPUT_MOUSE, MOUSE_FLAG_BUTTON3 | (device_flags & MOUSE_FLAG_DOWN), x, y);
+                this->queue_input(0, RDP_INPUT_MOUSE, MOUSE_FLAG_BUTTON3 | (device_flags & MOUSE_FLAG_DOWN), x, y);
             }
             if (device_flags == MOUSE_FLAG_BUTTON4 || /* 0x0280 */ device_flags == 0x0278) {
-                this->send_input(0, RDP_INPUT_MOUSE, MOUSE_FLAG_BUTTON4 | MOUSE_FLAG_DOWN, x, y);
-                this->send_input(0, RDP_INPUT_MOUSE, MOUSE_FLAG_BUTTON4, x, y);
+                this->queue_input(0, RDP_INPUT_MOUSE, MOUSE_FLAG_BUTTON4 | MOUSE_FLAG_DOWN, x, y);
+                this->queue_input(0, RDP_INPUT_MOUSE, MOUSE_FLAG_BUTTON4, x, y);
             }
             if (device_flags == MOUSE_FLAG_BUTTON5 || /* 0x0380 */ device_flags == 0x0388) {
-                this->send_input(0, RDP_INPUT_MOUSE, MOUSE_FLAG_BUTTON5 | MOUSE_FLAG_DOWN, x, y);
-                this->send_input(0, RDP_INPUT_MOUSE, MOUSE_FLAG_BUTTON5, x, y);
+                this->queue_input(0, RDP_INPUT_MOUSE, MOUSE_FLAG_BUTTON5 | MOUSE_FLAG_DOWN, x, y);
+                this->queue_input(0, RDP_INPUT_MOUSE, MOUSE_FLAG_BUTTON5, x, y);
             }
         }
     }
 
+    virtual void rdp_input_flush()
+    {
+        this->send_input_events();
+    }
+
     virtual void send_to_mod_channel(
                 const char * const front_channel_name,
                 uint8_t * data,
@@ -1135,6 +1168,34 @@ struct mod_rdp : public client_mod {
                     next_packet += sci.len;
                     switch (sci.pdu_type1) {
                     case PDUTYPE_DATAPDU:
+                    {
+                        // data PDUs are decompressed whatever the finalization
+                        // state to keep history in sync with server
+                        ShareDataIn share_data_in(stream);
+                        Stream data_stream;
+                        bool decompressed = false;
+                        if (share_data_in.compressedType & (PACKET_COMPRESSED|PACKET_FLUSHED)){
+                            if (!this->mppc_dec){
+                                LOG(LOG_ERR, "mod_rdp::compressed data PDU received, compression was not requested");
+                                throw Error(ERR_RDP_DATA_DECOMPRESS);
+                            }
+                            uint32_t roff = 0;
+                            uint32_t rlen = 0;
+                            const uint32_t clen = (share_data_in.compressedLen > 18)
+                                                ? share_data_in.compressedLen - 18 : 0;
+                            if (clen > (uint32_t)(next_packet - stream.p)
+                            || !this->mppc_dec->decompress(stream.p, clen, share_data_in.compressedType, roff, rlen)){
+                                throw Error(ERR_RDP_DATA_DECOMPRESS);
+                            }
+                            if (share_data_in.compressedType & PACKET_COMPRESSED){
+                                data_stream.init(rlen);
+                                data_stream.out_copy_bytes(this->mppc_dec->history_buf + roff, rlen);
+                                data_stream.mark_end();
+                                data_stream.p = data_stream.data;
+                                decompressed = true;
+                            }
+                        }
+                        Stream & pdu = decompressed ? data_stream : stream;
                         switch (this->connection_finalization_state){
                         case EARLY:
                             LOG(LOG_WARNING, "Rdp::finalization is early");
@@ -1163,7 +1224,6 @@ struct mod_rdp : public client_mod {
                         case UP_AND_RUNNING:
                         {
 //                            LOG(LOG_INFO, "Up and running bpp=%u", this->bpp);
-                            ShareDataIn share_data_in(stream);
 //                            LOG(LOG_INFO, "Up and running");
                             switch (share_data_in.pdutype2) {
                             case PDUTYPE2_UPDATE:
@@ -1176,27 +1236,27 @@ struct mod_rdp : public client_mod {
     // interact with the session running on the server. The global palette
     // information for a session is sent to the client in the Update Palette PDU.
 
-                                int update_type = stream.in_uint16_le();
+                                int update_type = pdu.in_uint16_le();
 //                                LOG(LOG_INFO, "mod_rdp::MOD_RDP_CONNECTED:update_type = %u", update_type);
                                 switch (update_type) {
                                 case RDP_UPDATE_ORDERS:
                                     {
-                                        stream.in_skip_bytes(2); /* pad */
-                                        int count = stream.in_uint16_le();
-                                        stream.in_skip_bytes(2); /* pad */
+                                        pdu.in_skip_bytes(2); /* pad */
+                                        int count = pdu.in_uint16_le();
+                                        pdu.in_skip_bytes(2); /* pad */
                                         this->front.begin_update();
-                                        this->orders.process_orders(this->bpp, stream, count, this);
+                                        this->orders.process_orders(this->bpp, pdu, count, this);
                                         this->front.end_update();
                                     }
                                     break;
                                 case RDP_UPDATE_BITMAP:
                                     this->front.begin_update();
-                                    this->process_bitmap_updates(stream, this);
+                                    this->process_bitmap_updates(pdu, this);
                                     this->front.end_update();
                                     break;
                                 case RDP_UPDATE_PALETTE:
                                     this->front.begin_update();
-                                    this->process_palette(stream, this);
+                                    this->process_palette(pdu, this);
                                     this->front.end_update();
                                     break;
                                 case RDP_UPDATE_SYNCHRONIZE:
@@ -1214,7 +1274,7 @@ struct mod_rdp : public client_mod {
                             break;
                             case PDUTYPE2_POINTER:
 //                                LOG(LOG_INFO, "mod_rdp::PDUTYPE2_POINTER");
-                                this->process_pointer_pdu(stream, this);
+                                this->process_pointer_pdu(pdu, this);
                             break;
                             case PDUTYPE2_PLAY_SOUND:
 //                                LOG(LOG_INFO, "mod_rdp::PDUTYPE2_PLAY_SOUND");
@@ -1224,7 +1284,7 @@ struct mod_rdp : public client_mod {
                             break;
                             case PDUTYPE2_SET_ERROR_INFO_PDU:
 //                                LOG(LOG_INFO, "DATA PDU DISCONNECT");
-                                this->process_disconnect_pdu(stream);
+                                this->process_disconnect_pdu(pdu);
                             break;
                             default:
                                 LOG(LOG_INFO, "mod_rdp::unknown PDUTYPE2");
@@ -1232,6 +1292,7 @@ struct mod_rdp : public client_mod {
                             }
                         }
                         break;
+                        }
                     }
                     break;
                     case PDUTYPE_DEMANDACTIVEPDU:
@@ -2316,6 +2377,14 @@ struct mod_rdp : public client_mod {
                     order_caps.recv(stream, capset_length);
                     break;
                 }
+                case CAPSTYPE_INPUT:
+                {
+                    InputCaps input_caps;
+                    input_caps.recv(stream, capset_length);
+                    input_caps.log("Received from server");
+                    this->fastpath_input = (input_caps.inputFlags & (INPUT_FLAG_FASTPATH_INPUT | INPUT_FLAG_FASTPATH_INPUT2)) != 0;
+                }
+                break;
                 default:
                     break;
                 }
@@ -2458,6 +2527,70 @@ struct mod_rdp : public client_mod {
             }
         }
 
+        void queue_input(int time, int message_type,
+                         int device_flags, int param1, int param2) throw(Error)
+        {
+            if (this->nb_input_events == MAX_INPUT_EVENTS){
+                this->send_input_events();
+            }
+            struct input_event & event = this->input_events[this->nb_input_events++];
+            event.time = time;
+            event.message_type = message_type;
+            event.device_flags = device_flags;
+            event.param1 = param1;
+            event.param2 = param2;
+        }
+
+        // Sends queued input events in one PDU, using fast-path input when
+        // server supports it
+        void send_input_events() throw(Error)
+        {
+            if (this->nb_input_events == 0){
+                return;
+            }
+            if (this->verbose > 10){
+                LOG(LOG_INFO, "mod_rdp::send_input_events(%u events, fastpath=%u)",
+                    this->nb_input_events, this->fastpath_input);
+            }
+
+            Stream stream(32768);
+            if (this->fastpath_input){
+                FastPathOut fastpath_out(stream, this->crypt_level != 0, this->encrypt, this->nb_input_events);
+                for (size_t i = 0; i < this->nb_input_events; i++){
+                    const struct input_event & event = this->input_events[i];
+                    emit_fastpath_input_event(stream, event.message_type, event.device_flags, event.param1, event.param2);
+                }
+                fastpath_out.end();
+                fastpath_out.send(this->nego.trans);
+            }
+            else {
+                X224Out tpdu(X224Packet::DT_TPDU, stream);
+                McsOut sdrq_out(stream, DomainMCSPDU_SendDataRequest, this->userid, MCS_GLOBAL_CHANNEL);
+                SecOut sec_out(stream, this->crypt_level?SEC_ENCRYPT:0, this->encrypt);
+                ShareControlOut rdp_control_out(stream, PDUTYPE_DATAPDU, this->userid + MCS_USERCHANNEL_BASE);
+                ShareDataOut rdp_data_out(stream, PDUTYPE2_INPUT, this->share_id, RDP::STREAM_HI);
+
+                stream.out_uint16_le(this->nb_input_events); /* number of events */
+                stream.out_uint16_le(0);
+                for (size_t i = 0; i < this->nb_input_events; i++){
+                    const struct input_event & event = this->input_events[i];
+                    stream.out_uint32_le(event.time);
+                    stream.out_uint16_le(event.message_type);
+                    stream.out_uint16_le(event.device_flags);
+                    stream.out_uint16_le(event.param1);
+                    stream.out_uint16_le(event.param2);
+                }
+
+                rdp_data_out.end();
+                rdp_control_out.end();
+                sec_out.end();
+                sdrq_out.end();
+                tpdu.end();
+                tpdu.send(this->nego.trans);
+            }
+            this->nb_input_events = 0;
+        }
+
         virtual void rdp_input_invalidate(const Rect & r)
         {
             if (this->verbose){
@@ -2748,6 +2881,9 @@ struct mod_rdp : public client_mod {
         memcpy(infoPacket.WorkingDir, this->directory, infoPacket.cbWorkingDir);
         infoPacket.extendedInfoPacket.performanceFlags = PERF_DISABLE_WALLPAPER | this->nego.tls * ( PERF_DISABLE_FULLWINDOWDRAG
                                                                                                    | PERF_DISABLE_MENUANIMATIONS );
+        if (this->mppc_dec){
+            infoPacket.flags |= INFO_COMPRESSION | (CompressionTypeMask & (PACKET_COMPR_TYPE_64K << 9));
+        }
         infoPacket.log("Sending to server: ");
         infoPacket.emit( stream );
 
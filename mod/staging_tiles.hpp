@@ -0,0 +1,174 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Staging tiles of modules drawing framebuffer rectangles (VNC updates,
+   xup shared memory framebuffer), kept for the whole connection: rows of
+   a rectangle, 32 at a time, are either received in one transport read or
+   read where they are, then cut in 32x32 tiles, filled in place into a
+   tile buffer already in RDP bitmap layout (bottom-up rows, width aligned
+   to 4 pixels) and handed to front without further copy. Each tile is
+   drawn as soon as filled, the same buffer is reused for the next one
+   (hot in cache).
+
+   Bitmap caches keep data of stored bitmaps: when the tile buffer is still
+   used by a cache after drawing, next tile gets a new buffer.
+*/
+
+#if !defined(__MOD_STAGING_TILES_HPP__)
+#define __MOD_STAGING_TILES_HPP__
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+
+#include "log.hpp"
+#include "error.hpp"
+#include "altoco.hpp"
+#include "bitmap.hpp"
+#include "transport.hpp"
+#include "front_api.hpp"
+
+struct StagingTiles
+{
+    enum {
+        TILE = 32,
+        // tile buffer fits any bpp
+        TILE_SIZE = TILE * TILE * 4
+    };
+
+    uint8_t bpp;
+    uint8_t Bpp;
+    Bitmap::CountdownData tile;
+    // raw pixels of a row of tiles as received
+    uint8_t * strip;
+    size_t strip_size;
+
+    // current row of tiles and its top-down pixels
+    uint16_t x;
+    uint16_t y;
+    uint16_t cx;
+    uint16_t cy;
+    const uint8_t * pixels;
+    size_t rowsize;
+
+    // statistics
+    uint64_t drawn;
+    uint64_t allocated;
+
+    StagingTiles()
+        : bpp(16)
+        , Bpp(2)
+        , tile()
+        , strip(0)
+        , strip_size(0)
+        , x(0), y(0), cx(0), cy(0)
+        , pixels(0)
+        , rowsize(0)
+        , drawn(0)
+        , allocated(0)
+    {
+    }
+
+    ~StagingTiles()
+    {
+        free(this->strip);
+    }
+
+    void set_bpp(uint8_t bpp)
+    {
+        this->bpp = bpp;
+        this->Bpp = nbbytes(bpp);
+    }
+
+    // row of tiles for rectangle (x, y, cx, cy), cy at most TILE
+    void start(uint16_t x, uint16_t y, uint16_t cx, uint16_t cy)
+    {
+        this->x = x;
+        this->y = y;
+        this->cx = cx;
+        this->cy = cy;
+    }
+
+    // pixels of row of tiles from transport
+    void recv(Transport * t)
+    {
+        const size_t len = this->cx * this->cy * this->Bpp;
+        if (len > this->strip_size){
+            free(this->strip);
+            this->strip = (uint8_t *)malloc(len);
+            if (!this->strip){
+                LOG(LOG_ERR, "Memory allocation failed for staging tiles strip");
+                throw Error(ERR_VNC_MEMORY_ALLOCATION_FAILED);
+            }
+            this->strip_size = len;
+        }
+        uint8_t * p = this->strip;
+        t->recv((char**)&p, len);
+        this->set_pixels(this->strip, this->cx * this->Bpp);
+    }
+
+    // pixels of row of tiles already decoded (top-down, rowsize bytes per row),
+    // must stay available until draw
+    void set_pixels(const uint8_t * pixels, size_t rowsize)
+    {
+        this->pixels = pixels;
+        this->rowsize = rowsize;
+    }
+
+    void draw(FrontAPI & front)
+    {
+        for (uint16_t tx = 0; tx < this->cx; tx += TILE){
+            const uint16_t cx = std::min<uint16_t>(TILE, this->cx - tx);
+            this->fill(this->pixels + tx * this->Bpp, cx);
+            const Bitmap bmp(this->bpp, cx, this->cy, this->tile);
+            front.draw_bitmap_tile(Rect(this->x + tx, this->y, cx, this->cy), bmp);
+            this->drawn++;
+        }
+    }
+
+private:
+    // tile buffer not used by anybody else, filled bottom-up from src
+    void fill(const uint8_t * src, uint16_t cx)
+    {
+        if (!this->tile.ptr || this->tile.shared()){
+            this->tile.release();
+            this->tile.alloc(TILE_SIZE);
+            this->allocated++;
+        }
+        else {
+            this->tile.forget_memo();
+        }
+        const size_t len = cx * this->Bpp;
+        const size_t line_size = align4(cx) * this->Bpp;
+        const size_t rowsize = this->rowsize;
+        const uint16_t cy = this->cy;
+        uint8_t * dst = this->tile.get() + (cy - 1) * line_size;
+        for (uint16_t r = 0; r < cy; r++){
+            memcpy(dst, src, len);
+            if (len < line_size){
+                memset(dst + len, 0, line_size - len);
+            }
+            src += rowsize;
+            dst -= line_size;
+        }
+    }
+};
+
+#endif
@@ -37,6 +37,8 @@
 #include "keymap2.hpp"
 #include "keymapSym.hpp"
 #include "client_mod.hpp"
+#include "vnc/vnc_decoders.hpp"
+#include "staging_tiles.hpp"
 
 // got extracts of VNC documentation from
 // http://tigervnc.sourceforge.net/cgi-bin/rfbproto
@@ -71,6 +73,13 @@ struct mod_vnc : public client_mod {
     KeymapSym keymapSym;
     int incr;
     wait_obj * event;
+    VNCDecoders decoders; // hextile, tight and zrle, zlib streams of connection
+    StagingTiles tiles;       // staging framebuffer, rectangles are drawn from there
+    unsigned pipeline;    // FramebufferUpdateRequests kept in flight
+    unsigned outstanding; // FramebufferUpdateRequests sent not answered yet
+    bool request_held;    // next update is asked for once server data already received is handled
+    uint64_t updates;
+    uint64_t updates_ahead; // updates whose successor was asked for before decoding
 
     mod_vnc ( Transport * t
             , wait_obj * event
@@ -82,12 +91,18 @@ struct mod_vnc : public client_mod {
             , int keylayout
             , int key_flags
             , uint32_t verbose
+            , unsigned pipeline = 1
             )
         : client_mod(front, front_width, front_height)
         , verbose(verbose)
         , incr(0)
         , event(event)
         , keymapSym(verbose)
+        , pipeline(std::max(pipeline, 1u))
+        , outstanding(0)
+        , request_held(false)
+        , updates(0)
+        , updates_ahead(0)
     {
         LOG(LOG_INFO, "Connecting to VNC Server");
         init_palette332(this->palette332);
@@ -352,8 +367,8 @@ struct mod_vnc : public client_mod {
                 "\x00\x1F" // red max     : 2 bytes = 31
                 "\x00\x3F" // green max   : 2 bytes = 63
                 "\x00\x1F" // blue max    : 2 bytes = 31
-                "\x0B" // red shift       : 1 bytes = 10
-                "\x05" // green shift     : 1 bytes =  6
+                "\x0B" // red shift       : 1 bytes = 11
+                "\x05" // green shift     : 1 bytes =  5
                 "\x00" // blue shift      : 1 bytes =  0
                 "\0\0\0"; // padding      : 3 bytes
             stream.out_copy_bytes(pixel_format, 16);
@@ -366,9 +381,12 @@ struct mod_vnc : public client_mod {
             this->red_max = 0x1F;
             this->green_max = 0x3F;
             this->blue_max = 0x1F;
-            this->red_shift = 10;
-            this->green_shift = 6;
+            this->red_shift = 11;
+            this->green_shift = 5;
             this->blue_shift = 0;
+            this->tiles.set_bpp(this->bpp);
+            this->decoders.set_pixel_format(this->bpp, this->red_max, this->green_max, this->blue_max,
+                                            this->red_shift, this->green_shift, this->blue_shift);
         }
 
         // 7.4.2   SetEncodings
@@ -390,16 +408,25 @@ struct mod_vnc : public client_mod {
         // does not support the extension until it gets some extension-
         // -specific confirmation from the server.
         {
-            /* SetEncodings */
+            /* SetEncodings, most compressed first */
+            const uint32_t encodings[] = {
+                VNCDecoders::COPYRECT,
+                VNCDecoders::TIGHT,
+                VNCDecoders::ZRLE,
+                VNCDecoders::HEXTILE,
+                VNCDecoders::RAW,
+                VNCDecoders::CURSOR,
+            };
+            const size_t nb_encodings = sizeof(encodings) / sizeof(encodings[0]);
             Stream stream(32768);
             stream.out_uint8(2);
             stream.out_uint8(0);
-            stream.out_uint16_be(3);
-            stream.out_uint32_be(0); /* raw */
-            stream.out_uint32_be(1); /* copy rect */
-            stream.out_uint32_be(0xffffff11); /* cursor */
+            stream.out_uint16_be(nb_encodings);
+            for (size_t i = 0; i < nb_encodings; i++){
+                stream.out_uint32_be(encodings[i]);
+            }
 
-            this->t->send(stream.data, 4 + 3 * 4);
+            this->t->send(stream.data, 4 + nb_encodings * 4);
         }
 
         TODO("Maybe the resize should be done in session ?")
@@ -447,7 +474,14 @@ struct mod_vnc : public client_mod {
         this->rdp_input_invalidate(Rect(0, 0, this->width, this->height));
     }
 
-    virtual ~mod_vnc(){}
+    virtual ~mod_vnc(){
+        LOG(LOG_INFO, "VNC: %llu bytes of compressed rectangles decoded to %llu bytes",
+            (unsigned long long)this->decoders.received, (unsigned long long)this->decoders.decoded);
+        LOG(LOG_INFO, "VNC: %llu tiles drawn, %llu tile buffers allocated",
+            (unsigned long long)this->tiles.drawn, (unsigned long long)this->tiles.allocated);
+        LOG(LOG_INFO, "VNC: %llu updates, %llu requested ahead (pipeline %u)",
+            (unsigned long long)this->updates, (unsigned long long)this->updates_ahead, this->pipeline);
+    }
 
     void change_mouse_state(uint16_t x, uint16_t y, uint8_t button, bool set)
     {
@@ -528,9 +562,20 @@ struct mod_vnc : public client_mod {
             stream.out_uint16_be(r.cy);
             this->t->send(stream.data, 10);
             this->incr = 1;
+            this->outstanding++;
         }
     }
 
+    // Asks for next updates while this one is decoded: keeps pipeline
+    // requests in flight, and at least one new request for each update
+    // received as servers may answer several pending requests at once.
+    void request_updates_ahead()
+    {
+        do {
+            this->rdp_input_invalidate(Rect(0, 0, this->width, this->height));
+        } while (this->outstanding < this->pipeline);
+    }
+
     virtual BackEvent_t draw_event(void)
     {
         if (this->verbose){
@@ -538,7 +583,7 @@ struct mod_vnc : public client_mod {
         }
         BackEvent_t rv = BACK_EVENT_NONE;
 
-        if (this->event->can_recv()){
+        if (this->event->is_set()){
             Stream stream(1);
             try {
                 this->t->recv((char**)&stream.end, 1);
@@ -566,6 +611,14 @@ struct mod_vnc : public client_mod {
                 LOG(LOG_INFO, "exception raised");
                 rv = BACK_EVENT_1;
             }
+            // servers may answer several pending requests with one update:
+            // counting requests in flight is not enough to be sure another
+            // update will come, nothing left to read from server is.
+            if (rv == BACK_EVENT_NONE && this->request_held
+            && !this->t->has_pending() && !this->event->can_recv()){
+                this->request_held = false;
+                this->rdp_input_invalidate(Rect(0, 0, this->width, this->height));
+            }
             this->event->set(1000);
         }
         else {
@@ -645,9 +698,24 @@ struct mod_vnc : public client_mod {
         stream.in_skip_bytes(1);
         size_t num_recs = stream.in_uint16_be();
 
+        this->updates++;
+        if (this->outstanding){
+            this->outstanding--;
+        }
+        // without pipeline, or when client is late, next update is asked
+        // for once this one and the ones already received are sent to
+        // client (frame rate follows client, requests in flight drain)
+        const bool ahead = (this->pipeline > 1) && !this->front.congested();
+        if (ahead){
+            this->updates_ahead++;
+            this->request_updates_ahead();
+        }
+
         uint8_t Bpp = nbbytes(this->bpp);
-        stream.init(256);
+        // the whole update is sent to client at once
+        this->front.begin_update();
         for (size_t i = 0; i < num_recs; i++) {
+            stream.init(256);
             this->t->recv((char**)&stream.end, 12);
             uint16_t x = stream.in_uint16_be();
             uint16_t y = stream.in_uint16_be();
@@ -658,22 +726,13 @@ struct mod_vnc : public client_mod {
             switch (encoding){
             case 0: /* raw */
             {
-                uint8_t * raw = (uint8_t *)malloc(cx*16*Bpp);
-                if (!raw){
-                    LOG(LOG_ERR, "Memory allocation failed for raw buffer in VNC");
-                    throw Error(ERR_VNC_MEMORY_ALLOCATION_FAILED);
-                }
-
-                for (uint16_t yy = y ; yy < y + cy ; yy += 16){
-                    uint8_t * tmp = raw;
-                    uint16_t cyy = std::min<uint16_t>(16, cy-(yy-y));
-                    this->t->recv((char**)&tmp, cyy*cx*Bpp);
-                    this->front.begin_update();
+                for (uint16_t yy = y ; yy < y + cy ; yy += StagingTiles::TILE){
+                    uint16_t cyy = std::min<uint16_t>(StagingTiles::TILE, cy-(yy-y));
+                    this->tiles.start(x, yy, cx, cyy);
+                    this->tiles.recv(this->t);
 //                    LOG(LOG_INFO, "draw vnc: x=%d y=%d cx=%d cy=%d", x, yy, cx, cyy);
-                    this->front.draw_vnc(Rect(x, yy, cx, cyy), this->bpp, this->palette332, raw, cx*16*Bpp);
-                    this->front.end_update();
+                    this->tiles.draw(this->front);
                 }
-                free(raw);
             }
             break;
             case 1: /* copy rect */
@@ -684,9 +743,20 @@ struct mod_vnc : public client_mod {
                 const int srcy = stream.in_uint16_be();
 //                LOG(LOG_INFO, "copy rect: x=%d y=%d cx=%d cy=%d encoding=%d src_x=%d, src_y=%d", x, y, cx, cy, encoding, srcx, srcy);
                 const RDPScrBlt scrblt(Rect(x, y, cx, cy), 0xCC, srcx, srcy);
-                this->front.begin_update();
                 this->front.draw(scrblt, Rect(0, 0, this->front_width, this->front_height));
-                this->front.end_update();
+            }
+            break;
+            case VNCDecoders::HEXTILE:
+            case VNCDecoders::TIGHT:
+            case VNCDecoders::ZRLE:
+            {
+                const uint8_t * pixels = this->decoders.decode(this->t, encoding, cx, cy);
+                for (uint16_t yy = y ; yy < y + cy ; yy += StagingTiles::TILE){
+                    uint16_t cyy = std::min<uint16_t>(StagingTiles::TILE, cy-(yy-y));
+                    this->tiles.start(x, yy, cx, cyy);
+                    this->tiles.set_pixels(pixels + (yy - y) * cx * Bpp, cx * Bpp);
+                    this->tiles.draw(this->front);
+                }
             }
             break;
             case 0xffffff11: /* cursor */
@@ -764,9 +834,7 @@ struct mod_vnc : public client_mod {
                 if (x > 31) { x = 31; }
                 if (y > 31) { y = 31; }
 TODO(" we should manage cursors bigger then 32 x 32  this is not an RDP protocol limitation")
-                this->front.begin_update();
                 this->front.server_set_pointer(x, y, rdp_cursor_data, rdp_cursor_mask);
-                this->front.end_update();
             }
             break;
             default:
@@ -775,8 +843,11 @@ TODO(" we should manage cursors bigger then 32 x 32  this is not an RDP protocol
                 break;
             }
         }
+        this->front.end_update();
 
-        this->rdp_input_invalidate(Rect(0, 0, this->width, this->height));
+        if (!ahead){
+            this->request_held = true;
+        }
     }
 
     void lib_clip_data(void)
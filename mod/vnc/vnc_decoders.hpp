@@ -0,0 +1,574 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Decoders of compressed rectangle encodings of VNC FramebufferUpdate
+   (Hextile, Tight and ZRLE). Rectangles are decoded to top-down pixels,
+   cx * Bpp bytes per row, as raw encoding. zlib streams last for the whole
+   connection as required by RFB protocol.
+
+   Decoders expect the pixel format set by mod_vnc (16 bpp true color, little
+   endian), where compressed pixels (ZRLE CPIXEL, Tight TPIXEL) are plain
+   pixels.
+*/
+
+#if !defined(__MOD_VNC_VNC_DECODERS_HPP__)
+#define __MOD_VNC_VNC_DECODERS_HPP__
+
+#include <string.h>
+#include <stdint.h>
+#include <zlib.h>
+#include <algorithm>
+
+#include "log.hpp"
+#include "error.hpp"
+#include "stream.hpp"
+#include "transport.hpp"
+
+struct VNCDecoders
+{
+    enum {
+        RAW      = 0,
+        COPYRECT = 1,
+        HEXTILE  = 5,
+        TIGHT    = 7,
+        ZRLE     = 16,
+        CURSOR   = 0xffffff11
+    };
+
+    uint8_t Bpp;
+    // true color components, for Tight gradient filter
+    uint16_t red_max;
+    uint16_t green_max;
+    uint16_t blue_max;
+    uint8_t red_shift;
+    uint8_t green_shift;
+    uint8_t blue_shift;
+
+    z_stream zrle_zstream;
+    z_stream tight_zstreams[4];
+    Stream compressed; // zlib data of current rectangle
+    Stream data;       // inflated data of current rectangle
+    Stream pixels;     // decoded rectangle
+    uint8_t hextile_bg[4]; // kept from tile to tile
+    uint8_t hextile_fg[4];
+
+    uint64_t received; // bytes of encoded rectangles
+    uint64_t decoded;  // bytes of decoded pixels
+
+    VNCDecoders()
+    : Bpp(2)
+    , red_max(0x1F)
+    , green_max(0x3F)
+    , blue_max(0x1F)
+    , red_shift(11)
+    , green_shift(5)
+    , blue_shift(0)
+    , compressed(65536)
+    , data(65536)
+    , pixels(65536)
+    , received(0)
+    , decoded(0)
+    {
+        VNCDecoders::init_zstream(this->zrle_zstream);
+        for (size_t i = 0; i < 4; i++){
+            VNCDecoders::init_zstream(this->tight_zstreams[i]);
+        }
+        memset(this->hextile_bg, 0, sizeof(this->hextile_bg));
+        memset(this->hextile_fg, 0, sizeof(this->hextile_fg));
+    }
+
+    ~VNCDecoders()
+    {
+        inflateEnd(&this->zrle_zstream);
+        for (size_t i = 0; i < 4; i++){
+            inflateEnd(&this->tight_zstreams[i]);
+        }
+    }
+
+    void set_pixel_format(uint8_t bpp, uint16_t red_max, uint16_t green_max, uint16_t blue_max,
+                          uint8_t red_shift, uint8_t green_shift, uint8_t blue_shift)
+    {
+        this->Bpp = (bpp + 7) / 8;
+        this->red_max = red_max;
+        this->green_max = green_max;
+        this->blue_max = blue_max;
+        this->red_shift = red_shift;
+        this->green_shift = green_shift;
+        this->blue_shift = blue_shift;
+    }
+
+    // decodes rectangle, returns pixels owned by decoders (valid until next call)
+    const uint8_t * decode(Transport * t, uint32_t encoding, uint16_t cx, uint16_t cy)
+    {
+        VNCDecoders::reserve(this->pixels, cx * cy * this->Bpp);
+        switch (encoding){
+        case HEXTILE:
+            this->hextile(t, cx, cy, this->pixels.data);
+        break;
+        case TIGHT:
+            this->tight(t, cx, cy, this->pixels.data);
+        break;
+        case ZRLE:
+            this->zrle(t, cx, cy, this->pixels.data);
+        break;
+        default:
+            LOG(LOG_ERR, "VNC: no decoder for encoding %u", encoding);
+            throw Error(ERR_VNC_UNEXPECTED_ENCODING_IN_LIB_FRAME_BUFFER);
+        }
+        this->decoded += cx * cy * this->Bpp;
+        return this->pixels.data;
+    }
+
+private:
+    static void init_zstream(z_stream & zstream)
+    {
+        memset(&zstream, 0, sizeof(zstream));
+        if (Z_OK != inflateInit(&zstream)){
+            LOG(LOG_ERR, "VNC: zlib initialization failed");
+            throw Error(ERR_VNC_MEMORY_ALLOCATION_FAILED);
+        }
+    }
+
+    // buffer of at least len bytes, content is not kept
+    static void reserve(Stream & stream, size_t len)
+    {
+        stream.init((len > stream.capacity) ? len : stream.capacity);
+    }
+
+    void recv(Transport * t, Stream & stream, size_t len)
+    {
+        VNCDecoders::reserve(stream, len);
+        t->recv((char**)&stream.end, len);
+        this->received += len;
+    }
+
+    void need(const uint8_t * p, const uint8_t * end, size_t len, const char * encoding)
+    {
+        if (p + len > end){
+            LOG(LOG_ERR, "VNC: truncated %s rectangle", encoding);
+            throw Error(ERR_VNC_DECODE_FAILED);
+        }
+    }
+
+    void fill(uint8_t * out, size_t rowsize, uint16_t cx, uint16_t cy, const uint8_t * pixel)
+    {
+        uint8_t * row = out;
+        for (uint16_t x = 0; x < cx; x++){
+            memcpy(row + x * this->Bpp, pixel, this->Bpp);
+        }
+        for (uint16_t y = 1; y < cy; y++){
+            memcpy(out + y * rowsize, row, cx * this->Bpp);
+        }
+    }
+
+    // receives len bytes of zlib data for a rectangle inflating to at most
+    // max_len bytes, larger length announced by server is rejected
+    void recv_compressed(Transport * t, size_t len, size_t max_len, const char * encoding)
+    {
+        // worst case of stored blocks, plus sync flush markers
+        const size_t max_compressed = ::compressBound(max_len) + 64;
+        if (len > max_compressed){
+            LOG(LOG_ERR, "VNC: %s zlib data too large (%u bytes, at most %u expected)", encoding,
+                (unsigned)len, (unsigned)max_compressed);
+            throw Error(ERR_VNC_DECODE_FAILED);
+        }
+        this->recv(t, this->compressed, len);
+    }
+
+    // inflates compressed into data, all compressed data must be consumed.
+    // If exact, len bytes must be produced, otherwise len is a size hint and
+    // no more than max_len bytes may be produced.
+    void inflate(z_stream & zstream, size_t len, size_t max_len, bool exact, const char * encoding)
+    {
+        size_t capacity = len;
+        VNCDecoders::reserve(this->data, capacity);
+        zstream.next_in = this->compressed.data;
+        zstream.avail_in = this->compressed.end - this->compressed.data;
+        size_t total = 0;
+        for (;;){
+            zstream.next_out = this->data.data + total;
+            zstream.avail_out = capacity - total;
+            int ret = ::inflate(&zstream, Z_SYNC_FLUSH);
+            total = capacity - zstream.avail_out;
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR){
+                LOG(LOG_ERR, "VNC: %s inflate failed (%d)", encoding, ret);
+                throw Error(ERR_VNC_DECODE_FAILED);
+            }
+            if (zstream.avail_in == 0 || exact || ret != Z_OK){
+                break;
+            }
+            // size unknown, buffer too small
+            if (capacity >= max_len){
+                LOG(LOG_ERR, "VNC: %s zlib data inflates to more than %u bytes", encoding,
+                    (unsigned)max_len);
+                throw Error(ERR_VNC_DECODE_FAILED);
+            }
+            capacity = std::min(2 * capacity, max_len);
+            Stream larger(capacity);
+            memcpy(larger.data, this->data.data, total);
+            VNCDecoders::reserve(this->data, capacity);
+            memcpy(this->data.data, larger.data, total);
+        }
+        if (zstream.avail_in || (exact && total != len)){
+            LOG(LOG_ERR, "VNC: bad %s zlib data (%u bytes left, %u of %u bytes)", encoding,
+                (unsigned)zstream.avail_in, (unsigned)total, (unsigned)len);
+            throw Error(ERR_VNC_DECODE_FAILED);
+        }
+        this->data.end = this->data.data + total;
+    }
+
+    // 7.7.4 Hextile: 16x16 tiles, raw or background color with subrectangles
+    void hextile(Transport * t, uint16_t cx, uint16_t cy, uint8_t * out)
+    {
+        const size_t rowsize = cx * this->Bpp;
+        Stream stream(2048);
+        for (uint16_t ty = 0; ty < cy; ty += 16){
+            const uint16_t h = std::min<uint16_t>(16, cy - ty);
+            for (uint16_t tx = 0; tx < cx; tx += 16){
+                const uint16_t w = std::min<uint16_t>(16, cx - tx);
+                uint8_t * tile = out + ty * rowsize + tx * this->Bpp;
+
+                this->recv(t, stream, 1);
+                const uint8_t subencoding = stream.in_uint8();
+                if (subencoding & 1){ // Raw
+                    this->recv(t, stream, w * h * this->Bpp);
+                    for (uint16_t y = 0; y < h; y++){
+                        memcpy(tile + y * rowsize, stream.in_uint8p(w * this->Bpp), w * this->Bpp);
+                    }
+                    continue;
+                }
+                const size_t len = ((subencoding & 2) ? this->Bpp : 0)
+                                 + ((subencoding & 4) ? this->Bpp : 0)
+                                 + ((subencoding & 8) ? 1 : 0);
+                this->recv(t, stream, len);
+                if (subencoding & 2){ // BackgroundSpecified
+                    memcpy(this->hextile_bg, stream.in_uint8p(this->Bpp), this->Bpp);
+                }
+                if (subencoding & 4){ // ForegroundSpecified
+                    memcpy(this->hextile_fg, stream.in_uint8p(this->Bpp), this->Bpp);
+                }
+                this->fill(tile, rowsize, w, h, this->hextile_bg);
+                if (!(subencoding & 8)){ // AnySubrects
+                    continue;
+                }
+                const uint8_t nb_subrects = stream.in_uint8();
+                const bool colored = subencoding & 16; // SubrectsColoured
+                this->recv(t, stream, nb_subrects * ((colored ? this->Bpp : 0) + 2));
+                for (uint8_t i = 0; i < nb_subrects; i++){
+                    const uint8_t * color = colored ? stream.in_uint8p(this->Bpp) : this->hextile_fg;
+                    const uint8_t xy = stream.in_uint8();
+                    const uint8_t wh = stream.in_uint8();
+                    const uint16_t sx = xy >> 4;
+                    const uint16_t sy = xy & 0xF;
+                    const uint16_t sw = (wh >> 4) + 1;
+                    const uint16_t sh = (wh & 0xF) + 1;
+                    if (sx + sw > w || sy + sh > h){
+                        LOG(LOG_ERR, "VNC: hextile subrectangle out of tile");
+                        throw Error(ERR_VNC_DECODE_FAILED);
+                    }
+                    this->fill(tile + sy * rowsize + sx * this->Bpp, rowsize, sw, sh, color);
+                }
+            }
+        }
+    }
+
+    // Tight compact length, 1 to 3 bytes
+    size_t compact_length(Transport * t)
+    {
+        Stream stream(1);
+        this->recv(t, stream, 1);
+        uint8_t b = stream.in_uint8();
+        size_t len = b & 0x7F;
+        if (b & 0x80){
+            this->recv(t, stream, 1);
+            b = stream.in_uint8();
+            len |= (b & 0x7F) << 7;
+            if (b & 0x80){
+                this->recv(t, stream, 1);
+                len |= stream.in_uint8() << 14;
+            }
+        }
+        return len;
+    }
+
+    // value of pixel (little endian)
+    uint32_t pixel_value(const uint8_t * p)
+    {
+        uint32_t value = 0;
+        for (uint8_t i = 0; i < this->Bpp; i++){
+            value |= p[i] << (8 * i);
+        }
+        return value;
+    }
+
+    void set_pixel_value(uint8_t * p, uint32_t value)
+    {
+        for (uint8_t i = 0; i < this->Bpp; i++){
+            p[i] = value >> (8 * i);
+        }
+    }
+
+    // Tight: fill, or basic compression with copy, palette or gradient filter.
+    // JPEG compression is only sent to clients asking for a quality level,
+    // mod_vnc does not.
+    void tight(Transport * t, uint16_t cx, uint16_t cy, uint8_t * out)
+    {
+        enum { FILTER_COPY = 0, FILTER_PALETTE = 1, FILTER_GRADIENT = 2 };
+        enum { MIN_TO_COMPRESS = 12 };
+
+        const size_t rowsize = cx * this->Bpp;
+        Stream stream(1024);
+        this->recv(t, stream, 1);
+        const uint8_t control = stream.in_uint8();
+        for (size_t i = 0; i < 4; i++){
+            if (control & (1 << i)){
+                inflateReset(&this->tight_zstreams[i]);
+            }
+        }
+        const uint8_t type = control >> 4;
+        if (type == 8){ // fill
+            this->recv(t, stream, this->Bpp);
+            this->fill(out, rowsize, cx, cy, stream.in_uint8p(this->Bpp));
+            return;
+        }
+        if (type > 8){
+            LOG(LOG_ERR, "VNC: unsupported tight compression %u", type);
+            throw Error(ERR_VNC_DECODE_FAILED);
+        }
+
+        uint8_t filter = FILTER_COPY;
+        if (type & 4){
+            this->recv(t, stream, 1);
+            filter = stream.in_uint8();
+        }
+        size_t palette_size = 0;
+        uint8_t palette[256 * 4];
+        size_t len = cx * cy * this->Bpp;
+        switch (filter){
+        case FILTER_COPY:
+        case FILTER_GRADIENT:
+        break;
+        case FILTER_PALETTE:
+            this->recv(t, stream, 1);
+            palette_size = stream.in_uint8() + 1;
+            this->recv(t, stream, palette_size * this->Bpp);
+            memcpy(palette, stream.in_uint8p(palette_size * this->Bpp), palette_size * this->Bpp);
+            len = (palette_size == 2) ? ((cx + 7) / 8) * cy : cx * cy;
+        break;
+        default:
+            LOG(LOG_ERR, "VNC: unknown tight filter %u", filter);
+            throw Error(ERR_VNC_DECODE_FAILED);
+        }
+
+        if (len < MIN_TO_COMPRESS){
+            this->recv(t, this->data, len);
+        }
+        else {
+            this->recv_compressed(t, this->compact_length(t), len, "tight");
+            this->inflate(this->tight_zstreams[type & 3], len, len, true, "tight");
+        }
+        const uint8_t * p = this->data.data;
+
+        switch (filter){
+        case FILTER_COPY:
+            memcpy(out, p, len);
+        break;
+        case FILTER_PALETTE:
+            for (uint16_t y = 0; y < cy; y++){
+                uint8_t * target = out + y * rowsize;
+                for (uint16_t x = 0; x < cx; x++){
+                    size_t index = (palette_size == 2) ? (p[x / 8] >> (7 - (x & 7))) & 1 : p[x];
+                    if (index >= palette_size){
+                        LOG(LOG_ERR, "VNC: tight palette index %u out of %u colors",
+                            (unsigned)index, (unsigned)palette_size);
+                        throw Error(ERR_VNC_DECODE_FAILED);
+                    }
+                    memcpy(target + x * this->Bpp, palette + index * this->Bpp, this->Bpp);
+                }
+                p += (palette_size == 2) ? (cx + 7) / 8 : cx;
+            }
+        break;
+        case FILTER_GRADIENT:
+        {
+            // every component predicted from left, upper and upper left pixels
+            const uint16_t max[3] = { this->red_max, this->green_max, this->blue_max };
+            const uint8_t shift[3] = { this->red_shift, this->green_shift, this->blue_shift };
+            for (uint16_t y = 0; y < cy; y++){
+                uint8_t * target = out + y * rowsize;
+                for (uint16_t x = 0; x < cx; x++){
+                    const uint32_t left = x ? this->pixel_value(target + (x - 1) * this->Bpp) : 0;
+                    const uint32_t up = y ? this->pixel_value(target - rowsize + x * this->Bpp) : 0;
+                    const uint32_t upleft = (x && y) ? this->pixel_value(target - rowsize + (x - 1) * this->Bpp) : 0;
+                    const uint32_t diff = this->pixel_value(p);
+                    p += this->Bpp;
+                    uint32_t value = 0;
+                    for (size_t c = 0; c < 3; c++){
+                        int prediction = (int)((left >> shift[c]) & max[c])
+                                       + (int)((up >> shift[c]) & max[c])
+                                       - (int)((upleft >> shift[c]) & max[c]);
+                        prediction = (prediction < 0) ? 0 : (prediction > max[c]) ? max[c] : prediction;
+                        value |= ((prediction + ((diff >> shift[c]) & max[c])) & max[c]) << shift[c];
+                    }
+                    this->set_pixel_value(target + x * this->Bpp, value);
+                }
+            }
+        }
+        break;
+        }
+    }
+
+    // ZRLE run length: sum of bytes up to first byte which is not 255, plus one
+    size_t zrle_run(const uint8_t *& p, const uint8_t * end)
+    {
+        size_t run = 1;
+        uint8_t b;
+        do {
+            this->need(p, end, 1, "zrle");
+            b = *p++;
+            run += b;
+        } while (b == 255);
+        return run;
+    }
+
+    // writes run pixels of color from position pos (in pixels) of tile
+    void zrle_put_run(uint8_t * tile, size_t rowsize, uint16_t w, size_t pos, size_t run, const uint8_t * color)
+    {
+        uint16_t x = pos % w;
+        uint8_t * target = tile + (pos / w) * rowsize + x * this->Bpp;
+        for (size_t i = 0; i < run; i++){
+            memcpy(target, color, this->Bpp);
+            target += this->Bpp;
+            if (++x == w){
+                x = 0;
+                target += rowsize - w * this->Bpp;
+            }
+        }
+    }
+
+    // 7.7.6 ZRLE: zlib compressed 64x64 tiles, raw, solid, packed palette,
+    // plain RLE or palette RLE
+    void zrle(Transport * t, uint16_t cx, uint16_t cy, uint8_t * out)
+    {
+        const size_t rowsize = cx * this->Bpp;
+        // raw tiles size, larger only if server chose a worse subencoding:
+        // at worst each tile has a 127 colors palette and each pixel a color
+        // and a run length byte (plain RLE)
+        const size_t nb_tiles = ((cx + 63) / 64) * ((cy + 63) / 64);
+        const size_t raw_len = cx * cy * this->Bpp + nb_tiles;
+        const size_t max_len = cx * cy * (this->Bpp + 1) + nb_tiles * (1 + 127 * this->Bpp);
+        {
+            Stream stream(4);
+            this->recv(t, stream, 4);
+            this->recv_compressed(t, stream.in_uint32_be(), max_len, "zrle");
+        }
+        this->inflate(this->zrle_zstream, raw_len, max_len, false, "zrle");
+        const uint8_t * p = this->data.data;
+        const uint8_t * end = this->data.end;
+        const uint8_t Bpp = this->Bpp;
+
+        for (uint16_t ty = 0; ty < cy; ty += 64){
+            const uint16_t h = std::min<uint16_t>(64, cy - ty);
+            for (uint16_t tx = 0; tx < cx; tx += 64){
+                const uint16_t w = std::min<uint16_t>(64, cx - tx);
+                uint8_t * tile = out + ty * rowsize + tx * Bpp;
+
+                this->need(p, end, 1, "zrle");
+                const uint8_t subencoding = *p++;
+                if (subencoding == 0){ // raw
+                    this->need(p, end, w * h * Bpp, "zrle");
+                    for (uint16_t y = 0; y < h; y++){
+                        memcpy(tile + y * rowsize, p, w * Bpp);
+                        p += w * Bpp;
+                    }
+                }
+                else if (subencoding == 1){ // solid
+                    this->need(p, end, Bpp, "zrle");
+                    this->fill(tile, rowsize, w, h, p);
+                    p += Bpp;
+                }
+                else if (subencoding <= 16){ // packed palette
+                    const size_t palette_size = subencoding;
+                    this->need(p, end, palette_size * Bpp, "zrle");
+                    const uint8_t * palette = p;
+                    p += palette_size * Bpp;
+                    const unsigned bits = (palette_size == 2) ? 1 : (palette_size <= 4) ? 2 : 4;
+                    const size_t row_len = (w * bits + 7) / 8;
+                    this->need(p, end, row_len * h, "zrle");
+                    for (uint16_t y = 0; y < h; y++){
+                        uint8_t * target = tile + y * rowsize;
+                        for (uint16_t x = 0; x < w; x++){
+                            const unsigned bit = x * bits;
+                            const size_t index = (p[bit / 8] >> (8 - bits - (bit & 7))) & ((1 << bits) - 1);
+                            if (index >= palette_size){
+                                LOG(LOG_ERR, "VNC: zrle palette index %u out of %u colors",
+                                    (unsigned)index, (unsigned)palette_size);
+                                throw Error(ERR_VNC_DECODE_FAILED);
+                            }
+                            memcpy(target + x * Bpp, palette + index * Bpp, Bpp);
+                        }
+                        p += row_len;
+                    }
+                }
+                else if (subencoding == 128){ // plain RLE
+                    const size_t nb_pixels = w * h;
+                    for (size_t pos = 0; pos < nb_pixels;){
+                        this->need(p, end, Bpp, "zrle");
+                        const uint8_t * color = p;
+                        p += Bpp;
+                        const size_t run = this->zrle_run(p, end);
+                        if (pos + run > nb_pixels){
+                            LOG(LOG_ERR, "VNC: zrle run out of tile");
+                            throw Error(ERR_VNC_DECODE_FAILED);
+                        }
+                        this->zrle_put_run(tile, rowsize, w, pos, run, color);
+                        pos += run;
+                    }
+                }
+                else if (subencoding >= 130){ // palette RLE
+                    const size_t palette_size = subencoding - 128;
+                    this->need(p, end, palette_size * Bpp, "zrle");
+                    const uint8_t * palette = p;
+                    p += palette_size * Bpp;
+                    const size_t nb_pixels = w * h;
+                    for (size_t pos = 0; pos < nb_pixels;){
+                        this->need(p, end, 1, "zrle");
+                        size_t index = *p++;
+                        size_t run = 1;
+                        if (index & 128){
+                            index &= 127;
+                            run = this->zrle_run(p, end);
+                        }
+                        if (index >= palette_size || pos + run > nb_pixels){
+                            LOG(LOG_ERR, "VNC: bad zrle palette run");
+                            throw Error(ERR_VNC_DECODE_FAILED);
+                        }
+                        this->zrle_put_run(tile, rowsize, w, pos, run, palette + index * Bpp);
+                        pos += run;
+                    }
+                }
+                else {
+                    LOG(LOG_ERR, "VNC: unused zrle subencoding %u", subencoding);
+                    throw Error(ERR_VNC_DECODE_FAILED);
+                }
+            }
+        }
+    }
+};
+
+#endif
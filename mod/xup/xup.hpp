@@ -28,10 +28,16 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/tcp.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
 #include <errno.h>
 
 /* include other h files */
 #include "stream.hpp"
+#include "staging_tiles.hpp"
 
 struct xup_mod : public client_mod {
 
@@ -52,6 +58,8 @@ enum {
     XUPWM_BUTTON5UP    = 109,
     XUPWM_BUTTON5DOWN  = 110,
     XUPWM_BUTTON_OK    = 300,
+    XUPWM_SHM_ATTACH   = 301,  // param1: 1 if framebuffer segment attached, else 0
+    XUPWM_SHM_FRAME_ACK = 302, // param1: damaged rectangles drawn, X side may write them again
     XUPWM_SCREENUPDATE = 0x4444,
     XUPWM_CHANNELDATA  = 0x5555,
 };
@@ -65,14 +73,37 @@ enum {
     int fgcolor;
     BGRPalette palette332;
 
-    xup_mod(Transport * t, struct ModContext & context, struct FrontAPI & front, uint16_t front_width, uint16_t front_height)
+    // Shared memory framebuffer (local X side only): X side writes its
+    // screen into a SysV shm segment and only sends damaged rectangles,
+    // drawn from the segment through staging tiles. Pixels are top-down
+    // rows of shm_rowsize bytes at module bpp. Segment must be owned and
+    // created by shm_uid, the uid of the local X side ((uid_t)-1 if X side
+    // is not local or shared memory is disabled, then it keeps sending
+    // paint orders).
+    uid_t shm_uid;
+    const uint8_t * shm;
+    uint16_t shm_width;
+    uint16_t shm_height;
+    uint32_t shm_rowsize;
+    StagingTiles tiles;
+    uint64_t shm_rects;
+
+    xup_mod(Transport * t, struct ModContext & context, struct FrontAPI & front, uint16_t front_width, uint16_t front_height,
+            uid_t shm_uid = (uid_t)-1)
         : client_mod(front, front_width, front_height)
+        , shm_uid(shm_uid)
     {
         this->width = atoi(context.get(STRAUTHID_OPT_WIDTH));
         this->height = atoi(context.get(STRAUTHID_OPT_HEIGHT));
         this->bpp = atoi(context.get(STRAUTHID_OPT_BPP));
         this->rop = 0xCC;
         init_palette332(this->palette332);
+        this->shm = 0;
+        this->shm_width = 0;
+        this->shm_height = 0;
+        this->shm_rowsize = 0;
+        this->tiles.set_bpp(this->bpp);
+        this->shm_rects = 0;
 
         try {
             this->t = t;
@@ -104,9 +135,106 @@ enum {
 
     virtual ~xup_mod()
     {
+        if (this->shm){
+            LOG(LOG_INFO, "xup: %llu rectangles drawn from shared memory framebuffer",
+                (unsigned long long)this->shm_rects);
+            shmdt(this->shm);
+        }
         delete this->t;
     }
 
+    // uid of the process at the other end of TCP socket sck if it is on
+    // this host (loopback connection), as found in /proc/net/tcp
+    static bool local_peer_uid(int sck, uid_t & uid)
+    {
+        struct sockaddr_in self;
+        struct sockaddr_in peer;
+        socklen_t len = sizeof(self);
+        if (getsockname(sck, (struct sockaddr*)&self, &len) != 0 || self.sin_family != AF_INET){
+            return false;
+        }
+        len = sizeof(peer);
+        if (getpeername(sck, (struct sockaddr*)&peer, &len) != 0 || peer.sin_family != AF_INET
+        || (ntohl(peer.sin_addr.s_addr) >> 24) != 127){
+            return false;
+        }
+        FILE * f = fopen("/proc/net/tcp", "r");
+        if (!f){
+            return false;
+        }
+        // sl local_address rem_address st tx_queue:rx_queue tr:tm->when retrnsmt uid ...
+        bool found = false;
+        char line[512];
+        while (!found && fgets(line, sizeof(line), f)){
+            unsigned laddr, lport, raddr, rport, owner;
+            if (5 == sscanf(line, " %*u: %X:%X %X:%X %*X %*X:%*X %*X:%*X %*X %u",
+                            &laddr, &lport, &raddr, &rport, &owner)
+            && laddr == peer.sin_addr.s_addr && lport == ntohs(peer.sin_port)
+            && raddr == self.sin_addr.s_addr && rport == ntohs(self.sin_port)){
+                uid = owner;
+                found = true;
+            }
+        }
+        fclose(f);
+        return found;
+    }
+
+    // maps framebuffer segment of X side, X side keeps sending paint orders if it fails
+    void shm_attach(int shmid, uint16_t width, uint16_t height, uint32_t rowsize)
+    {
+        if (this->shm){
+            shmdt(this->shm);
+            this->shm = 0;
+        }
+        bool ok = false;
+        struct shmid_ds ds;
+        if (this->shm_uid == (uid_t)-1){
+            LOG(LOG_WARNING, "xup: shared memory framebuffer refused, disabled or X side is not local");
+        }
+        else if (shmctl(shmid, IPC_STAT, &ds) != 0){
+            LOG(LOG_WARNING, "xup: can't attach shared memory framebuffer %d: %s", shmid, strerror(errno));
+        }
+        else if (ds.shm_perm.uid != this->shm_uid || ds.shm_perm.cuid != this->shm_uid){
+            LOG(LOG_WARNING, "xup: shared memory framebuffer %d refused, owner %u (creator %u) is not X side %u",
+                shmid, (unsigned)ds.shm_perm.uid, (unsigned)ds.shm_perm.cuid, (unsigned)this->shm_uid);
+        }
+        else if (rowsize < width * nbbytes(this->bpp) || ds.shm_segsz < (size_t)rowsize * height){
+            LOG(LOG_WARNING, "xup: shared memory framebuffer %d too small for %ux%u",
+                shmid, width, height);
+        }
+        else {
+            void * p = shmat(shmid, 0, SHM_RDONLY);
+            if (p == (void*)-1){
+                LOG(LOG_WARNING, "xup: can't attach shared memory framebuffer %d: %s", shmid, strerror(errno));
+            }
+            else {
+                this->shm = (const uint8_t *)p;
+                this->shm_width = width;
+                this->shm_height = height;
+                this->shm_rowsize = rowsize;
+                ok = true;
+            }
+        }
+        this->x_input_event(XUPWM_SHM_ATTACH, ok, 0, 0, 0);
+    }
+
+    void shm_paint(const Rect & rect)
+    {
+        if (!this->shm){
+            LOG(LOG_WARNING, "xup: shared memory paint without framebuffer");
+            return;
+        }
+        const Rect r = rect.intersect(Rect(0, 0, this->shm_width, this->shm_height));
+        const uint8_t Bpp = nbbytes(this->bpp);
+        for (uint16_t y = r.y; y < r.y + r.cy; y += StagingTiles::TILE){
+            const uint16_t cy = std::min<uint16_t>(StagingTiles::TILE, r.y + r.cy - y);
+            this->tiles.start(r.x, y, r.cx, cy);
+            this->tiles.set_pixels(this->shm + y * this->shm_rowsize + r.x * Bpp, this->shm_rowsize);
+            this->tiles.draw(this->front);
+        }
+        this->shm_rects++;
+    }
+
     enum {
         XUPWM_INVALIDATE = 200,
     };
@@ -171,6 +299,16 @@ enum {
         }
     }
 
+    // x, y, cx, cy of orders (read in that order, unlike arguments of a call)
+    static Rect in_rect(Stream & stream)
+    {
+        const int16_t x = stream.in_sint16_le();
+        const int16_t y = stream.in_sint16_le();
+        const uint16_t cx = stream.in_uint16_le();
+        const uint16_t cy = stream.in_uint16_le();
+        return Rect(x, y, cx, cy);
+    }
+
     void x_input_event(const int msg, const long param1, const long param2, const long param3, const long param4)
     {
         Stream stream(32768);
@@ -200,6 +338,7 @@ enum {
                 stream.init(len);
                 this->t->recv((char**)&stream.end, len);
 
+                unsigned shm_paints = 0;
                 for (int index = 0; index < num_orders; index++) {
                     type = stream.in_uint16_le();
                     switch (type) {
@@ -211,11 +350,7 @@ enum {
                         break;
                     case 3:
                     {
-                        const Rect r(
-                            stream.in_sint16_le(),
-                            stream.in_sint16_le(),
-                            stream.in_uint16_le(),
-                            stream.in_uint16_le());
+                        const Rect r = this->in_rect(stream);
                          this->front.draw(RDPPatBlt(r, this->rop, BLACK, WHITE,
                             RDPBrush(r.x, r.y, 3, 0xaa, (const uint8_t *)"\xaa\x55\xaa\x55\xaa\x55\xaa\x55")
                             ), r);
@@ -223,11 +358,7 @@ enum {
                     break;
                     case 4:
                     {
-                        const Rect r(
-                            stream.in_sint16_le(),
-                            stream.in_sint16_le(),
-                            stream.in_uint16_le(),
-                            stream.in_uint16_le());
+                        const Rect r = this->in_rect(stream);
                         const int srcx = stream.in_sint16_le();
                         const int srcy = stream.in_sint16_le();
                         const RDPScrBlt scrblt(r, 0xCC, srcx, srcy);
@@ -236,11 +367,7 @@ enum {
                     break;
                     case 5:
                     {
-                        const Rect r(
-                            stream.in_sint16_le(),
-                            stream.in_sint16_le(),
-                            stream.in_uint16_le(),
-                            stream.in_uint16_le());
+                        const Rect r = this->in_rect(stream);
                         int len_bmpdata = stream.in_uint32_le();
                         const uint8_t * bmpdata = stream.in_uint8p(len_bmpdata);
                         int width = stream.in_uint16_le();
@@ -253,11 +380,7 @@ enum {
                     break;
                     case 10: /* server_set_clip */
                     {
-                        const Rect r(
-                            stream.in_sint16_le(),
-                            stream.in_sint16_le(),
-                            stream.in_uint16_le(),
-                            stream.in_uint16_le());
+                        const Rect r = this->in_rect(stream);
                           TODO(" see clip management")
 //                        this->server_set_clip(r);
                     }
@@ -305,6 +428,22 @@ enum {
                         this->front.server_set_pointer(x, y, cur_data, cur_mask);
                     }
                     break;
+                    case 51: /* shm framebuffer attach */
+                    {
+                        int shmid = stream.in_uint32_le();
+                        uint16_t width = stream.in_uint16_le();
+                        uint16_t height = stream.in_uint16_le();
+                        uint32_t rowsize = stream.in_uint32_le();
+                        this->shm_attach(shmid, width, height, rowsize);
+                    }
+                    break;
+                    case 52: /* shm paint, damaged rectangle of framebuffer */
+                    {
+                        const Rect r = this->in_rect(stream);
+                        this->shm_paint(r);
+                        shm_paints++;
+                    }
+                    break;
                     default:
                         throw 1;
                     }
@@ -312,6 +451,9 @@ enum {
                         break;
                     }
                 }
+                if (shm_paints){
+                    this->x_input_event(XUPWM_SHM_FRAME_ACK, shm_paints, 0, 0, 0);
+                }
             }
         }
         catch(...){
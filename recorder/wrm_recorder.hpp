@@ -27,6 +27,7 @@
 #include "RDP/RDPDrawable.hpp"
 #include "bitmap.hpp"
 #include "stream.hpp"
+#include "wrm_index.hpp"
 
 // #include <iostream>
 
@@ -43,6 +44,9 @@ public:
 private:
     RDPGraphicDevice * redrawable;
 
+    std::string filename; // first file of recording
+    WRMIndex index;       // keyframes, loaded on first seek
+
 
 private:
     static int open(const char * filename)
@@ -62,6 +66,7 @@ public:
     , reader(&trans, 0, Rect())
     , meta(reader)
     , redrawable(0)
+    , filename(filename)
     {
         this->reader.screen_rect.cx = this->meta.width;
         this->reader.screen_rect.cy = this->meta.height;
@@ -102,6 +107,38 @@ public:
         return this->reader.remaining_order_count;
     }
 
+    // goes to last keyframe at or before time (us since start of recording)
+    // using index file (rebuilt from chunk headers if missing),
+    // returns time of this keyframe. Screen is redrawn by keyframe only if
+    // a redraw consumer is set.
+    uint64_t seek(uint64_t time)
+    {
+        if (this->index.entries.empty()){
+            std::string index_filename = WRMIndex::path(this->filename);
+            if (!this->index.load(index_filename.c_str())){
+                LOG(LOG_INFO, "wrm index %s not found, rebuilding it", index_filename.c_str());
+                this->index.rebuild(this->filename.c_str());
+            }
+        }
+        const WRMIndexEntry * entry = this->index.find(time);
+        if (!entry){
+            return 0;
+        }
+        return this->seek(*entry);
+    }
+
+    // goes to given keyframe, returns its time
+    uint64_t seek(const WRMIndexEntry & entry)
+    {
+        this->reopen(entry.filename.c_str());
+        if (entry.offset && (off_t)-1 == lseek(this->trans.fd, entry.offset, SEEK_SET)){
+            LOG(LOG_ERR, "Error seeking wrm reader file : %s", strerror(errno));
+            throw Error(ERR_WRM_RECORDER_OPEN_FAILED);
+        }
+        this->reader.clock.reset(entry.time);
+        return entry.time;
+    }
+
 private:
     void recv_rect(Rect& rect)
     {
@@ -133,6 +170,20 @@ private:
         pen.width = this->reader.stream.in_uint8();
     }
 
+    void reopen(const char * filename)
+    {
+        ::close(this->trans.fd);
+        this->trans.fd = -1;
+        this->trans.fd = open(filename); //can throw exception
+        this->trans.total_received = 0;
+        this->trans.last_quantum_received = 0;
+        this->trans.total_sent = 0;
+        this->trans.last_quantum_sent = 0;
+        this->trans.quantum_count = 0;
+        this->reader.remaining_order_count = 0;
+        this->reader.stream.p = this->reader.stream.end;
+    }
+
 public:
     void interpret_order()
     {
@@ -144,17 +195,13 @@ public:
                 this->reader.stream.in_copy_bytes((uint8_t*)filename, len);
 
                 filename[len] = 0;
-                ::close(this->trans.fd);
-                this->trans.fd = -1;
-                this->trans.fd = open(filename); //can throw exception
-                this->trans.total_received = 0;
-                this->trans.last_quantum_received = 0;
-                this->trans.total_sent = 0;
-                this->trans.last_quantum_sent = 0;
-                this->trans.quantum_count = 0;
-                this->reader.remaining_order_count = 0;
+                this->reopen(filename);
             }
             break;
+            case WRMChunk::META_INFO:
+                this->meta.recv(this->reader.stream);
+                --this->reader.remaining_order_count;
+            break;
             case WRMChunk::BREAKPOINT:
             {
                 //std::cout << "size stream " << short(this->reader.stream.end - this->reader.stream.data) << ' ' << short(this->reader.stream.end - this->reader.stream.p) << '\n';
@@ -168,8 +215,8 @@ public:
                     //}
                     //std::cout << "read meta " << meta << std::endl;
                 }
-                this->reader.wait_cap.timer.sec() = this->reader.stream.in_uint64_le();
-                this->reader.wait_cap.timer.usec() = this->reader.stream.in_uint64_le();
+                // wall time of keyframe when recorded, replay clock only uses timestamps
+                this->reader.stream.in_skip_bytes(16);
 
                 //char texttest[10000];
 
@@ -326,6 +373,7 @@ public:
                         this->reader.remaining_order_count = 0;
                     }
                 }
+                this->reader.bmp_cache.rebuild_lru();
             }
             break;
             default:
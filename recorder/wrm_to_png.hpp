@@ -0,0 +1,203 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Conversion of native (wrm) recording to png frames, one png for every
+   TIMESTAMP chunk in requested range. Conversion can be split at keyframes
+   (files of recording) between several processes.
+*/
+
+#if !defined(__RECORDER_WRM_TO_PNG_HPP__)
+#define __RECORDER_WRM_TO_PNG_HPP__
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <limits>
+#include <vector>
+#include <string>
+
+#include "wrm_recorder.hpp"
+#include "wrm_index.hpp"
+#include "staticcapture.hpp"
+
+struct WRMToPng
+{
+    std::string wrm_filename; // first file of recording
+    uint64_t start;           // range of png frames, us since start of recording
+    uint64_t stop;
+    unsigned max_frame;
+
+    WRMToPng(const char * wrm_filename,
+             uint64_t start = 0,
+             uint64_t stop = std::numeric_limits<uint64_t>::max(),
+             unsigned max_frame = std::numeric_limits<unsigned>::max())
+    : wrm_filename(wrm_filename)
+    , start(start)
+    , stop(stop)
+    , max_frame(max_frame)
+    {}
+
+    // serial conversion from nearest keyframe before start,
+    // returns number of png written
+    unsigned run(const char * png_path)
+    {
+        WRMRecorder recorder(this->wrm_filename.c_str());
+        StaticCapture capture(recorder.meta.width, recorder.meta.height, png_path, 0, 0);
+        recorder.consumer(&capture);
+        recorder.redraw_consumer(&capture);
+        recorder.reader.clock.mode = ReplayClock::BATCH;
+        recorder.seek(this->start);
+        this->replay(recorder, capture, true);
+        recorder.reader.clock.log();
+        return capture.framenb;
+    }
+
+    // parallel conversion, segments between keyframes are shared by jobs
+    // processes, each one with its own drawable. Every segment starts with a
+    // full screen keyframe, hence png are the same as serial conversion.
+    unsigned run(const char * png_path, unsigned jobs)
+    {
+        if (jobs <= 1){
+            return this->run(png_path);
+        }
+
+        WRMIndex index;
+        if (!index.rebuild(this->wrm_filename.c_str())){
+            LOG(LOG_ERR, "wrm to png: failed to read %s", this->wrm_filename.c_str());
+            throw Error(ERR_WRM_RECORDER_OPEN_FAILED);
+        }
+
+        // number of first png of every segment, segments without png are not replayed
+        const size_t nb_segments = index.entries.size();
+        std::vector<unsigned> first_frame(nb_segments);
+        std::vector<size_t> segments;
+        unsigned nb_frames = 0;
+        for (size_t i = 0; i < nb_segments; i++){
+            first_frame[i] = nb_frames;
+            size_t last = (i + 1 < nb_segments) ? index.entries[i + 1].first_timestamp
+                                                : index.timestamps.size();
+            for (size_t t = index.entries[i].first_timestamp; t < last; t++){
+                if (index.timestamps[t] >= this->start && index.timestamps[t] <= this->stop
+                && nb_frames < this->max_frame){
+                    nb_frames++;
+                }
+            }
+            if (nb_frames != first_frame[i]){
+                segments.push_back(i);
+            }
+        }
+
+        // made before fork, png are named after parent pid as with serial conversion
+        uint16_t width;
+        uint16_t height;
+        {
+            WRMRecorder recorder(this->wrm_filename.c_str());
+            width = recorder.meta.width;
+            height = recorder.meta.height;
+        }
+        StaticCapture capture(width, height, png_path, 0, 0);
+
+        std::vector<pid_t> pids;
+        bool ok = true;
+        for (unsigned job = 0; job < jobs && job < segments.size(); job++){
+            pid_t pid = fork();
+            if (pid == 0){
+                _exit(this->replay_segments(capture, index, first_frame, segments, job, jobs) ? 0 : 1);
+            }
+            if (pid < 0){
+                LOG(LOG_ERR, "wrm to png: fork failed, job %u done by main process : %s", job, strerror(errno));
+                ok = this->replay_segments(capture, index, first_frame, segments, job, jobs) && ok;
+                continue;
+            }
+            pids.push_back(pid);
+        }
+        for (size_t i = 0; i < pids.size(); i++){
+            int status = 0;
+            if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)){
+                ok = false;
+            }
+        }
+        if (!ok){
+            LOG(LOG_ERR, "wrm to png: some segments of %s failed", this->wrm_filename.c_str());
+            throw Error(ERR_WRM_RECORDER_OPEN_FAILED);
+        }
+        return nb_frames;
+    }
+
+private:
+    // replays recorder until end of range or max_frame,
+    // or until end of current file if follow is false.
+    // Returns false if conversion is done.
+    bool replay(WRMRecorder & recorder, StaticCapture & capture, bool follow)
+    {
+        const ReplayClock & clock = recorder.reader.clock;
+        while (recorder.selected_next_order()){
+            switch (recorder.chunk_type()){
+            case WRMChunk::TIMESTAMP:
+                recorder.interpret_order();
+                if (clock.recorded > this->stop || (unsigned)capture.framenb >= this->max_frame){
+                    return false;
+                }
+                if (clock.recorded >= this->start){
+                    capture.flush();
+                }
+            break;
+            case WRMChunk::NEXT_FILE:
+                if (!follow){
+                    return true;
+                }
+                recorder.interpret_order();
+            break;
+            default:
+                recorder.interpret_order();
+            break;
+            }
+        }
+        return false;
+    }
+
+    // segments job, job + jobs, job + 2 * jobs...
+    bool replay_segments(StaticCapture & capture, const WRMIndex & index,
+                         const std::vector<unsigned> & first_frame,
+                         const std::vector<size_t> & segments,
+                         unsigned job, unsigned jobs)
+    {
+        try {
+            WRMRecorder recorder(this->wrm_filename.c_str());
+            recorder.consumer(&capture);
+            recorder.redraw_consumer(&capture);
+            recorder.reader.clock.mode = ReplayClock::BATCH;
+            uint64_t replayed = 0;
+            for (size_t i = job; i < segments.size(); i += jobs){
+                capture.framenb = first_frame[segments[i]];
+                recorder.seek(index.entries[segments[i]]);
+                this->replay(recorder, capture, false);
+                replayed += recorder.reader.clock.recorded - recorder.reader.clock.origin;
+            }
+            LOG(LOG_INFO, "wrm to png: job %u replayed %llu us of recording", job, (unsigned long long)replayed);
+        }
+        catch (Error & e){
+            LOG(LOG_ERR, "wrm to png: job %u failed with error %u", job, e.id);
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif
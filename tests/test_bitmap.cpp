@@ -3671,3 +3671,128 @@ BOOST_AUTO_TEST_CASE(TestBitmapCompress)
    }
 
 }
+
+// bitmaps mixing structures seen by compressor: copies of line above,
+// xored (mix) spans, color runs, bicolor runs and noise.
+static void fuzz_bitmap_data(uint8_t * data, size_t line_size, size_t cy, uint8_t Bpp, uint32_t & seed)
+{
+    for (size_t y = 0 ; y < cy ; y++){
+        uint8_t * line = data + y * line_size;
+        size_t x = 0;
+        while (x < line_size){
+            seed = seed * 1103515245 + 12345;
+            const unsigned kind = (seed >> 16) % 6;
+            const size_t len = std::min<size_t>(line_size - x, (1 + (seed >> 8) % 40) * Bpp);
+            const uint8_t value = (uint8_t)(seed >> 24);
+            for (size_t i = 0 ; i < len ; i++){
+                const uint8_t above = y ? line[x + i - line_size] : 0;
+                switch (kind){
+                case 0: line[x + i] = above; break;
+                case 1: line[x + i] = above ^ ((i % Bpp) ? 0x55 : value); break;
+                case 2: line[x + i] = (i % Bpp) ? 0 : value; break;
+                case 3: line[x + i] = ((i / Bpp) & 1) ? 0xFF : value; break;
+                case 4: line[x + i] = 0; break;
+                default: line[x + i] = (uint8_t)(value * (i + 7)); break;
+                }
+            }
+            x += len;
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapCompressEnginesIdentical)
+{
+    const unsigned saved_engine = RLEScan::engine();
+    const uint8_t bpps[5] = { 8, 15, 16, 24, 32 };
+    uint32_t seed = 42;
+
+    for (unsigned round = 0 ; round < 400 ; round++){
+        const uint8_t bpp = bpps[round % 5];
+        const uint8_t Bpp = nbbytes(bpp);
+        seed = seed * 1103515245 + 12345;
+        const uint16_t cx = 4 * (1 + (seed >> 16) % 24);
+        const uint16_t cy = 1 + (seed >> 8) % 32;
+        const size_t size = cx * cy * Bpp;
+        uint8_t * raw = new uint8_t[size];
+        fuzz_bitmap_data(raw, cx * Bpp, cy, Bpp, seed);
+        Bitmap bmp(bpp, NULL, cx, cy, raw, size);
+        delete [] raw;
+
+        RLEScan::select_engine(RLE_SCAN_REFERENCE);
+        Stream ref(2 * bmp.bmp_size + 64);
+        bmp.rle_compress(ref);
+
+        for (unsigned engine = RLE_SCAN_SCALAR ; engine <= RLE_SCAN_AVX2 ; engine++){
+            if (!RLEScan::available(engine)){
+                continue;
+            }
+            RLEScan::select_engine(engine);
+            Stream out(2 * bmp.bmp_size + 64);
+            bmp.rle_compress(out);
+            BOOST_CHECK_EQUAL(ref.p - ref.data, out.p - out.data);
+            if (ref.p - ref.data != out.p - out.data
+            || 0 != memcmp(ref.data, out.data, ref.p - ref.data)){
+                BOOST_CHECK_MESSAGE(false, "engine " << engine << " differs bpp=" << (int)bpp
+                    << " cx=" << cx << " cy=" << cy << " round=" << round);
+                break;
+            }
+        }
+    }
+    RLEScan::select_engine(saved_engine);
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapDecompressIdentical)
+{
+    const uint8_t bpps[5] = { 8, 15, 16, 24, 32 };
+    uint32_t seed = 1234;
+
+    for (unsigned round = 0 ; round < 400 ; round++){
+        const uint8_t bpp = bpps[round % 5];
+        const uint8_t Bpp = nbbytes(bpp);
+        seed = seed * 1103515245 + 12345;
+        const uint16_t cx = 4 * (1 + (seed >> 16) % 24);
+        const uint16_t cy = 1 + (seed >> 8) % 32;
+        const size_t size = cx * cy * Bpp;
+        uint8_t * raw = new uint8_t[size];
+        fuzz_bitmap_data(raw, cx * Bpp, cy, Bpp, seed);
+        Bitmap bmp(bpp, NULL, cx, cy, raw, size);
+        delete [] raw;
+
+        Stream out(2 * bmp.bmp_size + 64);
+        bmp.rle_compress(out);
+
+        Bitmap::use_reference_decompressor() = true;
+        Bitmap ref(bpp, NULL, cx, cy, out.data, out.p - out.data, true);
+        Bitmap::use_reference_decompressor() = false;
+        Bitmap fast(bpp, NULL, cx, cy, out.data, out.p - out.data, true);
+
+        BOOST_CHECK(0 == memcmp(ref.data(), bmp.data(), bmp.bmp_size));
+        if (0 != memcmp(ref.data(), fast.data(), bmp.bmp_size)){
+            BOOST_CHECK_MESSAGE(false, "decompressors differ bpp=" << (int)bpp
+                << " cx=" << cx << " cy=" << cy << " round=" << round);
+        }
+    }
+
+    // orders never emitted by our compressor: white, black, special fgbg,
+    // long forms and fill runs longer than a scanline
+    const uint8_t compressed[] = {
+        0xFD, 0xFE, 0xFA, 0xF9,             // white, black, special fgbg 1 and 2
+        0xF3, 0x05, 0x00, 0x42,             // color long form
+        0xF0, 0x30, 0x00,                   // fill long form (more than one scanline)
+        0x25,                               // mix
+        0x01,                               // fill
+        0x02,                               // fill, starts with magic mix pixel
+        0xF8, 0x03, 0x00, 0x11, 0x22,       // bicolor long form
+        0xD1, 0x33, 0x81,                   // fom set
+        0x85, 0x01, 0x02, 0x03, 0x04, 0x05, // copy
+        0x40, 0x0F, 0xAA, 0x55,             // fom, two masks
+        0xC3, 0x77,                         // mix set
+    };
+    Bitmap::use_reference_decompressor() = true;
+    Bitmap ref(8, NULL, 16, 16, compressed, sizeof(compressed), true);
+    Bitmap::use_reference_decompressor() = false;
+    Bitmap fast(8, NULL, 16, 16, compressed, sizeof(compressed), true);
+    // pixels after end of compressed data are not set
+    const size_t decoded = 1 + 1 + 8 + 8 + 5 + 48 + 5 + 1 + 2 + 6 + 8 + 5 + 16 + 3;
+    BOOST_CHECK(0 == memcmp(ref.data(), fast.data(), decoded));
+}
@@ -30,6 +30,7 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <vector>
 #include <stdint.h>
 #include "bitmap.hpp"
 #include "bmpcache.hpp"
@@ -435,3 +436,136 @@ BOOST_AUTO_TEST_CASE(TestCreateBitmapCache)
 //    BOOST_CHECK(true);
 */
 }
+
+long long ustime() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (long long)now.tv_sec*1000000LL + (long long)now.tv_usec;
+}
+
+// fill every pixel with a pattern depending on cache id and rank of bitmap
+// to get distinct bitmaps
+static Bitmap * make_bitmap(uint16_t cx, uint16_t cy, uint8_t id, uint32_t rank)
+{
+    const size_t size = cx * cy * 3;
+    uint8_t * raw = new uint8_t[size];
+    for (size_t i = 0 ; i < size ; i += 3){
+        raw[i] = id;
+        raw[i+1] = rank;
+        raw[i+2] = rank >> 8;
+    }
+    Bitmap * bmp = new Bitmap(24, NULL, cx, cy, raw, size);
+    delete [] raw;
+    return bmp;
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapCacheFullOccupancyPerf)
+{
+    BmpCache cache(24);
+    const uint16_t sizes[3] = { 16, 32, 64 }; // 768, 3072 and 12288 bytes at 24 bpp
+
+    std::vector<Bitmap*> bitmaps[3];
+    for (uint8_t id = 0 ; id < 3 ; id++){
+        for (uint32_t rank = 0 ; rank < 8192 ; rank++){
+            bitmaps[id].push_back(make_bitmap(sizes[id], sizes[id], id, rank));
+        }
+    }
+
+    // filling cache, every bitmap is added at the first free entry
+    long long usec = ustime();
+    for (uint8_t id = 0 ; id < 3 ; id++){
+        for (uint32_t rank = 0 ; rank < 8192 ; rank++){
+            uint32_t res = cache.cache_bitmap(*bitmaps[id][rank]);
+            if (res != ((BITMAP_ADDED_TO_CACHE << 24)|(id << 16)|rank)){
+                BOOST_CHECK_EQUAL((BITMAP_ADDED_TO_CACHE << 24)|(id << 16)|rank, res);
+            }
+        }
+    }
+    long long elapusec = ustime() - usec;
+    printf("fill 3x8192 entries: %lld us (%f us/bitmap)\n", elapusec, (double)elapusec / (3*8192));
+
+    // cache is full, every lookup hits
+    usec = ustime();
+    for (uint32_t rank = 0 ; rank < 8192 ; rank++){
+        for (uint8_t id = 0 ; id < 3 ; id++){
+            uint32_t res = cache.cache_bitmap(*bitmaps[id][rank]);
+            if (res != ((BITMAP_FOUND_IN_CACHE << 24)|(id << 16)|rank)){
+                BOOST_CHECK_EQUAL((BITMAP_FOUND_IN_CACHE << 24)|(id << 16)|rank, res);
+            }
+        }
+    }
+    elapusec = ustime() - usec;
+    printf("hit 3x8192 entries: %lld us (%f us/bitmap)\n", elapusec, (double)elapusec / (3*8192));
+
+    // new bitmaps replace oldest entries first
+    usec = ustime();
+    for (uint8_t id = 0 ; id < 3 ; id++){
+        for (uint32_t rank = 0 ; rank < 1024 ; rank++){
+            Bitmap * bmp = make_bitmap(sizes[id], sizes[id], id, 8192 + rank);
+            uint32_t res = cache.cache_bitmap(*bmp);
+            delete bmp;
+            if (res != ((BITMAP_ADDED_TO_CACHE << 24)|(id << 16)|rank)){
+                BOOST_CHECK_EQUAL((BITMAP_ADDED_TO_CACHE << 24)|(id << 16)|rank, res);
+            }
+        }
+    }
+    elapusec = ustime() - usec;
+    printf("replace 3x1024 entries: %lld us (%f us/bitmap)\n", elapusec, (double)elapusec / (3*1024));
+
+    // replaced bitmaps are not found any more, others still are
+    BOOST_CHECK_EQUAL((BITMAP_ADDED_TO_CACHE << 24)|(1 << 16)|1024, cache.cache_bitmap(*bitmaps[1][0]));
+    BOOST_CHECK_EQUAL((BITMAP_FOUND_IN_CACHE << 24)|(1 << 16)|1024, cache.cache_bitmap(*bitmaps[1][0]));
+    BOOST_CHECK_EQUAL((BITMAP_FOUND_IN_CACHE << 24)|(2 << 16)|5000, cache.cache_bitmap(*bitmaps[2][5000]));
+
+    for (uint8_t id = 0 ; id < 3 ; id++){
+        for (uint32_t rank = 0 ; rank < 8192 ; rank++){
+            delete bitmaps[id][rank];
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapCacheFingerprint)
+{
+    uint8_t signatures[] = { BMPCACHE_SIGNATURE_FINGERPRINT, BMPCACHE_SIGNATURE_FINGERPRINT_CMP };
+    for (size_t i = 0 ; i < sizeof(signatures) ; i++){
+        BmpCache cache(24, 8192, 768, 8192, 3072, 8192, 12288, signatures[i]);
+
+        Bitmap * bmp1 = make_bitmap(32, 32, 1, 1);
+        Bitmap * bmp2 = make_bitmap(32, 32, 1, 2);
+        Bitmap * bmp1bis = make_bitmap(32, 32, 1, 1);
+        Bitmap * bmp1small = make_bitmap(16, 16, 1, 1);
+
+        BOOST_CHECK_EQUAL((BITMAP_ADDED_TO_CACHE << 24)|(1 << 16)|0, cache.cache_bitmap(*bmp1));
+        BOOST_CHECK_EQUAL((BITMAP_ADDED_TO_CACHE << 24)|(1 << 16)|1, cache.cache_bitmap(*bmp2));
+        // same pixels in another bitmap object
+        BOOST_CHECK_EQUAL((BITMAP_FOUND_IN_CACHE << 24)|(1 << 16)|0, cache.cache_bitmap(*bmp1bis));
+        BOOST_CHECK_EQUAL((BITMAP_ADDED_TO_CACHE << 24)|(0 << 16)|0, cache.cache_bitmap(*bmp1small));
+        BOOST_CHECK_EQUAL((BITMAP_FOUND_IN_CACHE << 24)|(1 << 16)|1, cache.cache_bitmap(*bmp2));
+
+        // a bitmap restored with put is found again
+        cache.put(1, 7, new Bitmap(24, *bmp1small));
+        BOOST_CHECK_EQUAL((BITMAP_FOUND_IN_CACHE << 24)|(0 << 16)|0, cache.cache_bitmap(*bmp1small));
+
+        delete bmp1;
+        delete bmp2;
+        delete bmp1bis;
+        delete bmp1small;
+    }
+
+    // fingerprint depends on geometry and color depth, not only on data
+    uint8_t raw[16*16*3] = {};
+    Bitmap a(24, NULL, 16, 16, raw, sizeof(raw));
+    Bitmap b(24, NULL, 32, 8, raw, sizeof(raw));
+    Bitmap c(8, NULL, 48, 16, raw, sizeof(raw));
+    uint8_t fa[16];
+    uint8_t fb[16];
+    uint8_t fc[16];
+    uint8_t fa2[16];
+    a.compute_fingerprint(fa);
+    b.compute_fingerprint(fb);
+    c.compute_fingerprint(fc);
+    a.compute_fingerprint(fa2);
+    BOOST_CHECK(0 == memcmp(fa, fa2, 16));
+    BOOST_CHECK(0 != memcmp(fa, fb, 16));
+    BOOST_CHECK(0 != memcmp(fa, fc, 16));
+}
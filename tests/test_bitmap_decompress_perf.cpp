@@ -0,0 +1,84 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Unit test for bitmap class, decompression performance
+
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestBitmapDecompressPerf
+#include <boost/test/auto_unit_test.hpp>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "bitmap.hpp"
+#include "colors.hpp"
+#include "config.hpp"
+#include <sys/time.h>
+#include "rdtsc.hpp"
+
+long long ustime() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (long long)now.tv_sec*1000000LL + (long long)now.tv_usec;
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapDecompressPerformance)
+{
+    const char * files[3] = {
+        FIXTURES_PATH "/color_image.bmp",
+        FIXTURES_PATH "/logo-redemption.bmp",
+        FIXTURES_PATH "/Philips_PM5544_640.bmp",
+    };
+    const uint8_t bpps[5] = { 8, 15, 16, 24, 32 };
+
+    for (size_t f = 0 ; f < 3 ; f++){
+        Bitmap source(files[f]);
+        for (size_t b = 0 ; b < 5 ; b++){
+            Bitmap bmp(bpps[b], source);
+            Stream out(2 * bmp.bmp_size + 64);
+            bmp.rle_compress(out);
+            const size_t compressed_size = out.p - out.data;
+            // enough loops to decode about 50 MB
+            const unsigned loops = std::max<unsigned>(20, 50000000 / bmp.bmp_size);
+
+            long long elapsed[2];
+            for (unsigned reference = 0 ; reference < 2 ; reference++){
+                Bitmap::use_reference_decompressor() = reference;
+                long long usec = ustime();
+                for (unsigned i = 0 ; i < loops ; i++){
+                    Bitmap decoded(bpps[b], &source.original_palette, bmp.cx, bmp.cy, out.data, compressed_size, true);
+                }
+                elapsed[reference] = ustime() - usec;
+
+                Bitmap decoded(bpps[b], &source.original_palette, bmp.cx, bmp.cy, out.data, compressed_size, true);
+                BOOST_CHECK(0 == memcmp(decoded.data(), bmp.data(), bmp.bmp_size));
+            }
+            Bitmap::use_reference_decompressor() = false;
+
+            printf("%ux%u %2u bpp (compressed %7u): reference %8.1f MB/s, runs %8.1f MB/s, speedup %.1f\n",
+                bmp.cx, bmp.cy, bpps[b], (unsigned)compressed_size,
+                (double)loops * bmp.bmp_size / (elapsed[1] ? elapsed[1] : 1),
+                (double)loops * bmp.bmp_size / (elapsed[0] ? elapsed[0] : 1),
+                (double)elapsed[1] / (elapsed[0] ? elapsed[0] : 1));
+        }
+    }
+}
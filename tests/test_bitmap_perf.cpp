@@ -149,3 +149,161 @@ BOOST_AUTO_TEST_CASE(TestBitmapCompressPerformance)
 
 
 }
+
+BOOST_AUTO_TEST_CASE(TestBitmapCompressEnginesPerformance)
+{
+    const uint8_t bpps[5] = { 8, 15, 16, 24, 32 };
+    const char * names[4] = { "reference", "scalar", "sse2", "avx2" };
+    const unsigned saved_engine = RLEScan::engine();
+    Bitmap photo(FIXTURES_PATH "/color_image.bmp");
+
+    // screen like content: flat background, windows with title bars, text lines
+    const uint16_t cx = 1024;
+    const uint16_t cy = 768;
+    uint8_t * raw = new uint8_t[cx * cy * 3];
+    for (size_t y = 0 ; y < cy ; y++){
+        for (size_t x = 0 ; x < cx ; x++){
+            uint8_t * pixel = raw + (y * cx + x) * 3;
+            const bool window = (x / 256) % 2 == (y / 192) % 2;
+            const bool title = window && (y % 192) < 20;
+            const bool text = window && !title && (y % 16) > 10 && ((x * 7 + y * 3) % 11) < 3;
+            pixel[0] = title ? 0x80 : text ? 0x00 : window ? 0xF0 : 0x40;
+            pixel[1] = title ? 0x20 : text ? 0x00 : window ? 0xF0 : 0x70;
+            pixel[2] = title ? 0x10 : text ? 0x00 : window ? 0xF0 : 0xA0;
+        }
+    }
+    Bitmap screen(24, NULL, cx, cy, raw, cx * cy * 3);
+    delete [] raw;
+
+    const Bitmap * sources[2] = { &photo, &screen };
+    for (size_t b = 0 ; b < 10 ; b++){
+        Bitmap bmp(bpps[b % 5], *sources[b / 5]);
+        Stream out(2 * bmp.bmp_size + 64);
+        const unsigned loops = 5;
+
+        for (unsigned engine = RLE_SCAN_REFERENCE ; engine <= RLE_SCAN_AVX2 ; engine++){
+            if (!RLEScan::available(engine)){
+                continue;
+            }
+            RLEScan::select_engine(engine);
+            long long usec = ustime();
+            for (unsigned i = 0 ; i < loops ; i++){
+                out.p = out.data;
+                // not compress(), compressed data would be memoized
+                bmp.rle_compress(out);
+            }
+            long long elapsed = ustime() - usec;
+            printf("%ux%u %2u bpp %-9s: %8.1f MB/s (compressed size %u)\n",
+                bmp.cx, bmp.cy, bpps[b % 5], names[engine],
+                (double)loops * bmp.bmp_size / (elapsed ? elapsed : 1),
+                (unsigned)(out.p - out.data));
+        }
+    }
+    RLEScan::select_engine(saved_engine);
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapSignaturePerformance)
+{
+    const uint8_t bpps[3] = { 8, 16, 24 };
+    const uint16_t sizes[2] = { 32, 64 };
+    const unsigned loops = 2000;
+    // several distinct tiles, so that results can't be computed once for all loops
+    const unsigned nb_tiles = 16;
+
+    for (size_t s = 0 ; s < 2 ; s++){
+        for (size_t b = 0 ; b < 3 ; b++){
+            const uint16_t cx = sizes[s];
+            const uint8_t bpp = bpps[b];
+            const size_t size = cx * cx * nbbytes(bpp);
+            uint8_t * raw = new uint8_t[size];
+            Bitmap * tiles[nb_tiles];
+            for (unsigned t = 0 ; t < nb_tiles ; t++){
+                for (size_t i = 0 ; i < size ; i++){
+                    raw[i] = (uint8_t)(i * 7 + i / 13 + t);
+                }
+                tiles[t] = new Bitmap(bpp, NULL, cx, cx, raw, size);
+            }
+            delete [] raw;
+
+            uint8_t sha1[20];
+            uint8_t fingerprint[16];
+            unsigned acc = 0;
+
+            long long usec = ustime();
+            for (unsigned i = 0 ; i < loops ; i++){
+                tiles[i % nb_tiles]->compute_sha1(sha1);
+                acc += sha1[0];
+            }
+            long long sha1_usec = ustime() - usec;
+
+            usec = ustime();
+            for (unsigned i = 0 ; i < loops ; i++){
+                acc += tiles[i % nb_tiles]->compute_crc();
+            }
+            long long crc_usec = ustime() - usec;
+
+            usec = ustime();
+            for (unsigned i = 0 ; i < loops ; i++){
+                tiles[i % nb_tiles]->compute_fingerprint(fingerprint);
+                acc += fingerprint[0];
+            }
+            long long fp_usec = ustime() - usec;
+
+            const double mb = (double)loops * tiles[0]->bmp_size / 1000000.0;
+            printf("%ux%u %2u bpp: sha1 %8.1f MB/s, crc %8.1f MB/s, fingerprint %8.1f MB/s (%x)\n",
+                cx, cx, bpp,
+                mb * 1000000 / (sha1_usec ? sha1_usec : 1),
+                mb * 1000000 / (crc_usec ? crc_usec : 1),
+                mb * 1000000 / (fp_usec ? fp_usec : 1),
+                acc);
+
+            for (unsigned t = 0 ; t < nb_tiles ; t++){
+                delete tiles[t];
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapCompressMemo)
+{
+    uint8_t raw[32*32*3];
+    for (size_t i = 0 ; i < sizeof(raw) ; i++){
+        raw[i] = (uint8_t)((i / 21) * 5);
+    }
+    Bitmap bmp(24, NULL, 32, 32, raw, sizeof(raw));
+
+    Bitmap::CompressStats stats;
+
+    Stream out1(2*bmp.bmp_size);
+    bmp.compress(out1, &stats);
+    BOOST_CHECK_EQUAL(1, stats.misses);
+    BOOST_CHECK_EQUAL(0u, stats.hits);
+
+    // same pixels, same bpp: compressed data is reused
+    Bitmap copy(24, bmp);
+    Stream out2(2*bmp.bmp_size);
+    copy.compress(out2, &stats);
+    BOOST_CHECK_EQUAL(1, stats.misses);
+    BOOST_CHECK_EQUAL(1, stats.hits);
+    BOOST_CHECK_EQUAL(out1.p - out1.data, out2.p - out2.data);
+    BOOST_CHECK(0 == memcmp(out1.data, out2.data, out1.p - out1.data));
+
+    // conversions to another bpp share memo, but have their own compressed data
+    Bitmap bmp16(16, bmp);
+    Stream out3(2*bmp16.bmp_size);
+    bmp16.compress(out3, &stats);
+    BOOST_CHECK_EQUAL(2, stats.misses);
+
+    Bitmap other16(16, bmp);
+    Stream out4(2*other16.bmp_size);
+    other16.compress(out4, &stats);
+    BOOST_CHECK_EQUAL(2, stats.misses);
+    BOOST_CHECK_EQUAL(2, stats.hits);
+    BOOST_CHECK_EQUAL(out3.p - out3.data, out4.p - out4.data);
+    BOOST_CHECK(0 == memcmp(out3.data, out4.data, out3.p - out3.data));
+
+    // and memoized compressed data is still valid RLE
+    Bitmap back(16, (BGRPalette *)NULL, bmp16.cx, bmp16.cy, out4.data, out4.p - out4.data, true);
+    BOOST_CHECK_EQUAL(back.bmp_size, bmp16.bmp_size);
+    BOOST_CHECK(0 == memcmp(back.data(), bmp16.data(), bmp16.bmp_size));
+}
@@ -453,3 +453,35 @@ BOOST_AUTO_TEST_CASE(TestMemblt)
     // uncomment to see result in png file
     //dump_png("/tmp/test_memblt_", gd.drawable);
 }
+
+BOOST_AUTO_TEST_CASE(TestDirtyArea)
+{
+    uint16_t width = 640;
+    uint16_t height = 480;
+    Rect screen_rect(0, 0, width, height);
+    RDPDrawable gd(width, height, true);
+
+    // new drawable is dirty as a whole
+    BOOST_CHECK(gd.drawable.dirty.equal(screen_rect));
+    gd.drawable.reset_dirty();
+    BOOST_CHECK(gd.drawable.dirty.isempty());
+
+    // orders outside clip do not change anything
+    gd.draw(RDPOpaqueRect(Rect(10, 10, 20, 20), RED), Rect(100, 100, 10, 10));
+    gd.draw(RDPLineTo(0, 0, 0, 50, 0, BLUE, 0xCC, RDPPen(0, 1, GREEN)), Rect(0, 100, 100, 100));
+    BOOST_CHECK(gd.drawable.dirty.isempty());
+
+    gd.draw(RDPOpaqueRect(Rect(10, 20, 30, 40), RED), screen_rect);
+    BOOST_CHECK(gd.drawable.dirty.equal(Rect(10, 20, 30, 40)));
+
+    // dirty area is bounding box of changed areas, limited to screen
+    gd.draw(RDPLineTo(0, 100, 200, 150, 210, BLUE, 0xCC, RDPPen(0, 1, GREEN)), screen_rect);
+    BOOST_CHECK(gd.drawable.dirty.equal(Rect(10, 20, 141, 191)));
+    gd.draw(RDPScrBlt(Rect(600, 470, 100, 100), 0xCC, 0, 0), screen_rect);
+    BOOST_CHECK(gd.drawable.dirty.equal(Rect(10, 20, 630, 460)));
+
+    gd.drawable.reset_dirty();
+    gd.draw(RDPPatBlt(Rect(5, 5, 10, 10), 0xF0, RED, WHITE, RDPBrush()), screen_rect);
+    gd.draw(RDPDestBlt(Rect(20, 20, 10, 10), 0x00), screen_rect);
+    BOOST_CHECK(gd.drawable.dirty.equal(Rect(5, 5, 25, 25)));
+}
@@ -0,0 +1,227 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Unit test to capture writer thread
+   Using lib boost functions for testing
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestCaptureWriter
+#include <boost/test/auto_unit_test.hpp>
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "capture_writer.hpp"
+#include "staticcapture.hpp"
+
+static long long ustime() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (long long)now.tv_sec*1000000LL + (long long)now.tv_usec;
+}
+
+static size_t read_file(const char * path, char * buffer, size_t len)
+{
+    FILE * f = fopen(path, "r");
+    if (!f){
+        return 0;
+    }
+    size_t res = fread(buffer, 1, len, f);
+    fclose(f);
+    return res;
+}
+
+BOOST_AUTO_TEST_CASE(TestCaptureWriterWrm)
+{
+    char path1[256];
+    char path2[256];
+    sprintf(path1, "/tmp/test_capture_writer-%u-0.wrm", getpid());
+    sprintf(path2, "/tmp/test_capture_writer-%u-1.wrm", getpid());
+    {
+        CaptureWriter writer;
+        writer.max_lag = 8;
+        int fd = open(path1, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+        BOOST_CHECK(fd >= 0);
+        writer.wrm_fd(fd);
+        CaptureWriterTransport trans(&writer);
+        trans.send("abc", 3);
+        writer.flush();
+        trans.send("defghijklmn", 11); // over max_lag, given at once
+        // file switch is done after data already sent
+        writer.wrm_open(path2);
+        trans.send("xyz", 3);
+        writer.sync();
+        BOOST_CHECK_EQUAL(17, trans.total_sent);
+        BOOST_CHECK_EQUAL(17, writer.bytes_written);
+        BOOST_CHECK_EQUAL(0, writer.nb_errors);
+    }
+    char buffer[64];
+    BOOST_CHECK_EQUAL(14, read_file(path1, buffer, sizeof(buffer)));
+    BOOST_CHECK(0 == memcmp(buffer, "abcdefghijklmn", 14));
+    BOOST_CHECK_EQUAL(3, read_file(path2, buffer, sizeof(buffer)));
+    BOOST_CHECK(0 == memcmp(buffer, "xyz", 3));
+    unlink(path1);
+    unlink(path2);
+}
+
+BOOST_AUTO_TEST_CASE(TestCaptureWriterFrames)
+{
+    // session side cost of png snapshots, synchronous then with writer thread
+    const unsigned nb_snapshots = 20;
+    char path[256];
+    sprintf(path, "/tmp/test_capture_writer_png-%u", getpid());
+
+    StaticCapture sync_capture(1024, 768, path, 0, 0);
+    long long start = ustime();
+    for (unsigned i = 0; i < nb_snapshots; i++){
+        sync_capture.flush();
+    }
+    long long sync_usec = ustime() - start;
+
+    unsigned written = 0;
+    long long async_usec = 0;
+    {
+        CaptureWriter writer;
+        StaticCapture async_capture(1024, 768, path, 0, 0, true, &writer);
+        start = ustime();
+        for (unsigned i = 0; i < nb_snapshots; i++){
+            async_capture.flush();
+        }
+        async_usec = ustime() - start;
+        BOOST_CHECK_EQUAL(nb_snapshots, writer.nb_frames + writer.nb_dropped_frames);
+        BOOST_CHECK_EQUAL(writer.nb_frames, async_capture.framenb);
+        writer.sync();
+        BOOST_CHECK_EQUAL(0, writer.nb_errors);
+        written = writer.nb_frames;
+        printf("%u png snapshots: %lld us synchronous, %lld us with writer thread"
+               " (%u written, %u dropped)\n",
+            nb_snapshots, sync_usec, async_usec,
+            (unsigned)writer.nb_frames, (unsigned)writer.nb_dropped_frames);
+    }
+    BOOST_CHECK(written > 0);
+    BOOST_CHECK(async_usec < sync_usec);
+
+    // frames written by writer thread are the same as synchronous ones
+    for (unsigned i = 0; i < nb_snapshots; i++){
+        char png_path[256];
+        sprintf(png_path, "%s-%u-%u.png", path, getpid(), i);
+        if (i < written){
+            struct stat st;
+            BOOST_CHECK_EQUAL(0, stat(png_path, &st));
+            BOOST_CHECK(st.st_size > 0);
+        }
+        unlink(png_path);
+        strcat(png_path, ".meta");
+        unlink(png_path);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestCaptureWriterLag)
+{
+    char path[256];
+    sprintf(path, "/tmp/test_capture_writer_lag-%u.wrm", getpid());
+    const unsigned nb_chunks = 2000;
+    {
+        CaptureWriter writer;
+        writer.max_lag = 4096;
+        writer.wrm_open(path);
+        char chunk[1000];
+        for (unsigned i = 0; i < nb_chunks; i++){
+            memset(chunk, i % 251, sizeof(chunk));
+            writer.write(chunk, sizeof(chunk));
+            writer.flush();
+        }
+        writer.sync();
+        BOOST_CHECK_EQUAL(nb_chunks * sizeof(chunk), writer.bytes_written);
+        // every chunk was given to writer, either at once or later
+        BOOST_CHECK(writer.nb_batches <= nb_chunks);
+        BOOST_CHECK(writer.nb_batches + writer.nb_lagged >= nb_chunks);
+    }
+    // chunks are written in order, whatever lag
+    FILE * f = fopen(path, "r");
+    BOOST_CHECK(f != 0);
+    char chunk[1000];
+    for (unsigned i = 0; f && i < nb_chunks; i++){
+        BOOST_CHECK_EQUAL(sizeof(chunk), fread(chunk, 1, sizeof(chunk), f));
+        BOOST_CHECK_EQUAL((int)(i % 251), (int)(uint8_t)chunk[0]);
+        BOOST_CHECK_EQUAL((int)(i % 251), (int)(uint8_t)chunk[sizeof(chunk) - 1]);
+    }
+    if (f){
+        fclose(f);
+    }
+    unlink(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestStaticCaptureDirtyOnly)
+{
+    char path[256];
+    sprintf(path, "/tmp/test_capture_writer_dirty-%u", getpid());
+    StaticCapture capture(800, 600, path, 0, 0);
+    capture.dirty_only = true;
+    Rect screen(0, 0, 800, 600);
+
+    // first png is the whole screen
+    capture.flush();
+    BOOST_CHECK_EQUAL(1, capture.framenb);
+
+    // nothing drawn, no png (idle sessions cost nothing)
+    for (size_t i = 0; i < 100; i++){
+        capture.flush();
+    }
+    BOOST_CHECK_EQUAL(1, capture.framenb);
+
+    // only changed area is written
+    capture.draw(RDPOpaqueRect(Rect(10, 20, 30, 40), 0xFF0000), screen);
+    capture.draw(RDPOpaqueRect(Rect(50, 30, 10, 10), 0x00FF00), screen);
+    capture.flush();
+    BOOST_CHECK_EQUAL(2, capture.framenb);
+    BOOST_CHECK(capture.drawable.dirty.isempty());
+
+    char index[4096] = {};
+    BOOST_CHECK(read_file(capture.index_path, index, sizeof(index) - 1) > 0);
+    char expected[4096];
+    sprintf(expected,
+        "%s-%u-0.png,0,0,800,600\n"
+        "%s-%u-1.png,10,20,50,40\n",
+        path, getpid(), path, getpid());
+    BOOST_CHECK_EQUAL(std::string(expected), std::string(index));
+
+    char png_path[256];
+    sprintf(png_path, "%s-%u-1.png", path, getpid());
+    FILE * f = fopen(png_path, "r");
+    BOOST_CHECK(f != 0);
+    if (f){
+        // png IHDR holds width and height
+        uint8_t header[24];
+        BOOST_CHECK_EQUAL(sizeof(header), fread(header, 1, sizeof(header), f));
+        BOOST_CHECK_EQUAL(50, (header[18] << 8) | header[19]);
+        BOOST_CHECK_EQUAL(40, (header[22] << 8) | header[23]);
+        fclose(f);
+    }
+
+    for (unsigned i = 0; i < 2; i++){
+        sprintf(png_path, "%s-%u-%u.png", path, getpid(), i);
+        unlink(png_path);
+        strcat(png_path, ".meta");
+        unlink(png_path);
+    }
+    unlink(capture.index_path);
+}
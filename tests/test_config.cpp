@@ -51,8 +51,21 @@ BOOST_AUTO_TEST_CASE(TestConfigDefault)
     BOOST_CHECK_EQUAL(true, ini.globals.bitmap_cache);
     BOOST_CHECK_EQUAL(false, ini.globals.nomouse);
     BOOST_CHECK_EQUAL(false, ini.globals.notimestamp);
+    BOOST_CHECK_EQUAL(false, ini.globals.png_dirty_only);
+    BOOST_CHECK_EQUAL(600,  ini.globals.wrm_keyframe_interval);
+    BOOST_CHECK_EQUAL(0,    ini.globals.wrm_compression);
+    BOOST_CHECK_EQUAL(false, ini.globals.video_capture);
+    BOOST_CHECK_EQUAL(false, ini.globals.selector_local_index);
     BOOST_CHECK_EQUAL(true, ini.globals.bitmap_compression);
+    BOOST_CHECK_EQUAL(true, ini.globals.rdp_compression);
+    BOOST_CHECK_EQUAL(false, ini.globals.rdp_server_compression);
+    BOOST_CHECK_EQUAL(0,    ini.globals.bitmap_cache_signature);
     BOOST_CHECK_EQUAL(3389, ini.globals.port);
+    BOOST_CHECK_EQUAL(128,  ini.globals.listen_backlog);
+    BOOST_CHECK_EQUAL(0,    ini.globals.session_workers);
+    BOOST_CHECK_EQUAL(524288, ini.globals.send_queue_high_water);
+    BOOST_CHECK_EQUAL(2,    ini.globals.vnc_pipeline);
+    BOOST_CHECK_EQUAL(false, ini.globals.xup_shm);
     BOOST_CHECK_EQUAL(0,    ini.globals.crypt_level);
     BOOST_CHECK_EQUAL(1,    ini.globals.channel_code);
     BOOST_CHECK_EQUAL(0,    ini.globals.autologin);
@@ -85,6 +98,10 @@ BOOST_AUTO_TEST_CASE(TestConfig1)
     "bitmap_cache=yes\n"
     "bitmap_compression=true\n"
     "port=3390\n"
+    "session_workers=16\n"
+    "vnc_pipeline=4\n"
+    "xup_shm=yes\n"
+    "selector_local_index=yes\n"
     "crypt_level=low\n"
     "channel_code=1\n"
     "\n"
@@ -101,6 +118,10 @@ BOOST_AUTO_TEST_CASE(TestConfig1)
     BOOST_CHECK_EQUAL(true, ini.globals.bitmap_cache);
     BOOST_CHECK_EQUAL(true, ini.globals.bitmap_compression);
     BOOST_CHECK_EQUAL(3390, ini.globals.port);
+    BOOST_CHECK_EQUAL(16,   ini.globals.session_workers);
+    BOOST_CHECK_EQUAL(4,    ini.globals.vnc_pipeline);
+    BOOST_CHECK_EQUAL(true, ini.globals.xup_shm);
+    BOOST_CHECK_EQUAL(true, ini.globals.selector_local_index);
     BOOST_CHECK_EQUAL(1,    ini.globals.channel_code);
 
     struct IniAccounts & acc = ini.account[0];
@@ -162,6 +183,13 @@ BOOST_AUTO_TEST_CASE(TestConfig2)
     "[globals]\n"
     "bitmap_cache=no\n"
     "bitmap_compression=false\n"
+    "rdp_compression=no\n"
+    "rdp_server_compression=yes\n"
+    "png_dirty_only=yes\n"
+    "wrm_keyframe_interval=30\n"
+    "wrm_compression=6\n"
+    "video_capture=yes\n"
+    "bitmap_cache_signature=fingerprint_compare\n"
     "crypt_level=high\n"
     "channel_code=0\n"
     "\n"
@@ -172,6 +200,13 @@ BOOST_AUTO_TEST_CASE(TestConfig2)
     Inifile ini(oss);
     BOOST_CHECK_EQUAL(false, ini.globals.bitmap_cache);
     BOOST_CHECK_EQUAL(false, ini.globals.bitmap_compression);
+    BOOST_CHECK_EQUAL(false, ini.globals.rdp_compression);
+    BOOST_CHECK_EQUAL(true, ini.globals.rdp_server_compression);
+    BOOST_CHECK_EQUAL(true, ini.globals.png_dirty_only);
+    BOOST_CHECK_EQUAL(30, ini.globals.wrm_keyframe_interval);
+    BOOST_CHECK_EQUAL(6, ini.globals.wrm_compression);
+    BOOST_CHECK_EQUAL(true, ini.globals.video_capture);
+    BOOST_CHECK_EQUAL(2, ini.globals.bitmap_cache_signature);
     BOOST_CHECK_EQUAL(2, ini.globals.crypt_level);
     BOOST_CHECK_EQUAL(0, ini.globals.channel_code);
 
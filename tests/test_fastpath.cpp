@@ -0,0 +1,113 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Unit test to fast-path output coder
+   Using lib boost functions for testing
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestFastPath
+#include <boost/test/auto_unit_test.hpp>
+
+#include "stream.hpp"
+#include "transport.hpp"
+#include "RDP/fastpath.hpp"
+
+
+BOOST_AUTO_TEST_CASE(TestSend_FastPathSynchronize)
+{
+    CheckTransport t("\x00\x80\x06\x03\x00\x00", 6);
+    CryptContext encrypt;
+    Stream stream(32768);
+    FastPathOut fastpath_out(stream, false, encrypt);
+    FastPathUpdateOut fastpath_update(stream, FASTPATH_UPDATETYPE_SYNCHRONIZE);
+    fastpath_update.end();
+    fastpath_out.end();
+    fastpath_out.send(&t);
+    BOOST_CHECK_EQUAL(true, t.status);
+}
+
+BOOST_AUTO_TEST_CASE(TestSend_FastPathCachedPointerAndOrders)
+{
+    // two updates in the same fast-path PDU
+    CheckTransport t("\x00\x80\x0E"
+                     "\x0A\x02\x00" "\x05\x00"
+                     "\x00\x03\x00" "\x00\x00" "\xAA"
+                     , 14);
+    CryptContext encrypt;
+    Stream stream(32768);
+    FastPathOut fastpath_out(stream, false, encrypt);
+    FastPathUpdateOut pointer_update(stream, FASTPATH_UPDATETYPE_CACHED);
+    stream.out_uint16_le(5);
+    pointer_update.end();
+    FastPathUpdateOut orders_update(stream, FASTPATH_UPDATETYPE_ORDERS);
+    stream.out_uint16_le(0);
+    stream.out_uint8(0xAA);
+    orders_update.end();
+    fastpath_out.end();
+    fastpath_out.send(&t);
+    BOOST_CHECK_EQUAL(true, t.status);
+}
+
+BOOST_AUTO_TEST_CASE(TestReceive_FastPathInput)
+{
+    // fpInputHeader (2 events), length, mouse move event, key release event
+    GeneratorTransport t("\x08\x0B"
+                         "\x20" "\x00\x08" "\x10\x00" "\x20\x00"
+                         "\x03" "\x1D"
+                         , 11);
+    CryptContext decrypt;
+    Stream stream(65535);
+    t.recv((char**)(&(stream.end)), 1);
+    BOOST_CHECK(FASTPATH_INPUT_ACTION_X224 != (stream.p[0] & 0x03));
+    FastPathIn fastpath_in(&t, stream, decrypt);
+    BOOST_CHECK_EQUAL(2, fastpath_in.numEvents);
+    BOOST_CHECK_EQUAL(11, fastpath_in.length);
+
+    FastPathInputEventIn mouse(stream);
+    BOOST_CHECK_EQUAL((uint16_t)RDP_INPUT_MOUSE, mouse.message_type);
+    BOOST_CHECK_EQUAL((uint16_t)MOUSE_FLAG_MOVE, mouse.device_flags);
+    BOOST_CHECK_EQUAL(16, mouse.param1);
+    BOOST_CHECK_EQUAL(32, mouse.param2);
+
+    FastPathInputEventIn key(stream);
+    BOOST_CHECK_EQUAL((uint16_t)RDP_INPUT_SCANCODE, key.message_type);
+    BOOST_CHECK_EQUAL((uint16_t)(KBD_FLAG_UP | KBD_FLAG_EXT), key.device_flags);
+    BOOST_CHECK_EQUAL(0x1D, key.param1);
+    BOOST_CHECK_EQUAL(stream.p, stream.end);
+}
+
+BOOST_AUTO_TEST_CASE(TestSend_FastPathInput)
+{
+    CheckTransport t("\x0C\x80\x0D"
+                     "\x20" "\x00\x08" "\x10\x00" "\x20\x00"
+                     "\x01" "\x1D"
+                     "\x62"
+                     , 13);
+    CryptContext encrypt;
+    Stream stream(32768);
+    FastPathOut fastpath_out(stream, false, encrypt, 3);
+    emit_fastpath_input_event(stream, RDP_INPUT_MOUSE, MOUSE_FLAG_MOVE, 16, 32);
+    emit_fastpath_input_event(stream, RDP_INPUT_SCANCODE, KBD_FLAG_UP, 0x1D, 0);
+    emit_fastpath_input_event(stream, RDP_INPUT_SYNCHRONIZE, 0, KBD_FLAG_NUMLOCK, 0);
+    fastpath_out.end();
+    fastpath_out.send(&t);
+    BOOST_CHECK_EQUAL(true, t.status);
+}
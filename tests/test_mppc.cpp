@@ -0,0 +1,203 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Unit test to MPPC bulk compression (8K and 64K history),
+   with compression ratio and speed on recorded server traffic
+   Using lib boost functions for testing
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestMppc
+#include <boost/test/auto_unit_test.hpp>
+
+#include <stdio.h>
+#include <sys/time.h>
+#include "stream.hpp"
+#include "RDP/mppc.hpp"
+#include "RDP/rdp.hpp"
+#include "rdtsc.hpp"
+
+namespace tls {
+    #include "./fixtures/dump_TLSw2008.hpp"
+}
+
+static long long ustime() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (long long)now.tv_sec*1000000LL + (long long)now.tv_usec;
+}
+
+// compresses then decompresses data, checks decompressed data is the same
+static bool round_trip(rdp_mppc_enc & enc, rdp_mppc_dec & dec, const uint8_t * data, uint32_t len)
+{
+    enc.compress(data, len);
+    const uint8_t ctype = enc.flags ? (enc.flags | enc.protocol_type) : 0;
+    if (!(ctype & (PACKET_COMPRESSED|PACKET_FLUSHED))){
+        return true;
+    }
+    const uint8_t * cdata = (enc.flags & PACKET_COMPRESSED) ? enc.outputBuffer : data;
+    const uint32_t clen = (enc.flags & PACKET_COMPRESSED) ? enc.bytes_in_opb : len;
+    uint32_t roff = 0;
+    uint32_t rlen = 0;
+    if (!dec.decompress(cdata, clen, ctype, roff, rlen)){
+        return false;
+    }
+    if (!(ctype & PACKET_COMPRESSED)){
+        return true;
+    }
+    return (rlen == len) && (0 == memcmp(dec.history_buf + roff, data, len));
+}
+
+BOOST_AUTO_TEST_CASE(TestMppcCompress8K)
+{
+    rdp_mppc_enc enc(PACKET_COMPR_TYPE_8K);
+    enc.compress((const uint8_t *)"abcabcabc", 9);
+    BOOST_CHECK_EQUAL(PACKET_AT_FRONT|PACKET_COMPRESSED, enc.flags);
+    BOOST_CHECK_EQUAL(5, enc.bytes_in_opb);
+    BOOST_CHECK(0 == memcmp("\x61\x62\x63\xF0\xE8", enc.outputBuffer, 5));
+
+    // second packet refers to history of first one
+    enc.compress((const uint8_t *)"abcabcabc", 9);
+    BOOST_CHECK_EQUAL((uint8_t)PACKET_COMPRESSED, enc.flags);
+    BOOST_CHECK(enc.bytes_in_opb < 9);
+
+    rdp_mppc_dec dec;
+    uint32_t roff = 0;
+    uint32_t rlen = 0;
+    BOOST_CHECK(dec.decompress((const uint8_t *)"\x61\x62\x63\xF0\xE8", 5,
+        PACKET_AT_FRONT|PACKET_COMPRESSED|PACKET_COMPR_TYPE_8K, roff, rlen));
+    BOOST_CHECK_EQUAL(0, roff);
+    BOOST_CHECK_EQUAL(9, rlen);
+    BOOST_CHECK(0 == memcmp("abcabcabc", dec.history_buf + roff, 9));
+}
+
+BOOST_AUTO_TEST_CASE(TestMppcIncompressible)
+{
+    rdp_mppc_enc enc(PACKET_COMPR_TYPE_64K);
+    rdp_mppc_dec dec;
+    uint8_t data[1000];
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < sizeof(data); i++){
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+    enc.compress(data, sizeof(data));
+    BOOST_CHECK_EQUAL((uint8_t)PACKET_FLUSHED, enc.flags);
+    BOOST_CHECK(round_trip(enc, dec, data, sizeof(data)));
+
+    // empty data is never compressed
+    enc.compress(data, 0);
+    BOOST_CHECK_EQUAL(0, enc.flags);
+}
+
+BOOST_AUTO_TEST_CASE(TestMppcRoundTrip)
+{
+    uint8_t data[4000];
+    int protocol_types[2] = { PACKET_COMPR_TYPE_8K, PACKET_COMPR_TYPE_64K };
+    for (size_t t = 0; t < 2; t++){
+        rdp_mppc_enc enc(protocol_types[t]);
+        rdp_mppc_dec dec;
+        uint32_t seed = 1;
+        // enough packets to wrap history several times, with some random
+        // (incompressible) packets flushing history
+        for (size_t n = 0; n < 200; n++){
+            const uint32_t len = 1 + (n * 397) % sizeof(data);
+            for (size_t i = 0; i < len; i++){
+                seed = seed * 1103515245 + 12345;
+                data[i] = (n % 7 == 3) ? (seed >> 16) : ((seed >> 28) + 'a');
+            }
+            BOOST_CHECK(round_trip(enc, dec, data, len));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestMppcShareData)
+{
+    rdp_mppc_enc enc(PACKET_COMPR_TYPE_64K);
+    Stream stream(65536);
+    ShareDataOut rdp_data_out(stream, PDUTYPE2_UPDATE, 0x1234, RDP::STREAM_MED, &enc);
+    for (size_t i = 0; i < 100; i++){
+        stream.out_copy_bytes("orders orders ", 14);
+    }
+    rdp_data_out.end();
+    stream.mark_end();
+    BOOST_CHECK(stream.end - stream.data < 200);
+
+    stream.p = stream.data;
+    ShareDataIn share_data_in(stream);
+    BOOST_CHECK_EQUAL((uint8_t)PDUTYPE2_UPDATE, share_data_in.pdutype2);
+    BOOST_CHECK_EQUAL(1400 + 4, share_data_in.len);
+    BOOST_CHECK_EQUAL(PACKET_AT_FRONT|PACKET_COMPRESSED|PACKET_COMPR_TYPE_64K, share_data_in.compressedType);
+    BOOST_CHECK_EQUAL(stream.end - stream.p + 18, share_data_in.compressedLen);
+
+    rdp_mppc_dec dec;
+    uint32_t roff = 0;
+    uint32_t rlen = 0;
+    BOOST_CHECK(dec.decompress(stream.p, share_data_in.compressedLen - 18, share_data_in.compressedType, roff, rlen));
+    BOOST_CHECK_EQUAL(1400, rlen);
+    BOOST_CHECK(0 == memcmp("orders orders orders", dec.history_buf + roff, 20));
+}
+
+// compression ratio and speed on server PDUs recorded in dump (slow-path and
+// fast-path PDUs are compressed as a whole)
+static void bench(const char * name, const uint8_t * data, size_t len, int protocol_type)
+{
+    rdp_mppc_enc enc(protocol_type);
+    rdp_mppc_dec dec;
+    size_t nb_pdu = 0;
+    unsigned long long usec = ustime();
+    unsigned long long cycles = rdtsc();
+    for (size_t i = 0; i + 4 <= len ; nb_pdu++){
+        size_t pdu_len = 0;
+        if (data[i] == 3){ // TPKT
+            pdu_len = (data[i + 2] << 8) | data[i + 3];
+        }
+        else if ((data[i] & 3) == 0){ // fast-path
+            pdu_len = (data[i + 1] & 0x80) ? (((data[i + 1] & 0x7F) << 8) | data[i + 2]) : data[i + 1];
+        }
+        if (pdu_len < 4 || i + pdu_len > len){
+            break;
+        }
+        BOOST_CHECK(round_trip(enc, dec, data + i, pdu_len));
+        i += pdu_len;
+    }
+    unsigned long long elapusec = ustime() - usec;
+    unsigned long long elapcyc = rdtsc() - cycles;
+    printf("%s %s: %u PDUs, %llu bytes -> %llu bytes (%.1f%%), %llu us, %llu cycles, %.1f MB/s\n",
+        name, (protocol_type == PACKET_COMPR_TYPE_8K) ? "8K" : "64K",
+        (unsigned)nb_pdu, (unsigned long long)enc.total_in, (unsigned long long)enc.total_out,
+        enc.total_in ? 100.0 * enc.total_out / enc.total_in : 0.0,
+        elapusec, elapcyc, elapusec ? (double)enc.total_in / elapusec : 0.0);
+    BOOST_CHECK(nb_pdu > 0);
+    BOOST_CHECK(enc.total_out <= enc.total_in);
+}
+
+BOOST_AUTO_TEST_CASE(TestMppcDumpBenchmark)
+{
+    const uint8_t * data = (const uint8_t *)tls::indata;
+    size_t len = sizeof(tls::indata);
+    // first TPKT header in dump
+    size_t start = 0;
+    while (start + 1 < len && !(data[start] == 3 && data[start + 1] == 0)){
+        start++;
+    }
+    bench("TLSw2008", data + start, len - start, PACKET_COMPR_TYPE_8K);
+    bench("TLSw2008", data + start, len - start, PACKET_COMPR_TYPE_64K);
+}
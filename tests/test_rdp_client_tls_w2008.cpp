@@ -50,7 +50,9 @@
 #include "staticcapture.hpp"
 
 
-BOOST_AUTO_TEST_CASE(TestDecodePacket)
+#include <sys/time.h>
+
+static void replay_w2008_tls()
 {
 
     ClientInfo info(1, 1, true, true);
@@ -228,3 +230,37 @@ BOOST_AUTO_TEST_CASE(TestDecodePacket)
 //    front.dump_png("trace_w2008_tls_");
 
 }
+
+BOOST_AUTO_TEST_CASE(TestDecodePacket)
+{
+    replay_w2008_tls();
+}
+
+static long long ustime() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (long long)now.tv_sec*1000000LL + (long long)now.tv_usec;
+}
+
+// Stream buffers allocated on heap during session, without then with pool
+BOOST_AUTO_TEST_CASE(TestStreamBufferPoolReplay)
+{
+    StreamBufferPool & pool = stream_buffer_pool();
+    uint64_t allocated[2];
+    for (size_t i = 0; i < 2; i++){
+        pool.disabled = (i == 0);
+        uint64_t nb_acquired = pool.nb_acquired;
+        uint64_t nb_allocated = pool.nb_allocated;
+        long long usec = ustime();
+        replay_w2008_tls();
+        usec = ustime() - usec;
+        allocated[i] = pool.nb_allocated - nb_allocated;
+        printf("stream buffers %s pool: %llu acquired, %llu allocated in %lld us (%.0f allocations/s)\n",
+            pool.disabled ? "without" : "with",
+            (unsigned long long)(pool.nb_acquired - nb_acquired),
+            (unsigned long long)allocated[i], usec,
+            usec ? allocated[i] * 1000000.0 / usec : 0.0);
+    }
+    pool.disabled = false;
+    BOOST_CHECK(allocated[1] < allocated[0]);
+}
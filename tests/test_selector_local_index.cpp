@@ -0,0 +1,207 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Unit test for selector local index mode: targets are fetched from a
+   stand-in acl (paging and filtering like tools/authhook.py) page by page,
+   as session does, then paging and filtering do not go to acl any more.
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestSelectorLocalIndex
+#include <boost/test/auto_unit_test.hpp>
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "RDP/RDPGraphicDevice.hpp"
+#include "channel_list.hpp"
+#include "front_api.hpp"
+#include "wait_obj.hpp"
+#include "modcontext.hpp"
+#include "client_mod.hpp"
+#include "internal/internal_mod.hpp"
+#include "internal/selector.hpp"
+
+static ProtocolKeyword keywords[] = {
+    {STRAUTHID_TARGET_USER, TYPE_TEXT, "!"},
+    {STRAUTHID_TARGET_DEVICE, TYPE_TEXT, "!"},
+    {STRAUTHID_TARGET_PROTOCOL, TYPE_TEXT, "!RDP"},
+    {STRAUTHID_END_TIME, TYPE_TEXT, "!-"},
+    {STRAUTHID_HOST, TYPE_TEXT, "!"},
+    {STRAUTHID_AUTH_USER, TYPE_TEXT, "!"},
+    {STRAUTHID_PASSWORD, TYPE_TEXT, "!"},
+    {STRAUTHID_SELECTOR_GROUP_FILTER, TYPE_TEXT, "!"},
+    {STRAUTHID_SELECTOR_DEVICE_FILTER, TYPE_TEXT, "!"},
+    {STRAUTHID_SELECTOR_LINES_PER_PAGE, TYPE_TEXT, "!20"},
+    {STRAUTHID_SELECTOR_NUMBER_OF_PAGES, TYPE_TEXT, "!"},
+    {STRAUTHID_SELECTOR_CURRENT_PAGE, TYPE_TEXT, "!1"},
+    {STRAUTHID_SELECTOR, TYPE_BOOLEAN, "!False"},
+};
+
+// answers selector requests like tools/authhook.py
+struct AclStandIn {
+    unsigned nb_targets;
+    unsigned requests;
+
+    AclStandIn(unsigned nb_targets) : nb_targets(nb_targets), requests(0) {}
+
+    void answer(ModContext & context)
+    {
+        const std::string group_filter = context.get(STRAUTHID_SELECTOR_GROUP_FILTER);
+        const std::string device_filter = context.get(STRAUTHID_SELECTOR_DEVICE_FILTER);
+        const unsigned lines = atoi(context.get(STRAUTHID_SELECTOR_LINES_PER_PAGE));
+        unsigned page = atoi(context.get(STRAUTHID_SELECTOR_CURRENT_PAGE)) - 1;
+
+        std::vector<std::string> targets;
+        std::vector<std::string> groups;
+        for (unsigned i = 0; i < this->nb_targets; i++){
+            char target[64];
+            sprintf(target, "admin@srv%04u", i);
+            const char * group = (i % 3) ? "rdp" : "vnc";
+            if (strstr(target, device_filter.c_str()) && strstr(group, group_filter.c_str())){
+                targets.push_back(target);
+                groups.push_back(group);
+            }
+        }
+        const unsigned nb_pages = 1 + targets.size() / lines;
+        if (page >= nb_pages){
+            page = nb_pages - 1;
+        }
+        std::string t, g, p, e;
+        for (unsigned i = page * lines; i < targets.size() && i < (page + 1) * lines; i++){
+            if (!t.empty()){
+                t += " "; g += " "; p += " "; e += ";";
+            }
+            t += targets[i];
+            g += groups[i];
+            p += groups[i] == "rdp" ? "RDP" : "VNC";
+            e += "-";
+        }
+        context.cpy(STRAUTHID_TARGET_DEVICE, t.c_str());
+        context.cpy(STRAUTHID_TARGET_USER, g.c_str());
+        context.cpy(STRAUTHID_TARGET_PROTOCOL, p.c_str());
+        context.cpy(STRAUTHID_END_TIME, e.c_str());
+        context.cpy(STRAUTHID_SELECTOR_NUMBER_OF_PAGES, (int)nb_pages);
+        context.cpy(STRAUTHID_SELECTOR, "True");
+        this->requests++;
+    }
+};
+
+class CountingFront : public FrontAPI {
+public:
+    ChannelDefArray cl;
+    unsigned orders;
+    unsigned texts;
+
+    CountingFront() : FrontAPI(false, false), orders(0), texts(0) {}
+
+    virtual void flush() {}
+    virtual void draw(const RDPOpaqueRect & cmd, const Rect & clip) { this->orders++; }
+    virtual void draw(const RDPScrBlt & cmd, const Rect & clip) { this->orders++; }
+    virtual void draw(const RDPDestBlt & cmd, const Rect & clip) { this->orders++; }
+    virtual void draw(const RDPPatBlt & cmd, const Rect & clip) { this->orders++; }
+    virtual void draw(const RDPMemBlt & cmd, const Rect & clip, const Bitmap & bmp) { this->orders++; }
+    virtual void draw(const RDPLineTo & cmd, const Rect & clip) { this->orders++; }
+    virtual void draw(const RDPGlyphIndex & cmd, const Rect & clip) { this->orders++; }
+    virtual const ChannelDefArray & get_channel_list(void) const { return this->cl; }
+    virtual void send_to_channel(const ChannelDef & channel, uint8_t* data, size_t length, size_t chunk_size, int flags) {}
+    virtual void send_pointer(int cache_idx, uint8_t* data, uint8_t* mask, int x, int y) throw (Error) {}
+    virtual void send_global_palette() throw (Error) {}
+    virtual void set_pointer(int cache_idx) throw (Error) {}
+    virtual void begin_update() {}
+    virtual void end_update() {}
+    virtual void color_cache(const BGRPalette & palette, uint8_t cacheIndex) {}
+    virtual void set_mod_palette(const BGRPalette & palette) {}
+    virtual void server_set_pointer(int x, int y, uint8_t* data, uint8_t* mask) {}
+    virtual void server_draw_text(uint16_t x, uint16_t y, const char * text, uint32_t fgcolor, uint32_t bgcolor, const Rect & clip) { this->texts++; }
+    virtual void text_metrics(const char * text, int & width, int & height) {}
+    virtual int server_resize(int width, int height, int bpp) { return 0; }
+};
+
+BOOST_AUTO_TEST_CASE(TestSelectorLocalIndex)
+{
+    ModContext context(keywords, sizeof(keywords)/sizeof(keywords[0]));
+    CountingFront front;
+    wait_obj event(-1);
+    AclStandIn acl(1234);
+
+    // session recreates selector after each acl answer
+    selector_mod * mod = new selector_mod(&event, context, front, 1024, 768, true);
+    while (mod->draw_event() == BACK_EVENT_REFRESH){
+        BOOST_CHECK_EQUAL(std::string("50"), context.get(STRAUTHID_SELECTOR_LINES_PER_PAGE));
+        acl.answer(context);
+        mod->refresh_context(context);
+        delete mod;
+        mod = new selector_mod(&event, context, front, 1024, 768, true);
+    }
+    // 1234 targets, 25 pages of 50
+    BOOST_CHECK_EQUAL(25u, acl.requests);
+    BOOST_CHECK(context.selector_index_loaded);
+    BOOST_CHECK_EQUAL(1234u, context.selector_index.size());
+
+    const size_t lines = mod->nblines();
+    BOOST_CHECK_EQUAL((1234 + lines - 1) / lines, mod->total_page);
+    BOOST_CHECK_EQUAL(std::string("admin@srv0000"), mod->grid[0].target);
+    BOOST_CHECK_EQUAL(std::string("vnc"), mod->grid[0].group);
+
+    // paging is local
+    mod->click(selector_mod::FOCUS_ON_NEXTPAGE);
+    BOOST_CHECK_EQUAL(BACK_EVENT_NONE, mod->draw_event());
+    BOOST_CHECK_EQUAL(25u, acl.requests);
+    char expected[64];
+    sprintf(expected, "admin@srv%04u", (unsigned)lines);
+    BOOST_CHECK_EQUAL(std::string(expected), mod->grid[0].target);
+
+    // filtering too, only grid lines that changed are redrawn
+    mod->click(selector_mod::FOCUS_ON_FIRSTPAGE);
+    mod->draw_event();
+    front.texts = 0;
+    strcpy(mod->filter_device_text, "srv0");
+    mod->click(selector_mod::FOCUS_ON_APPLY);
+    BOOST_CHECK_EQUAL(BACK_EVENT_NONE, mod->draw_event());
+    BOOST_CHECK_EQUAL((1000 + lines - 1) / lines, mod->total_page);
+    // same lines shown: filters and page number only
+    BOOST_CHECK_EQUAL(3u, front.texts);
+
+    front.texts = 0;
+    strcpy(mod->filter_device_text, "srv12");
+    mod->click(selector_mod::FOCUS_ON_APPLY);
+    BOOST_CHECK_EQUAL(BACK_EVENT_NONE, mod->draw_event());
+    BOOST_CHECK_EQUAL((34 + lines - 1) / lines, mod->total_page);
+    BOOST_CHECK_EQUAL(std::string("admin@srv1200"), mod->grid[0].target);
+    BOOST_CHECK_EQUAL(std::string("admin@srv1210"), mod->grid[10].target);
+    BOOST_CHECK_EQUAL(3u + 4 * lines, front.texts);
+    BOOST_CHECK_EQUAL(25u, acl.requests);
+
+    // moving focus line redraws the two lines involved
+    front.texts = 0;
+    mod->focus_line = 1;
+    mod->draw_event();
+    BOOST_CHECK_EQUAL(3u + 4 * 2, front.texts);
+
+    // index is kept by context when selector comes back
+    delete mod;
+    mod = new selector_mod(&event, context, front, 1024, 768, true);
+    BOOST_CHECK_EQUAL(BACK_EVENT_NONE, mod->draw_event());
+    BOOST_CHECK_EQUAL(25u, acl.requests);
+    BOOST_CHECK_EQUAL(std::string("admin@srv0000"), mod->grid[0].target);
+    delete mod;
+}
@@ -0,0 +1,219 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Unit test for staging tiles: VNC raw rectangles received in place into
+   RDP bitmap tiles, tiles kept by bitmap caches, speed compared to per tile
+   bitmap copies.
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestStagingTiles
+#include <boost/test/auto_unit_test.hpp>
+
+#include <stdio.h>
+#include <sys/time.h>
+#include <vector>
+
+#include "transport.hpp"
+#include "difftimeval.hpp"
+#include "RDP/RDPGraphicDevice.hpp"
+#include "channel_list.hpp"
+#include "front_api.hpp"
+#include "staging_tiles.hpp"
+
+// draws tiles to a 16 bpp top-down screen, may keep tiles as a bitmap cache does
+class TileFront : public FrontAPI {
+public:
+    uint16_t width;
+    std::vector<uint16_t> screen;
+    std::vector<const Bitmap *> cache;
+    size_t cache_max;
+    ChannelDefArray cl;
+
+    TileFront(uint16_t width, uint16_t height, size_t cache_max)
+        : FrontAPI(false, false)
+        , width(width)
+        , screen(width * height)
+        , cache_max(cache_max)
+    {
+    }
+
+    ~TileFront()
+    {
+        for (size_t i = 0; i < this->cache.size(); i++){
+            delete this->cache[i];
+        }
+    }
+
+    virtual void draw_bitmap_tile(const Rect & dst_tile, const Bitmap & tile)
+    {
+        const uint8_t * data = tile.data_bitmap.get();
+        for (uint16_t y = 0; y < dst_tile.cy; y++){
+            memcpy(&this->screen[(dst_tile.y + y) * this->width + dst_tile.x],
+                   data + (tile.cy - 1 - y) * tile.line_size, dst_tile.cx * 2);
+        }
+        if (this->cache.size() < this->cache_max){
+            this->cache.push_back(new Bitmap(tile.original_bpp, tile));
+        }
+    }
+
+    virtual void flush() {}
+    virtual void draw(const RDPOpaqueRect & cmd, const Rect & clip) {}
+    virtual void draw(const RDPScrBlt & cmd, const Rect & clip) {}
+    virtual void draw(const RDPDestBlt & cmd, const Rect & clip) {}
+    virtual void draw(const RDPPatBlt & cmd, const Rect & clip) {}
+    virtual void draw(const RDPMemBlt & cmd, const Rect & clip, const Bitmap & bmp) {}
+    virtual void draw(const RDPLineTo & cmd, const Rect & clip) {}
+    virtual void draw(const RDPGlyphIndex & cmd, const Rect & clip) {}
+    virtual const ChannelDefArray & get_channel_list(void) const { return this->cl; }
+    virtual void send_to_channel(const ChannelDef & channel, uint8_t* data, size_t length, size_t chunk_size, int flags) {}
+    virtual void send_pointer(int cache_idx, uint8_t* data, uint8_t* mask, int x, int y) throw (Error) {}
+    virtual void send_global_palette() throw (Error) {}
+    virtual void set_pointer(int cache_idx) throw (Error) {}
+    virtual void begin_update() {}
+    virtual void end_update() {}
+    virtual void color_cache(const BGRPalette & palette, uint8_t cacheIndex) {}
+    virtual void set_mod_palette(const BGRPalette & palette) {}
+    virtual void server_set_pointer(int x, int y, uint8_t* data, uint8_t* mask) {}
+    virtual void server_draw_text(uint16_t x, uint16_t y, const char * text, uint32_t fgcolor, uint32_t bgcolor, const Rect & clip) {}
+    virtual void text_metrics(const char * text, int & width, int & height) {}
+    virtual int server_resize(int width, int height, int bpp) { return 0; }
+};
+
+static void make_rect(std::vector<uint16_t> & pixels, uint16_t cx, uint16_t cy, unsigned seed)
+{
+    pixels.resize(cx * cy);
+    for (unsigned i = 0; i < pixels.size(); i++){
+        pixels[i] = (i * 2654435761u + seed) >> 11;
+    }
+}
+
+// raw rectangle as mod_vnc draws it
+static void draw_raw(StagingTiles & tiles, Transport * t, FrontAPI & front, uint16_t x, uint16_t y, uint16_t cx, uint16_t cy)
+{
+    for (uint16_t yy = y; yy < y + cy; yy += StagingTiles::TILE){
+        uint16_t cyy = std::min<uint16_t>(StagingTiles::TILE, cy - (yy - y));
+        tiles.start(x, yy, cx, cyy);
+        tiles.recv(t);
+        tiles.draw(front);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestVncTilesRaw)
+{
+    // odd sizes: partial tiles and rows not aligned to 4 pixels
+    const uint16_t x = 5, y = 3, cx = 101, cy = 70;
+    TileFront front(128, 80, 0);
+    StagingTiles tiles;
+    tiles.set_bpp(16);
+
+    for (unsigned frame = 0; frame < 3; frame++){
+        std::vector<uint16_t> pixels;
+        make_rect(pixels, cx, cy, frame);
+        GeneratorTransport t((const char *)&pixels[0], pixels.size() * 2);
+        draw_raw(tiles, &t, front, x, y, cx, cy);
+
+        for (uint16_t yy = 0; yy < cy; yy++){
+            BOOST_CHECK_EQUAL(0, memcmp(&front.screen[(y + yy) * 128 + x], &pixels[yy * cx], cx * 2));
+        }
+    }
+    BOOST_CHECK_EQUAL(4u * 3u * 3u, tiles.drawn);
+    // tile buffer allocated once for the connection
+    BOOST_CHECK_EQUAL(1u, tiles.allocated);
+}
+
+BOOST_AUTO_TEST_CASE(TestVncTilesKeptByCache)
+{
+    TileFront front(64, 32, 1);
+    StagingTiles tiles;
+    tiles.set_bpp(16);
+
+    std::vector<uint16_t> first;
+    make_rect(first, 64, 32, 1);
+    GeneratorTransport t1((const char *)&first[0], first.size() * 2);
+    draw_raw(tiles, &t1, front, 0, 0, 64, 32);
+    // first tile is kept by cache: next tile got a new buffer
+    BOOST_CHECK_EQUAL(1u, front.cache.size());
+    BOOST_CHECK_EQUAL(2u, tiles.allocated);
+
+    // cached pixels are unchanged by next update
+    std::vector<uint16_t> second;
+    make_rect(second, 64, 32, 2);
+    GeneratorTransport t2((const char *)&second[0], second.size() * 2);
+    draw_raw(tiles, &t2, front, 0, 0, 64, 32);
+    BOOST_CHECK_EQUAL(2u, tiles.allocated);
+
+    const Bitmap & cached = *front.cache[0];
+    for (uint16_t yy = 0; yy < 32; yy++){
+        BOOST_CHECK_EQUAL(0, memcmp(cached.data_bitmap.get() + (31 - yy) * cached.line_size, &first[yy * 64], 64));
+    }
+    for (uint16_t yy = 0; yy < 32; yy++){
+        BOOST_CHECK_EQUAL(0, memcmp(&front.screen[yy * 64], &second[yy * 64], 128));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestVncTilesSpeed)
+{
+    const uint16_t width = 1024, height = 768;
+    const unsigned nb_frames = 20;
+    std::vector<uint16_t> pixels;
+    make_rect(pixels, width, height, 0);
+    TileFront tile_front(width, height, 0);
+    FrontAPI & front = tile_front;
+
+    // previous path: strips of 16 rows in a new buffer, a bitmap copy per tile
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    for (unsigned frame = 0; frame < nb_frames; frame++){
+        GeneratorTransport t((const char *)&pixels[0], pixels.size() * 2);
+        uint8_t * raw = (uint8_t *)malloc(width * 16 * 2);
+        for (uint16_t yy = 0; yy < height; yy += 16){
+            uint8_t * tmp = raw;
+            t.recv((char**)&tmp, width * 16 * 2);
+            for (uint16_t x = 0; x < width; x += 32){
+                const Rect tile(x, 0, 32, 16);
+                const Bitmap bmp(raw, width, 16, 16, tile);
+                front.draw_bitmap_tile(Rect(x, yy, 32, 16), bmp);
+            }
+        }
+        free(raw);
+    }
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    uint64_t copy_elapsed = difftimeval(end, start);
+
+    StagingTiles tiles;
+    tiles.set_bpp(16);
+    gettimeofday(&start, NULL);
+    for (unsigned frame = 0; frame < nb_frames; frame++){
+        GeneratorTransport t((const char *)&pixels[0], pixels.size() * 2);
+        draw_raw(tiles, &t, front, 0, 0, width, height);
+    }
+    gettimeofday(&end, NULL);
+    uint64_t tiles_elapsed = difftimeval(end, start);
+
+    fprintf(stderr, "vnc raw %ux%u, %u frames: %llu us with bitmap copies (%u allocations), "
+        "%llu us with staging tiles (%llu allocations)\n",
+        width, height, nb_frames, (unsigned long long)copy_elapsed,
+        nb_frames * (height / 16) * (width / 32 + 1),
+        (unsigned long long)tiles_elapsed, (unsigned long long)tiles.allocated);
+    BOOST_CHECK_EQUAL(1u, tiles.allocated);
+    BOOST_CHECK(0 == memcmp(&tile_front.screen[0], &pixels[0], pixels.size() * 2));
+}
@@ -288,3 +288,47 @@ BOOST_AUTO_TEST_CASE(TestStream_out_Stream)
 
     delete s;
 }
+
+BOOST_AUTO_TEST_CASE(TestStreamBufferPool)
+{
+    StreamBufferPool & pool = stream_buffer_pool();
+    uint64_t nb_allocated = pool.nb_allocated;
+    uint8_t * data = 0;
+    {
+        Stream s(65536);
+        BOOST_CHECK_EQUAL(nb_allocated + 1, pool.nb_allocated);
+        data = s.data;
+    }
+    // buffer of same size class is reused
+    {
+        Stream s(40000);
+        BOOST_CHECK(s.data == data);
+        BOOST_CHECK_EQUAL(40000, s.capacity);
+        // other size class, buffer of 64 KB class is given back
+        s.init(32768);
+        BOOST_CHECK(s.data != data);
+        Stream s2(65535);
+        BOOST_CHECK(s2.data == data);
+    }
+    BOOST_CHECK_EQUAL(nb_allocated + 2, pool.nb_allocated);
+
+    // small streams don't use pool, large ones are not kept
+    uint64_t nb_acquired = pool.nb_acquired;
+    {
+        Stream s(100);
+        Stream big(1 << 20);
+    }
+    {
+        Stream big(1 << 20);
+    }
+    BOOST_CHECK_EQUAL(nb_acquired + 2, pool.nb_acquired);
+    BOOST_CHECK_EQUAL(nb_allocated + 4, pool.nb_allocated);
+
+    // disabled pool allocates each buffer
+    pool.disabled = true;
+    for (size_t i = 0; i < 10; i++){
+        Stream s(65536);
+    }
+    pool.disabled = false;
+    BOOST_CHECK(pool.nb_allocated >= nb_allocated + 4 + 9);
+}
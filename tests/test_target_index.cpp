@@ -0,0 +1,124 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Unit test for the index of targets paged and filtered locally by selector
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestTargetIndex
+#include <boost/test/auto_unit_test.hpp>
+
+#include <stdio.h>
+#include <sys/time.h>
+#include <string>
+
+#include "difftimeval.hpp"
+#include "target_index.hpp"
+
+BOOST_AUTO_TEST_CASE(TestTargetIndexAppend)
+{
+    TargetIndex index;
+    BOOST_CHECK_EQUAL(3u, index.append("rdp vnc rdp", "a@srv1 b@srv2 c@srv3", "RDP VNC RDP", "-;2012-12-31;"));
+    BOOST_CHECK_EQUAL(1u, index.append("rdp\n", "d@srv4\n", "RDP\n", "-\n"));
+    BOOST_CHECK_EQUAL(0u, index.append("", "", "", ""));
+    BOOST_CHECK_EQUAL(4u, index.size());
+    // group names stored once
+    BOOST_CHECK_EQUAL(2u, index.groups.size());
+
+    index.filter("", "");
+    BOOST_CHECK_EQUAL(4u, index.matches.size());
+    const TargetIndex::Entry & entry = index.matching(1);
+    BOOST_CHECK_EQUAL(std::string("vnc"), index.group(entry));
+    BOOST_CHECK_EQUAL(std::string("b@srv2"), index.str(entry.target));
+    BOOST_CHECK_EQUAL(std::string("VNC"), index.str(entry.protocol));
+    BOOST_CHECK_EQUAL(std::string("2012-12-31"), index.str(entry.endtime));
+    BOOST_CHECK_EQUAL(std::string(""), index.str(index.matching(2).endtime));
+    BOOST_CHECK_EQUAL(std::string("d@srv4"), index.str(index.matching(3).target));
+}
+
+BOOST_AUTO_TEST_CASE(TestTargetIndexFilter)
+{
+    TargetIndex index;
+    index.append("rdp vnc rdp rdp", "a@srv1 b@srv12 c@srv123 d@host", "RDP VNC RDP RDP", "-;-;-;-");
+
+    index.filter("", "srv");
+    BOOST_CHECK_EQUAL(3u, index.matches.size());
+    BOOST_CHECK_EQUAL(4u, index.scanned);
+
+    // filter extended: only previous matches tested again
+    index.filter("", "srv12");
+    BOOST_CHECK_EQUAL(2u, index.matches.size());
+    BOOST_CHECK_EQUAL(7u, index.scanned);
+    index.filter("rd", "srv12");
+    BOOST_CHECK_EQUAL(1u, index.matches.size());
+    BOOST_CHECK_EQUAL(std::string("c@srv123"), index.str(index.matching(0).target));
+    BOOST_CHECK_EQUAL(9u, index.scanned);
+
+    // filter shortened: all targets tested again
+    index.filter("rd", "");
+    BOOST_CHECK_EQUAL(3u, index.matches.size());
+    BOOST_CHECK_EQUAL(13u, index.scanned);
+
+    index.filter("", "nothing");
+    BOOST_CHECK_EQUAL(0u, index.matches.size());
+    BOOST_CHECK_EQUAL(1u, index.nb_pages(20));
+
+    index.filter("", "");
+    BOOST_CHECK_EQUAL(4u, index.matches.size());
+    BOOST_CHECK_EQUAL(1u, index.nb_pages(4));
+    BOOST_CHECK_EQUAL(2u, index.nb_pages(3));
+}
+
+BOOST_AUTO_TEST_CASE(TestTargetIndexSpeed)
+{
+    // 20000 targets, typed one char at a time in device filter
+    const unsigned nb = 20000;
+    std::string groups, targets, protocols, endtimes;
+    for (unsigned i = 0; i < nb; i++){
+        char buffer[64];
+        sprintf(buffer, "%sgroup%u", i ? " " : "", i % 40);
+        groups += buffer;
+        sprintf(buffer, "%sadmin@server%05u.example.com", i ? " " : "", i);
+        targets += buffer;
+        protocols += i ? " RDP" : "RDP";
+        endtimes += i ? ";2013-01-01 00:00:00" : "2013-01-01 00:00:00";
+    }
+    TargetIndex index;
+    BOOST_CHECK_EQUAL(nb, index.append(groups.c_str(), targets.c_str(), protocols.c_str(), endtimes.c_str()));
+    BOOST_CHECK_EQUAL(40u, index.groups.size());
+
+    const char * typed[] = { "s", "se", "ser", "serv", "server", "server0", "server01", "server012" };
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    for (size_t i = 0; i < sizeof(typed) / sizeof(typed[0]); i++){
+        index.filter("group1", typed[i]);
+    }
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    const uint64_t elapsed = difftimeval(end, start);
+
+    // group1 and group1x groups, server012xx
+    BOOST_CHECK_EQUAL(33u, index.matches.size());
+    // first keystroke tests all targets, next ones only previous matches
+    BOOST_CHECK(index.scanned < 8 * nb / 2);
+
+    fprintf(stderr, "target index, %u targets: %u us for 8 filter keystrokes, %u targets tested\n",
+        nb, (unsigned)elapsed, (unsigned)index.scanned);
+}
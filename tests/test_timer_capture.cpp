@@ -62,3 +62,60 @@ BOOST_AUTO_TEST_CASE(TestTimerCapture)
     elapsed = timer.elapsed(now);
     BOOST_CHECK_EQUAL(elapsed, 0);
 }
+
+static uint64_t ustime()
+{
+    struct timeval now;
+    gettimeofday(&now, 0);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+BOOST_AUTO_TEST_CASE(TestReplayClockBatch)
+{
+    // one hour of recording at 25 frames per second, replayed at once
+    ReplayClock clock(ReplayClock::BATCH);
+    uint64_t start = ustime();
+    for (unsigned i = 0; i < 25 * 3600; i++){
+        clock.wait(40000);
+    }
+    BOOST_CHECK(ustime() - start < 1000000);
+    BOOST_CHECK_EQUAL(3600ULL * 1000000, clock.recorded);
+    BOOST_CHECK_EQUAL(25 * 3600, clock.nb_timestamps);
+    BOOST_CHECK_EQUAL(0, clock.slept);
+    BOOST_CHECK(clock.speed() > 1000);
+
+    // replay restarting after seek
+    clock.reset(60000000);
+    clock.wait(40000);
+    BOOST_CHECK_EQUAL(60040000, clock.recorded);
+    BOOST_CHECK_EQUAL(60000000, clock.origin);
+}
+
+BOOST_AUTO_TEST_CASE(TestReplayClockRealTime)
+{
+    // drawing between timestamps is taken off sleep, replay does not drift
+    ReplayClock clock;
+    BOOST_CHECK_EQUAL((int)ReplayClock::REAL_TIME, clock.mode);
+    uint64_t start = ustime();
+    clock.wait(0);
+    for (unsigned i = 0; i < 10; i++){
+        struct timespec work = { 0, 10000000 };
+        nanosleep(&work, NULL);
+        clock.wait(20000);
+    }
+    uint64_t elapsed = ustime() - start;
+    BOOST_CHECK(elapsed >= 200000);
+    // without drawing taken off, sleeps would add up to the whole 200 ms
+    BOOST_CHECK(clock.slept < 200000);
+
+    // drawing slower than recording, replay is late but never sleeps
+    clock.reset();
+    clock.wait(0);
+    for (unsigned i = 0; i < 3; i++){
+        struct timespec work = { 0, 20000000 };
+        nanosleep(&work, NULL);
+        clock.wait(10000);
+    }
+    BOOST_CHECK_EQUAL(0, clock.slept);
+    BOOST_CHECK(clock.late >= 30000);
+}
@@ -26,12 +26,26 @@
 
 #include <boost/test/auto_unit_test.hpp>
 #include <stdlib.h>
+#include <stdio.h>
 #include <unistd.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <netinet/in.h>
 
 #include "transport.hpp"
 #include "error.hpp"
 #include "log.hpp"
 
+namespace w2000 {
+    #include "./fixtures/dump_w2000.hpp"
+}
+namespace w2008 {
+    #include "./fixtures/dump_w2008.hpp"
+}
+namespace tls {
+    #include "./fixtures/dump_TLSw2008.hpp"
+}
+
 BOOST_AUTO_TEST_CASE(TestGeneratorTransport)
 {
     // test we can read from a GeneratorTransport;
@@ -221,3 +235,340 @@ BOOST_AUTO_TEST_CASE(TestTestTransport)
     };
     BOOST_CHECK_EQUAL(gt.status, false);
 }
+
+BOOST_AUTO_TEST_CASE(TestSocketTransportBuffered)
+{
+    int sv[2];
+    BOOST_CHECK_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    // two PDUs (TPKT header and payload) arriving together
+    BOOST_CHECK_EQUAL(14, write(sv[1], "\x03\x00\x00\x07xyz\x03\x00\x00\x07uvw", 14));
+
+    SocketTransport st("buffered", sv[0], 0);
+    char buf[128] = {};
+    char * p = buf;
+    st.recv(&p, 4);
+    BOOST_CHECK_EQUAL(1, st.total_recv_syscalls);
+    st.recv(&p, 3);
+    BOOST_CHECK(0 == memcmp(buf, "\x03\x00\x00\x07xyz", 7));
+    // second PDU is already received
+    BOOST_CHECK(st.has_pending());
+    st.recv(&p, 7);
+    BOOST_CHECK(0 == memcmp(buf + 7, "\x03\x00\x00\x07uvw", 7));
+    BOOST_CHECK_EQUAL(1, st.total_recv_syscalls);
+    BOOST_CHECK_EQUAL(14, st.total_received);
+    BOOST_CHECK(!st.has_pending());
+
+    // read larger than receive buffer goes straight to destination
+    SocketTransport small("small", sv[0], 0, 16);
+    BOOST_CHECK_EQUAL(24, write(sv[1], "abcdefghijklmnopqrstuvwx", 24));
+    p = buf;
+    small.recv(&p, 20);
+    BOOST_CHECK(0 == memcmp(buf, "abcdefghijklmnopqrst", 20));
+    BOOST_CHECK_EQUAL(1, small.total_recv_syscalls);
+    p = buf;
+    small.recv(&p, 4);
+    BOOST_CHECK(0 == memcmp(buf, "uvwx", 4));
+    BOOST_CHECK_EQUAL(2, small.total_recv_syscalls);
+    small.sck_closed = 1; // socket is closed by st
+
+    // peer closing socket
+    close(sv[1]);
+    p = buf;
+    try {
+        st.recv(&p, 1);
+        BOOST_CHECK(false);
+    } catch (const Error & e){
+        BOOST_CHECK_EQUAL((uint16_t)ERR_SOCKET_CLOSED, (uint16_t)e.id);
+    };
+}
+
+static long long ustime() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (long long)now.tv_sec*1000000LL + (long long)now.tv_usec;
+}
+
+// length of data made of complete slow-path or fast-path PDUs
+static size_t pdu_data_len(const uint8_t * data, size_t len)
+{
+    size_t i = 0;
+    while (i + 4 <= len){
+        size_t pdu_len = 0;
+        if (data[i] == 3){ // TPKT
+            pdu_len = (data[i + 2] << 8) | data[i + 3];
+        }
+        else if ((data[i] & 3) == 0){ // fast-path
+            pdu_len = (data[i + 1] & 0x80) ? (((data[i + 1] & 0x7F) << 8) | data[i + 2]) : data[i + 1];
+        }
+        if (pdu_len < 4 || i + pdu_len > len){
+            break;
+        }
+        i += pdu_len;
+    }
+    return i;
+}
+
+// a peer process sends recorded server data, PDUs are read as mod_rdp and
+// front do (header first then payload), returns recv syscalls
+static uint64_t replay(const char * name, const uint8_t * data, size_t len, size_t recv_buffer_size)
+{
+    int sv[2];
+    BOOST_CHECK_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    pid_t pid = fork();
+    if (pid == 0){
+        close(sv[0]);
+        for (size_t i = 0; i < len; ){
+            // TCP segment sized writes
+            ssize_t sent = write(sv[1], data + i, std::min<size_t>(1448, len - i));
+            if (sent <= 0){
+                _exit(1);
+            }
+            i += sent;
+        }
+        close(sv[1]);
+        _exit(0);
+    }
+    close(sv[1]);
+
+    SocketTransport st(name, sv[0], 0, recv_buffer_size);
+    uint8_t buf[65536];
+    size_t received = 0;
+    long long usec = ustime();
+    while (received < len){
+        uint8_t * p = buf;
+        st.recv(&p, 1);
+        size_t pdu_len = 0;
+        if (buf[0] == 3){
+            st.recv(&p, 3);
+            pdu_len = (buf[2] << 8) | buf[3];
+        }
+        else {
+            st.recv(&p, 1);
+            pdu_len = buf[1];
+            if (pdu_len & 0x80){
+                st.recv(&p, 1);
+                pdu_len = ((pdu_len & 0x7F) << 8) | buf[2];
+            }
+        }
+        st.recv(&p, pdu_len - (p - buf));
+        st.total_pdu_received++;
+        received += pdu_len;
+    }
+    usec = ustime() - usec;
+    int status = 1;
+    waitpid(pid, &status, 0);
+    BOOST_CHECK_EQUAL(0, status);
+    BOOST_CHECK_EQUAL(len, st.total_received);
+
+    printf("%s buffer %u: %u PDUs, %llu bytes, %llu recv syscalls (%.2f per PDU), %llu us\n",
+        name, (unsigned)recv_buffer_size, (unsigned)st.total_pdu_received,
+        (unsigned long long)st.total_received, (unsigned long long)st.total_recv_syscalls,
+        st.total_pdu_received ? (double)st.total_recv_syscalls / st.total_pdu_received : 0.0,
+        usec);
+    return st.total_recv_syscalls;
+}
+
+BOOST_AUTO_TEST_CASE(TestSocketTransportReplay)
+{
+    const char * names[3] = { "w2000", "w2008", "TLSw2008" };
+    const uint8_t * dumps[3] = {
+        (const uint8_t *)w2000::indata,
+        (const uint8_t *)w2008::indata,
+        (const uint8_t *)tls::indata
+    };
+    size_t sizes[3] = { sizeof(w2000::indata), sizeof(w2008::indata), sizeof(tls::indata) };
+    for (size_t i = 0; i < 3; i++){
+        size_t len = pdu_data_len(dumps[i], sizes[i]);
+        BOOST_CHECK(len > 0);
+        uint64_t unbuffered = replay(names[i], dumps[i], len, 0);
+        uint64_t buffered = replay(names[i], dumps[i], len, SocketTransport::RECV_BUFFER_SIZE);
+        BOOST_CHECK(buffered < unbuffered);
+    }
+}
+
+// connected TCP sockets on loopback, with small buffers to throttle sender
+static void tcp_socketpair(int sv[2])
+{
+    int lsck = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    BOOST_CHECK_EQUAL(0, bind(lsck, (struct sockaddr*)&addr, sizeof(addr)));
+    BOOST_CHECK_EQUAL(0, listen(lsck, 1));
+    BOOST_CHECK_EQUAL(0, getsockname(lsck, (struct sockaddr*)&addr, &addr_len));
+    sv[0] = socket(AF_INET, SOCK_STREAM, 0);
+    int size = 4096;
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    BOOST_CHECK_EQUAL(0, connect(sv[0], (struct sockaddr*)&addr, sizeof(addr)));
+    sv[1] = accept(lsck, NULL, NULL);
+    setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    close(lsck);
+}
+
+BOOST_AUTO_TEST_CASE(TestSocketTransportSendQueue)
+{
+    int sv[2];
+    tcp_socketpair(sv);
+
+    SocketTransport st("queue", sv[0], 0);
+    st.send_queueing = true;
+    st.send_high_water = 65536;
+
+    // peer does not read: data is queued instead of blocking
+    char pdu[4096];
+    for (size_t i = 0; i < 32; i++){
+        memset(pdu, 'a' + i % 26, sizeof(pdu));
+        st.send(pdu, sizeof(pdu));
+    }
+    BOOST_CHECK_EQUAL(32 * 4096, st.total_sent);
+    BOOST_CHECK(st.has_queued_output());
+    BOOST_CHECK(st.congested());
+    size_t queued = st.queued();
+
+    // peer reads some, queue goes down when sent again
+    char buf[4096];
+    size_t received = 0;
+    while (received < 16 * 4096){
+        ssize_t n = ::recv(sv[1], buf, sizeof(buf), MSG_DONTWAIT);
+        if (n > 0){
+            for (ssize_t k = 0; k < n; k++){
+                BOOST_REQUIRE_EQUAL((char)('a' + ((received + k) / 4096) % 26), buf[k]);
+            }
+            received += n;
+        }
+        st.send_queue(NULL, 0);
+    }
+    BOOST_CHECK(st.queued() < queued);
+    BOOST_CHECK(!st.congested());
+
+    // corked data is only sent on uncork, all at once
+    while (received < 32 * 4096){
+        ssize_t n = ::recv(sv[1], buf, sizeof(buf), MSG_DONTWAIT);
+        if (n > 0){
+            received += n;
+        }
+        st.send_queue(NULL, 0);
+    }
+    BOOST_CHECK(!st.has_queued_output());
+    st.cork();
+    st.send("abc", 3);
+    st.send("def", 3);
+    BOOST_CHECK_EQUAL(-1, ::recv(sv[1], buf, sizeof(buf), MSG_DONTWAIT));
+    st.uncork();
+    BOOST_CHECK_EQUAL(6, ::recv(sv[1], buf, sizeof(buf), 0));
+    BOOST_CHECK(0 == memcmp(buf, "abcdef", 6));
+    BOOST_CHECK(!st.has_queued_output());
+    close(sv[1]);
+}
+
+// throttled peer process reads 4 KB every millisecond, sender is only blocked
+// when queue is 4 times over high water mark, all data arrives in order
+BOOST_AUTO_TEST_CASE(TestSocketTransportThrottledPeer)
+{
+    int sv[2];
+    tcp_socketpair(sv);
+    const size_t total = 1024 * 1024;
+
+    pid_t pid = fork();
+    if (pid == 0){
+        close(sv[0]);
+        char buf[4096];
+        for (size_t received = 0; received < total; ){
+            ssize_t n = ::recv(sv[1], buf, sizeof(buf), 0);
+            if (n <= 0){
+                _exit(1);
+            }
+            for (ssize_t k = 0; k < n; k++){
+                if (buf[k] != (char)((received + k) % 251)){
+                    _exit(2);
+                }
+            }
+            received += n;
+            usleep(1000);
+        }
+        _exit(0);
+    }
+    close(sv[1]);
+
+    SocketTransport st("throttled", sv[0], 0);
+    st.send_queueing = true;
+    st.send_high_water = 65536;
+    char pdu[8192];
+    size_t max_queued = 0;
+    size_t nb_congested = 0;
+    for (size_t sent = 0; sent < total; sent += sizeof(pdu)){
+        for (size_t k = 0; k < sizeof(pdu); k++){
+            pdu[k] = (char)((sent + k) % 251);
+        }
+        st.send(pdu, sizeof(pdu));
+        max_queued = std::max(max_queued, st.queued());
+        nb_congested += st.congested();
+    }
+    BOOST_CHECK(nb_congested > 0);
+    BOOST_CHECK(max_queued <= 4 * 65536 + sizeof(pdu));
+    st.wait_send_queue(0);
+    int status = 1;
+    waitpid(pid, &status, 0);
+    BOOST_CHECK_EQUAL(0, status);
+}
+
+// receiving only sends what socket takes of queue: data from peer is read
+// even though peer does not read what was queued
+BOOST_AUTO_TEST_CASE(TestSocketTransportRecvWithQueuedOutput)
+{
+    int sv[2];
+    tcp_socketpair(sv);
+
+    SocketTransport st("queue", sv[0], 0);
+    st.send_queueing = true;
+    char pdu[4096] = {};
+    for (size_t i = 0; i < 64; i++){
+        st.send(pdu, sizeof(pdu));
+    }
+    BOOST_CHECK(st.has_queued_output());
+
+    BOOST_CHECK_EQUAL(5, ::send(sv[1], "hello", 5, 0));
+    char buf[5];
+    char * p = buf;
+    st.recv(&p, 5);
+    BOOST_CHECK(0 == memcmp(buf, "hello", 5));
+    BOOST_CHECK(st.has_queued_output());
+    close(sv[1]);
+}
+
+// without send_queueing send blocks until peer took all data, nothing is
+// left for session to flush
+BOOST_AUTO_TEST_CASE(TestSocketTransportBlockingSend)
+{
+    int sv[2];
+    tcp_socketpair(sv);
+    const size_t total = 256 * 1024;
+
+    pid_t pid = fork();
+    if (pid == 0){
+        close(sv[0]);
+        char buf[4096];
+        for (size_t received = 0; received < total; ){
+            ssize_t n = ::recv(sv[1], buf, sizeof(buf), 0);
+            if (n <= 0){
+                _exit(1);
+            }
+            received += n;
+            usleep(100);
+        }
+        _exit(0);
+    }
+    close(sv[1]);
+
+    SocketTransport st("blocking", sv[0], 0);
+    char pdu[8192] = {};
+    for (size_t sent = 0; sent < total; sent += sizeof(pdu)){
+        st.send(pdu, sizeof(pdu));
+        BOOST_CHECK(!st.has_queued_output());
+    }
+    int status = 1;
+    waitpid(pid, &status, 0);
+    BOOST_CHECK_EQUAL(0, status);
+}
@@ -0,0 +1,186 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Unit test for mjpeg video capture, encoding speed and skipped frames
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestVideoCapturePerf
+#include <boost/test/auto_unit_test.hpp>
+
+#include <stdio.h>
+#include <sys/time.h>
+#include "videocapture.hpp"
+#include "RDP/RDPDrawable.hpp"
+
+static uint32_t le32(const uint8_t * p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+// encode speed of full screen frames, then of unchanged frames. With
+// writer thread, only time spent in session thread is measured.
+static void video_perf(uint16_t width, uint16_t height, bool threaded)
+{
+    char path[256];
+    sprintf(path, "/tmp/test_video_capture_perf-%ux%u", width, height);
+    char filename[300];
+    sprintf(filename, "%s-%u-0.avi", path, getpid());
+
+    RDPDrawable drawable(width, height, false);
+    // some detailed content, flat areas would be too easy for encoder
+    for (size_t y = 0; y < height; y++){
+        uint8_t * row = drawable.drawable.data + y * drawable.drawable.rowsize;
+        for (size_t x = 0; x < width * 3u; x++){
+            row[x] = ((x * 7) ^ (y * 13) ^ ((x / 24) * (y / 16))) & 0xFF;
+        }
+    }
+
+    const unsigned nb_frames = 20;
+    {
+        CaptureWriter writer;
+        VideoCapture video(drawable.drawable, path, 5, 15, threaded ? &writer : 0);
+        struct timeval start;
+        gettimeofday(&start, NULL);
+        for (unsigned i = 0; i < nb_frames; i++){
+            RDPOpaqueRect cmd(Rect(i * 32, i * 16, width / 2, height / 2), i * 0x0A0B0C);
+            const Rect screen(0, 0, width, height);
+            drawable.draw(cmd, screen);
+            video.draw(cmd, screen);
+            video.frame();
+        }
+        struct timeval end;
+        gettimeofday(&end, NULL);
+        uint64_t elapsed = difftimeval(end, start);
+        if (threaded){
+            fprintf(stderr, "video capture %ux%u, writer thread: %u frames in %llu us on session thread,"
+                " %llu delayed\n",
+                width, height, nb_frames, (unsigned long long)elapsed,
+                (unsigned long long)video.nb_delayed);
+            writer.sync();
+        }
+        else {
+            fprintf(stderr, "video capture %ux%u: %u frames encoded in %llu ms (%.1f fps), %u bytes per frame\n",
+                width, height, nb_frames, (unsigned long long)elapsed / 1000,
+                nb_frames * 1000000.0 / (elapsed ? elapsed : 1),
+                (unsigned)(video.recorder->avi.movi_size / nb_frames));
+            BOOST_CHECK_EQUAL(nb_frames, video.recorder->nb_encoded);
+        }
+
+        gettimeofday(&start, NULL);
+        for (unsigned i = 0; i < nb_frames; i++){
+            video.frame();
+        }
+        gettimeofday(&end, NULL);
+        elapsed = difftimeval(end, start);
+        fprintf(stderr, "video capture %ux%u: %u unchanged frames in %llu us\n",
+            width, height, nb_frames, (unsigned long long)elapsed);
+        if (!threaded){
+            BOOST_CHECK_EQUAL(nb_frames, video.nb_skipped);
+            BOOST_CHECK_EQUAL(nb_frames, video.recorder->nb_encoded);
+            BOOST_CHECK_EQUAL(2 * nb_frames, video.recorder->avi.nb_frames);
+        }
+    }
+
+    // avi headers completed when file is closed
+    FILE * f = fopen(filename, "r");
+    BOOST_CHECK(f);
+    uint8_t header[AVIWriter::HEADERS_SIZE + 10];
+    BOOST_CHECK_EQUAL(sizeof(header), fread(header, 1, sizeof(header), f));
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    BOOST_CHECK_EQUAL(0, memcmp(header, "RIFF", 4));
+    BOOST_CHECK_EQUAL(size - 8, le32(header + 4));
+    BOOST_CHECK_EQUAL(0, memcmp(header + 8, "AVI LIST", 8));
+    BOOST_CHECK_EQUAL(2 * nb_frames, le32(header + 48)); // dwTotalFrames
+    BOOST_CHECK_EQUAL(width, le32(header + 64));
+    BOOST_CHECK_EQUAL(height, le32(header + 68));
+    BOOST_CHECK_EQUAL(0, memcmp(header + 220, "movi00dc", 8));
+    BOOST_CHECK_EQUAL(0xFF, header[232]); // jpeg SOI marker
+    BOOST_CHECK_EQUAL(0xD8, header[233]);
+    unlink(filename);
+}
+
+BOOST_AUTO_TEST_CASE(TestVideoCapturePerf1280x1024)
+{
+    video_perf(1280, 1024, false);
+}
+
+BOOST_AUTO_TEST_CASE(TestVideoCapturePerf1920x1080)
+{
+    video_perf(1920, 1080, false);
+}
+
+BOOST_AUTO_TEST_CASE(TestVideoCapturePerf1920x1080Threaded)
+{
+    video_perf(1920, 1080, true);
+}
+
+BOOST_AUTO_TEST_CASE(TestVideoCaptureFramerate)
+{
+    RDPDrawable drawable(640, 480, false);
+    char filename[300];
+    sprintf(filename, "/tmp/test_video_capture_framerate-%u-0.avi", getpid());
+    VideoCapture video(drawable.drawable, "/tmp/test_video_capture_framerate", 5, 15);
+
+    struct timeval now;
+    now.tv_sec = 1000;
+    now.tv_usec = 0;
+    video.snapshot(now);
+    BOOST_CHECK_EQUAL(1u, video.recorder->avi.nb_frames);
+    BOOST_CHECK_EQUAL(200000u, video.snapshot_delay(now));
+
+    // one second later, 5 frames due, screen unchanged
+    now.tv_sec = 1001;
+    video.snapshot(now);
+    BOOST_CHECK_EQUAL(6u, video.recorder->avi.nb_frames);
+    BOOST_CHECK_EQUAL(1u, video.recorder->nb_encoded);
+    BOOST_CHECK_EQUAL(5u, video.nb_skipped);
+
+    // drawing is encoded in next frame only
+    now.tv_usec = 500000;
+    RDPOpaqueRect cmd(Rect(10, 10, 20, 20), 0xFF0000);
+    drawable.draw(cmd, Rect(0, 0, 640, 480));
+    video.draw(cmd, Rect(0, 0, 640, 480));
+    video.snapshot(now);
+    BOOST_CHECK_EQUAL(8u, video.recorder->avi.nb_frames);
+    BOOST_CHECK_EQUAL(2u, video.recorder->nb_encoded);
+    BOOST_CHECK_EQUAL(6u, video.nb_skipped);
+    BOOST_CHECK_EQUAL(100000u, video.snapshot_delay(now));
+    unlink(filename);
+}
+
+BOOST_AUTO_TEST_CASE(TestVideoCaptureJpegBufferGrows)
+{
+    RDPDrawable drawable(64, 64, false);
+    for (size_t i = 0; i < 64 * 64 * 3u; i++){
+        drawable.drawable.data[i] = (i * 2654435761u) >> 24;
+    }
+    JPEGEncoder encoder(64, 64, 95);
+    // jpeg larger than buffer: buffer allocated by libjpeg is kept
+    encoder.capacity = 100;
+    size_t len = encoder.encode(drawable.drawable.data, drawable.drawable.rowsize);
+    BOOST_CHECK(len > 100);
+    BOOST_CHECK_EQUAL(len, encoder.capacity);
+    BOOST_CHECK_EQUAL(0xFF, encoder.buffer[0]);
+    BOOST_CHECK_EQUAL(0xD8, encoder.buffer[1]);
+    BOOST_CHECK_EQUAL(len, encoder.encode(drawable.drawable.data, drawable.drawable.rowsize));
+}
@@ -317,9 +317,10 @@ BOOST_AUTO_TEST_CASE(TestDecodePacket)
  /* 0010 */ "\x00\x00\x00\x00"                                                 // ....
 // Dump done VNC Target (3) sending 20 bytes
 // Send done on VNC Target (3)
-// Socket VNC Target (3) sending 16 bytes
- /* 0000 */ "\x02\x00\x00\x03\x00\x00\x00\x00\x00\x00\x00\x01\xff\xff\xff\x11" // ................
-// Dump done VNC Target (3) sending 16 bytes
+// Socket VNC Target (3) sending 28 bytes
+ /* 0000 */ "\x02\x00\x00\x06\x00\x00\x00\x01\x00\x00\x00\x07\x00\x00\x00\x10" // ................
+ /* 0010 */ "\x00\x00\x00\x05\x00\x00\x00\x00\xff\xff\xff\x11"                 // ............
+// Dump done VNC Target (3) sending 28 bytes
 // Send done on VNC Target (3)
 // --------- FRONT ------------------------
 // server_resize(width=1024, height=768, bpp=16
@@ -407,9 +408,10 @@ BOOST_AUTO_TEST_CASE(TestDecodePacket)
  /* 0010 */ "\x00\x00\x00\x00"                                                 // ....
 // Dump done VNC Target (3) sending 20 bytes
 // Send done on VNC Target (3)
-// Socket VNC Target (3) sending 16 bytes
- /* 0000 */ "\x02\x00\x00\x03\x00\x00\x00\x00\x00\x00\x00\x01\xff\xff\xff\x11" // ................
-// Dump done VNC Target (3) sending 16 bytes
+// Socket VNC Target (3) sending 28 bytes
+ /* 0000 */ "\x02\x00\x00\x06\x00\x00\x00\x01\x00\x00\x00\x07\x00\x00\x00\x10" // ................
+ /* 0010 */ "\x00\x00\x00\x05\x00\x00\x00\x00\xff\xff\xff\x11"                 // ............
+// Dump done VNC Target (3) sending 28 bytes
 // Send done on VNC Target (3)
 // --------- FRONT ------------------------
 // server_resize(width=1024, height=768, bpp=16
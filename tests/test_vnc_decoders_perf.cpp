@@ -0,0 +1,591 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Unit test for VNC Hextile, Tight and ZRLE decoders: RFB traces of a
+   desktop (encoded the way VNC servers do) replayed through TestTransport,
+   decoding speed and size compared to raw encoding.
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestVncDecodersPerf
+#include <boost/test/auto_unit_test.hpp>
+
+#include <stdio.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "rect.hpp"
+#include "transport.hpp"
+#include "difftimeval.hpp"
+#include "vnc/vnc_decoders.hpp"
+
+typedef std::vector<uint16_t> Screen; // 16 bpp pixels, as asked by mod_vnc
+
+static uint16_t rgb565(unsigned r, unsigned g, unsigned b)
+{
+    return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+}
+
+// background, windows with title bar and text, a photo
+static void make_screen(Screen & screen, uint16_t width, uint16_t height, unsigned frame)
+{
+    screen.resize(width * height);
+    for (unsigned y = 0; y < height; y++){
+        for (unsigned x = 0; x < width; x++){
+            screen[y * width + x] = rgb565(0, 64 + y / 12, 128);
+        }
+    }
+    for (unsigned w = 0; w < 3; w++){
+        const unsigned wx = 40 + w * 220 + frame * 8;
+        const unsigned wy = 40 + w * 140;
+        for (unsigned y = wy; y < wy + 300 && y < height; y++){
+            for (unsigned x = wx; x < wx + 400 && x < width; x++){
+                uint16_t pixel = rgb565(255, 255, 255);
+                if (y < wy + 20){
+                    pixel = rgb565(0, 0, 160);
+                }
+                else if ((y - wy) % 14 < 9 && x > wx + 8 && (x - wx) % 60 < 50
+                && ((x * 7 + y * 3 + w) % 11) < 3){
+                    pixel = rgb565(0, 0, 0);
+                }
+                screen[y * width + x] = pixel;
+            }
+        }
+    }
+    uint32_t seed = 12345 + frame;
+    for (unsigned y = 500; y < 650 && y < height; y++){
+        for (unsigned x = 700; x < 900 && x < width; x++){
+            seed = seed * 1103515245 + 12345;
+            const unsigned noise = (seed >> 16) & 7;
+            screen[y * width + x] = rgb565((x - 700) + noise, (y - 500) + noise, (x + y) / 8 + noise);
+        }
+    }
+}
+
+static void put8(std::string & s, uint8_t v)
+{
+    s += (char)v;
+}
+
+static void put16be(std::string & s, uint16_t v)
+{
+    put8(s, v >> 8);
+    put8(s, v);
+}
+
+static void put32be(std::string & s, uint32_t v)
+{
+    put16be(s, v >> 16);
+    put16be(s, v);
+}
+
+static void put_pixel(std::string & s, uint16_t pixel)
+{
+    put8(s, pixel);
+    put8(s, pixel >> 8);
+}
+
+// distinct colors of area, at most max_colors + 1
+static void colors(const Screen & screen, uint16_t width, const Rect & r, size_t max_colors,
+                   std::vector<uint16_t> & palette)
+{
+    palette.clear();
+    for (int y = r.y; y < r.y + r.cy; y++){
+        for (int x = r.x; x < r.x + r.cx; x++){
+            const uint16_t pixel = screen[y * width + x];
+            if (std::find(palette.begin(), palette.end(), pixel) == palette.end()){
+                palette.push_back(pixel);
+                if (palette.size() > max_colors){
+                    return;
+                }
+            }
+        }
+    }
+}
+
+static size_t index_of(const std::vector<uint16_t> & palette, uint16_t pixel)
+{
+    return std::find(palette.begin(), palette.end(), pixel) - palette.begin();
+}
+
+static void deflate_to(z_stream & zstream, const std::string & in, std::string & out)
+{
+    std::vector<uint8_t> buffer(in.size() + in.size() / 100 + 1024);
+    zstream.next_in = (Bytef*)in.data();
+    zstream.avail_in = in.size();
+    zstream.next_out = &buffer[0];
+    zstream.avail_out = buffer.size();
+    BOOST_CHECK_EQUAL(Z_OK, deflate(&zstream, Z_SYNC_FLUSH));
+    BOOST_CHECK_EQUAL(0u, zstream.avail_in);
+    out.append((const char *)&buffer[0], buffer.size() - zstream.avail_out);
+}
+
+struct Encoder
+{
+    uint16_t width;
+    z_stream zstreams[4];
+    bool reset[4];
+    int hextile_bg;
+
+    Encoder(uint16_t width) : width(width), hextile_bg(-1)
+    {
+        for (size_t i = 0; i < 4; i++){
+            memset(&this->zstreams[i], 0, sizeof(z_stream));
+            deflateInit(&this->zstreams[i], Z_DEFAULT_COMPRESSION);
+            this->reset[i] = false;
+        }
+    }
+
+    ~Encoder()
+    {
+        for (size_t i = 0; i < 4; i++){
+            deflateEnd(&this->zstreams[i]);
+        }
+    }
+
+    void zrle(const Screen & screen, const Rect & r, std::string & out)
+    {
+        std::string tiles;
+        std::vector<uint16_t> palette;
+        for (int ty = r.y; ty < r.y + r.cy; ty += 64){
+            for (int tx = r.x; tx < r.x + r.cx; tx += 64){
+                const Rect tile(tx, ty, std::min<int>(64, r.x + r.cx - tx), std::min<int>(64, r.y + r.cy - ty));
+                colors(screen, this->width, tile, 127, palette);
+                if (palette.size() == 1){
+                    put8(tiles, 1);
+                    put_pixel(tiles, palette[0]);
+                }
+                else if (palette.size() <= 16){
+                    put8(tiles, palette.size());
+                    for (size_t i = 0; i < palette.size(); i++){
+                        put_pixel(tiles, palette[i]);
+                    }
+                    const unsigned bits = (palette.size() == 2) ? 1 : (palette.size() <= 4) ? 2 : 4;
+                    for (int y = tile.y; y < tile.y + tile.cy; y++){
+                        uint8_t byte = 0;
+                        unsigned nbits = 0;
+                        for (int x = tile.x; x < tile.x + tile.cx; x++){
+                            byte = (byte << bits) | index_of(palette, screen[y * this->width + x]);
+                            nbits += bits;
+                            if (nbits == 8){
+                                put8(tiles, byte);
+                                byte = 0;
+                                nbits = 0;
+                            }
+                        }
+                        if (nbits){
+                            put8(tiles, byte << (8 - nbits));
+                        }
+                    }
+                }
+                else {
+                    // runs of tile, palette RLE if few colors, plain RLE otherwise
+                    const bool with_palette = palette.size() <= 127;
+                    std::string runs;
+                    if (with_palette){
+                        put8(runs, 128 + palette.size());
+                        for (size_t i = 0; i < palette.size(); i++){
+                            put_pixel(runs, palette[i]);
+                        }
+                    }
+                    else {
+                        put8(runs, 128);
+                    }
+                    const size_t nb_pixels = tile.cx * tile.cy;
+                    for (size_t pos = 0; pos < nb_pixels;){
+                        const uint16_t pixel = screen[(tile.y + pos / tile.cx) * this->width + tile.x + pos % tile.cx];
+                        size_t run = 1;
+                        while (pos + run < nb_pixels
+                        && screen[(tile.y + (pos + run) / tile.cx) * this->width + tile.x + (pos + run) % tile.cx] == pixel){
+                            run++;
+                        }
+                        if (with_palette){
+                            put8(runs, index_of(palette, pixel) | ((run > 1) ? 128 : 0));
+                        }
+                        else {
+                            put_pixel(runs, pixel);
+                        }
+                        if (!with_palette || run > 1){
+                            size_t len = run - 1;
+                            for (; len >= 255; len -= 255){
+                                put8(runs, 255);
+                            }
+                            put8(runs, len);
+                        }
+                        pos += run;
+                    }
+                    if (runs.size() < 1 + nb_pixels * 2){
+                        tiles += runs;
+                    }
+                    else {
+                        put8(tiles, 0);
+                        for (int y = tile.y; y < tile.y + tile.cy; y++){
+                            for (int x = tile.x; x < tile.x + tile.cx; x++){
+                                put_pixel(tiles, screen[y * this->width + x]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        std::string compressed;
+        deflate_to(this->zstreams[0], tiles, compressed);
+        put32be(out, compressed.size());
+        out += compressed;
+    }
+
+    void hextile(const Screen & screen, const Rect & r, std::string & out)
+    {
+        std::vector<uint16_t> palette;
+        for (int ty = r.y; ty < r.y + r.cy; ty += 16){
+            for (int tx = r.x; tx < r.x + r.cx; tx += 16){
+                const Rect tile(tx, ty, std::min<int>(16, r.x + r.cx - tx), std::min<int>(16, r.y + r.cy - ty));
+                const uint16_t bg = screen[tile.y * this->width + tile.x];
+                // one row high subrectangles of pixels different from background
+                std::string subrects;
+                unsigned nb_subrects = 0;
+                int fg = -1;
+                bool colored = false;
+                for (int y = tile.y; y < tile.y + tile.cy; y++){
+                    for (int x = tile.x; x < tile.x + tile.cx;){
+                        const uint16_t pixel = screen[y * this->width + x];
+                        int run = 1;
+                        while (x + run < tile.x + tile.cx && screen[y * this->width + x + run] == pixel){
+                            run++;
+                        }
+                        if (pixel != bg){
+                            colored = colored || (fg >= 0 && fg != pixel);
+                            fg = pixel;
+                            put_pixel(subrects, pixel);
+                            put8(subrects, ((x - tile.x) << 4) | (y - tile.y));
+                            put8(subrects, ((run - 1) << 4));
+                            nb_subrects++;
+                        }
+                        x += run;
+                    }
+                }
+                const uint8_t bg_flag = (bg != this->hextile_bg) ? 2 : 0;
+                if (nb_subrects > 255 || subrects.size() >= tile.cx * tile.cy * 2u){
+                    put8(out, 1);
+                    for (int y = tile.y; y < tile.y + tile.cy; y++){
+                        for (int x = tile.x; x < tile.x + tile.cx; x++){
+                            put_pixel(out, screen[y * this->width + x]);
+                        }
+                    }
+                    this->hextile_bg = -1;
+                    continue;
+                }
+                if (!nb_subrects){
+                    put8(out, bg_flag);
+                }
+                else if (colored){
+                    put8(out, bg_flag | 8 | 16);
+                }
+                else {
+                    put8(out, bg_flag | 4 | 8);
+                }
+                if (bg_flag){
+                    put_pixel(out, bg);
+                }
+                this->hextile_bg = bg;
+                if (!nb_subrects){
+                    continue;
+                }
+                if (!colored){
+                    put_pixel(out, fg);
+                }
+                put8(out, nb_subrects);
+                for (size_t i = 0; i < subrects.size(); i += 4){
+                    if (colored){
+                        out.append(subrects, i, 2);
+                    }
+                    out.append(subrects, i + 2, 2);
+                }
+            }
+        }
+    }
+
+    void tight(const Screen & screen, const Rect & r, std::string & out, bool gradient)
+    {
+        std::vector<uint16_t> palette;
+        colors(screen, this->width, r, 256, palette);
+        if (palette.size() == 1){
+            put8(out, 0x80);
+            put_pixel(out, palette[0]);
+            return;
+        }
+        std::string data;
+        uint8_t stream_id = 0;
+        uint8_t filter = 0;
+        if (palette.size() <= 256 && palette.size() < r.cx * r.cy / 2u){
+            stream_id = 1;
+            filter = 1;
+            for (int y = r.y; y < r.y + r.cy; y++){
+                uint8_t byte = 0;
+                unsigned nbits = 0;
+                for (int x = r.x; x < r.x + r.cx; x++){
+                    const size_t index = index_of(palette, screen[y * this->width + x]);
+                    if (palette.size() > 2){
+                        put8(data, index);
+                        continue;
+                    }
+                    byte = (byte << 1) | index;
+                    if (++nbits == 8){
+                        put8(data, byte);
+                        byte = 0;
+                        nbits = 0;
+                    }
+                }
+                if (nbits){
+                    put8(data, byte << (8 - nbits));
+                }
+            }
+        }
+        else if (gradient){
+            stream_id = 2;
+            filter = 2;
+            const unsigned max[3] = { 0x1F, 0x3F, 0x1F };
+            const unsigned shift[3] = { 11, 5, 0 };
+            for (int y = r.y; y < r.y + r.cy; y++){
+                for (int x = r.x; x < r.x + r.cx; x++){
+                    const uint16_t pixel = screen[y * this->width + x];
+                    const uint16_t left = (x > r.x) ? screen[y * this->width + x - 1] : 0;
+                    const uint16_t up = (y > r.y) ? screen[(y - 1) * this->width + x] : 0;
+                    const uint16_t upleft = (x > r.x && y > r.y) ? screen[(y - 1) * this->width + x - 1] : 0;
+                    uint16_t diff = 0;
+                    for (size_t c = 0; c < 3; c++){
+                        int prediction = (int)((left >> shift[c]) & max[c]) + (int)((up >> shift[c]) & max[c])
+                                       - (int)((upleft >> shift[c]) & max[c]);
+                        prediction = (prediction < 0) ? 0 : (prediction > (int)max[c]) ? max[c] : prediction;
+                        diff |= ((((pixel >> shift[c]) & max[c]) - prediction) & max[c]) << shift[c];
+                    }
+                    put_pixel(data, diff);
+                }
+            }
+        }
+        else {
+            for (int y = r.y; y < r.y + r.cy; y++){
+                for (int x = r.x; x < r.x + r.cx; x++){
+                    put_pixel(data, screen[y * this->width + x]);
+                }
+            }
+        }
+        uint8_t control = (stream_id << 4) | (filter ? 0x40 : 0);
+        if (this->reset[stream_id]){
+            deflateReset(&this->zstreams[stream_id]);
+            control |= 1 << stream_id;
+            this->reset[stream_id] = false;
+        }
+        put8(out, control);
+        if (filter){
+            put8(out, filter);
+        }
+        if (filter == 1){
+            put8(out, palette.size() - 1);
+            for (size_t i = 0; i < palette.size(); i++){
+                put_pixel(out, palette[i]);
+            }
+        }
+        if (data.size() < 12){
+            out += data;
+            return;
+        }
+        std::string compressed;
+        deflate_to(this->zstreams[stream_id], data, compressed);
+        size_t len = compressed.size();
+        put8(out, (len & 0x7F) | ((len > 0x7F) ? 0x80 : 0));
+        if (len > 0x7F){
+            put8(out, ((len >> 7) & 0x7F) | ((len > 0x3FFF) ? 0x80 : 0));
+            if (len > 0x3FFF){
+                put8(out, len >> 14);
+            }
+        }
+        out += compressed;
+    }
+};
+
+// FramebufferUpdate messages of frames, 128x128 rectangles
+static void make_trace(uint32_t encoding, uint16_t width, uint16_t height,
+                       const std::vector<Screen> & frames, std::string & trace)
+{
+    Encoder encoder(width);
+    for (size_t f = 0; f < frames.size(); f++){
+        std::vector<Rect> rects;
+        for (unsigned y = 0; y < height; y += 128){
+            for (unsigned x = 0; x < width; x += 128){
+                rects.push_back(Rect(x, y, std::min<int>(128, width - x), std::min<int>(128, height - y)));
+            }
+        }
+        // tight streams reset by server from time to time
+        encoder.reset[0] = encoder.reset[1] = encoder.reset[2] = (f == 1);
+        put8(trace, 0);
+        put8(trace, 0);
+        put16be(trace, rects.size());
+        for (size_t i = 0; i < rects.size(); i++){
+            put16be(trace, rects[i].x);
+            put16be(trace, rects[i].y);
+            put16be(trace, rects[i].cx);
+            put16be(trace, rects[i].cy);
+            put32be(trace, encoding);
+            switch (encoding){
+            case VNCDecoders::ZRLE:
+                encoder.zrle(frames[f], rects[i], trace);
+            break;
+            case VNCDecoders::HEXTILE:
+                encoder.hextile(frames[f], rects[i], trace);
+            break;
+            case VNCDecoders::TIGHT:
+                encoder.tight(frames[f], rects[i], trace, i & 1);
+            break;
+            }
+        }
+    }
+}
+
+// decodes trace as mod_vnc does, returns last frame
+static void replay(const std::string & trace, uint16_t width, uint16_t height, size_t nb_frames, Screen & screen)
+{
+    screen.assign(width * height, 0);
+    TestTransport t("vnc", trace.data(), trace.size(), "", 0);
+    VNCDecoders decoders;
+    size_t nb_headers = 0;
+    for (size_t f = 0; f < nb_frames; f++){
+        Stream stream(12);
+        t.recv((char**)&stream.end, 4);
+        stream.in_skip_bytes(2);
+        const uint16_t nb_rects = stream.in_uint16_be();
+        nb_headers += 4 + nb_rects * 12;
+        for (uint16_t i = 0; i < nb_rects; i++){
+            stream.init(12);
+            t.recv((char**)&stream.end, 12);
+            const uint16_t x = stream.in_uint16_be();
+            const uint16_t y = stream.in_uint16_be();
+            const uint16_t cx = stream.in_uint16_be();
+            const uint16_t cy = stream.in_uint16_be();
+            const uint32_t encoding = stream.in_uint32_be();
+            const uint8_t * pixels = decoders.decode(&t, encoding, cx, cy);
+            for (uint16_t yy = 0; yy < cy; yy++){
+                for (uint16_t xx = 0; xx < cx; xx++){
+                    const uint8_t * p = pixels + (yy * cx + xx) * 2;
+                    screen[(y + yy) * width + x + xx] = p[0] | (p[1] << 8);
+                }
+            }
+        }
+    }
+    BOOST_CHECK_EQUAL(trace.size(), nb_headers + decoders.received);
+    BOOST_CHECK_EQUAL((uint64_t)nb_frames * width * height * 2, decoders.decoded);
+}
+
+static void decoder_perf(uint32_t encoding, const char * name)
+{
+    const uint16_t width = 1024;
+    const uint16_t height = 768;
+    std::vector<Screen> frames(2);
+    make_screen(frames[0], width, height, 0);
+    make_screen(frames[1], width, height, 1);
+    std::string trace;
+    make_trace(encoding, width, height, frames, trace);
+
+    Screen screen;
+    const unsigned repeat = 10;
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    for (unsigned i = 0; i < repeat; i++){
+        replay(trace, width, height, frames.size(), screen);
+    }
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    BOOST_CHECK(screen == frames.back());
+
+    const uint64_t elapsed = difftimeval(end, start);
+    const double raw_size = frames.size() * width * height * 2.0;
+    fprintf(stderr, "%s: %u bytes for %u bytes of raw pixels (%.1f%%), "
+                    "decoded at %.0f MB/s (%.0f frames %ux%u per second)\n",
+        name, (unsigned)trace.size(), (unsigned)raw_size, trace.size() * 100.0 / raw_size,
+        raw_size * repeat / (elapsed ? elapsed : 1),
+        frames.size() * repeat * 1000000.0 / (elapsed ? elapsed : 1), width, height);
+}
+
+BOOST_AUTO_TEST_CASE(TestVncZrleDecoder)
+{
+    decoder_perf(VNCDecoders::ZRLE, "zrle");
+}
+
+BOOST_AUTO_TEST_CASE(TestVncHextileDecoder)
+{
+    decoder_perf(VNCDecoders::HEXTILE, "hextile");
+}
+
+BOOST_AUTO_TEST_CASE(TestVncTightDecoder)
+{
+    decoder_perf(VNCDecoders::TIGHT, "tight");
+}
+
+BOOST_AUTO_TEST_CASE(TestVncTruncatedZrle)
+{
+    std::vector<Screen> frames(1);
+    make_screen(frames[0], 256, 128, 0);
+    std::string trace;
+    make_trace(VNCDecoders::ZRLE, 256, 128, frames, trace);
+    // zlib data of first rectangle cut
+    trace[4 + 12 + 3] = trace[4 + 12 + 3] - 8;
+    TestTransport t("vnc", trace.data(), trace.size(), "", 0);
+    VNCDecoders decoders;
+    char * end = (char *)malloc(16);
+    char * buffer = end;
+    t.recv(&end, 16);
+    free(buffer);
+    BOOST_CHECK_THROW(decoders.decode(&t, VNCDecoders::ZRLE, 128, 128), Error);
+}
+
+// zlib data length announced larger than what a 16x16 rectangle may need
+// is rejected before being read
+BOOST_AUTO_TEST_CASE(TestVncOversizedZrle)
+{
+    std::string trace;
+    put32be(trace, 65536);
+    trace.append(65536, '\0');
+    TestTransport t("vnc", trace.data(), trace.size(), "", 0);
+    VNCDecoders decoders;
+    BOOST_CHECK_THROW(decoders.decode(&t, VNCDecoders::ZRLE, 16, 16), Error);
+    char * buffer = (char *)malloc(65536);
+    char * end = buffer;
+    t.recv(&end, 65536);
+    free(buffer);
+}
+
+// zlib data inflating to more than any 16x16 rectangle encoding is rejected
+BOOST_AUTO_TEST_CASE(TestVncZrleInflateBound)
+{
+    z_stream zstream;
+    memset(&zstream, 0, sizeof(zstream));
+    deflateInit(&zstream, Z_DEFAULT_COMPRESSION);
+    std::string zdata;
+    deflate_to(zstream, std::string(65536, '\0'), zdata);
+    deflateEnd(&zstream);
+    std::string trace;
+    put32be(trace, zdata.size());
+    trace.append(zdata);
+    TestTransport t("vnc", trace.data(), trace.size(), "", 0);
+    VNCDecoders decoders;
+    BOOST_CHECK_THROW(decoders.decode(&t, VNCDecoders::ZRLE, 16, 16), Error);
+}
@@ -0,0 +1,291 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Unit test for pipelined FramebufferUpdateRequests of mod_vnc: a stand-in
+   VNC server (always changing desktop, like a playing video) answers each
+   request after a simulated network round trip, frames/s are compared for
+   several pipeline depths.
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestVncPipeline
+#include <boost/test/auto_unit_test.hpp>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <string>
+#include <deque>
+
+#include "transport.hpp"
+#include "difftimeval.hpp"
+#include "wait_obj.hpp"
+#include "RDP/RDPGraphicDevice.hpp"
+#include "channel_list.hpp"
+#include "front_api.hpp"
+#include "vnc/vnc.hpp"
+
+static uint64_t now_usec()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+// answers handshake, then one raw FramebufferUpdate per request, each
+// available rtt after request was sent. If merge is set, requests coming
+// while an update is in flight are answered by this update (as servers
+// merging requested regions do).
+class VncServerStandIn : public Transport {
+public:
+    uint64_t rtt;
+    uint16_t cx;
+    uint16_t cy;
+    bool merge;
+    std::string received;               // arrived, not read yet
+    std::deque<uint64_t> arrivals;      // updates in flight
+    unsigned requests;
+
+    VncServerStandIn(uint64_t rtt, uint16_t cx, uint16_t cy, bool merge = false)
+        : rtt(rtt), cx(cx), cy(cy), merge(merge), requests(0)
+    {
+        this->received.append("RFB 003.003\n", 12);
+        this->received.append("\x00\x00\x00\x01", 4);   // no security
+        this->received.append("\x04\x00\x03\x00", 4);   // 1024x768
+        this->received.append("\x10\x10\x00\x01\x00\x1f\x00\x3f\x00\x1f\x0b\x05\x00\x00\x00\x00", 16);
+        this->received.append("\x00\x00\x00\x04" "test", 8);
+    }
+
+    // moves updates already arrived to received data
+    void arrive()
+    {
+        const uint64_t now = now_usec();
+        while (!this->arrivals.empty() && this->arrivals.front() <= now){
+            this->arrivals.pop_front();
+            const char header[] = {
+                0, 0, 0, 1,                                  // FramebufferUpdate, 1 rectangle
+                0, 0, 0, 0,                                  // x, y
+                (char)(this->cx >> 8), (char)this->cx, (char)(this->cy >> 8), (char)this->cy,
+                0, 0, 0, 0                                   // raw
+            };
+            this->received.append(header, sizeof(header));
+            this->received.append(this->cx * this->cy * 2, (char)this->requests);
+        }
+    }
+
+    // sleeps until next update arrives
+    void wait()
+    {
+        if (!this->arrivals.empty()){
+            const uint64_t now = now_usec();
+            if (this->arrivals.front() > now){
+                usleep(this->arrivals.front() - now);
+            }
+            this->arrive();
+        }
+    }
+
+    virtual bool has_pending() const
+    {
+        const_cast<VncServerStandIn*>(this)->arrive();
+        return !this->received.empty();
+    }
+
+    using Transport::recv;
+    virtual void recv(char ** pbuffer, size_t len) throw (Error)
+    {
+        while (this->received.size() < len){
+            if (this->arrivals.empty()){
+                throw Error(ERR_TRANSPORT_NO_MORE_DATA, 0);
+            }
+            this->wait();
+        }
+        memcpy(*pbuffer, this->received.data(), len);
+        this->received.erase(0, len);
+        *pbuffer += len;
+    }
+
+    using Transport::send;
+    virtual void send(const char * const buffer, size_t len) throw (Error)
+    {
+        if (len == 10 && buffer[0] == 3){ // FramebufferUpdateRequest
+            if (!this->merge || this->arrivals.empty()){
+                this->arrivals.push_back(now_usec() + this->rtt);
+            }
+            this->requests++;
+        }
+    }
+};
+
+class NullFront : public FrontAPI {
+public:
+    ChannelDefArray cl;
+    bool is_congested;
+
+    NullFront(bool is_congested) : FrontAPI(false, false), is_congested(is_congested) {}
+
+    virtual bool congested() { return this->is_congested; }
+    virtual void flush() {}
+    virtual void draw(const RDPOpaqueRect & cmd, const Rect & clip) {}
+    virtual void draw(const RDPScrBlt & cmd, const Rect & clip) {}
+    virtual void draw(const RDPDestBlt & cmd, const Rect & clip) {}
+    virtual void draw(const RDPPatBlt & cmd, const Rect & clip) {}
+    virtual void draw(const RDPMemBlt & cmd, const Rect & clip, const Bitmap & bmp) {}
+    virtual void draw(const RDPLineTo & cmd, const Rect & clip) {}
+    virtual void draw(const RDPGlyphIndex & cmd, const Rect & clip) {}
+    virtual const ChannelDefArray & get_channel_list(void) const { return this->cl; }
+    virtual void send_to_channel(const ChannelDef & channel, uint8_t* data, size_t length, size_t chunk_size, int flags) {}
+    virtual void send_pointer(int cache_idx, uint8_t* data, uint8_t* mask, int x, int y) throw (Error) {}
+    virtual void send_global_palette() throw (Error) {}
+    virtual void set_pointer(int cache_idx) throw (Error) {}
+    virtual void begin_update() {}
+    virtual void end_update() {}
+    virtual void color_cache(const BGRPalette & palette, uint8_t cacheIndex) {}
+    virtual void set_mod_palette(const BGRPalette & palette) {}
+    virtual void server_set_pointer(int x, int y, uint8_t* data, uint8_t* mask) {}
+    virtual void server_draw_text(uint16_t x, uint16_t y, const char * text, uint32_t fgcolor, uint32_t bgcolor, const Rect & clip) {}
+    virtual void text_metrics(const char * text, int & width, int & height) {}
+    virtual int server_resize(int width, int height, int bpp) { return 0; }
+};
+
+// drives mod_vnc as session does (draw_event when server socket is
+// readable). While client is congested, session does not read server:
+// updates in flight pile up before draw_event is called.
+static void run_until(mod_vnc & mod, wait_obj & event, VncServerStandIn & server, uint64_t updates,
+                      bool congested = false)
+{
+    while (mod.updates < updates){
+        if (congested){
+            while (!server.arrivals.empty()){
+                server.wait();
+            }
+        }
+        if (event.is_set()){
+            BOOST_CHECK_EQUAL(BACK_EVENT_NONE, mod.draw_event());
+        }
+        else if (server.arrivals.empty()){
+            BOOST_CHECK_MESSAGE(false, "no update requested, display frozen after "
+                << mod.updates << " updates");
+            return;
+        }
+        else {
+            server.wait();
+        }
+    }
+}
+
+// frames/s received through mod_vnc
+static double vnc_fps(unsigned pipeline, bool congested, unsigned & ahead)
+{
+    const unsigned nb_frames = 60;
+    VncServerStandIn server(10000, 256, 256);
+    NullFront front(congested);
+    int fds[2];
+    BOOST_CHECK_EQUAL(0, pipe(fds));
+    double fps = 0;
+    {
+        wait_obj event(fds[0], &server);
+        mod_vnc mod(&server, &event, "user", "password", front, 1024, 768, 0, 0, 0, pipeline);
+
+        const uint64_t start = now_usec();
+        run_until(mod, event, server, nb_frames);
+        const uint64_t elapsed = now_usec() - start;
+        fps = nb_frames * 1000000.0 / elapsed;
+        ahead = mod.updates_ahead;
+        fprintf(stderr, "vnc pipeline %u%s, rtt 10 ms: %.1f frames/s, %u requests for %u updates\n",
+            pipeline, congested ? " (client congested)" : "", fps, server.requests, nb_frames);
+    }
+    close(fds[0]);
+    close(fds[1]);
+    return fps;
+}
+
+BOOST_AUTO_TEST_CASE(TestVncPipeline)
+{
+    unsigned ahead = 0;
+    const double fps1 = vnc_fps(1, false, ahead);
+    BOOST_CHECK_EQUAL(0u, ahead);
+    const double fps2 = vnc_fps(2, false, ahead);
+    BOOST_CHECK(ahead > 0);
+    const double fps4 = vnc_fps(4, false, ahead);
+    BOOST_CHECK(fps2 > 1.5 * fps1);
+    BOOST_CHECK(fps4 > fps2);
+}
+
+BOOST_AUTO_TEST_CASE(TestVncPipelineClientCongested)
+{
+    // no request ahead while client does not follow
+    unsigned ahead = 0;
+    vnc_fps(4, true, ahead);
+    BOOST_CHECK_EQUAL(0u, ahead);
+}
+
+BOOST_AUTO_TEST_CASE(TestVncPipelineCongestedMidway)
+{
+    // requests in flight drain down to one when client gets late
+    VncServerStandIn server(10000, 256, 256);
+    NullFront front(false);
+    int fds[2];
+    BOOST_CHECK_EQUAL(0, pipe(fds));
+    {
+        wait_obj event(fds[0], &server);
+        mod_vnc mod(&server, &event, "user", "password", front, 1024, 768, 0, 0, 0, 4);
+
+        run_until(mod, event, server, 10);
+        BOOST_CHECK_EQUAL(4u, mod.outstanding);
+        BOOST_CHECK_EQUAL(4u, server.requests - mod.updates);
+
+        front.is_congested = true;
+        const uint64_t ahead = mod.updates_ahead;
+        run_until(mod, event, server, 20, true);
+        BOOST_CHECK_EQUAL(1u, mod.outstanding);
+        BOOST_CHECK_EQUAL(1u, server.requests - mod.updates);
+        BOOST_CHECK_EQUAL(ahead, mod.updates_ahead);
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+BOOST_AUTO_TEST_CASE(TestVncPipelineMergedRequests)
+{
+    // server answers all pending requests with one update: requests sent
+    // outnumber updates, updates must keep flowing when client gets late
+    VncServerStandIn server(10000, 256, 256, true);
+    NullFront front(false);
+    int fds[2];
+    BOOST_CHECK_EQUAL(0, pipe(fds));
+    {
+        wait_obj event(fds[0], &server);
+        mod_vnc mod(&server, &event, "user", "password", front, 1024, 768, 0, 0, 0, 4);
+
+        run_until(mod, event, server, 10);
+        BOOST_CHECK(server.requests > mod.updates + 1);
+
+        front.is_congested = true;
+        run_until(mod, event, server, 20, true);
+        BOOST_CHECK_EQUAL(20u, mod.updates);
+
+        front.is_congested = false;
+        run_until(mod, event, server, 30);
+        BOOST_CHECK_EQUAL(30u, mod.updates);
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
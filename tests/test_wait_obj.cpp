@@ -0,0 +1,162 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Unit test to wait_obj and Reactor
+   Using lib boost functions for testing
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestWaitObj
+#include <boost/test/auto_unit_test.hpp>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "wait_obj.hpp"
+
+BOOST_AUTO_TEST_CASE(TestReactorSocket)
+{
+    int sv[2];
+    BOOST_CHECK_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    Reactor reactor;
+    wait_obj event(sv[0]);
+
+    // nothing to read: sleeps until timeout
+    URT start;
+    reactor.add(&event);
+    reactor.wait(20000);
+    URT end;
+    BOOST_CHECK(difftimeval(end.tv, start.tv) >= 19000);
+    BOOST_CHECK(!event.is_set());
+
+    // data to read: wakes up at once
+    BOOST_CHECK_EQUAL(1, write(sv[1], "x", 1));
+    start = URT();
+    reactor.add(&event);
+    reactor.wait(1000000);
+    end = URT();
+    BOOST_CHECK(difftimeval(end.tv, start.tv) < 500000);
+    BOOST_CHECK(event.is_set());
+
+    // socket not watched any more is polled again
+    reactor.wait(0);
+    BOOST_CHECK(event.reactor == 0);
+    BOOST_CHECK(event.is_set());
+
+    // idle waits on an already registered socket cost one syscall each
+    reactor.add(&event);
+    reactor.wait(0);
+    uint64_t nb_syscalls = reactor.nb_syscalls;
+    char c;
+    BOOST_CHECK_EQUAL(1, read(sv[0], &c, 1));
+    for (size_t i = 0; i < 5; i++){
+        reactor.add(&event);
+        reactor.wait(1000);
+        BOOST_CHECK(!event.is_set());
+    }
+    BOOST_CHECK_EQUAL(nb_syscalls + 5, reactor.nb_syscalls);
+    close(sv[1]);
+}
+
+BOOST_AUTO_TEST_CASE(TestReactorTimer)
+{
+    Reactor reactor;
+    wait_obj event(-1);
+
+    // timer object not set: sleeps until timeout
+    reactor.add(&event);
+    reactor.wait(10000);
+    BOOST_CHECK(!event.is_set());
+
+    // sleeps until timer object is due, not until timeout
+    event.set(30000);
+    URT start;
+    reactor.add(&event);
+    reactor.wait(5000000);
+    URT end;
+    BOOST_CHECK(event.is_set());
+    BOOST_CHECK(difftimeval(end.tv, start.tv) >= 29000);
+    BOOST_CHECK(difftimeval(end.tv, start.tv) < 1000000);
+
+    // due timer object does not sleep at all
+    start = URT();
+    reactor.add(&event);
+    reactor.wait(5000000);
+    end = URT();
+    BOOST_CHECK(difftimeval(end.tv, start.tv) < 1000000);
+    BOOST_CHECK(event.is_set());
+
+    event.reset();
+    BOOST_CHECK(!event.is_set());
+}
+
+BOOST_AUTO_TEST_CASE(TestReactorForget)
+{
+    int sv[2];
+    BOOST_CHECK_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    Reactor reactor;
+    {
+        wait_obj event(sv[0]);
+        reactor.add(&event);
+        reactor.wait(0);
+        BOOST_CHECK(event.reactor == &reactor);
+        // watched object destroyed, reactor must not keep it
+    }
+    // socket was closed with wait_obj, a new wait must not use it
+    uint64_t nb_syscalls = reactor.nb_syscalls;
+    reactor.wait(0);
+    BOOST_CHECK_EQUAL(nb_syscalls + 1, reactor.nb_syscalls);
+    close(sv[1]);
+}
+
+BOOST_AUTO_TEST_CASE(TestReactorQueuedOutput)
+{
+    int sv[2];
+    BOOST_CHECK_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    int size = 4096;
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    SocketTransport st("reactor", sv[0], 0);
+    st.send_queueing = true;
+    Reactor reactor;
+    wait_obj event(sv[0], &st);
+
+    // socket full, transport queues data
+    char data[65536] = {};
+    st.send(data, sizeof(data));
+    BOOST_CHECK(st.has_queued_output());
+
+    // not writable until peer reads
+    reactor.add(&event);
+    reactor.wait(10000);
+    BOOST_CHECK(!event.can_send());
+    BOOST_CHECK(!event.is_set());
+
+    char buf[65536];
+    BOOST_CHECK(read(sv[1], buf, sizeof(buf)) > 0);
+    reactor.add(&event);
+    reactor.wait(1000000);
+    BOOST_CHECK(event.can_send());
+    BOOST_CHECK(!event.is_set());
+    st.send_queue(NULL, 0);
+    while (st.has_queued_output()){
+        BOOST_CHECK(read(sv[1], buf, sizeof(buf)) > 0);
+        st.send_queue(NULL, 0);
+    }
+    close(sv[1]);
+}
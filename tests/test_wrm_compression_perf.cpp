@@ -0,0 +1,152 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Unit test for compressed wrm chunks, size and cpu cost on fixtures
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestWrmCompressionPerf
+#include <boost/test/auto_unit_test.hpp>
+
+#include <stdio.h>
+#include <time.h>
+#include "transport.hpp"
+#include "GraphicToFile.hpp"
+#include "meta_wrm.hpp"
+#include "RDP/RDPDrawable.hpp"
+
+// replays file to consumer (as fast as possible), returns screen size
+static Rect replay(const char * filename, RDPGraphicDevice * consumer, MetaWRM & meta)
+{
+    int fd = ::open(filename, O_RDONLY);
+    BOOST_CHECK(fd >= 0);
+    InFileTransport in_trans(fd);
+    RDPUnserializer reader(&in_trans, consumer, Rect());
+    reader.clock.mode = ReplayClock::BATCH;
+    meta.recv(reader);
+    reader.screen_rect = Rect(0, 0, meta.width, meta.height);
+    while (reader.next()){
+    }
+    ::close(fd);
+    return reader.screen_rect;
+}
+
+// screen drawn by recording
+static void replay_to_drawable(const char * filename, RDPDrawable *& drawable, MetaWRM & meta)
+{
+    MetaWRM first;
+    {
+        int fd = ::open(filename, O_RDONLY);
+        InFileTransport in_trans(fd);
+        RDPUnserializer reader(&in_trans, 0, Rect());
+        first.recv(reader);
+        ::close(fd);
+    }
+    drawable = new RDPDrawable(first.width, first.height, false);
+    replay(filename, drawable, meta);
+}
+
+BOOST_AUTO_TEST_CASE(TestWrmCompression)
+{
+    const char * fixtures[] = {
+        FIXTURES_PATH "/replay.wrm",
+        FIXTURES_PATH "/replay2.wrm",
+        FIXTURES_PATH "/bug8.wrm",
+        FIXTURES_PATH "/test_card.wrm",
+    };
+    const int levels[] = {0, 1, 6};
+    char path[256];
+    sprintf(path, "/tmp/test_wrm_compression-%u.wrm", getpid());
+
+    for (size_t f = 0; f < sizeof(fixtures) / sizeof(fixtures[0]); f++){
+        RDPDrawable * expected = 0;
+        MetaWRM meta;
+        replay_to_drawable(fixtures[f], expected, meta);
+
+        for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++){
+            // recording of fixture orders
+            clock_t cpu = 0;
+            uint64_t raw_bytes = 0;
+            uint64_t written_bytes = 0;
+            {
+                int fd = ::open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+                BOOST_CHECK(fd >= 0);
+                OutFileTransport trans(fd);
+                GraphicsToFile recorder(&trans, NULL, 24, 8192, 768, 8192, 3072, 8192, 12288);
+                recorder.compression_level = levels[l];
+                MetaWRM out_meta(meta.width, meta.height, 24,
+                                 levels[l] ? WRMCompression::ZLIB : WRMCompression::NONE);
+                out_meta.emit(recorder);
+
+                // orders are decoded first, only recording is measured
+                clock_t start = clock();
+                replay(fixtures[f], &recorder, meta);
+                recorder.flush();
+                cpu = clock() - start;
+                raw_bytes = recorder.raw_bytes;
+                written_bytes = recorder.written_bytes;
+                ::close(fd);
+            }
+            BOOST_CHECK(written_bytes > 0);
+            if (levels[l]){
+                BOOST_CHECK(written_bytes < raw_bytes);
+            }
+            else {
+                BOOST_CHECK_EQUAL(raw_bytes, written_bytes);
+            }
+            double sec = (double)cpu / CLOCKS_PER_SEC;
+            printf("%s level %d: %llu -> %llu bytes (%.1f%%), replay+record cpu %.3f s, %.1f MB/s recorded\n",
+                fixtures[f], levels[l],
+                (unsigned long long)raw_bytes, (unsigned long long)written_bytes,
+                100. * written_bytes / raw_bytes, sec,
+                sec > 0 ? raw_bytes / sec / 1000000. : 0.);
+
+            // compressed recording is read as uncompressed one
+            RDPDrawable * drawable = 0;
+            MetaWRM read_meta;
+            replay_to_drawable(path, drawable, read_meta);
+            BOOST_CHECK_EQUAL(levels[l] ? 1 : 0, read_meta.version);
+            BOOST_CHECK_EQUAL(levels[l] ? (int)WRMCompression::ZLIB : (int)WRMCompression::NONE, (int)read_meta.compression);
+            BOOST_CHECK(0 == memcmp(expected->drawable.data, drawable->drawable.data, expected->drawable.pix_len));
+            delete drawable;
+        }
+        delete expected;
+    }
+    unlink(path);
+}
+
+BOOST_AUTO_TEST_CASE(TestWrmUnsupportedVersion)
+{
+    // recordings from newer versions are rejected, not misread
+    Stream stream(64);
+    MetaWRM meta(800, 600, 24, WRMCompression::ZLIB);
+    meta.version = MetaWRM::LAST_VERSION + 1;
+    meta.emit(stream);
+    stream.end = stream.p;
+    stream.p = stream.data;
+    MetaWRM read_meta;
+    try {
+        read_meta.recv(stream);
+        BOOST_CHECK(false);
+    }
+    catch (Error & e){
+        BOOST_CHECK_EQUAL((int)ERR_WRM_UNSUPPORTED_FORMAT, e.id);
+    }
+}
@@ -275,3 +275,106 @@ void TestMultiWRMToPng_random_file(uint nfile, uint numtest, uint totalframe, co
 //                                  "\x69\x48\x48\x9c\xe7\x9b\x4e\x59\x1b\xa1",
 //                                  true);
 //}
+
+static void wrm_index_seek(int compression_level)
+{
+    char path[256];
+    sprintf(path, "/tmp/test_wrm_index");
+    char file0[256];
+    sprintf(file0, "%s-%u-0.wrm", path, getpid());
+    char index_path[256];
+    sprintf(index_path, "%s-%u.wrm.idx", path, getpid());
+
+    Rect screen(0, 0, 800, 600);
+    RDPDrawable drawable(800, 600, false);
+    uint64_t keyframes[4] = {0, 0, 0, 0};
+    {
+        NativeCapture nc(800, 600, path);
+        nc.recorder.compression_level = compression_level;
+        MetaWRM meta(800, 600, 24, compression_level ? WRMCompression::ZLIB : WRMCompression::NONE);
+        meta.emit(nc.recorder);
+
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        for (unsigned i = 0; i < 10; i++){
+            RDPOpaqueRect cmd(Rect(i * 10, i * 20, 100, 50), 0x102030 * (i + 1));
+            drawable.draw(cmd, screen);
+            nc.draw(cmd, screen);
+            now.tv_sec += 1;
+            nc.recorder.timestamp(now);
+            if (i % 3 == 2){
+                nc.breakpoint(drawable.drawable.data, 24, 800, 600);
+                keyframes[i / 3 + 1] = nc.recorder.time_offset;
+            }
+        }
+        nc.recorder.flush();
+    }
+
+    // index written while recording is the same as the rebuilt one
+    WRMIndex index;
+    BOOST_CHECK(index.load(index_path));
+    WRMIndex rebuilt;
+    BOOST_CHECK(rebuilt.rebuild(file0));
+    BOOST_CHECK_EQUAL(4, index.entries.size());
+    BOOST_CHECK_EQUAL(4, rebuilt.entries.size());
+    for (size_t i = 0; i < 4 && i < index.entries.size() && i < rebuilt.entries.size(); i++){
+        char filename[256];
+        sprintf(filename, "%s-%u-%u.wrm", path, getpid(), (unsigned)i);
+        BOOST_CHECK_EQUAL(keyframes[i], index.entries[i].time);
+        BOOST_CHECK_EQUAL(std::string(filename), index.entries[i].filename);
+        BOOST_CHECK_EQUAL(index.entries[i].time, rebuilt.entries[i].time);
+        BOOST_CHECK_EQUAL(index.entries[i].filename, rebuilt.entries[i].filename);
+    }
+    BOOST_CHECK(keyframes[1] >= 3000000 && keyframes[2] > keyframes[1]);
+
+    // last keyframe before time
+    BOOST_CHECK(index.find(0) == &index.entries[0]);
+    BOOST_CHECK(index.find(keyframes[2] - 1) == &index.entries[1]);
+    BOOST_CHECK(index.find(keyframes[2]) == &index.entries[2]);
+    BOOST_CHECK(index.find(keyframes[3] + 3600000000ULL) == &index.entries[3]);
+
+    // replay from last keyframe gives the final screen
+    {
+        WRMRecorder recorder(file0);
+        RDPDrawable replay(800, 600, false);
+        recorder.consumer(&replay);
+        recorder.redraw_consumer(&replay);
+        BOOST_CHECK_EQUAL(keyframes[3], recorder.seek(keyframes[3] + 1));
+        uint ntime = 0;
+        while (recorder.selected_next_order()){
+            if (recorder.chunk_type() == WRMChunk::TIMESTAMP){
+                ++ntime;
+                recorder.remaining_order_count() = 0;
+            }
+            else {
+                recorder.interpret_order();
+            }
+        }
+        BOOST_CHECK_EQUAL(1, ntime);
+        BOOST_CHECK(0 == memcmp(drawable.drawable.data, replay.drawable.data, drawable.drawable.pix_len));
+    }
+
+    // missing index is rebuilt on demand
+    unlink(index_path);
+    {
+        WRMRecorder recorder(file0);
+        BOOST_CHECK_EQUAL(keyframes[1], recorder.seek(keyframes[1] + 10));
+    }
+
+    for (unsigned i = 0; i < 4; i++){
+        char filename[256];
+        sprintf(filename, "%s-%u-%u.wrm", path, getpid(), i);
+        unlink(filename);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestWrmIndexSeek)
+{
+    wrm_index_seek(0);
+}
+
+BOOST_AUTO_TEST_CASE(TestCompressedWrmIndexSeek)
+{
+    // compressed chunks do not change index nor seek
+    wrm_index_seek(6);
+}
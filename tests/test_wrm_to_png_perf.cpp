@@ -0,0 +1,173 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Unit test for wrm to png conversion, serial and parallel performance
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestWrmToPngPerf
+#include <boost/test/auto_unit_test.hpp>
+
+#include <stdio.h>
+#include <sys/time.h>
+#include "wrm_to_png.hpp"
+#include "nativecapture.hpp"
+
+static long long ustime() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (long long)now.tv_sec*1000000LL + (long long)now.tv_usec;
+}
+
+static std::string read_file(const char * path)
+{
+    std::string res;
+    FILE * f = fopen(path, "r");
+    if (f){
+        char buffer[65536];
+        size_t len;
+        while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0){
+            res.append(buffer, len);
+        }
+        fclose(f);
+    }
+    return res;
+}
+
+static void png_name(char * buffer, const char * path, unsigned frame)
+{
+    sprintf(buffer, "%s-%u-%u.png", path, getpid(), frame);
+}
+
+static void unlink_png(const char * path, unsigned nb_frames)
+{
+    for (unsigned i = 0; i < nb_frames; i++){
+        char filename[256];
+        png_name(filename, path, i);
+        unlink(filename);
+        strcat(filename, ".meta");
+        unlink(filename);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestWrmToPngJobs)
+{
+    const unsigned nb_segments = 8;
+    const unsigned frames_per_segment = 10;
+    const unsigned nb_frames = nb_segments * frames_per_segment;
+    const char * path = "/tmp/test_wrm_to_png";
+    char file0[256];
+    sprintf(file0, "%s-%u-0.wrm", path, getpid());
+
+    // recording of moving rectangles, keyframe every frames_per_segment timestamps
+    {
+        Rect screen(0, 0, 640, 480);
+        RDPDrawable drawable(640, 480, false);
+        NativeCapture nc(640, 480, path);
+        MetaWRM meta(640, 480, 24);
+        meta.emit(nc.recorder);
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        for (unsigned i = 0; i < nb_frames; i++){
+            for (unsigned j = 0; j < 20; j++){
+                RDPOpaqueRect cmd(Rect((i * 37 + j * 53) % 600, (i * 17 + j * 29) % 440, 40 + j, 30 + i % 10),
+                                  (i * 0x10203 + j * 0x30201) & 0xFFFFFF);
+                drawable.draw(cmd, screen);
+                nc.draw(cmd, screen);
+            }
+            now.tv_usec += 40000;
+            if (now.tv_usec >= 1000000){
+                now.tv_usec -= 1000000;
+                now.tv_sec += 1;
+            }
+            nc.recorder.timestamp(now);
+            if (i % frames_per_segment == frames_per_segment - 1 && i + 1 < nb_frames){
+                nc.breakpoint(drawable.drawable.data, 24, 640, 480);
+            }
+        }
+        nc.recorder.flush();
+    }
+
+    long long serial_usec = 0;
+    unsigned jobs[] = {1, 2, 4};
+    for (size_t n = 0; n < sizeof(jobs) / sizeof(jobs[0]); n++){
+        char png_path[256];
+        sprintf(png_path, "%s_jobs%u", path, jobs[n]);
+        WRMToPng to_png(file0);
+        long long start = ustime();
+        BOOST_CHECK_EQUAL(nb_frames, to_png.run(png_path, jobs[n]));
+        long long usec = ustime() - start;
+        if (jobs[n] == 1){
+            serial_usec = usec;
+        }
+        printf("wrm to png, %u jobs: %u frames in %lld us, %.1f frames/s (x%.2f)\n",
+            jobs[n], nb_frames, usec, nb_frames * 1000000.0 / usec, (double)serial_usec / usec);
+    }
+
+    // parallel conversion gives the same png as serial one
+    char serial_path[256];
+    sprintf(serial_path, "%s_jobs1", path);
+    for (unsigned i = 0; i < nb_frames; i++){
+        char serial_png[256];
+        png_name(serial_png, serial_path, i);
+        std::string serial = read_file(serial_png);
+        BOOST_CHECK(!serial.empty());
+        for (size_t n = 1; n < sizeof(jobs) / sizeof(jobs[0]); n++){
+            char png_path[256];
+            sprintf(png_path, "%s_jobs%u", path, jobs[n]);
+            char png[256];
+            png_name(png, png_path, i);
+            BOOST_CHECK(serial == read_file(png));
+        }
+    }
+
+    // range and frame limit are the same in parallel conversion
+    {
+        char png_path[256];
+        sprintf(png_path, "%s_range", path);
+        WRMToPng to_png(file0, 1000000, 2000000, 20);
+        BOOST_CHECK_EQUAL(20, to_png.run(png_path, 3));
+        char png[256];
+        char serial_png[256];
+        png_name(png, png_path, 0);
+        png_name(serial_png, serial_path, 24); // first timestamp at 1s
+        BOOST_CHECK(read_file(serial_png) == read_file(png));
+        png_name(png, png_path, 19);
+        png_name(serial_png, serial_path, 43);
+        BOOST_CHECK(read_file(serial_png) == read_file(png));
+        png_name(png, png_path, 20);
+        BOOST_CHECK(read_file(png).empty());
+        unlink_png(png_path, 20);
+    }
+
+    for (size_t n = 0; n < sizeof(jobs) / sizeof(jobs[0]); n++){
+        char png_path[256];
+        sprintf(png_path, "%s_jobs%u", path, jobs[n]);
+        unlink_png(png_path, nb_frames);
+    }
+    for (unsigned i = 0; i < nb_segments; i++){
+        char filename[256];
+        sprintf(filename, "%s-%u-%u.wrm", path, getpid(), i);
+        unlink(filename);
+    }
+    char index_path[256];
+    sprintf(index_path, "%s-%u.wrm.idx", path, getpid());
+    unlink(index_path);
+}
@@ -0,0 +1,398 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Unit test for xup shared memory framebuffer: a stand-in X producer
+   draws its screen in a shm segment and sends damaged rectangles, compared
+   to paint orders carrying bitmaps through the socket.
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestXupShm
+#include <boost/test/auto_unit_test.hpp>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+
+#include "transport.hpp"
+#include "difftimeval.hpp"
+#include "RDP/RDPGraphicDevice.hpp"
+#include "channel_list.hpp"
+#include "front_api.hpp"
+#include "modcontext.hpp"
+#include "client_mod.hpp"
+#include "xup/xup.hpp"
+
+// messages of X side waiting to be read by xup, messages sent by xup
+class XTransport : public Transport {
+public:
+    std::string in;
+    size_t pos;
+    std::vector<uint32_t> sent_msgs;
+    std::vector<uint32_t> sent_param1;
+
+    XTransport() : pos(0) {}
+
+    using Transport::recv;
+    virtual void recv(char ** pbuffer, size_t len) throw (Error)
+    {
+        if (this->pos + len > this->in.size()){
+            throw Error(ERR_TRANSPORT_NO_MORE_DATA, 0);
+        }
+        memcpy(*pbuffer, this->in.data() + this->pos, len);
+        this->pos += len;
+        *pbuffer += len;
+        if (this->pos == this->in.size()){
+            this->in.clear();
+            this->pos = 0;
+        }
+    }
+
+    using Transport::send;
+    virtual void send(const char * const buffer, size_t len) throw (Error)
+    {
+        // x_input_event: len, 103, msg, param1..4
+        const uint8_t * p = (const uint8_t *)buffer;
+        this->sent_msgs.push_back(p[6] | (p[7] << 8) | (p[8] << 16) | (p[9] << 24));
+        this->sent_param1.push_back(p[10] | (p[11] << 8) | (p[12] << 16) | (p[13] << 24));
+    }
+};
+
+// stand-in X producer: 16 bpp screen in a shm segment, order lists as X11rdp sends them
+class XProducer {
+public:
+    uint16_t width;
+    uint16_t height;
+    int shmid;
+    uint16_t * screen;
+    Stream orders;
+    unsigned nb_orders;
+
+    XProducer(uint16_t width, uint16_t height)
+        : width(width), height(height), orders(262144), nb_orders(0)
+    {
+        this->shmid = shmget(IPC_PRIVATE, width * height * 2, IPC_CREAT | 0600);
+        this->screen = (uint16_t *)shmat(this->shmid, 0, 0);
+        // segment goes away once detached by both sides
+        shmctl(this->shmid, IPC_RMID, 0);
+    }
+
+    ~XProducer()
+    {
+        shmdt(this->screen);
+    }
+
+    void draw(unsigned frame)
+    {
+        for (unsigned i = 0; i < (unsigned)this->width * this->height; i++){
+            this->screen[i] = (i * 2654435761u + frame) >> 13;
+        }
+    }
+
+    void order_rect(uint16_t type, const Rect & r)
+    {
+        this->orders.out_uint16_le(type);
+        this->orders.out_uint16_le(r.x);
+        this->orders.out_uint16_le(r.y);
+        this->orders.out_uint16_le(r.cx);
+        this->orders.out_uint16_le(r.cy);
+        this->nb_orders++;
+    }
+
+    void attach()
+    {
+        this->orders.out_uint16_le(51);
+        this->orders.out_uint32_le(this->shmid);
+        this->orders.out_uint16_le(this->width);
+        this->orders.out_uint16_le(this->height);
+        this->orders.out_uint32_le(this->width * 2);
+        this->nb_orders++;
+    }
+
+    void damage(const Rect & r)
+    {
+        this->order_rect(52, r);
+    }
+
+    // paint order with bitmap (bottom-up rows) of a rectangle of screen
+    void paint(const Rect & r)
+    {
+        this->order_rect(5, r);
+        this->orders.out_uint32_le(r.cx * r.cy * 2);
+        for (int y = r.cy - 1; y >= 0; y--){
+            this->orders.out_copy_bytes((const uint8_t *)&this->screen[(r.y + y) * this->width + r.x], r.cx * 2);
+        }
+        this->orders.out_uint16_le(r.cx);
+        this->orders.out_uint16_le(r.cy);
+        this->orders.out_uint16_le(0);
+        this->orders.out_uint16_le(0);
+    }
+
+    void begin_update() { this->orders.out_uint16_le(1); this->nb_orders++; }
+    void end_update() { this->orders.out_uint16_le(2); this->nb_orders++; }
+
+    void send(XTransport & t)
+    {
+        this->orders.mark_end();
+        const size_t len = this->orders.end - this->orders.data;
+        char header[8] = { 1, 0, (char)this->nb_orders, (char)(this->nb_orders >> 8),
+            (char)len, (char)(len >> 8), (char)(len >> 16), (char)(len >> 24) };
+        t.in.append(header, 8);
+        t.in.append((const char *)this->orders.data, len);
+        this->orders.init(262144);
+        this->nb_orders = 0;
+    }
+};
+
+// draws bitmaps to a 16 bpp top-down screen
+class ScreenFront : public FrontAPI {
+public:
+    uint16_t width;
+    std::vector<uint16_t> screen;
+    ChannelDefArray cl;
+
+    ScreenFront(uint16_t width, uint16_t height)
+        : FrontAPI(false, false), width(width), screen(width * height) {}
+
+    void blit(const Rect & dst, const Bitmap & bmp)
+    {
+        const uint8_t * data = bmp.data_bitmap.get();
+        for (uint16_t y = 0; y < dst.cy; y++){
+            memcpy(&this->screen[(dst.y + y) * this->width + dst.x],
+                   data + (bmp.cy - 1 - y) * bmp.line_size, dst.cx * 2);
+        }
+    }
+
+    virtual void draw_bitmap_tile(const Rect & dst_tile, const Bitmap & tile) { this->blit(dst_tile, tile); }
+    virtual void draw(const RDPMemBlt & cmd, const Rect & clip, const Bitmap & bmp) { this->blit(cmd.rect, bmp); }
+
+    virtual void flush() {}
+    virtual void draw(const RDPOpaqueRect & cmd, const Rect & clip) {}
+    virtual void draw(const RDPScrBlt & cmd, const Rect & clip) {}
+    virtual void draw(const RDPDestBlt & cmd, const Rect & clip) {}
+    virtual void draw(const RDPPatBlt & cmd, const Rect & clip) {}
+    virtual void draw(const RDPLineTo & cmd, const Rect & clip) {}
+    virtual void draw(const RDPGlyphIndex & cmd, const Rect & clip) {}
+    virtual const ChannelDefArray & get_channel_list(void) const { return this->cl; }
+    virtual void send_to_channel(const ChannelDef & channel, uint8_t* data, size_t length, size_t chunk_size, int flags) {}
+    virtual void send_pointer(int cache_idx, uint8_t* data, uint8_t* mask, int x, int y) throw (Error) {}
+    virtual void send_global_palette() throw (Error) {}
+    virtual void set_pointer(int cache_idx) throw (Error) {}
+    virtual void begin_update() {}
+    virtual void end_update() {}
+    virtual void color_cache(const BGRPalette & palette, uint8_t cacheIndex) {}
+    virtual void set_mod_palette(const BGRPalette & palette) {}
+    virtual void server_set_pointer(int x, int y, uint8_t* data, uint8_t* mask) {}
+    virtual void server_draw_text(uint16_t x, uint16_t y, const char * text, uint32_t fgcolor, uint32_t bgcolor, const Rect & clip) {}
+    virtual void text_metrics(const char * text, int & width, int & height) {}
+    virtual int server_resize(int width, int height, int bpp) { return 0; }
+};
+
+static ProtocolKeyword keywords[] = {
+    {STRAUTHID_OPT_WIDTH, TYPE_INTEGER, "!1024"},
+    {STRAUTHID_OPT_HEIGHT, TYPE_INTEGER, "!768"},
+    {STRAUTHID_OPT_BPP, TYPE_INTEGER, "!16"},
+};
+
+BOOST_AUTO_TEST_CASE(TestXupShmDamage)
+{
+    ModContext context(keywords, sizeof(keywords)/sizeof(keywords[0]));
+    ScreenFront front(1024, 768);
+    XTransport * t = new XTransport;
+    xup_mod mod(t, context, front, 1024, 768, getuid());
+    XProducer x(1024, 768);
+
+    x.attach();
+    x.send(*t);
+    BOOST_CHECK_EQUAL(BACK_EVENT_NONE, mod.draw_event());
+    BOOST_CHECK_EQUAL((uint32_t)xup_mod::XUPWM_SHM_ATTACH, t->sent_msgs.back());
+    BOOST_CHECK_EQUAL(1u, t->sent_param1.back());
+
+    // only damaged rectangles are drawn, odd sizes and partial tiles
+    x.draw(1);
+    x.begin_update();
+    x.damage(Rect(3, 5, 101, 70));
+    x.damage(Rect(1000, 700, 100, 100)); // clipped to screen
+    x.end_update();
+    x.send(*t);
+    BOOST_CHECK_EQUAL(BACK_EVENT_NONE, mod.draw_event());
+    BOOST_CHECK_EQUAL((uint32_t)xup_mod::XUPWM_SHM_FRAME_ACK, t->sent_msgs.back());
+    BOOST_CHECK_EQUAL(2u, t->sent_param1.back());
+
+    for (unsigned y = 0; y < 768; y++){
+        for (unsigned xx = 0; xx < 1024; xx++){
+            const bool damaged = (xx >= 3 && xx < 104 && y >= 5 && y < 75)
+                              || (xx >= 1000 && y >= 700);
+            const uint16_t expected = damaged ? x.screen[y * 1024 + xx] : 0;
+            if (front.screen[y * 1024 + xx] != expected){
+                BOOST_CHECK_EQUAL(expected, front.screen[y * 1024 + xx]);
+                return;
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestXupShmAttachFailure)
+{
+    ModContext context(keywords, sizeof(keywords)/sizeof(keywords[0]));
+    ScreenFront front(1024, 768);
+    XTransport * t = new XTransport;
+    xup_mod mod(t, context, front, 1024, 768, getuid());
+
+    // segment too small for announced framebuffer
+    XProducer x(64, 64);
+    x.orders.out_uint16_le(51);
+    x.orders.out_uint32_le(x.shmid);
+    x.orders.out_uint16_le(1024);
+    x.orders.out_uint16_le(768);
+    x.orders.out_uint32_le(2048);
+    x.nb_orders++;
+    x.send(*t);
+    BOOST_CHECK_EQUAL(BACK_EVENT_NONE, mod.draw_event());
+    BOOST_CHECK_EQUAL((uint32_t)xup_mod::XUPWM_SHM_ATTACH, t->sent_msgs.back());
+    BOOST_CHECK_EQUAL(0u, t->sent_param1.back());
+}
+
+BOOST_AUTO_TEST_CASE(TestXupShmRefused)
+{
+    ModContext context(keywords, sizeof(keywords)/sizeof(keywords[0]));
+    ScreenFront front(1024, 768);
+    XProducer x(1024, 768);
+
+    // X side is not local: paint orders through socket
+    {
+        XTransport * t = new XTransport;
+        xup_mod mod(t, context, front, 1024, 768);
+        x.attach();
+        x.send(*t);
+        BOOST_CHECK_EQUAL(BACK_EVENT_NONE, mod.draw_event());
+        BOOST_CHECK_EQUAL((uint32_t)xup_mod::XUPWM_SHM_ATTACH, t->sent_msgs.back());
+        BOOST_CHECK_EQUAL(0u, t->sent_param1.back());
+    }
+
+    // segment not owned by X side
+    {
+        XTransport * t = new XTransport;
+        xup_mod mod(t, context, front, 1024, 768, getuid() + 1);
+        x.attach();
+        x.send(*t);
+        BOOST_CHECK_EQUAL(BACK_EVENT_NONE, mod.draw_event());
+        BOOST_CHECK_EQUAL((uint32_t)xup_mod::XUPWM_SHM_ATTACH, t->sent_msgs.back());
+        BOOST_CHECK_EQUAL(0u, t->sent_param1.back());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestXupLocalPeerUid)
+{
+    // loopback connection to ourself: peer uid is ours
+    int server = socket(PF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    BOOST_CHECK_EQUAL(0, bind(server, (struct sockaddr*)&addr, sizeof(addr)));
+    BOOST_CHECK_EQUAL(0, listen(server, 1));
+    socklen_t len = sizeof(addr);
+    BOOST_CHECK_EQUAL(0, getsockname(server, (struct sockaddr*)&addr, &len));
+    int client = socket(PF_INET, SOCK_STREAM, 0);
+    BOOST_CHECK_EQUAL(0, connect(client, (struct sockaddr*)&addr, sizeof(addr)));
+
+    uid_t uid = (uid_t)-1;
+    BOOST_CHECK(xup_mod::local_peer_uid(client, uid));
+    BOOST_CHECK_EQUAL(getuid(), uid);
+
+    // not connected
+    int other = socket(PF_INET, SOCK_STREAM, 0);
+    uid = (uid_t)-1;
+    BOOST_CHECK(!xup_mod::local_peer_uid(other, uid));
+    BOOST_CHECK_EQUAL((uid_t)-1, uid);
+
+    close(other);
+    close(client);
+    close(server);
+}
+
+BOOST_AUTO_TEST_CASE(TestXupShmSpeed)
+{
+    const unsigned nb_frames = 20;
+    ModContext context(keywords, sizeof(keywords)/sizeof(keywords[0]));
+    ScreenFront front(1024, 768);
+    XTransport * t = new XTransport;
+    xup_mod mod(t, context, front, 1024, 768, getuid());
+    XProducer x(1024, 768);
+    x.draw(0);
+
+    // paint orders of 64x64 bitmaps, as X11rdp sends them
+    uint64_t socket_elapsed = 0;
+    size_t socket_bytes = 0;
+    for (unsigned frame = 0; frame < nb_frames; frame++){
+        for (uint16_t y = 0; y < 768; y += 64){
+            x.begin_update();
+            for (uint16_t xx = 0; xx < 1024; xx += 64){
+                x.paint(Rect(xx, y, 64, 64));
+            }
+            x.end_update();
+            x.send(*t);
+        }
+        socket_bytes += t->in.size();
+        struct timeval start;
+        gettimeofday(&start, NULL);
+        while (!t->in.empty()){
+            mod.draw_event();
+        }
+        struct timeval end;
+        gettimeofday(&end, NULL);
+        socket_elapsed += difftimeval(end, start);
+    }
+    BOOST_CHECK(0 == memcmp(&front.screen[0], x.screen, 1024 * 768 * 2));
+
+    x.attach();
+    x.send(*t);
+    mod.draw_event();
+    uint64_t shm_elapsed = 0;
+    size_t shm_bytes = 0;
+    for (unsigned frame = 0; frame < nb_frames; frame++){
+        x.draw(frame + 1);
+        x.begin_update();
+        x.damage(Rect(0, 0, 1024, 768));
+        x.end_update();
+        x.send(*t);
+        shm_bytes += t->in.size();
+        struct timeval start;
+        gettimeofday(&start, NULL);
+        mod.draw_event();
+        struct timeval end;
+        gettimeofday(&end, NULL);
+        shm_elapsed += difftimeval(end, start);
+    }
+    BOOST_CHECK(0 == memcmp(&front.screen[0], x.screen, 1024 * 768 * 2));
+
+    BOOST_CHECK(shm_bytes * 1000 < socket_bytes);
+
+    fprintf(stderr, "xup 1024x768x16, %u full frames: %llu us and %u bytes read with paint orders,"
+                    " %llu us and %u bytes read with shared memory\n",
+        nb_frames, (unsigned long long)socket_elapsed, (unsigned)socket_bytes,
+        (unsigned long long)shm_elapsed, (unsigned)shm_bytes);
+}
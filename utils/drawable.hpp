@@ -50,11 +50,16 @@ struct Drawable
     uint8_t timestamp_data[ts_width * ts_height * 3];
     char previous_timestamp[size_str_timestamp];
 
+    // bounding box of area changed by drawing orders since last reset_dirty()
+    // (mouse and timestamp overlays are not counted)
+    Rect dirty;
+
     Drawable(int width, int height)
     : width(width)
     , height(height)
     , rowsize(width * Bpp)
     , pix_len(this->rowsize * height)
+    , dirty(0, 0, width, height)
     {
         if (!this->pix_len) {
             throw Error(ERR_RECORDER_EMPTY_IMAGE);
@@ -111,6 +116,21 @@ struct Drawable
         return this->width * this->height;
     }
 
+    void mark_dirty(const Rect & rect)
+    {
+        const Rect & r = rect.intersect(this->width, this->height);
+        if (r.isempty()){
+            return;
+        }
+        this->dirty = this->dirty.isempty() ? r
+                    : this->dirty.enlarge_to(r.x, r.y).enlarge_to(r.x + r.cx - 1, r.y + r.cy - 1);
+    }
+
+    void reset_dirty()
+    {
+        this->dirty = Rect();
+    }
+
     struct Mouse_t{
         uint8_t y;
         uint8_t x;
@@ -0,0 +1,107 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Non cryptographic 128 bits fingerprint (MurmurHash3 x64 128 variant,
+   public domain algorithm by Austin Appleby). It is only suitable to
+   detect identical data inside one session (like bitmap cache
+   deduplication), never for anything security related.
+*/
+
+#if !defined(__FINGERPRINT_HPP__)
+#define __FINGERPRINT_HPP__
+
+#include <stdint.h>
+#include <string.h>
+
+struct Fingerprint128 {
+    uint64_t h1;
+    uint64_t h2;
+    uint64_t total;
+
+    Fingerprint128(uint64_t seed = 0) : h1(seed), h2(seed), total(0)
+    {
+    }
+
+    static uint64_t rotl64(uint64_t x, int8_t r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static uint64_t fmix64(uint64_t k)
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    static uint64_t load64(const uint8_t * p)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    void mix(uint64_t k1, uint64_t k2)
+    {
+        const uint64_t c1 = 0x87c37b91114253d5ULL;
+        const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; this->h1 ^= k1;
+        this->h1 = rotl64(this->h1, 27); this->h1 += this->h2; this->h1 = this->h1 * 5 + 0x52dce729;
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; this->h2 ^= k2;
+        this->h2 = rotl64(this->h2, 31); this->h2 += this->h1; this->h2 = this->h2 * 5 + 0x38495ab5;
+    }
+
+    // data is consumed by blocks of 16 bytes, trailing bytes (if any) are
+    // zero padded: successive updates are not equivalent to one update
+    // over concatenated data unless sizes are multiple of 16.
+    void update(const uint8_t * data, size_t len)
+    {
+        const uint8_t * p = data;
+        const uint8_t * end = data + (len & ~(size_t)15);
+        for (; p < end ; p += 16){
+            this->mix(load64(p), load64(p + 8));
+        }
+        if (len & 15){
+            uint8_t tail[16] = {};
+            memcpy(tail, p, len & 15);
+            this->mix(load64(tail), load64(tail + 8));
+        }
+        this->total += len;
+    }
+
+    void final(uint8_t (&sig)[16])
+    {
+        uint64_t h1 = this->h1 ^ this->total;
+        uint64_t h2 = this->h2 ^ this->total;
+        h1 += h2;
+        h2 += h1;
+        h1 = fmix64(h1);
+        h2 = fmix64(h2);
+        h1 += h2;
+        h2 += h1;
+        memcpy(sig, &h1, 8);
+        memcpy(sig + 8, &h2, 8);
+    }
+};
+
+#endif
@@ -0,0 +1,205 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2026
+   Author(s): redemption contributors
+
+   Run detection for bitmap RLE compressor. Finds the length of the span
+   of bytes where (a[i] ^ b[i]) == pattern[i], b being optional. Fill,
+   mix and color runs are all spans of this kind once pixels are seen as
+   bytes. SSE2 and AVX2 versions are chosen at runtime when available.
+*/
+
+#if !defined(__RLE_SCAN_HPP__)
+#define __RLE_SCAN_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define RLE_SCAN_HAVE_SSE2
+#include <emmintrin.h>
+#if (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define RLE_SCAN_HAVE_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+enum {
+    RLE_SCAN_REFERENCE,   // historical pixel by pixel scans (in Bitmap)
+    RLE_SCAN_SCALAR,
+    RLE_SCAN_SSE2,
+    RLE_SCAN_AVX2
+};
+
+// engine in use, chosen once at program start (before threads are spawned)
+// and only read afterward
+template <class Dummy>
+struct RLEScanEngine {
+    static unsigned current;
+};
+
+struct RLEScan {
+    // pattern period is 48 bytes (a multiple of any pixel size and of
+    // 16 bytes), pattern buffer holds two periods to allow unaligned
+    // reads of a whole vector from any phase.
+    enum {
+        PERIOD = 48,
+        PATTERN_SIZE = 96
+    };
+
+    static void make_pattern(uint8_t (&pattern)[PATTERN_SIZE], uint8_t Bpp, unsigned value)
+    {
+        // 12 bytes is a multiple of any pixel size
+        for (size_t i = 0; i < 12 ; i++){
+            pattern[i] = (uint8_t)(value >> (8 * (i % Bpp)));
+        }
+        memcpy(pattern + 12, pattern, 12);
+        memcpy(pattern + 24, pattern, 24);
+        memcpy(pattern + 48, pattern, 48);
+    }
+
+    static size_t scan_scalar(const uint8_t * a, const uint8_t * b, const uint8_t * pattern, size_t n)
+    {
+        size_t i = 0;
+        if (b){
+            for (; i < n ; i++){
+                if ((a[i] ^ b[i]) != pattern[i % PERIOD]){
+                    break;
+                }
+            }
+        }
+        else {
+            for (; i < n ; i++){
+                if (a[i] != pattern[i % PERIOD]){
+                    break;
+                }
+            }
+        }
+        return i;
+    }
+
+#if defined(RLE_SCAN_HAVE_SSE2)
+    static size_t scan_sse2(const uint8_t * a, const uint8_t * b, const uint8_t * pattern, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 16 <= n ; i += 16){
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            if (b){
+                va = _mm_xor_si128(va, _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+            }
+            const __m128i vp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern + i % PERIOD));
+            const unsigned diff = ~_mm_movemask_epi8(_mm_cmpeq_epi8(va, vp)) & 0xFFFF;
+            if (diff){
+                return i + __builtin_ctz(diff);
+            }
+        }
+        return i + scan_scalar(a + i, b ? b + i : 0, pattern + i % PERIOD, n - i);
+    }
+#endif
+
+#if defined(RLE_SCAN_HAVE_AVX2)
+    __attribute__((target("avx2")))
+    static size_t scan_avx2(const uint8_t * a, const uint8_t * b, const uint8_t * pattern, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 32 <= n ; i += 32){
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            if (b){
+                va = _mm256_xor_si256(va, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+            }
+            const __m256i vp = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pattern + i % PERIOD));
+            const unsigned diff = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vp));
+            if (diff){
+                return i + __builtin_ctz(diff);
+            }
+        }
+        return i + scan_sse2(a + i, b ? b + i : 0, pattern + i % PERIOD, n - i);
+    }
+#endif
+
+    static unsigned best_engine()
+    {
+#if defined(RLE_SCAN_HAVE_AVX2)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")){
+            return RLE_SCAN_AVX2;
+        }
+#endif
+#if defined(RLE_SCAN_HAVE_SSE2)
+        return RLE_SCAN_SSE2;
+#else
+        return RLE_SCAN_SCALAR;
+#endif
+    }
+
+    static bool available(unsigned engine)
+    {
+        switch (engine){
+        case RLE_SCAN_REFERENCE:
+        case RLE_SCAN_SCALAR:
+            return true;
+#if defined(RLE_SCAN_HAVE_SSE2)
+        case RLE_SCAN_SSE2:
+            return true;
+#endif
+#if defined(RLE_SCAN_HAVE_AVX2)
+        case RLE_SCAN_AVX2:
+            return best_engine() == RLE_SCAN_AVX2;
+#endif
+        default:
+            return false;
+        }
+    }
+
+    static unsigned engine()
+    {
+        return RLEScanEngine<void>::current;
+    }
+
+    // change engine in use (to compare engines), if available. Not thread
+    // safe: only meant for tests, while no compression is running.
+    static void select_engine(unsigned engine)
+    {
+        if (available(engine)){
+            RLEScanEngine<void>::current = engine;
+        }
+    }
+
+    // length of span starting at a (and b if not NULL) matching pattern,
+    // at most n
+    static size_t scan(const uint8_t * a, const uint8_t * b, const uint8_t * pattern, size_t n)
+    {
+        switch (engine()){
+#if defined(RLE_SCAN_HAVE_AVX2)
+        case RLE_SCAN_AVX2:
+            return scan_avx2(a, b, pattern, n);
+#endif
+#if defined(RLE_SCAN_HAVE_SSE2)
+        case RLE_SCAN_SSE2:
+            return scan_sse2(a, b, pattern, n);
+#endif
+        default:
+            return scan_scalar(a, b, pattern, n);
+        }
+    }
+};
+
+template <class Dummy>
+unsigned RLEScanEngine<Dummy>::current = RLEScan::best_engine();
+
+#endif
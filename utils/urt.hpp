@@ -49,6 +49,11 @@ struct URT
 
     ~URT(){}
 
+    // as a duration in usec
+    uint64_t usec() const {
+        return (uint64_t)this->tv.tv_sec * 1000000 + this->tv.tv_usec;
+    }
+
     bool operator==(const URT & other) const {
         return (this->tv.tv_sec == other.tv.tv_sec) && (this->tv.tv_usec == other.tv.tv_usec);
     }